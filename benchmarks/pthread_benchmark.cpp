@@ -14,8 +14,14 @@
  * limitations under the License.
  */
 
+#include <limits.h>
 #include <pthread.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 #include "util.h"
 
@@ -53,6 +59,20 @@ static void BM_pthread_setspecific(benchmark::State& state) {
 }
 BIONIC_BENCHMARK(BM_pthread_setspecific);
 
+// Gets a key created after many others, whose value isn't stored inline.
+static void BM_pthread_getspecific_many_keys(benchmark::State& state) {
+  std::vector<pthread_key_t> keys(PTHREAD_KEYS_MAX * 2);
+  for (pthread_key_t& key : keys) pthread_key_create(&key, nullptr);
+  pthread_setspecific(keys.back(), &keys);
+
+  while (state.KeepRunning()) {
+    pthread_getspecific(keys.back());
+  }
+
+  for (pthread_key_t key : keys) pthread_key_delete(key);
+}
+BIONIC_BENCHMARK(BM_pthread_getspecific_many_keys);
+
 static void NoOpPthreadOnceInitFunction() {}
 
 static void BM_pthread_once(benchmark::State& state) {
@@ -174,6 +194,199 @@ static void BM_pthread_rwlock_write(benchmark::State& state) {
 }
 BIONIC_BENCHMARK(BM_pthread_rwlock_write);
 
+static void BM_pthread_spin_lock(benchmark::State& state) {
+  pthread_spinlock_t lock;
+  pthread_spin_init(&lock, PTHREAD_PROCESS_PRIVATE);
+
+  while (state.KeepRunning()) {
+    pthread_spin_lock(&lock);
+    pthread_spin_unlock(&lock);
+  }
+
+  pthread_spin_destroy(&lock);
+}
+BIONIC_BENCHMARK(BM_pthread_spin_lock);
+
+// Each thread takes and releases the spinlock kRounds times, doing a little
+// work while holding it, so all of the threads contend for the one lock.
+static void RunSpinlockContended(benchmark::State& state, size_t num_threads) {
+  constexpr size_t kMaxThreads = 8;
+  constexpr size_t kRounds = 20000;
+  pthread_spinlock_t spinlock;
+  pthread_spin_init(&spinlock, PTHREAD_PROCESS_PRIVATE);
+  volatile size_t counter = 0;
+
+  std::mutex m;
+  bool ready = false;
+  std::condition_variable cv;
+  std::thread* threads[kMaxThreads];
+
+  auto thread_task = [&]() {
+    {
+      std::unique_lock lock(m);
+      cv.wait(lock, [&] { return ready; });
+    }
+    for (size_t i = 0; i < kRounds; i++) {
+      pthread_spin_lock(&spinlock);
+      for (size_t j = 0; j < 16; j++) counter = counter + 1;
+      pthread_spin_unlock(&spinlock);
+    }
+  };
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    ready = false;
+    for (size_t i = 0; i < num_threads; ++i) threads[i] = new std::thread(thread_task);
+    state.ResumeTiming();
+
+    {
+      std::unique_lock lock(m);
+      ready = true;
+    }
+    cv.notify_all();
+
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads[i]->join();
+      delete threads[i];
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * num_threads * kRounds);
+  pthread_spin_destroy(&spinlock);
+}
+
+#define BM_PTHREAD_SPIN_LOCK_CONTENDED(NUM_THREADS)                                      \
+  static void BM_pthread_spin_lock_contended_##NUM_THREADS(benchmark::State& state) { \
+    RunSpinlockContended(state, NUM_THREADS);                                             \
+  }                                                                                       \
+  BIONIC_BENCHMARK(BM_pthread_spin_lock_contended_##NUM_THREADS);
+
+BM_PTHREAD_SPIN_LOCK_CONTENDED(2);
+BM_PTHREAD_SPIN_LOCK_CONTENDED(4);
+BM_PTHREAD_SPIN_LOCK_CONTENDED(8);
+
+// Each thread takes and releases the read lock kRounds times. With the default kind every
+// reader updates the same word; with PTHREAD_RWLOCK_SCALABLE_READER_NP they shouldn't.
+static void RunRwlockReaders(benchmark::State& state, int kind, size_t num_threads) {
+  constexpr size_t kMaxThreads = 8;
+  constexpr size_t kRounds = 100000;
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  if (kind != -1 && pthread_rwlockattr_setkind_np(&attr, kind) != 0) {
+    state.SkipWithError("pthread_rwlockattr_setkind_np failed");
+    pthread_rwlockattr_destroy(&attr);
+    return;
+  }
+  pthread_rwlock_t rwlock;
+  pthread_rwlock_init(&rwlock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+
+  std::mutex m;
+  bool ready = false;
+  std::condition_variable cv;
+  std::thread* threads[kMaxThreads];
+
+  auto thread_task = [&]() {
+    {
+      std::unique_lock lock(m);
+      cv.wait(lock, [&] { return ready; });
+    }
+    for (size_t i = 0; i < kRounds; i++) {
+      pthread_rwlock_rdlock(&rwlock);
+      pthread_rwlock_unlock(&rwlock);
+    }
+  };
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    ready = false;
+    for (size_t i = 0; i < num_threads; ++i) threads[i] = new std::thread(thread_task);
+    state.ResumeTiming();
+
+    {
+      std::unique_lock lock(m);
+      ready = true;
+    }
+    cv.notify_all();
+
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads[i]->join();
+      delete threads[i];
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * num_threads * kRounds);
+  pthread_rwlock_destroy(&rwlock);
+}
+
+#define BM_PTHREAD_RWLOCK_READERS(NAME, KIND, NUM_THREADS)                                  \
+  static void BM_pthread_rwlock_read_##NAME##_##NUM_THREADS(benchmark::State& state) { \
+    RunRwlockReaders(state, KIND, NUM_THREADS);                                             \
+  }                                                                                         \
+  BIONIC_BENCHMARK(BM_pthread_rwlock_read_##NAME##_##NUM_THREADS);
+
+BM_PTHREAD_RWLOCK_READERS(default, -1, 1);
+BM_PTHREAD_RWLOCK_READERS(default, -1, 4);
+BM_PTHREAD_RWLOCK_READERS(default, -1, 8);
+#if defined(__BIONIC__)
+BM_PTHREAD_RWLOCK_READERS(scalable, PTHREAD_RWLOCK_SCALABLE_READER_NP, 1);
+BM_PTHREAD_RWLOCK_READERS(scalable, PTHREAD_RWLOCK_SCALABLE_READER_NP, 4);
+BM_PTHREAD_RWLOCK_READERS(scalable, PTHREAD_RWLOCK_SCALABLE_READER_NP, 8);
+#endif
+
+// Each broadcast wakes all of the waiters, which then all need the mutex.
+static void RunCondBroadcast(benchmark::State& state, size_t num_waiters) {
+  constexpr size_t kMaxWaiters = 16;
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+  pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+  size_t generation = 0;
+  size_t acked = 0;
+  bool stop = false;
+
+  auto waiter_task = [&]() {
+    size_t seen = 0;
+    pthread_mutex_lock(&mutex);
+    while (true) {
+      while (generation == seen && !stop) pthread_cond_wait(&cond, &mutex);
+      if (stop) break;
+      seen = generation;
+      if (++acked == num_waiters) pthread_cond_signal(&done);
+    }
+    pthread_mutex_unlock(&mutex);
+  };
+  std::thread* threads[kMaxWaiters];
+  for (size_t i = 0; i < num_waiters; ++i) threads[i] = new std::thread(waiter_task);
+
+  for (auto _ : state) {
+    pthread_mutex_lock(&mutex);
+    generation++;
+    acked = 0;
+    pthread_cond_broadcast(&cond);
+    while (acked != num_waiters) pthread_cond_wait(&done, &mutex);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  pthread_mutex_lock(&mutex);
+  stop = true;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+  for (size_t i = 0; i < num_waiters; ++i) {
+    threads[i]->join();
+    delete threads[i];
+  }
+}
+
+#define BM_PTHREAD_COND_BROADCAST(NUM_WAITERS)                                      \
+  static void BM_pthread_cond_broadcast_##NUM_WAITERS(benchmark::State& state) { \
+    RunCondBroadcast(state, NUM_WAITERS);                                           \
+  }                                                                                 \
+  BIONIC_BENCHMARK(BM_pthread_cond_broadcast_##NUM_WAITERS);
+
+BM_PTHREAD_COND_BROADCAST(1);
+BM_PTHREAD_COND_BROADCAST(4);
+BM_PTHREAD_COND_BROADCAST(16);
+
 static void* IdleThread(void*) {
   return nullptr;
 }
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <locale.h>
+#include <regex.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "util.h"
+
+// Lines like the ones a logcat filter sees.
+static const std::vector<std::string>& LogLines() {
+  static const std::vector<std::string> lines = [] {
+    static const char* kTags[] = {"ActivityManager", "PackageManager", "WifiService",
+                                  "ConnectivityService", "SurfaceFlinger", "chatty"};
+    static const char* kMessages[] = {
+        "Start proc 4242:com.example.app/u0a123 for activity",
+        "Killing 1234:com.example.other/u0a99 (adj 900): empty #17",
+        "Skipping  disconnected event for network 100",
+        "requestRoute() failed: timeout after 5000ms",
+        "uid=10123 identical 12 lines",
+        "Finished setting display mode 1080x2400@120Hz",
+    };
+    std::vector<std::string> result;
+    for (size_t i = 0; i < 64; i++) {
+      char line[256];
+      snprintf(line, sizeof(line), "01-01 12:%02zu:%02zu.%03zu  1000  %zu %c %s: %s", i % 60,
+               (i * 7) % 60, (i * 131) % 1000, 1000 + i, "VDIWE"[i % 5], kTags[i % 6],
+               kMessages[(i * 5) % 6]);
+      result.push_back(line);
+    }
+    return result;
+  }();
+  return lines;
+}
+
+static void RunRegexec(benchmark::State& state, const char* locale_name, const char* pattern,
+                       int cflags, size_t nmatch) {
+  locale_t locale = newlocale(LC_ALL_MASK, locale_name, nullptr);
+  locale_t old_locale = uselocale(locale);
+  regex_t re;
+  if (regcomp(&re, pattern, cflags) != 0) {
+    state.SkipWithError("regcomp failed");
+  } else {
+    const std::vector<std::string>& lines = LogLines();
+    size_t bytes = 0;
+    for (const std::string& line : lines) bytes += line.size();
+
+    regmatch_t match[2];
+    for (auto _ : state) {
+      for (const std::string& line : lines) {
+        benchmark::DoNotOptimize(regexec(&re, line.c_str(), nmatch, match, 0));
+      }
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+    regfree(&re);
+  }
+  uselocale(old_locale);
+  freelocale(locale);
+}
+
+#define REGEXEC_BENCHMARK(__name, __locale, __pattern, __cflags, __nmatch) \
+  static void BM_regex_regexec_##__name(benchmark::State& state) {         \
+    RunRegexec(state, __locale, __pattern, __cflags, __nmatch);           \
+  }                                                                       \
+  BIONIC_BENCHMARK(BM_regex_regexec_##__name)
+
+// Patterns that the bit-parallel matcher handles in any locale.
+REGEXEC_BENCHMARK(literal_miss, "C.UTF-8", "NetworkMonitor", REG_EXTENDED | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(literal_hit, "C.UTF-8", "timeout", REG_EXTENDED | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(literal_offsets, "C.UTF-8", "timeout", REG_EXTENDED, 1);
+REGEXEC_BENCHMARK(class, "C.UTF-8", "[0-9]+x[0-9]+@[0-9]+Hz", REG_EXTENDED | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(anchored, "C.UTF-8", "^01-01 12:0[0-9]", REG_EXTENDED | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(class_offsets, "C.UTF-8", "u0a[0-9]*", REG_EXTENDED, 1);
+// Patterns that it only handles in the C locale, compared with UTF-8.
+REGEXEC_BENCHMARK(icase, "C", "killing", REG_EXTENDED | REG_ICASE | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(icase_utf8, "C.UTF-8", "killing", REG_EXTENDED | REG_ICASE | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(dot_star, "C", "Start proc.*activity", REG_EXTENDED | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(dot_star_utf8, "C.UTF-8", "Start proc.*activity", REG_EXTENDED | REG_NOSUB, 0);
+// Patterns that still need the full engine.
+REGEXEC_BENCHMARK(alternation, "C", "WifiService|SurfaceFlinger", REG_EXTENDED | REG_NOSUB, 0);
+REGEXEC_BENCHMARK(subexpression, "C", "(Killing|Start) ([0-9]+):", REG_EXTENDED, 2);
+REGEXEC_BENCHMARK(backref, "C", "\\(identical\\) [0-9]* \\1*", REG_NOSUB, 0);
+
+static void BM_regex_regcomp(benchmark::State& state) {
+  for (auto _ : state) {
+    regex_t re;
+    benchmark::DoNotOptimize(regcomp(&re, "[0-9]+x[0-9]+@[0-9]+Hz", REG_EXTENDED));
+    regfree(&re);
+  }
+}
+BIONIC_BENCHMARK(BM_regex_regcomp);
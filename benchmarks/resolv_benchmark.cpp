@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+#include "util.h"
+
+#if defined(__BIONIC__)
+
+// These are only exported for netd, so they aren't in any public header.
+struct __res_params;
+extern "C" int _resolv_set_nameservers_for_net(unsigned netid, const char** servers,
+                                               unsigned numservers, const char* domains,
+                                               const __res_params* params);
+extern "C" int android_getaddrinfofornet(const char* hostname, const char* servname,
+                                         const addrinfo* hints, unsigned netid, unsigned mark,
+                                         addrinfo** res);
+
+static constexpr unsigned kNetId = 4242;
+static constexpr size_t kNumNames = 256;
+
+// Answers every query with a single A record, so that the resolver can
+// fill its cache without any network access.
+static void StubDnsServer(int fd) {
+  uint8_t buf[512];
+  while (true) {
+    sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    ssize_t n = recvfrom(fd, buf, sizeof(buf) - 16, 0, reinterpret_cast<sockaddr*>(&from),
+                         &from_len);
+    if (n < 12) continue;
+    buf[2] |= 0x80;  // QR
+    buf[3] = 0x80;   // RA, NOERROR
+    buf[6] = 0;      // ANCOUNT = 1
+    buf[7] = 1;
+    buf[10] = 0;  // Drop any EDNS0 OPT record.
+    buf[11] = 0;
+    // Skip the question, then append the answer.
+    size_t pos = 12;
+    while (pos < static_cast<size_t>(n) && buf[pos] != 0) pos += buf[pos] + 1;
+    pos += 5;
+    if (pos > static_cast<size_t>(n)) continue;
+    static const uint8_t kAnswer[] = {
+        0xc0, 0x0c,              // Name: pointer to the question.
+        0x00, 0x01, 0x00, 0x01,  // Type A, class IN.
+        0x00, 0x00, 0x0e, 0x10,  // TTL: one hour.
+        0x00, 0x04, 192,  0,    2, 1,
+    };
+    memcpy(buf + pos, kAnswer, sizeof(kAnswer));
+    sendto(fd, buf, pos + sizeof(kAnswer), 0, reinterpret_cast<sockaddr*>(&from), from_len);
+  }
+}
+
+// The stub server is on an ephemeral loopback port, which the resolver
+// accepts as "address:port", so that the benchmark doesn't need root.
+static bool SetUpResolver() {
+  static bool ready = [] {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return false;
+    sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len) == -1) {
+      close(fd);
+      return false;
+    }
+    std::thread(StubDnsServer, fd).detach();
+
+    // Resolve in this process, with a cache, rather than asking netd.
+    setenv("ANDROID_DNS_MODE", "local", 1);
+    char server[32];
+    snprintf(server, sizeof(server), "127.0.0.1:%u", ntohs(addr.sin_port));
+    const char* servers[] = {server};
+    return _resolv_set_nameservers_for_net(kNetId, servers, 1, "", nullptr) == 0;
+  }();
+  return ready;
+}
+
+static void Lookup(size_t name) {
+  char host[64];
+  snprintf(host, sizeof(host), "host%zu.bench.test", name);
+  addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  addrinfo* ai = nullptr;
+  if (android_getaddrinfofornet(host, nullptr, &hints, kNetId, 0, &ai) == 0) {
+    freeaddrinfo(ai);
+  }
+}
+
+// Each thread looks up every name, starting at a different one, so after
+// the first pass all of the lookups hit the cache.
+static void RunCacheLookups(benchmark::State& state, size_t num_threads) {
+  constexpr size_t kMaxThreads = 8;
+  constexpr size_t kRounds = 16;
+  if (!SetUpResolver()) {
+    state.SkipWithError("could not start the stub DNS server");
+    return;
+  }
+  for (size_t i = 0; i < kNumNames; i++) Lookup(i);
+
+  std::mutex m;
+  bool ready = false;
+  std::condition_variable cv;
+  std::thread* threads[kMaxThreads];
+
+  auto thread_task = [&](size_t id) {
+    {
+      std::unique_lock lock(m);
+      cv.wait(lock, [&] { return ready; });
+    }
+    for (size_t round = 0; round < kRounds; round++) {
+      for (size_t i = 0; i < kNumNames; i++) Lookup((i + id * kNumNames / kMaxThreads) % kNumNames);
+    }
+  };
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    ready = false;
+    for (size_t i = 0; i < num_threads; ++i) threads[i] = new std::thread(thread_task, i);
+    state.ResumeTiming();
+
+    {
+      std::unique_lock lock(m);
+      ready = true;
+    }
+    cv.notify_all();
+
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads[i]->join();
+      delete threads[i];
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * num_threads * kRounds * kNumNames);
+}
+
+#define BM_RESOLV_CACHE_LOOKUP(NUM_THREADS)                                      \
+  static void BM_resolv_cache_lookup_##NUM_THREADS(benchmark::State& state) { \
+    RunCacheLookups(state, NUM_THREADS);                                         \
+  }                                                                              \
+  BIONIC_BENCHMARK(BM_resolv_cache_lookup_##NUM_THREADS);
+
+BM_RESOLV_CACHE_LOOKUP(1);
+BM_RESOLV_CACHE_LOOKUP(4);
+BM_RESOLV_CACHE_LOOKUP(8);
+
+#endif
@@ -20,6 +20,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 #include "util.h"
 
@@ -44,3 +48,71 @@ static void BM_semaphore_sem_wait_sem_post(benchmark::State& state) {
   }
 }
 BIONIC_BENCHMARK(BM_semaphore_sem_wait_sem_post);
+
+// A work queue: the producer hands out kItems units to num_consumers threads
+// waiting on one semaphore, either one sem_post() at a time or in batches,
+// and waits for them to all be consumed.
+static void RunSemProducerConsumer(benchmark::State& state, size_t num_consumers,
+                                   [[maybe_unused]] bool batch) {
+  constexpr size_t kItems = 1024;
+  constexpr size_t kBatch = 16;
+  sem_t work;
+  sem_t done;
+  sem_init(&work, 0, 0);
+  sem_init(&done, 0, 0);
+  std::atomic<size_t> remaining;
+  std::atomic<bool> stop = false;
+
+  std::vector<std::thread> consumers;
+  for (size_t i = 0; i < num_consumers; ++i) {
+    consumers.emplace_back([&]() {
+      while (true) {
+        sem_wait(&work);
+        if (stop) break;
+        if (--remaining == 0) sem_post(&done);
+      }
+    });
+  }
+
+  for (auto _ : state) {
+    remaining = kItems;
+    for (size_t i = 0; i < kItems; i += kBatch) {
+#if defined(__BIONIC__)
+      if (batch) {
+        android_sem_post_n(&work, kBatch);
+        continue;
+      }
+#endif
+      for (size_t j = 0; j < kBatch; ++j) sem_post(&work);
+    }
+    sem_wait(&done);
+  }
+
+  stop = true;
+  for (size_t i = 0; i < num_consumers; ++i) sem_post(&work);
+  for (std::thread& t : consumers) t.join();
+  sem_destroy(&work);
+  sem_destroy(&done);
+  state.SetItemsProcessed(state.iterations() * kItems);
+}
+
+#define BM_SEMAPHORE_PRODUCER_CONSUMER(NUM_CONSUMERS)                                      \
+  static void BM_semaphore_producer_consumer_##NUM_CONSUMERS(benchmark::State& state) { \
+    RunSemProducerConsumer(state, NUM_CONSUMERS, false);                                   \
+  }                                                                                        \
+  BIONIC_BENCHMARK(BM_semaphore_producer_consumer_##NUM_CONSUMERS);
+
+BM_SEMAPHORE_PRODUCER_CONSUMER(1);
+BM_SEMAPHORE_PRODUCER_CONSUMER(4);
+BM_SEMAPHORE_PRODUCER_CONSUMER(32);
+
+#if defined(__BIONIC__)
+#define BM_SEMAPHORE_PRODUCER_CONSUMER_POST_N(NUM_CONSUMERS)                                      \
+  static void BM_semaphore_producer_consumer_post_n_##NUM_CONSUMERS(benchmark::State& state) { \
+    RunSemProducerConsumer(state, NUM_CONSUMERS, true);                                           \
+  }                                                                                               \
+  BIONIC_BENCHMARK(BM_semaphore_producer_consumer_post_n_##NUM_CONSUMERS);
+
+BM_SEMAPHORE_PRODUCER_CONSUMER_POST_N(4);
+BM_SEMAPHORE_PRODUCER_CONSUMER_POST_N(32);
+#endif
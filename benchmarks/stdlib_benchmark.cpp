@@ -19,8 +19,12 @@
 #include <locale.h>
 #include <malloc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <random>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 #include "ScopedDecayTimeRestorer.h"
 #include "util.h"
@@ -238,3 +242,91 @@ BIONIC_TRIVIAL_BENCHMARK(BM_stdlib_strtoull, strtoull(" -123", nullptr, 0));
 
 BIONIC_TRIVIAL_BENCHMARK(BM_stdlib_strtol_hex, strtol("0xdeadbeef", nullptr, 0));
 BIONIC_TRIVIAL_BENCHMARK(BM_stdlib_strtoul_hex, strtoul("0xdeadbeef", nullptr, 0));
+
+template <size_t N>
+struct SortElement {
+  uint32_t key;
+  char payload[N - sizeof(uint32_t)];
+};
+
+template <>
+struct SortElement<sizeof(uint32_t)> {
+  uint32_t key;
+};
+
+template <size_t N>
+static int CompareSortElements(const void* lhs, const void* rhs) {
+  uint32_t a = static_cast<const SortElement<N>*>(lhs)->key;
+  uint32_t b = static_cast<const SortElement<N>*>(rhs)->key;
+  return (a > b) - (a < b);
+}
+
+enum class SortInput { kRandom, kSorted, kReversed, kFewUnique };
+
+template <size_t N>
+static std::vector<SortElement<N>> MakeSortInput(SortInput input, size_t count) {
+  std::vector<SortElement<N>> result(count);
+  std::mt19937 rng(42);
+  for (size_t i = 0; i < count; i++) {
+    memset(&result[i], 0, sizeof(result[i]));
+    switch (input) {
+      case SortInput::kRandom: result[i].key = rng(); break;
+      case SortInput::kSorted: result[i].key = i; break;
+      case SortInput::kReversed: result[i].key = count - i; break;
+      case SortInput::kFewUnique: result[i].key = rng() % 16; break;
+    }
+  }
+  return result;
+}
+
+template <size_t N>
+static void RunQsort(benchmark::State& state, SortInput input) {
+  constexpr size_t kCount = 10000;
+  const std::vector<SortElement<N>> original = MakeSortInput<N>(input, kCount);
+  std::vector<SortElement<N>> data(kCount);
+  for (auto _ : state) {
+    state.PauseTiming();
+    data = original;
+    state.ResumeTiming();
+    qsort(data.data(), data.size(), sizeof(data[0]), CompareSortElements<N>);
+  }
+  state.SetItemsProcessed(state.iterations() * kCount);
+}
+
+#define QSORT_BENCHMARK(__size, __input, __name)                                 \
+  static void BM_stdlib_qsort_##__size##_##__name(benchmark::State& state) { \
+    RunQsort<__size>(state, SortInput::__input);                             \
+  }                                                                          \
+  BIONIC_BENCHMARK(BM_stdlib_qsort_##__size##_##__name)
+
+QSORT_BENCHMARK(4, kRandom, random);
+QSORT_BENCHMARK(4, kSorted, sorted);
+QSORT_BENCHMARK(4, kReversed, reversed);
+QSORT_BENCHMARK(4, kFewUnique, few_unique);
+QSORT_BENCHMARK(8, kRandom, random);
+QSORT_BENCHMARK(16, kRandom, random);
+QSORT_BENCHMARK(32, kRandom, random);
+QSORT_BENCHMARK(32, kSorted, sorted);
+
+static int CompareInts(const void* lhs, const void* rhs) {
+  int a = *static_cast<const int*>(lhs);
+  int b = *static_cast<const int*>(rhs);
+  return (a > b) - (a < b);
+}
+
+static void BM_stdlib_bsearch(benchmark::State& state) {
+  constexpr size_t kCount = 4096;
+  std::vector<int> data(kCount);
+  for (size_t i = 0; i < kCount; i++) data[i] = 2 * i;
+  std::vector<int> keys(1024);
+  std::mt19937 rng(42);
+  for (int& key : keys) key = rng() % (2 * kCount);  // About half of these miss.
+
+  for (auto _ : state) {
+    for (int key : keys) {
+      benchmark::DoNotOptimize(bsearch(&key, data.data(), kCount, sizeof(int), CompareInts));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BIONIC_BENCHMARK(BM_stdlib_bsearch);
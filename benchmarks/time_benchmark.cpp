@@ -14,11 +14,16 @@
  * limitations under the License.
  */
 
+#include <pthread.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 #include "util.h"
 
@@ -100,6 +105,36 @@ static void BM_time_clock_gettime_BOOTTIME(benchmark::State& state) {
 }
 BIONIC_BENCHMARK(BM_time_clock_gettime_BOOTTIME);
 
+static void BM_time_clock_gettime_THREAD_CPUTIME_ID(benchmark::State& state) {
+  // The CPU-time clocks are never supported in vdso
+  timespec t;
+  while (state.KeepRunning()) {
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  }
+}
+BIONIC_BENCHMARK(BM_time_clock_gettime_THREAD_CPUTIME_ID);
+
+static void BM_time_clock_gettime_PROCESS_CPUTIME_ID(benchmark::State& state) {
+  timespec t;
+  while (state.KeepRunning()) {
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  }
+}
+BIONIC_BENCHMARK(BM_time_clock_gettime_PROCESS_CPUTIME_ID);
+
+static void BM_time_clock_gettime_pthread_getcpuclockid(benchmark::State& state) {
+  clockid_t clock;
+  if (pthread_getcpuclockid(pthread_self(), &clock) != 0) {
+    state.SkipWithError("pthread_getcpuclockid failed");
+    return;
+  }
+  timespec t;
+  while (state.KeepRunning()) {
+    clock_gettime(clock, &t);
+  }
+}
+BIONIC_BENCHMARK(BM_time_clock_gettime_pthread_getcpuclockid);
+
 static void BM_time_clock_getres(benchmark::State& state) {
   // CLOCK_MONOTONIC is required supported in vdso
   timespec t;
@@ -203,6 +238,70 @@ void BM_time_localtime_r(benchmark::State& state) {
 }
 BIONIC_BENCHMARK(BM_time_localtime_r);
 
+// Several threads converting timestamps at once, as a logging library does.
+static void RunLocaltimeThreads(benchmark::State& state, size_t num_threads) {
+  constexpr size_t kCalls = 10000;
+  time_t t = time(nullptr);
+  for (auto _ : state) {
+    std::atomic<bool> go = false;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back([&go, t] {
+        while (!go.load(std::memory_order_acquire)) {
+        }
+        struct tm tm;
+        for (size_t j = 0; j < kCalls; j++) {
+          time_t when = t + j;
+          benchmark::DoNotOptimize(localtime_r(&when, &tm));
+        }
+      });
+    }
+    go.store(true, std::memory_order_release);
+    for (std::thread& thread : threads) thread.join();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads * kCalls);
+}
+
+#define BM_TIME_LOCALTIME_R_THREADS(NUM_THREADS)                                     \
+  static void BM_time_localtime_r_##NUM_THREADS##_threads(benchmark::State& state) { \
+    RunLocaltimeThreads(state, NUM_THREADS);                                         \
+  }                                                                                  \
+  BIONIC_BENCHMARK(BM_time_localtime_r_##NUM_THREADS##_threads);
+
+BM_TIME_LOCALTIME_R_THREADS(4);
+BM_TIME_LOCALTIME_R_THREADS(8);
+
+void BM_time_mktime(benchmark::State& state) {
+  time_t t = time(nullptr);
+  struct tm tm;
+  localtime_r(&t, &tm);
+  while (state.KeepRunning()) {
+    struct tm copy = tm;
+    benchmark::DoNotOptimize(mktime(&copy));
+  }
+}
+BIONIC_BENCHMARK(BM_time_mktime);
+
+#if defined(__BIONIC__)
+// Renders a timestamp in several zones, loading each zone as it goes, as a
+// server that shows times in each user's zone does.
+void BM_time_tzalloc_localtime_rz(benchmark::State& state) {
+  static const char* kZones[] = {"America/New_York", "Europe/London", "Asia/Kolkata",
+                                 "Australia/Sydney"};
+  time_t t = time(nullptr);
+  while (state.KeepRunning()) {
+    for (const char* name : kZones) {
+      timezone_t tz = tzalloc(name);
+      struct tm tm;
+      benchmark::DoNotOptimize(localtime_rz(tz, &t, &tm));
+      tzfree(tz);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+BIONIC_BENCHMARK(BM_time_tzalloc_localtime_rz);
+#endif
+
 void BM_time_strftime(benchmark::State& state) {
   char buf[128];
   time_t t = 0;
@@ -212,3 +311,42 @@ void BM_time_strftime(benchmark::State& state) {
   }
 }
 BIONIC_BENCHMARK(BM_time_strftime);
+
+void BM_time_strftime_iso8601(benchmark::State& state) {
+  char buf[128];
+  time_t t = 1475619727;
+  struct tm tm;
+  localtime_r(&t, &tm);
+  for (auto _ : state) {
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", &tm);
+  }
+}
+BIONIC_BENCHMARK(BM_time_strftime_iso8601);
+
+void BM_time_strftime_rfc2822(benchmark::State& state) {
+  char buf[128];
+  time_t t = 1475619727;
+  struct tm tm;
+  localtime_r(&t, &tm);
+  for (auto _ : state) {
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %z", &tm);
+  }
+}
+BIONIC_BENCHMARK(BM_time_strftime_rfc2822);
+
+void BM_time_strptime_iso8601(benchmark::State& state) {
+  struct tm tm;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(strptime("2016-10-04T15:22:07-0700", "%Y-%m-%dT%H:%M:%S%z", &tm));
+  }
+}
+BIONIC_BENCHMARK(BM_time_strptime_iso8601);
+
+void BM_time_strptime_rfc2822(benchmark::State& state) {
+  struct tm tm;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        strptime("Tue, 04 Oct 2016 15:22:07 -0700", "%a, %d %b %Y %H:%M:%S %z", &tm));
+  }
+}
+BIONIC_BENCHMARK(BM_time_strptime_rfc2822);
@@ -33,6 +33,7 @@
 #include <private/bionic_globals.h>
 
 #include "gwp_asan_wrappers.h"
+#include "malloc_common.h"
 #include "malloc_limit.h"
 
 #if !defined(LIBC_STATIC)
@@ -85,6 +86,13 @@ extern "C" bool android_mallopt(int opcode, void* arg, size_t arg_size) {
   if (opcode == M_SET_ALLOCATION_LIMIT_BYTES) {
     return LimitEnable(arg, arg_size);
   }
+  if (opcode == M_GET_HEAP_STATS_V2) {
+    if (arg == nullptr || arg_size != sizeof(android_mallopt_heap_stats_t)) {
+      errno = EINVAL;
+      return false;
+    }
+    return GetHeapStats(reinterpret_cast<android_mallopt_heap_stats_t*>(arg));
+  }
 
 #if defined(LIBC_STATIC)
   errno = ENOTSUP;
@@ -195,11 +195,39 @@ size_t StaticTlsLayout::reserve_bionic_tls() {
   return offset_bionic_tls_;
 }
 
+// Reserves `size` bytes of static TLS that the dynamic linker can later hand
+// out to dlopen'ed modules (see allocate_from_surplus). A module placed in the
+// surplus is accessed through a static TLSDESC resolver or a DTV slot pointing
+// into static TLS, so it avoids the dynamic TLS allocator, and TLS IE accesses
+// to it also work. The surplus is bump-allocated and isn't reclaimed when a
+// module is unloaded.
+void StaticTlsLayout::reserve_surplus(size_t size) {
+  if (size == 0) return;
+  surplus_cursor_ = reserve(TlsAlignedSize{.size = size});
+  surplus_end_ = cursor_;
+}
+
 void StaticTlsLayout::finish_layout() {
   // Round the offset up to the alignment.
   cursor_ = align_checked(cursor_, TlsAlign{.value = align_});
 }
 
+// Allocates a module's TLS segment from the static TLS surplus. Returns its
+// offset, or SIZE_MAX if the surplus can't fit the segment. The layout must
+// already be finished, because a segment can't be more aligned than the static
+// TLS block itself.
+size_t StaticTlsLayout::allocate_from_surplus(const TlsSegment& segment) {
+  const TlsAlign align = segment.aligned_size.align;
+  if (surplus_cursor_ >= surplus_end_ || align.value > align_) return SIZE_MAX;
+
+  const size_t offset = align_checked(surplus_cursor_, align);
+  if (offset > surplus_end_ || segment.aligned_size.size > surplus_end_ - offset) {
+    return SIZE_MAX;
+  }
+  surplus_cursor_ = offset + segment.aligned_size.size;
+  return offset;
+}
+
 size_t StaticTlsLayout::align_cursor(TlsAlign align) {
   cursor_ = align_checked(cursor_, align);
   align_ = MAX(align_, align.value);
@@ -261,10 +289,11 @@ void __init_static_tls(void* static_tls) {
 
   for (size_t i = 0; i < modules.module_count; ++i) {
     TlsModule& module = modules.module_table[i];
-    if (module.static_offset == SIZE_MAX) {
-      // All of the static modules come before all of the dynamic modules, so
-      // once we see the first dynamic module, we're done.
-      break;
+    if (module.static_offset == SIZE_MAX || module.static_image_pending) {
+      // Modules allocated from the static TLS surplus can follow dynamic
+      // modules, so keep scanning. A pending module is initialized in every
+      // thread once it has been relocated.
+      continue;
     }
     if (module.segment.init_size == 0) {
       // Skip the memcpy call for TLS segments with no initializer, which is
@@ -277,6 +306,29 @@ void __init_static_tls(void* static_tls) {
   }
 }
 
+// Returns true if a DTV slot points into the thread's static TLS block, which
+// happens for a module that was allocated from the static TLS surplus. Such a
+// slot outlives its module (e.g. after dlclose), and it must not be passed to
+// the TLS allocator.
+static bool is_static_tls_ptr(bionic_tcb* tcb, void* ptr) {
+  const StaticTlsLayout& layout = __libc_shared_globals()->static_tls_layout;
+  char* static_tls = reinterpret_cast<char*>(tcb) - layout.offset_bionic_tcb();
+  char* p = static_cast<char*>(ptr);
+  return p >= static_tls && p < static_tls + layout.size();
+}
+
+// Frees a module's dynamic TLS block, telling sanitizers about it first.
+static void free_dynamic_tls_block(void* dtls_begin) {
+  const TlsModules& modules = __libc_shared_globals()->tls_modules;
+  BionicAllocator& allocator = __libc_shared_globals()->tls_allocator;
+  if (modules.on_destruction_cb != nullptr) {
+    void* dtls_end =
+        static_cast<void*>(static_cast<char*>(dtls_begin) + allocator.get_chunk_size(dtls_begin));
+    modules.on_destruction_cb(dtls_begin, dtls_end);
+  }
+  allocator.free(dtls_begin);
+}
+
 static inline size_t dtv_size_in_bytes(size_t module_count) {
   return sizeof(TlsDtv) + module_count * sizeof(void*);
 }
@@ -336,6 +388,11 @@ static void update_tls_dtv(bionic_tcb* tcb) {
     if (i < modules.module_count) {
       const TlsModule& mod = modules.module_table[i];
       if (mod.static_offset != SIZE_MAX) {
+        // A surplus module can reuse the index of an unloaded dynamic module,
+        // whose block this thread may still hold.
+        if (dtv->modules[i] != nullptr && !is_static_tls_ptr(tcb, dtv->modules[i])) {
+          free_dynamic_tls_block(dtv->modules[i]);
+        }
         dtv->modules[i] = static_tls + mod.static_offset;
         continue;
       }
@@ -344,13 +401,11 @@ static void update_tls_dtv(bionic_tcb* tcb) {
         continue;
       }
     }
-    if (modules.on_destruction_cb != nullptr) {
-      void* dtls_begin = dtv->modules[i];
-      void* dtls_end =
-          static_cast<void*>(static_cast<char*>(dtls_begin) + allocator.get_chunk_size(dtls_begin));
-      modules.on_destruction_cb(dtls_begin, dtls_end);
+    if (is_static_tls_ptr(tcb, dtv->modules[i])) {
+      dtv->modules[i] = nullptr;
+      continue;
     }
-    allocator.free(dtv->modules[i]);
+    free_dynamic_tls_block(dtv->modules[i]);
     dtv->modules[i] = nullptr;
   }
 
@@ -439,19 +494,12 @@ void __free_dynamic_tls(bionic_tcb* tcb) {
 
   // First free everything in the current DTV.
   for (size_t i = 0; i < dtv->count; ++i) {
-    if (i < modules.module_count && modules.module_table[i].static_offset != SIZE_MAX) {
-      // This module's TLS memory is allocated statically, so don't free it here.
-      continue;
-    }
-
-    if (modules.on_destruction_cb != nullptr) {
-      void* dtls_begin = dtv->modules[i];
-      void* dtls_end =
-          static_cast<void*>(static_cast<char*>(dtls_begin) + allocator.get_chunk_size(dtls_begin));
-      modules.on_destruction_cb(dtls_begin, dtls_end);
-    }
+    // Static TLS memory isn't freed here. Check the slot rather than the
+    // module: a module in the static TLS surplus can have reused the index of
+    // an unloaded module whose dynamic block is still in this slot.
+    if (is_static_tls_ptr(tcb, dtv->modules[i])) continue;
 
-    allocator.free(dtv->modules[i]);
+    free_dynamic_tls_block(dtv->modules[i]);
   }
 
   // Now free the thread's list of DTVs.
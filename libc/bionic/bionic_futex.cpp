@@ -28,6 +28,7 @@
 
 #include "private/bionic_futex.h"
 
+#include <linux/time_types.h>
 #include <stdatomic.h>
 #include <time.h>
 
@@ -95,3 +96,31 @@ int __futex_pi_lock_ex(volatile void* ftx, bool shared, bool use_realtime_clock,
   if (!shared) op |= FUTEX_PRIVATE_FLAG;
   return FutexWithTimeout(ftx, op, 0 /* value */, use_realtime_clock, abs_timeout, 0 /* bitset */);
 }
+
+int __futex_waitv_ex(futex_waitv* waiters, size_t count, bool use_realtime_clock,
+                     const timespec* abs_timeout) {
+  // As in FutexWithTimeout, always wait on CLOCK_MONOTONIC. futex_waitv() takes a 64-bit time_t
+  // even for 32-bit processes.
+  __kernel_timespec kernel_timeout;
+  __kernel_timespec* kernel_timeout_ptr = nullptr;
+  if (abs_timeout) {
+    timespec converted_timeout = *abs_timeout;
+    if (use_realtime_clock) {
+      monotonic_time_from_realtime_time(converted_timeout, *abs_timeout);
+    }
+    if (converted_timeout.tv_sec < 0) {
+      return -ETIMEDOUT;
+    }
+    kernel_timeout.tv_sec = converted_timeout.tv_sec;
+    kernel_timeout.tv_nsec = converted_timeout.tv_nsec;
+    kernel_timeout_ptr = &kernel_timeout;
+  }
+
+  int saved_errno = errno;
+  int result = syscall(__NR_futex_waitv, waiters, count, 0, kernel_timeout_ptr, CLOCK_MONOTONIC);
+  if (__predict_false(result == -1)) {
+    result = -errno;
+    errno = saved_errno;
+  }
+  return result;
+}
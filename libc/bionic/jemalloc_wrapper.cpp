@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <sys/param.h>
 #include <unistd.h>
 
@@ -162,6 +163,46 @@ int je_mallopt(int param, int value) {
   return 0;
 }
 
+// The bin sizes are fixed when jemalloc is built, so look them up once
+// rather than resolving "arenas.bin.<i>.size" by name on every call.
+static size_t g_bin_sizes[ANDROID_MALLOPT_HEAP_STATS_MAX_SIZE_CLASSES];
+static size_t g_nbins;
+static pthread_once_t g_bin_sizes_once = PTHREAD_ONCE_INIT;
+
+static void je_init_bin_sizes() {
+  size_t mib[4];
+  size_t miblen = sizeof(mib) / sizeof(mib[0]);
+  if (je_mallctlnametomib("arenas.bin.0.size", mib, &miblen) != 0) {
+    return;
+  }
+  size_t nbins = MIN(je_mallinfo_nbins(), ANDROID_MALLOPT_HEAP_STATS_MAX_SIZE_CLASSES);
+  for (size_t j = 0; j < nbins; j++) {
+    mib[2] = j;
+    size_t sz = sizeof(g_bin_sizes[j]);
+    if (je_mallctlbymib(mib, miblen, &g_bin_sizes[j], &sz, nullptr, 0) != 0) {
+      g_bin_sizes[j] = 0;
+    }
+  }
+  g_nbins = nbins;
+}
+
+size_t je_heap_size_classes(android_mallopt_heap_size_class_t* classes, size_t max_classes) {
+  pthread_once(&g_bin_sizes_once, je_init_bin_sizes);
+  size_t nbins = MIN(g_nbins, max_classes);
+  size_t narenas = je_mallinfo_narenas();
+  for (size_t j = 0; j < nbins; j++) {
+    android_mallopt_heap_size_class_t* size_class = &classes[j];
+    size_class->size = g_bin_sizes[j];
+    for (size_t i = 0; i < narenas; i++) {
+      struct mallinfo mi = je_mallinfo_bin_info(i, j);
+      size_class->allocated_bytes += mi.ordblks;
+      size_class->nmalloc += mi.uordblks;
+      size_class->ndalloc += mi.fordblks;
+    }
+  }
+  return nbins;
+}
+
 int je_malloc_info(int options, FILE* fp) {
   if (options != 0) {
     errno = EINVAL;
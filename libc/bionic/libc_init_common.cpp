@@ -307,6 +307,9 @@ static bool __is_unsafe_environment_variable(const char* name) {
   // of executing a setuid program or the result of an SELinux
   // security transition.
   static constexpr const char* UNSAFE_VARIABLE_NAMES[] = {
+      "ANDROID_DNS_CACHE_NEGATIVE_TTL",
+      "ANDROID_DNS_CACHE_SIZE",
+      "ANDROID_DNS_CACHE_STALE_TTL",
       "ANDROID_DNS_MODE",
       "GCONV_PATH",
       "GETCONF_DIR",
@@ -325,6 +328,7 @@ static bool __is_unsafe_environment_variable(const char* name) {
       "LD_PRELOAD",
       "LD_PROFILE",
       "LD_SHOW_AUXV",
+      "LD_STATIC_TLS_SURPLUS",
       "LD_USE_LOAD_BIAS",
       "LIBC_DEBUG_MALLOC_OPTIONS",
       "LIBC_HOOKS_ENABLE",
@@ -95,6 +95,9 @@ static void __libc_preinit_impl() {
   TlsModules& tls_modules = __libc_shared_globals()->tls_modules;
   tls_modules.generation_libc_so = &__libc_tls_generation_copy;
   __libc_tls_generation_copy = tls_modules.generation;
+  // Let the linker initialize dlopen'ed modules placed in the static TLS
+  // surplus in every thread, not just its own copy of libc's thread list.
+  tls_modules.static_tls_init_cb = __pthread_internal_init_static_tls_module;
 
   __libc_init_globals();
   __libc_init_common();
@@ -102,6 +102,30 @@ extern "C" int malloc_info(int options, FILE* fp) {
   return Malloc(malloc_info)(options, fp);
 }
 
+// Used by android_mallopt(M_GET_HEAP_STATS_V2). This always reports the
+// native allocator, even when malloc debug or hooks are enabled, since
+// those don't change how the heap itself is laid out.
+bool GetHeapStats(android_mallopt_heap_stats_t* stats) {
+  *stats = {};
+  stats->version = ANDROID_MALLOPT_HEAP_STATS_VERSION;
+
+  // Both jemalloc and scudo report the mapped and allocated bytes here, and
+  // neither formats anything or allocates to do it.
+  struct mallinfo mi = Malloc(mallinfo)();
+  stats->mapped_bytes = mi.hblkhd;
+  stats->allocated_bytes = mi.uordblks;
+  if (stats->mapped_bytes > stats->allocated_bytes) {
+    stats->cached_bytes = stats->mapped_bytes - stats->allocated_bytes;
+    stats->fragmentation_permille = stats->cached_bytes * 1000 / stats->mapped_bytes;
+  }
+
+#if !__has_feature(hwaddress_sanitizer) && !defined(USE_SCUDO) && !defined(USE_SCUDO_SVELTE)
+  stats->num_size_classes =
+      je_heap_size_classes(stats->size_classes, ANDROID_MALLOPT_HEAP_STATS_MAX_SIZE_CLASSES);
+#endif
+  return true;
+}
+
 extern "C" int mallopt(int param, int value) {
   // Some are handled by libc directly rather than by the allocator.
   if (param == M_BIONIC_SET_HEAP_TAGGING_LEVEL) {
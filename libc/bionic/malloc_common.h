@@ -32,6 +32,7 @@
 #include <stdio.h>
 
 #include <async_safe/log.h>
+#include <platform/bionic/malloc.h>
 #include <private/bionic_globals.h>
 #include <private/bionic_malloc_dispatch.h>
 
@@ -76,6 +77,10 @@ __END_DECLS
 
 const MallocDispatch* NativeAllocatorDispatch();
 
+// Fills in stats for android_mallopt(M_GET_HEAP_STATS_V2) from the native
+// allocator. Defined in malloc_common.cpp.
+bool GetHeapStats(android_mallopt_heap_stats_t* stats);
+
 static inline const MallocDispatch* GetDispatchTable() {
   return atomic_load_explicit(&__libc_globals->current_dispatch_table, memory_order_acquire);
 }
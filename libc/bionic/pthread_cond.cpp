@@ -117,7 +117,13 @@ struct pthread_cond_internal_t {
 
 #if defined(__LP64__)
   atomic_uint waiters;
-  char __reserved[40];
+  // Set by pthread_cond_broadcast, which only wakes one waiter itself. The first waiter to see
+  // it moves the rest onto its mutex, so that they're woken one at a time as the mutex is
+  // unlocked rather than all at once just to sleep on the mutex again.
+  atomic_uint requeue_pending;
+  // The number of times waiters have been moved onto a mutex.
+  atomic_uint requeue_count;
+  char __reserved[32];
 #endif
 };
 
@@ -144,6 +150,8 @@ int pthread_cond_init(pthread_cond_t* cond_interface, const pthread_condattr_t*
 
 #if defined(__LP64__)
   atomic_store_explicit(&cond->waiters, 0, memory_order_relaxed);
+  atomic_store_explicit(&cond->requeue_pending, 0, memory_order_relaxed);
+  atomic_store_explicit(&cond->requeue_count, 0, memory_order_relaxed);
 #endif
 
   return 0;
@@ -172,6 +180,13 @@ static int __pthread_cond_pulse(pthread_cond_internal_t* cond, int thread_count)
   if (atomic_load_explicit(&cond->waiters, memory_order_relaxed) == 0) {
     return 0;
   }
+
+  // A broadcast on a process-private condition variable wakes one waiter, and leaves that
+  // waiter to requeue the rest onto the mutex that only it knows about.
+  if (thread_count == INT_MAX && !cond->process_shared()) {
+    atomic_store_explicit(&cond->requeue_pending, 1, memory_order_relaxed);
+    thread_count = 1;
+  }
 #endif
 
   // The increase of value should leave flags alone, even if the value can overflows.
@@ -181,6 +196,28 @@ static int __pthread_cond_pulse(pthread_cond_internal_t* cond, int thread_count)
   return 0;
 }
 
+#if defined(__LP64__)
+// Called by a waiter that has been woken, to finish any broadcast that is waiting for it.
+static void __pthread_cond_finish_broadcast(pthread_cond_internal_t* cond,
+                                            volatile void* mutex_futex) {
+  if (atomic_load_explicit(&cond->requeue_pending, memory_order_relaxed) == 0 ||
+      atomic_exchange_explicit(&cond->requeue_pending, 0, memory_order_relaxed) == 0) {
+    return;
+  }
+  if (mutex_futex != nullptr) {
+    // Waiters that start waiting after the broadcast may be requeued too. That's just a
+    // spurious wakeup for them. If the state has changed again since it was read, fall back to
+    // waking everyone.
+    unsigned int state = atomic_load_explicit(&cond->state, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cond->requeue_count, 1, memory_order_relaxed);
+    if (__futex_cmp_requeue_ex(&cond->state, false, 0, INT_MAX, mutex_futex, state) >= 0) {
+      return;
+    }
+  }
+  __futex_wake_ex(&cond->state, false, INT_MAX);
+}
+#endif
+
 static int __pthread_cond_timedwait(pthread_cond_internal_t* cond, pthread_mutex_t* mutex,
                                     bool use_realtime_clock, const timespec* abs_timeout_or_null) {
   int result = check_timespec(abs_timeout_or_null, true);
@@ -191,6 +228,8 @@ static int __pthread_cond_timedwait(pthread_cond_internal_t* cond, pthread_mutex
   unsigned int old_state = atomic_load_explicit(&cond->state, memory_order_relaxed);
 
 #if defined(__LP64__)
+  unsigned int old_requeue_count =
+      atomic_load_explicit(&cond->requeue_count, memory_order_relaxed);
   atomic_fetch_add_explicit(&cond->waiters, 1, memory_order_relaxed);
 #endif
 
@@ -200,6 +239,18 @@ static int __pthread_cond_timedwait(pthread_cond_internal_t* cond, pthread_mutex
 
 #if defined(__LP64__)
   atomic_fetch_sub_explicit(&cond->waiters, 1, memory_order_relaxed);
+
+  if (!cond->process_shared()) {
+    volatile void* mutex_futex = __pthread_mutex_requeue_futex(mutex);
+    __pthread_cond_finish_broadcast(cond, mutex_futex);
+    // If anyone was requeued while we waited, we may have been too, and others may still be
+    // asleep on the mutex.
+    if (mutex_futex != nullptr &&
+        atomic_load_explicit(&cond->requeue_count, memory_order_relaxed) != old_requeue_count) {
+      __pthread_mutex_lock_requeued(mutex);
+      return (status == -ETIMEDOUT) ? ETIMEDOUT : 0;
+    }
+  }
 #endif
 
   pthread_mutex_lock(mutex);
@@ -416,6 +416,11 @@ int pthread_create(pthread_t* thread_out, pthread_attr_t const* attr,
     attr = nullptr; // Prevent misuse below.
   }
 
+  // Snapshot the TLS generation before initializing the new thread's static
+  // TLS. See the check under g_thread_creation_lock below.
+  TlsModules& tls_modules = __libc_shared_globals()->tls_modules;
+  const size_t tls_generation = atomic_load(&tls_modules.generation);
+
   bionic_tcb* tcb = nullptr;
   void* child_stack = nullptr;
   int result = __allocate_thread(&thread_attr, &tcb, &child_stack);
@@ -452,6 +457,14 @@ int pthread_create(pthread_t* thread_out, pthread_attr_t const* attr,
 
   ScopedReadLock locker(&g_thread_creation_lock);
 
+  // If a module in the static TLS surplus became ready after this thread's
+  // static TLS was initialized, __pthread_internal_init_static_tls_module
+  // won't see the thread, so initialize it again here.
+  if (__predict_false(tls_generation != atomic_load(&tls_modules.generation))) {
+    const StaticTlsLayout& layout = __libc_shared_globals()->static_tls_layout;
+    __init_static_tls(reinterpret_cast<char*>(tcb) - layout.offset_bionic_tcb());
+  }
+
 // This has to be done under g_thread_creation_lock or g_thread_list_lock to avoid racing with
 // __pthread_internal_remap_stack_with_mte.
 #ifdef __aarch64__
@@ -139,6 +139,9 @@ __attribute__((no_sanitize("memtag"))) void pthread_exit(void* return_value) {
   __notify_thread_exit_callbacks();
   __hwasan_thread_exit();
 
+  // Nothing else can set a pthread key on this thread now.
+  pthread_key_free_overflow();
+
 #if defined(__aarch64__)
   if (void* stack_mte_tls = thread->bionic_tcb->tls_slot(TLS_SLOT_STACK_MTE)) {
     stack_mte_free_ringbuffer(reinterpret_cast<uintptr_t>(stack_mte_tls));
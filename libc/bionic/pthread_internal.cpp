@@ -237,6 +237,23 @@ bool __pthread_internal_remap_stack_with_mte() {
 #endif  // defined(__aarch64__)
 }
 
+void __pthread_internal_init_static_tls_module(size_t static_offset, const TlsSegment* segment) {
+  // Hold the creation lock so that no thread is added to the list while we
+  // walk it. A thread whose static TLS was initialized while the module was
+  // still pending re-initializes it in pthread_create.
+  ScopedWriteLock creation_locker(&g_thread_creation_lock);
+  ScopedReadLock list_locker(&g_thread_list_lock);
+
+  const StaticTlsLayout& layout = __libc_shared_globals()->static_tls_layout;
+  for (pthread_internal_t* t = g_thread_list; t != nullptr; t = t->next) {
+    if (atomic_load(&t->terminating)) continue;
+    char* static_tls = reinterpret_cast<char*>(t->bionic_tcb) - layout.offset_bionic_tcb();
+    memcpy(static_tls + static_offset, segment->init_ptr, segment->init_size);
+    memset(static_tls + static_offset + segment->init_size, 0,
+           segment->aligned_size.size - segment->init_size);
+  }
+}
+
 bool android_run_on_all_threads(bool (*func)(void*), void* arg) {
   // Take the locks in this order to avoid inversion (pthread_create ->
   // __pthread_internal_add).
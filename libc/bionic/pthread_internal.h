@@ -241,6 +241,11 @@ static inline void __set_tcb_dtv(bionic_tcb* tcb, TlsDtv* val) {
 }
 
 __LIBC_HIDDEN__ void pthread_key_clean_all(void);
+__LIBC_HIDDEN__ void pthread_key_free_overflow(void);
+
+// Used by pthread_cond_broadcast to move waiters straight onto their mutex.
+__LIBC_HIDDEN__ volatile void* __pthread_mutex_requeue_futex(pthread_mutex_t* mutex);
+__LIBC_HIDDEN__ void __pthread_mutex_lock_requeued(pthread_mutex_t* mutex);
 
 // Address space is precious on LP32, so use the minimum unit: one page.
 // On LP64, we could use more but there's no obvious advantage to doing
@@ -278,6 +283,12 @@ __LIBC_HIDDEN__ extern void __bionic_atfork_run_parent();
 // took place, 'false' on error or if the stacks were already remapped in the past.
 __LIBC_HIDDEN__ bool __pthread_internal_remap_stack_with_mte();
 
+// Copies a dlopen'ed module's TLS initialization image into the static TLS
+// surplus of every existing thread. Registered with the dynamic linker via
+// TlsModules::static_tls_init_cb.
+__LIBC_HIDDEN__ void __pthread_internal_init_static_tls_module(size_t static_offset,
+                                                               const TlsSegment* segment);
+
 extern "C" bool android_run_on_all_threads(bool (*func)(void*), void* arg);
 
 extern pthread_rwlock_t g_thread_creation_lock;
@@ -29,7 +29,10 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 
+#include "platform/bionic/page.h"
 #include "private/bionic_defs.h"
 #include "private/bionic_tls.h"
 #include "pthread_internal.h"
@@ -69,54 +72,116 @@ static inline bool KeyInValidRange(pthread_key_t key) {
   return (key < (KEY_VALID_FLAG | BIONIC_PTHREAD_KEY_COUNT));
 }
 
-static inline pthread_key_data_t* get_thread_key_data() {
-  return __get_bionic_tls().key_data;
+// Returns the current thread's data for the key index, or nullptr if the thread hasn't set any
+// key past the inline ones.
+static inline pthread_key_data_t* get_thread_key_data(size_t key) {
+  bionic_tls& tls = __get_bionic_tls();
+  if (__predict_true(key < BIONIC_PTHREAD_KEY_INLINE_COUNT)) {
+    return &tls.key_data[key];
+  }
+  pthread_key_overflow_t* overflow = tls.key_overflow;
+  if (overflow == nullptr) {
+    return nullptr;
+  }
+  return &overflow->key_data[key - BIONIC_PTHREAD_KEY_INLINE_COUNT];
+}
+
+static size_t key_overflow_size() {
+  return __BIONIC_ALIGN(sizeof(pthread_key_overflow_t), page_size());
+}
+
+static pthread_key_overflow_t* allocate_key_overflow() {
+  // This is only needed by threads that use more than BIONIC_PTHREAD_KEY_INLINE_COUNT keys.
+  // Like the rest of the thread's bionic_tls, it's mapped directly rather than coming from
+  // malloc, which can itself be using pthread keys. All the overflow keys share one mapping,
+  // and only the pages holding keys the thread actually sets are ever touched.
+  size_t size = key_overflow_size();
+  void* overflow = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (overflow == MAP_FAILED) {
+    return nullptr;
+  }
+  // We can only use const static allocated string for mapped region name, as Android kernel
+  // uses the string pointer directly when dumping /proc/pid/maps.
+  prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, overflow, size, "pthread key data");
+  return static_cast<pthread_key_overflow_t*>(overflow);
+}
+
+// Calls the destructor for the key index, if the thread has a value for it. Returns true if a
+// destructor was called.
+static bool call_key_destructor(size_t i, pthread_key_data_t* data) {
+  uintptr_t seq = atomic_load_explicit(&key_map[i].seq, memory_order_relaxed);
+  if (!SeqOfKeyInUse(seq) || seq != data->seq) {
+    return false;
+  }
+  // POSIX explicitly says that the destructor is only called if the
+  // thread has a non-null value for the key.
+  if (data->data == nullptr) {
+    return false;
+  }
+
+  // Other threads can call pthread_key_delete()/pthread_key_create()
+  // while this thread is exiting, so we need to ensure we read the right
+  // key_destructor.
+  // We can rely on a user-established happens-before relationship between the creation and
+  // use of a pthread key to ensure that we're not getting an earlier key_destructor.
+  // To avoid using the key_destructor of the newly created key in the same slot, we need to
+  // recheck the sequence number after reading key_destructor. As a result, we either see the
+  // right key_destructor, or the sequence number must have changed when we reread it below.
+  key_destructor_t key_destructor = reinterpret_cast<key_destructor_t>(
+    atomic_load_explicit(&key_map[i].key_destructor, memory_order_relaxed));
+  if (key_destructor == nullptr) {
+    return false;
+  }
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&key_map[i].seq, memory_order_relaxed) != seq) {
+    return false;
+  }
+
+  // We need to clear the key data now, this will prevent the destructor (or a later one)
+  // from seeing the old value if it calls pthread_getspecific().
+  // We don't do this if 'key_destructor == NULL' just in case another destructor
+  // function is responsible for manually releasing the corresponding data.
+  void* value = data->data;
+  data->data = nullptr;
+  (*key_destructor)(value);
+  return true;
+}
+
+// Calls the destructors for the keys whose bits are set in set[], clearing each word first so that
+// keys set again by a destructor are seen in the next round.
+static size_t call_key_destructors(uintptr_t* set, size_t count, size_t first_key,
+                                   pthread_key_data_t* data) {
+  size_t called_destructor_count = 0;
+  for (size_t w = 0; w < BIONIC_PTHREAD_KEY_SET_WORDS(count); ++w) {
+    uintptr_t bits = set[w];
+    set[w] = 0;
+    while (bits != 0) {
+      size_t i = w * BIONIC_PTHREAD_KEYS_PER_SET_WORD + __builtin_ctzl(bits);
+      bits &= bits - 1;
+      if (call_key_destructor(first_key + i, &data[i])) {
+        ++called_destructor_count;
+      }
+    }
+  }
+  return called_destructor_count;
 }
 
 // Called from pthread_exit() to remove all pthread keys. This must call the destructor of
-// all keys that have a non-NULL data value and a non-NULL destructor.
+// all keys that have a non-NULL data value and a non-NULL destructor. Only the keys that the
+// thread has set are looked at.
 __LIBC_HIDDEN__ void pthread_key_clean_all() {
+  bionic_tls& tls = __get_bionic_tls();
   // Because destructors can do funky things like deleting/creating other keys,
   // we need to implement this in a loop.
-  pthread_key_data_t* key_data = get_thread_key_data();
   for (size_t rounds = PTHREAD_DESTRUCTOR_ITERATIONS; rounds > 0; --rounds) {
-    size_t called_destructor_count = 0;
-    for (size_t i = 0; i < BIONIC_PTHREAD_KEY_COUNT; ++i) {
-      uintptr_t seq = atomic_load_explicit(&key_map[i].seq, memory_order_relaxed);
-      if (SeqOfKeyInUse(seq) && seq == key_data[i].seq) {
-        // POSIX explicitly says that the destructor is only called if the
-        // thread has a non-null value for the key.
-        if (key_data[i].data == nullptr) {
-          continue;
-        }
-
-        // Other threads can call pthread_key_delete()/pthread_key_create()
-        // while this thread is exiting, so we need to ensure we read the right
-        // key_destructor.
-        // We can rely on a user-established happens-before relationship between the creation and
-        // use of a pthread key to ensure that we're not getting an earlier key_destructor.
-        // To avoid using the key_destructor of the newly created key in the same slot, we need to
-        // recheck the sequence number after reading key_destructor. As a result, we either see the
-        // right key_destructor, or the sequence number must have changed when we reread it below.
-        key_destructor_t key_destructor = reinterpret_cast<key_destructor_t>(
-          atomic_load_explicit(&key_map[i].key_destructor, memory_order_relaxed));
-        if (key_destructor == nullptr) {
-          continue;
-        }
-        atomic_thread_fence(memory_order_acquire);
-        if (atomic_load_explicit(&key_map[i].seq, memory_order_relaxed) != seq) {
-           continue;
-        }
-
-        // We need to clear the key data now, this will prevent the destructor (or a later one)
-        // from seeing the old value if it calls pthread_getspecific().
-        // We don't do this if 'key_destructor == NULL' just in case another destructor
-        // function is responsible for manually releasing the corresponding data.
-        void* data = key_data[i].data;
-        key_data[i].data = nullptr;
-        (*key_destructor)(data);
-        ++called_destructor_count;
-      }
+    size_t called_destructor_count = call_key_destructors(
+        tls.key_data_set, BIONIC_PTHREAD_KEY_INLINE_COUNT, 0, tls.key_data);
+    // Read this after the inline destructors, which may have set an overflow key.
+    pthread_key_overflow_t* overflow = tls.key_overflow;
+    if (overflow != nullptr) {
+      called_destructor_count +=
+          call_key_destructors(overflow->key_data_set, BIONIC_PTHREAD_KEY_OVERFLOW_COUNT,
+                               BIONIC_PTHREAD_KEY_INLINE_COUNT, overflow->key_data);
     }
 
     // If we didn't call any destructors, there is no need to check the pthread keys again.
@@ -126,6 +191,17 @@ __LIBC_HIDDEN__ void pthread_key_clean_all() {
   }
 }
 
+// Called from pthread_exit() once nothing else can run on the thread, to free the overflow
+// mapping. This is separate from pthread_key_clean_all() so that a pthread_setspecific() between
+// the two (from a thread exit callback, say) can't map a new one that is never freed.
+__LIBC_HIDDEN__ void pthread_key_free_overflow() {
+  bionic_tls& tls = __get_bionic_tls();
+  if (tls.key_overflow != nullptr) {
+    munmap(tls.key_overflow, key_overflow_size());
+    tls.key_overflow = nullptr;
+  }
+}
+
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
 int pthread_key_create(pthread_key_t* key, void (*key_destructor)(void*)) {
   for (size_t i = 0; i < BIONIC_PTHREAD_KEY_COUNT; ++i) {
@@ -168,7 +244,10 @@ void* pthread_getspecific(pthread_key_t key) {
   }
   key &= ~KEY_VALID_FLAG;
   uintptr_t seq = atomic_load_explicit(&key_map[key].seq, memory_order_relaxed);
-  pthread_key_data_t* data = &get_thread_key_data()[key];
+  pthread_key_data_t* data = get_thread_key_data(key);
+  if (__predict_false(data == nullptr)) {
+    return nullptr;
+  }
   // It is the user's responsibility to synchronize between the creation and use of pthread keys,
   // so we use memory_order_relaxed when checking the sequence number.
   if (__predict_true(SeqOfKeyInUse(seq) && data->seq == seq)) {
@@ -187,11 +266,35 @@ int pthread_setspecific(pthread_key_t key, const void* ptr) {
   }
   key &= ~KEY_VALID_FLAG;
   uintptr_t seq = atomic_load_explicit(&key_map[key].seq, memory_order_relaxed);
-  if (__predict_true(SeqOfKeyInUse(seq))) {
-    pthread_key_data_t* data = &get_thread_key_data()[key];
-    data->seq = seq;
-    data->data = const_cast<void*>(ptr);
-    return 0;
+  if (__predict_false(!SeqOfKeyInUse(seq))) {
+    return EINVAL;
   }
-  return EINVAL;
+
+  bionic_tls& tls = __get_bionic_tls();
+  pthread_key_data_t* data;
+  uintptr_t* set;
+  size_t index = key;
+  if (__predict_true(index < BIONIC_PTHREAD_KEY_INLINE_COUNT)) {
+    data = &tls.key_data[index];
+    set = tls.key_data_set;
+  } else {
+    index -= BIONIC_PTHREAD_KEY_INLINE_COUNT;
+    if (tls.key_overflow == nullptr) {
+      // There's nothing to store, so don't allocate the overflow mapping just for that.
+      if (ptr == nullptr) {
+        return 0;
+      }
+      tls.key_overflow = allocate_key_overflow();
+      if (tls.key_overflow == nullptr) {
+        return ENOMEM;
+      }
+    }
+    data = &tls.key_overflow->key_data[index];
+    set = tls.key_overflow->key_data_set;
+  }
+  data->seq = seq;
+  data->data = const_cast<void*>(ptr);
+  set[index / BIONIC_PTHREAD_KEYS_PER_SET_WORD] |=
+      static_cast<uintptr_t>(1) << (index % BIONIC_PTHREAD_KEYS_PER_SET_WORD);
+  return 0;
 }
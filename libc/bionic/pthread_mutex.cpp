@@ -844,6 +844,32 @@ int pthread_mutex_lock(pthread_mutex_t* mutex_interface) {
     return NonPI::MutexLockWithTimeout(mutex, false, nullptr);
 }
 
+// Returns the futex word that condition variable waiters can be requeued onto, or nullptr if
+// the mutex doesn't allow it. Only normal, process-private, Non-PI mutexes do: their unlock
+// wakes a sleeper whenever it releases the lock from the locked_contended state.
+volatile void* __pthread_mutex_requeue_futex(pthread_mutex_t* mutex_interface) {
+    pthread_mutex_internal_t* mutex = __get_internal_mutex(mutex_interface);
+    uint16_t old_state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
+    if ((old_state & (MUTEX_TYPE_MASK | MUTEX_SHARED_MASK)) != MUTEX_TYPE_BITS_NORMAL) {
+        return nullptr;
+    }
+    return &mutex->state;
+}
+
+// Locks a mutex accepted by __pthread_mutex_requeue_futex() for a condition variable waiter
+// that may have been requeued. Other requeued waiters may be asleep on the mutex without having
+// marked it as contended, so the lock is always taken in the locked_contended state: the
+// unlock will then wake the next of them.
+void __pthread_mutex_lock_requeued(pthread_mutex_t* mutex_interface) {
+    pthread_mutex_internal_t* mutex = __get_internal_mutex(mutex_interface);
+    const uint16_t unlocked         = MUTEX_STATE_BITS_UNLOCKED;
+    const uint16_t locked_contended = MUTEX_STATE_BITS_LOCKED_CONTENDED;
+    while (atomic_exchange_explicit(&mutex->state, locked_contended,
+                                    memory_order_acquire) != unlocked) {
+        __futex_wait_ex(&mutex->state, false, locked_contended, false, nullptr);
+    }
+}
+
 int pthread_mutex_unlock(pthread_mutex_t* mutex_interface) {
 #if !defined(__LP64__)
     // Some apps depend on being able to pass NULL as a mutex and get EINVAL
@@ -27,8 +27,10 @@
  */
 
 #include <errno.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "pthread_internal.h"
 #include "private/bionic_futex.h"
@@ -59,15 +61,15 @@
 
 // A rwlockattr is implemented as a 32-bit integer which has following fields:
 //  bits    name              description
-//   1     rwlock_kind       have rwlock preference like PTHREAD_RWLOCK_PREFER_READER_NP.
+//  2-1    rwlock_kind       have rwlock preference like PTHREAD_RWLOCK_PREFER_READER_NP.
 //   0      process_shared    set to 1 if the rwlock is shared between processes.
 
 #define RWLOCKATTR_PSHARED_SHIFT 0
 #define RWLOCKATTR_KIND_SHIFT    1
 
 #define RWLOCKATTR_PSHARED_MASK  1
-#define RWLOCKATTR_KIND_MASK     2
-#define RWLOCKATTR_RESERVED_MASK (~3)
+#define RWLOCKATTR_KIND_MASK     6
+#define RWLOCKATTR_RESERVED_MASK (~7)
 
 static inline __always_inline bool __rwlockattr_getpshared(const pthread_rwlockattr_t* attr) {
   return (*attr & RWLOCKATTR_PSHARED_MASK) >> RWLOCKATTR_PSHARED_SHIFT;
@@ -128,6 +130,7 @@ int pthread_rwlockattr_setkind_np(pthread_rwlockattr_t* attr, int pref) {
   switch (pref) {
     case PTHREAD_RWLOCK_PREFER_READER_NP:   // Fall through.
     case PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP:
+    case PTHREAD_RWLOCK_SCALABLE_READER_NP:
       __rwlockattr_setkind(attr, pref);
       return 0;
     default:
@@ -161,7 +164,8 @@ struct pthread_rwlock_internal_t {
 
   bool pshared;
   bool writer_nonrecursive_preferred;
-  uint16_t __pad;
+  bool scalable_readers;  // Set for a private PTHREAD_RWLOCK_SCALABLE_READER_NP lock.
+  atomic_bool reader_bias;  // Whether readers should try the reader slots; see below.
 
 // When a reader thread plans to suspend on the rwlock, it will add STATE_HAVE_PENDING_READERS_FLAG
 // in state, increase pending_reader_count, and wait on pending_reader_wakeup_serial. After woken
@@ -175,10 +179,12 @@ struct pthread_rwlock_internal_t {
   uint32_t pending_reader_wakeup_serial;  // Pending reader threads wait on this address by futex_wait.
   uint32_t pending_writer_wakeup_serial;  // Pending writer threads wait on this address by futex_wait.
 
+  // The CLOCK_MONOTONIC millisecond (truncated to 32 bits) before which readers shouldn't restore
+  // reader_bias.
+  atomic_uint reader_bias_inhibited_until_ms;
+
 #if defined(__LP64__)
-  char __reserved[20];
-#else
-  char __reserved[4];
+  char __reserved[16];
 #endif
 };
 
@@ -224,6 +230,142 @@ static inline __always_inline pthread_rwlock_internal_t* __get_internal_rwlock(p
   return reinterpret_cast<pthread_rwlock_internal_t*>(rwlock_interface);
 }
 
+// Readers of a scalable lock don't write to the lock while it's reader biased. Each one instead
+// claims a slot in a table shared by all such locks, chosen by hashing the lock and the thread, so
+// that readers on different CPUs write to different cache lines (this is BRAVO, from Dice and
+// Kogan's "BRAVO: Biased Locking for Reader-Writer Locks"). A writer takes the lock as usual, then
+// clears reader_bias and waits until no slot names the lock. Readers whose slot is already taken,
+// or that find the bias cleared, use the lock's state as usual.
+//
+// Since clearing the bias is slow, a reader that takes the lock the usual way only restores it
+// after several times as long as the last writer took to clear it.
+
+struct rwlock_reader_slot {
+  _Atomic(pthread_rwlock_internal_t*) rwlock;
+  // The thread that claimed the slot, so that an unlock by another thread whose slot collides
+  // doesn't release it.
+  _Atomic(pthread_internal_t*) owner;
+};
+
+static constexpr size_t kReaderSlotBits = 11;
+static rwlock_reader_slot g_reader_slots[1 << kReaderSlotBits];
+
+static constexpr uint32_t kReaderBiasInhibitFactor = 9;
+
+static inline __always_inline rwlock_reader_slot* __get_reader_slot(
+    pthread_rwlock_internal_t* rwlock, pthread_internal_t* thread) {
+  uint64_t hash = (reinterpret_cast<uintptr_t>(rwlock) ^ reinterpret_cast<uintptr_t>(thread)) *
+                  0x9e3779b97f4a7c15ULL;
+  return &g_reader_slots[hash >> (64 - kReaderSlotBits)];
+}
+
+static uint32_t __reader_bias_now_ms() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static inline __always_inline bool __pthread_rwlock_biased_tryrdlock(
+    pthread_rwlock_internal_t* rwlock) {
+  if (__predict_true(!atomic_load_explicit(&rwlock->reader_bias, memory_order_relaxed))) {
+    return false;
+  }
+  pthread_internal_t* self = __get_thread();
+  rwlock_reader_slot* slot = __get_reader_slot(rwlock, self);
+  pthread_rwlock_internal_t* expected = nullptr;
+  // Claiming the slot and then checking the bias pairs with a writer clearing the bias and then
+  // checking the slots: one or the other sees the other's write.
+  if (!atomic_compare_exchange_strong(&slot->rwlock, &expected, rwlock)) {
+    return false;
+  }
+  if (__predict_false(!atomic_load(&rwlock->reader_bias))) {
+    atomic_store_explicit(&slot->rwlock, nullptr, memory_order_relaxed);
+    return false;
+  }
+  atomic_store_explicit(&slot->owner, self, memory_order_relaxed);
+  return true;
+}
+
+static inline __always_inline bool __pthread_rwlock_biased_unlock(
+    pthread_rwlock_internal_t* rwlock) {
+  pthread_internal_t* self = __get_thread();
+  rwlock_reader_slot* slot = __get_reader_slot(rwlock, self);
+  if (atomic_load_explicit(&slot->rwlock, memory_order_relaxed) != rwlock ||
+      atomic_load_explicit(&slot->owner, memory_order_relaxed) != self) {
+    return false;
+  }
+  atomic_store_explicit(&slot->owner, nullptr, memory_order_relaxed);
+  atomic_store_explicit(&slot->rwlock, nullptr, memory_order_release);
+  return true;
+}
+
+// Called by a reader that took the lock the usual way.
+static void __pthread_rwlock_restore_reader_bias(pthread_rwlock_internal_t* rwlock) {
+  if (atomic_load_explicit(&rwlock->reader_bias, memory_order_relaxed)) {
+    return;
+  }
+  uint32_t until = atomic_load_explicit(&rwlock->reader_bias_inhibited_until_ms,
+                                        memory_order_relaxed);
+  if (static_cast<int32_t>(__reader_bias_now_ms() - until) >= 0) {
+    atomic_store(&rwlock->reader_bias, true);
+  }
+}
+
+static bool __timed_out(bool use_realtime_clock, const timespec* abs_timeout_or_null) {
+  if (abs_timeout_or_null == nullptr) {
+    return false;
+  }
+  timespec now;
+  clock_gettime(use_realtime_clock ? CLOCK_REALTIME : CLOCK_MONOTONIC, &now);
+  return now.tv_sec > abs_timeout_or_null->tv_sec ||
+         (now.tv_sec == abs_timeout_or_null->tv_sec &&
+          now.tv_nsec >= abs_timeout_or_null->tv_nsec);
+}
+
+// Called by a writer that holds the lock, if reader_bias is set. Returns EBUSY (if try_only) or
+// ETIMEDOUT if readers still hold slots, in which case the caller must release the lock.
+static int __pthread_rwlock_revoke_reader_bias(pthread_rwlock_internal_t* rwlock, bool try_only,
+                                               bool use_realtime_clock,
+                                               const timespec* abs_timeout_or_null) {
+  uint32_t start_ms = __reader_bias_now_ms();
+  atomic_store_explicit(&rwlock->reader_bias_inhibited_until_ms, start_ms + 1,
+                        memory_order_relaxed);
+  atomic_store(&rwlock->reader_bias, false);
+
+  for (rwlock_reader_slot& slot : g_reader_slots) {
+    // Readers don't hold the lock for long, so spin at first, but don't keep a CPU busy waiting
+    // for one that does.
+    for (size_t i = 0; atomic_load(&slot.rwlock) == rwlock; ++i) {
+      int result = 0;
+      if (try_only) {
+        result = EBUSY;
+      } else if (i >= 100 && __timed_out(use_realtime_clock, abs_timeout_or_null)) {
+        result = ETIMEDOUT;
+      }
+      if (result != 0) {
+        // Restore the bias, so that the next writer knows to wait for the slots too. This writer
+        // never entered its critical section, so new readers may as well use their slots.
+        atomic_store(&rwlock->reader_bias, true);
+        return result;
+      }
+      if (i < 100) {
+        continue;
+      }
+      if (i < 200) {
+        sched_yield();
+      } else {
+        usleep(1000);
+      }
+    }
+  }
+
+  uint32_t elapsed_ms = __reader_bias_now_ms() - start_ms;
+  atomic_store_explicit(&rwlock->reader_bias_inhibited_until_ms,
+                        start_ms + 1 + elapsed_ms * (kReaderBiasInhibitFactor + 1),
+                        memory_order_relaxed);
+  return 0;
+}
+
 int pthread_rwlock_init(pthread_rwlock_t* rwlock_interface, const pthread_rwlockattr_t* attr) {
   pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
 
@@ -239,6 +381,10 @@ int pthread_rwlock_init(pthread_rwlock_t* rwlock_interface, const pthread_rwlock
       case PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP:
         rwlock->writer_nonrecursive_preferred = true;
         break;
+      case PTHREAD_RWLOCK_SCALABLE_READER_NP:
+        // The reader slots are private to this process.
+        rwlock->scalable_readers = !rwlock->pshared;
+        break;
       default:
         return EINVAL;
     }
@@ -248,6 +394,7 @@ int pthread_rwlock_init(pthread_rwlock_t* rwlock_interface, const pthread_rwlock
   }
 
   atomic_store_explicit(&rwlock->state, 0, memory_order_relaxed);
+  atomic_store_explicit(&rwlock->reader_bias, rwlock->scalable_readers, memory_order_relaxed);
   rwlock->pending_lock.init(rwlock->pshared);
   return 0;
 }
@@ -258,6 +405,13 @@ int pthread_rwlock_destroy(pthread_rwlock_t* rwlock_interface) {
   if (atomic_load_explicit(&rwlock->state, memory_order_relaxed) != 0) {
     return EBUSY;
   }
+  if (rwlock->scalable_readers) {
+    for (rwlock_reader_slot& slot : g_reader_slots) {
+      if (atomic_load_explicit(&slot.rwlock, memory_order_relaxed) == rwlock) {
+        return EBUSY;
+      }
+    }
+  }
   return 0;
 }
 
@@ -281,6 +435,9 @@ static inline __always_inline int __pthread_rwlock_tryrdlock(pthread_rwlock_inte
     }
     if (__predict_true(atomic_compare_exchange_weak_explicit(&rwlock->state, &old_state, new_state,
                                               memory_order_acquire, memory_order_relaxed))) {
+      if (__predict_false(rwlock->scalable_readers)) {
+        __pthread_rwlock_restore_reader_bias(rwlock);
+      }
       return 0;
     }
   }
@@ -293,6 +450,9 @@ static int __pthread_rwlock_timedrdlock(pthread_rwlock_internal_t* rwlock, bool
     return EDEADLK;
   }
 
+  if (__pthread_rwlock_biased_tryrdlock(rwlock)) {
+    return 0;
+  }
   while (true) {
     int result = __pthread_rwlock_tryrdlock(rwlock);
     if (result == 0 || result == EAGAIN) {
@@ -359,6 +519,23 @@ static inline __always_inline int __pthread_rwlock_trywrlock(pthread_rwlock_inte
   return EBUSY;
 }
 
+static int __pthread_rwlock_unlock(pthread_rwlock_internal_t* rwlock);
+
+// Called by a writer that has just taken the lock.
+static inline __always_inline int __pthread_rwlock_finish_wrlock(
+    pthread_rwlock_internal_t* rwlock, bool try_only, bool use_realtime_clock,
+    const timespec* abs_timeout_or_null) {
+  if (__predict_true(!atomic_load_explicit(&rwlock->reader_bias, memory_order_relaxed))) {
+    return 0;
+  }
+  int result = __pthread_rwlock_revoke_reader_bias(rwlock, try_only, use_realtime_clock,
+                                                   abs_timeout_or_null);
+  if (result != 0) {
+    __pthread_rwlock_unlock(rwlock);
+  }
+  return result;
+}
+
 static int __pthread_rwlock_timedwrlock(pthread_rwlock_internal_t* rwlock, bool use_realtime_clock,
                                         const timespec* abs_timeout_or_null) {
   if (atomic_load_explicit(&rwlock->writer_tid, memory_order_relaxed) == __get_thread()->tid) {
@@ -367,7 +544,8 @@ static int __pthread_rwlock_timedwrlock(pthread_rwlock_internal_t* rwlock, bool
   while (true) {
     int result = __pthread_rwlock_trywrlock(rwlock);
     if (result == 0) {
-      return result;
+      return __pthread_rwlock_finish_wrlock(rwlock, false, use_realtime_clock,
+                                            abs_timeout_or_null);
     }
     result = check_timespec(abs_timeout_or_null, true);
     if (result != 0) {
@@ -411,7 +589,7 @@ static int __pthread_rwlock_timedwrlock(pthread_rwlock_internal_t* rwlock, bool
 int pthread_rwlock_rdlock(pthread_rwlock_t* rwlock_interface) {
   pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
   // Avoid slowing down fast path of rdlock.
-  if (__predict_true(__pthread_rwlock_tryrdlock(rwlock) == 0)) {
+  if (__pthread_rwlock_biased_tryrdlock(rwlock) || __pthread_rwlock_tryrdlock(rwlock) == 0) {
     return 0;
   }
   return __pthread_rwlock_timedrdlock(rwlock, false, nullptr);
@@ -443,14 +621,18 @@ int pthread_rwlock_clockrdlock(pthread_rwlock_t* rwlock_interface, clockid_t clo
 }
 
 int pthread_rwlock_tryrdlock(pthread_rwlock_t* rwlock_interface) {
-  return __pthread_rwlock_tryrdlock(__get_internal_rwlock(rwlock_interface));
+  pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
+  if (__pthread_rwlock_biased_tryrdlock(rwlock)) {
+    return 0;
+  }
+  return __pthread_rwlock_tryrdlock(rwlock);
 }
 
 int pthread_rwlock_wrlock(pthread_rwlock_t* rwlock_interface) {
   pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
   // Avoid slowing down fast path of wrlock.
   if (__predict_true(__pthread_rwlock_trywrlock(rwlock) == 0)) {
-    return 0;
+    return __pthread_rwlock_finish_wrlock(rwlock, false, false, nullptr);
   }
   return __pthread_rwlock_timedwrlock(rwlock, false, nullptr);
 }
@@ -481,11 +663,22 @@ int pthread_rwlock_clockwrlock(pthread_rwlock_t* rwlock_interface, clockid_t clo
 }
 
 int pthread_rwlock_trywrlock(pthread_rwlock_t* rwlock_interface) {
-  return __pthread_rwlock_trywrlock(__get_internal_rwlock(rwlock_interface));
+  pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
+  int result = __pthread_rwlock_trywrlock(rwlock);
+  if (result == 0) {
+    result = __pthread_rwlock_finish_wrlock(rwlock, true, false, nullptr);
+  }
+  return result;
 }
 
 int pthread_rwlock_unlock(pthread_rwlock_t* rwlock_interface) {
-  pthread_rwlock_internal_t* rwlock = __get_internal_rwlock(rwlock_interface);
+  return __pthread_rwlock_unlock(__get_internal_rwlock(rwlock_interface));
+}
+
+static int __pthread_rwlock_unlock(pthread_rwlock_internal_t* rwlock) {
+  if (__predict_false(rwlock->scalable_readers) && __pthread_rwlock_biased_unlock(rwlock)) {
+    return 0;
+  }
 
   int old_state = atomic_load_explicit(&rwlock->state, memory_order_relaxed);
   if (__state_owned_by_writer(old_state)) {
@@ -0,0 +1,525 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * qsort(3), as a pattern-defeating quicksort. Like the FreeBSD qsort.c it
+ * replaces, the same source builds each entry point: qsort_r.c defines
+ * I_AM_QSORT_R and includes this file, and I_AM_QSORT_R_COMPAT and
+ * I_AM_QSORT_S select the other FreeBSD variants.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(I_AM_QSORT_R)
+typedef int		 cmp_t(const void *, const void *, void *);
+#elif defined(I_AM_QSORT_R_COMPAT)
+typedef int		 cmp_t(void *, const void *, const void *);
+#elif defined(I_AM_QSORT_S)
+typedef int		 cmp_t(const void *, const void *, void *);
+#else
+typedef int		 cmp_t(const void *, const void *);
+#endif
+
+#define	MIN(a, b)	((a) < (b) ? a : b)
+
+/*
+ * Pattern-defeating quicksort, after Orson Peters' pdqsort: introsort
+ * with insertion sort for small runs, median-of-3 or ninther pivots,
+ * BlockQuicksort-style partitioning (Edelkamp & Weiss) and a heapsort
+ * fallback when too many partitions come out badly unbalanced, so the
+ * worst case is O(n log n).  Sorted, reversed and all-equal inputs are
+ * O(n).
+ *
+ * Every scan is bounded by the ends of the array, so a comparator that
+ * is not a consistent ordering gives an unspecified order rather than
+ * out of bounds accesses.
+ */
+
+#define	INSERTION_SORT_THRESHOLD	24
+#define	NINTHER_THRESHOLD		128
+#define	PARTIAL_INSERTION_SORT_LIMIT	8
+#define	BLOCK_SIZE			64
+
+/* Element swaps, specialized for the common element sizes. */
+enum {
+	SWAP_BYTES,
+	SWAP_4,
+	SWAP_8,
+	SWAP_16,
+	SWAP_LONGS,
+};
+
+struct sort_ctx {
+	size_t es;
+	cmp_t *cmp;
+	void *thunk;
+	int swaptype;
+};
+
+#if defined(I_AM_QSORT_R)
+#define	CMP(c, x, y) ((c)->cmp((x), (y), (c)->thunk))
+#elif defined(I_AM_QSORT_R_COMPAT)
+#define	CMP(c, x, y) ((c)->cmp((c)->thunk, (x), (y)))
+#elif defined(I_AM_QSORT_S)
+#define	CMP(c, x, y) ((c)->cmp((x), (y), (c)->thunk))
+#else
+#define	CMP(c, x, y) ((c)->cmp((x), (y)))
+#endif
+#define	LESS(c, x, y) (CMP(c, x, y) < 0)
+
+static inline int
+swaptype(const void *a, size_t es)
+{
+	uintptr_t align = (uintptr_t)a | es;
+
+	if (es == 4 && (align & 3) == 0)
+		return (SWAP_4);
+	if (es == 8 && (align & 7) == 0)
+		return (SWAP_8);
+	if (es == 16 && (align & 7) == 0)
+		return (SWAP_16);
+	if ((align & (sizeof(long) - 1)) == 0)
+		return (SWAP_LONGS);
+	return (SWAP_BYTES);
+}
+
+#define	SWAP_WORDS(a, b, size, align) do {			\
+	char __t[size];						\
+	memcpy(__t, __builtin_assume_aligned(a, align), size);	\
+	memcpy(__builtin_assume_aligned(a, align),		\
+	    __builtin_assume_aligned(b, align), size);		\
+	memcpy(__builtin_assume_aligned(b, align), __t, size);	\
+} while (0)
+
+static inline void
+swapfunc(char *a, char *b, const struct sort_ctx *c)
+{
+	size_t n;
+	char t;
+
+	switch (c->swaptype) {
+	case SWAP_4:
+		SWAP_WORDS(a, b, 4, 4);
+		return;
+	case SWAP_8:
+		SWAP_WORDS(a, b, 8, 8);
+		return;
+	case SWAP_16:
+		SWAP_WORDS(a, b, 16, 8);
+		return;
+	case SWAP_LONGS:
+		for (n = c->es; n > 0; n -= sizeof(long)) {
+			SWAP_WORDS(a, b, sizeof(long), sizeof(long));
+			a += sizeof(long);
+			b += sizeof(long);
+		}
+		return;
+	default:
+		n = c->es;
+		do {
+			t = *a;
+			*a++ = *b;
+			*b++ = t;
+		} while (--n > 0);
+		return;
+	}
+}
+
+static inline void
+sort2(char *a, char *b, const struct sort_ctx *c)
+{
+	if (LESS(c, b, a))
+		swapfunc(a, b, c);
+}
+
+static inline void
+sort3(char *a, char *b, char *d, const struct sort_ctx *c)
+{
+	sort2(a, b, c);
+	sort2(b, d, c);
+	sort2(a, b, c);
+}
+
+static void
+insertion_sort(char *begin, char *end, const struct sort_ctx *c)
+{
+	const size_t es = c->es;
+	char *cur, *p;
+
+	for (cur = begin + es; cur < end; cur += es)
+		for (p = cur; p > begin && LESS(c, p, p - es); p -= es)
+			swapfunc(p, p - es, c);
+}
+
+/*
+ * Insertion sort that gives up once it has moved more than a few
+ * elements.  Returns whether [begin, end) ended up sorted.
+ */
+static bool
+partial_insertion_sort(char *begin, char *end, const struct sort_ctx *c)
+{
+	const size_t es = c->es;
+	size_t moved = 0;
+	char *cur, *p;
+
+	for (cur = begin + es; cur < end; cur += es) {
+		if (moved > PARTIAL_INSERTION_SORT_LIMIT)
+			return (false);
+		for (p = cur; p > begin && LESS(c, p, p - es); p -= es) {
+			swapfunc(p, p - es, c);
+			moved++;
+		}
+	}
+	return (true);
+}
+
+static void
+siftdown(char *a, size_t root, size_t n, const struct sort_ctx *c)
+{
+	const size_t es = c->es;
+	size_t child;
+
+	while ((child = 2 * root + 1) < n) {
+		if (child + 1 < n && LESS(c, a + child * es, a + (child + 1) * es))
+			child++;
+		if (!LESS(c, a + root * es, a + child * es))
+			return;
+		swapfunc(a + root * es, a + child * es, c);
+		root = child;
+	}
+}
+
+static void
+heapsort_range(char *a, size_t n, const struct sort_ctx *c)
+{
+	size_t i;
+
+	for (i = n / 2; i-- > 0;)
+		siftdown(a, i, n, c);
+	for (i = n; i-- > 1;) {
+		swapfunc(a, a + i * c->es, c);
+		siftdown(a, 0, i, c);
+	}
+}
+
+/*
+ * Partitions [begin, end) around the pivot at begin, putting elements
+ * equal to it on the right.  Returns the pivot's final position, and sets
+ * *partitioned if no elements had to be moved.
+ *
+ * The elements on the wrong side are found a block at a time, recording
+ * their offsets without branching on the comparisons, and then swapped
+ * in pairs.
+ */
+static char *
+partition_right(char *begin, char *end, bool *partitioned,
+    const struct sort_ctx *c)
+{
+	const size_t es = c->es;
+	unsigned char offsets_l[BLOCK_SIZE], offsets_r[BLOCK_SIZE];
+	char *first = begin, *last = end, *pivot = begin;
+	char *base_l, *base_r;
+	size_t num_l, num_r, start_l, start_r, num, i;
+	size_t unknown, split_l, split_r;
+
+	/* Skip the elements that are already on the correct side. */
+	do
+		first += es;
+	while (first < end && LESS(c, first, pivot));
+	do
+		last -= es;
+	while (last > first && !LESS(c, last, pivot));
+
+	*partitioned = first >= last;
+	if (*partitioned)
+		goto done;
+	swapfunc(first, last, c);
+	first += es;
+
+	base_l = first;
+	base_r = last;
+	num_l = num_r = start_l = start_r = 0;
+	while (first < last) {
+		/* Decide how much of what's left each side looks at. */
+		unknown = (last - first) / es;
+		split_l = num_l == 0 ? (num_r == 0 ? unknown / 2 : unknown) : 0;
+		split_r = num_r == 0 ? unknown - split_l : 0;
+		if (split_l > BLOCK_SIZE)
+			split_l = BLOCK_SIZE;
+		if (split_r > BLOCK_SIZE)
+			split_r = BLOCK_SIZE;
+
+		for (i = 0; i < split_l; i++) {
+			offsets_l[num_l] = i;
+			num_l += !LESS(c, first, pivot);
+			first += es;
+		}
+		for (i = 0; i < split_r; i++) {
+			last -= es;
+			offsets_r[num_r] = i + 1;
+			num_r += LESS(c, last, pivot);
+		}
+
+		num = MIN(num_l, num_r);
+		for (i = 0; i < num; i++)
+			swapfunc(base_l + offsets_l[start_l + i] * es,
+			    base_r - offsets_r[start_r + i] * es, c);
+		num_l -= num;
+		num_r -= num;
+		start_l += num;
+		start_r += num;
+		if (num_l == 0) {
+			start_l = 0;
+			base_l = first;
+		}
+		if (num_r == 0) {
+			start_r = 0;
+			base_r = last;
+		}
+	}
+
+	/* Move whatever is left over on one side past the other. */
+	if (num_l != 0) {
+		while (num_l-- > 0) {
+			last -= es;
+			swapfunc(base_l + offsets_l[start_l + num_l] * es, last, c);
+		}
+		first = last;
+	}
+	if (num_r != 0) {
+		while (num_r-- > 0) {
+			swapfunc(base_r - offsets_r[start_r + num_r] * es, first, c);
+			first += es;
+		}
+	}
+
+done:
+	swapfunc(begin, first - es, c);
+	return (first - es);
+}
+
+/*
+ * Partitions [begin, end) around the pivot at begin, putting elements
+ * equal to it on the left.  Used when the pivot equals the element just
+ * before begin, so the left side is a run of equal elements that needs no
+ * more sorting.
+ */
+static char *
+partition_left(char *begin, char *end, const struct sort_ctx *c)
+{
+	const size_t es = c->es;
+	char *first = begin, *last = end, *pivot = begin;
+
+	do
+		last -= es;
+	while (last > begin && LESS(c, pivot, last));
+	do
+		first += es;
+	while (first < last && !LESS(c, pivot, first));
+	while (first < last) {
+		swapfunc(first, last, c);
+		do
+			last -= es;
+		while (last > begin && LESS(c, pivot, last));
+		do
+			first += es;
+		while (first < end && !LESS(c, pivot, first));
+	}
+	swapfunc(begin, last, c);
+	return (last);
+}
+
+/*
+ * The actual qsort() implementation is static to avoid preemptible calls when
+ * recursing. Also give them different names for improved debugging.
+ */
+#if defined(I_AM_QSORT_R)
+#define local_qsort local_qsort_r
+#define pdqsort_loop pdqsort_loop_r
+#elif defined(I_AM_QSORT_R_COMPAT)
+#define local_qsort local_qsort_r_compat
+#define pdqsort_loop pdqsort_loop_r_compat
+#elif defined(I_AM_QSORT_S)
+#define local_qsort local_qsort_s
+#define pdqsort_loop pdqsort_loop_s
+#endif
+static void
+pdqsort_loop(char *begin, char *end, int bad_allowed, bool leftmost,
+    const struct sort_ctx *c)
+{
+	const size_t es = c->es;
+	size_t n, half, l_size, r_size;
+	char *pivot;
+	bool partitioned;
+
+	for (;;) {
+		n = (end - begin) / es;
+		if (n < INSERTION_SORT_THRESHOLD) {
+			insertion_sort(begin, end, c);
+			return;
+		}
+
+		/* Put the median of 3, or the ninther, at begin. */
+		half = n / 2;
+		if (n > NINTHER_THRESHOLD) {
+			sort3(begin, begin + half * es, end - es, c);
+			sort3(begin + es, begin + (half - 1) * es, end - 2 * es, c);
+			sort3(begin + 2 * es, begin + (half + 1) * es,
+			    end - 3 * es, c);
+			sort3(begin + (half - 1) * es, begin + half * es,
+			    begin + (half + 1) * es, c);
+			swapfunc(begin, begin + half * es, c);
+		} else
+			sort3(begin + half * es, begin, end - es, c);
+
+		/*
+		 * Nothing in [begin, end) is less than the element before it,
+		 * which is a previous pivot.  If this pivot is equal to that
+		 * one, all the elements equal to them go on the left and are
+		 * done with.
+		 */
+		if (!leftmost && !LESS(c, begin - es, begin)) {
+			begin = partition_left(begin, end, c) + es;
+			continue;
+		}
+
+		pivot = partition_right(begin, end, &partitioned, c);
+		l_size = (pivot - begin) / es;
+		r_size = (end - pivot) / es - 1;
+
+		if (l_size < n / 8 || r_size < n / 8) {
+			/* Too many bad pivots: guarantee O(n log n). */
+			if (--bad_allowed == 0) {
+				heapsort_range(begin, n, c);
+				return;
+			}
+			/* Break up patterns that lead to bad pivots. */
+			if (l_size >= INSERTION_SORT_THRESHOLD) {
+				swapfunc(begin, begin + l_size / 4 * es, c);
+				swapfunc(pivot - es, pivot - l_size / 4 * es, c);
+				if (l_size > NINTHER_THRESHOLD) {
+					swapfunc(begin + es,
+					    begin + (l_size / 4 + 1) * es, c);
+					swapfunc(begin + 2 * es,
+					    begin + (l_size / 4 + 2) * es, c);
+					swapfunc(pivot - 2 * es,
+					    pivot - (l_size / 4 + 1) * es, c);
+					swapfunc(pivot - 3 * es,
+					    pivot - (l_size / 4 + 2) * es, c);
+				}
+			}
+			if (r_size >= INSERTION_SORT_THRESHOLD) {
+				swapfunc(pivot + es, pivot + (1 + r_size / 4) * es, c);
+				swapfunc(end - es, end - r_size / 4 * es, c);
+				if (r_size > NINTHER_THRESHOLD) {
+					swapfunc(pivot + 2 * es,
+					    pivot + (2 + r_size / 4) * es, c);
+					swapfunc(pivot + 3 * es,
+					    pivot + (3 + r_size / 4) * es, c);
+					swapfunc(end - 2 * es,
+					    end - (1 + r_size / 4) * es, c);
+					swapfunc(end - 3 * es,
+					    end - (2 + r_size / 4) * es, c);
+				}
+			}
+		} else if (partitioned &&
+		    partial_insertion_sort(begin, pivot, c) &&
+		    partial_insertion_sort(pivot + es, end, c)) {
+			/* It was already (nearly) sorted. */
+			return;
+		}
+
+		/* Recurse into the smaller side to bound the stack depth. */
+		if (l_size < r_size) {
+			pdqsort_loop(begin, pivot, bad_allowed, leftmost, c);
+			begin = pivot + es;
+			leftmost = false;
+		} else {
+			pdqsort_loop(pivot + es, end, bad_allowed, false, c);
+			end = pivot;
+		}
+	}
+}
+
+static void
+local_qsort(void *a, size_t n, size_t es, cmp_t *cmp, void *thunk)
+{
+	struct sort_ctx c;
+	int bad_allowed;
+	size_t i;
+
+	/* if there are less than 2 elements, then sorting is not needed */
+	if (__predict_false(n < 2 || es == 0))
+		return;
+
+	c.es = es;
+	c.cmp = cmp;
+	c.thunk = thunk;
+	c.swaptype = swaptype(a, es);
+	/* log2(n) bad partitions before falling back to heapsort */
+	bad_allowed = 0;
+	for (i = n; i > 1; i >>= 1)
+		bad_allowed++;
+	pdqsort_loop(a, (char *)a + n * es, bad_allowed, true, &c);
+}
+
+#if defined(I_AM_QSORT_R)
+void
+(qsort_r)(void *a, size_t n, size_t es, cmp_t *cmp, void *thunk)
+{
+	local_qsort_r(a, n, es, cmp, thunk);
+}
+#elif defined(I_AM_QSORT_R_COMPAT)
+void
+__qsort_r_compat(void *a, size_t n, size_t es, void *thunk, cmp_t *cmp)
+{
+	local_qsort_r_compat(a, n, es, cmp, thunk);
+}
+#elif defined(I_AM_QSORT_S)
+errno_t
+qsort_s(void *a, rsize_t n, rsize_t es, cmp_t *cmp, void *thunk)
+{
+	if (n > RSIZE_MAX || es > RSIZE_MAX)
+		return (EINVAL);
+	if (n != 0 && (a == NULL || cmp == NULL || es <= 0))
+		return (EINVAL);
+
+	local_qsort_s(a, n, es, cmp, thunk);
+	return (0);
+}
+#else
+void
+qsort(void *a, size_t n, size_t es, cmp_t *cmp)
+{
+	local_qsort(a, n, es, cmp, NULL);
+}
+#endif
@@ -55,12 +55,20 @@
 //
 // post(1)  ==> 2
 // post(0)  ==> 1
-// post(-1) ==> 1, then wake all waiters
+// post(-1) ==> 1, then wake waiters
 //
 // wait(2)  ==> 1
 // wait(1)  ==> 0
 // wait(0)  ==> -1 then wait for a wake up + loop
 // wait(-1) ==> -1 then wait for a wake up + loop
+//
+// On LP64, sem_t also has room for a count of the threads that are
+// (about to be) sleeping on the semaphore. Waiters add themselves to it
+// before their last look at the value, and sem_post() looks at it after
+// changing the value, so a post that sees no waiters needs no wake up,
+// and a post of n units only needs to wake n waiters, whatever the old
+// value was. On ILP32, sem_t is just the value, so a post of a contended
+// semaphore has to wake all the waiters.
 
 // Use the upper 31-bits for the counter, and the lower one
 // for the shared flag.
@@ -76,14 +84,11 @@ static inline int SEMCOUNT_TO_VALUE(unsigned int sval) {
   return (static_cast<int>(sval) >> SEMCOUNT_VALUE_SHIFT);
 }
 
-// The value +1 as a sem->count bit-pattern.
-#define SEMCOUNT_ONE              SEMCOUNT_FROM_VALUE(1)
-
 // The value -1 as a sem->count bit-pattern.
 #define SEMCOUNT_MINUS_ONE        SEMCOUNT_FROM_VALUE(~0U)
 
 #define SEMCOUNT_DECREMENT(sval)    (((sval) - (1U << SEMCOUNT_VALUE_SHIFT)) & SEMCOUNT_VALUE_MASK)
-#define SEMCOUNT_INCREMENT(sval)    (((sval) + (1U << SEMCOUNT_VALUE_SHIFT)) & SEMCOUNT_VALUE_MASK)
+#define SEMCOUNT_ADD(sval, n)       (((sval) + SEMCOUNT_FROM_VALUE(n)) & SEMCOUNT_VALUE_MASK)
 
 static inline atomic_uint* SEM_TO_ATOMIC_POINTER(sem_t* sem) {
   static_assert(sizeof(atomic_uint) == sizeof(sem->count),
@@ -94,6 +99,14 @@ static inline atomic_uint* SEM_TO_ATOMIC_POINTER(sem_t* sem) {
   return reinterpret_cast<atomic_uint*>(&sem->count);
 }
 
+#if defined(__LP64__)
+static inline atomic_uint* SEM_TO_WAITERS_POINTER(sem_t* sem) {
+  static_assert(sizeof(atomic_uint) == sizeof(sem->__reserved[0]),
+                "sem->__reserved[0] should actually be atomic_uint in implementation.");
+  return reinterpret_cast<atomic_uint*>(&sem->__reserved[0]);
+}
+#endif
+
 // Return the shared bitflag from a semaphore counter.
 static inline unsigned int SEM_GET_SHARED(atomic_uint* sem_count_ptr) {
   // memory_order_relaxed is used as SHARED flag will not be changed after init.
@@ -114,6 +127,9 @@ int sem_init(sem_t* sem, int pshared, unsigned int value) {
 
   atomic_uint* sem_count_ptr = SEM_TO_ATOMIC_POINTER(sem);
   atomic_store_explicit(sem_count_ptr, count, memory_order_relaxed);
+#if defined(__LP64__)
+  atomic_store_explicit(SEM_TO_WAITERS_POINTER(sem), 0, memory_order_relaxed);
+#endif
   return 0;
 }
 
@@ -178,13 +194,14 @@ static int __sem_trydec(atomic_uint* sem_count_ptr) {
   return SEMCOUNT_TO_VALUE(old_value);
 }
 
-// "Increment" the value of a semaphore atomically and
+// "Increment" the value of a semaphore by n atomically and
 // return its old value. Note that this implements
 // the special case of "incrementing" any negative
-// value to +1 directly.
+// value to +n directly.
 //
-// NOTE: The value will _not_ wrap above SEM_VALUE_MAX
-static int __sem_inc(atomic_uint* sem_count_ptr) {
+// NOTE: The value will _not_ go above SEM_VALUE_MAX: if
+// it would, the value is left alone.
+static int __sem_inc(atomic_uint* sem_count_ptr, unsigned int n) {
   unsigned int old_value = atomic_load_explicit(sem_count_ptr, memory_order_relaxed);
   unsigned int shared = old_value  & SEMCOUNT_SHARED_MASK;
   unsigned int new_value;
@@ -195,15 +212,15 @@ static int __sem_inc(atomic_uint* sem_count_ptr) {
   // POSIX semaphores should provide sequential consistency.
   do {
     // Can't go higher than SEM_VALUE_MAX.
-    if (SEMCOUNT_TO_VALUE(old_value) == SEM_VALUE_MAX) {
+    if (SEMCOUNT_TO_VALUE(old_value) > static_cast<int>(SEM_VALUE_MAX - n)) {
       break;
     }
 
-    // If the counter is negative, go directly to one, otherwise just increment.
+    // If the counter is negative, go directly to n, otherwise just add n.
     if (SEMCOUNT_TO_VALUE(old_value) < 0) {
-      new_value = SEMCOUNT_ONE | shared;
+      new_value = SEMCOUNT_FROM_VALUE(n) | shared;
     } else {
-      new_value = SEMCOUNT_INCREMENT(old_value) | shared;
+      new_value = SEMCOUNT_ADD(old_value, n) | shared;
     }
   } while (!atomic_compare_exchange_weak(sem_count_ptr, &old_value,
            new_value));
@@ -211,18 +228,77 @@ static int __sem_inc(atomic_uint* sem_count_ptr) {
   return SEMCOUNT_TO_VALUE(old_value);
 }
 
+// On LP64, private semaphores count their sleeping waiters in sem->__reserved[0] so that a post
+// only wakes as many waiters as it has units for. Process-shared semaphores don't: an ILP32
+// process sharing the semaphore has no count, so its waiters would never be woken. They keep
+// the original protocol, where a post to a contended semaphore wakes every waiter.
+static inline bool __sem_counts_waiters(sem_t* sem __unused) {
+#if defined(__LP64__)
+  return SEM_GET_SHARED(SEM_TO_ATOMIC_POINTER(sem)) == 0;
+#else
+  return false;
+#endif
+}
+
+// Called by a thread before it first sleeps on a semaphore.
+static inline void __sem_add_waiter(sem_t* sem) {
+#if defined(__LP64__)
+  if (__sem_counts_waiters(sem)) {
+    atomic_fetch_add(SEM_TO_WAITERS_POINTER(sem), 1);
+    // The new waiter must be visible before this thread next looks at the value,
+    // because sem_post() only looks for waiters after changing the value.
+    atomic_thread_fence(memory_order_seq_cst);
+  }
+#endif
+}
+
+// Called by a thread when it stops waiting on a semaphore.
+static inline void __sem_remove_waiter(sem_t* sem) {
+#if defined(__LP64__)
+  if (__sem_counts_waiters(sem)) {
+    atomic_fetch_sub(SEM_TO_WAITERS_POINTER(sem), 1);
+  }
+#endif
+}
+
+// Wake the waiters that n units just posted to a semaphore whose old value was
+// old_value could be for.
+static void __sem_wake(sem_t* sem, int old_value, unsigned int n __unused) {
+  atomic_uint* sem_count_ptr = SEM_TO_ATOMIC_POINTER(sem);
+  unsigned int shared = SEM_GET_SHARED(sem_count_ptr);
+#if defined(__LP64__)
+  if (__sem_counts_waiters(sem)) {
+    // The kernel wakes at most as many as are actually sleeping.
+    if (atomic_load(SEM_TO_WAITERS_POINTER(sem)) > 0) {
+      __futex_wake_ex(sem_count_ptr, shared, n);
+    }
+    return;
+  }
+#endif
+  if (old_value < 0) {
+    __futex_wake_ex(sem_count_ptr, shared, INT_MAX);
+  }
+}
+
 int sem_wait(sem_t* sem) {
   atomic_uint* sem_count_ptr = SEM_TO_ATOMIC_POINTER(sem);
   unsigned int shared = SEM_GET_SHARED(sem_count_ptr);
 
+  if (__sem_dec(sem_count_ptr) > 0) {
+    return 0;
+  }
+
+  __sem_add_waiter(sem);
   while (true) {
     if (__sem_dec(sem_count_ptr) > 0) {
+      __sem_remove_waiter(sem);
       return 0;
     }
 
     int result = __futex_wait_ex(sem_count_ptr, shared, shared | SEMCOUNT_MINUS_ONE, false, nullptr);
     if (android_get_application_target_sdk_version() >= 24) {
       if (result ==-EINTR) {
+        __sem_remove_waiter(sem);
         errno = EINTR;
         return -1;
       }
@@ -249,9 +325,11 @@ static int __sem_timedwait(sem_t* sem, const timespec* abs_timeout, bool use_rea
 
   unsigned int shared = SEM_GET_SHARED(sem_count_ptr);
 
+  __sem_add_waiter(sem);
   while (true) {
     // Try to grab the semaphore. If the value was 0, this will also change it to -1.
     if (__sem_dec(sem_count_ptr) > 0) {
+      __sem_remove_waiter(sem);
       return 0;
     }
 
@@ -261,6 +339,7 @@ static int __sem_timedwait(sem_t* sem, const timespec* abs_timeout, bool use_rea
 
     // Return in case of timeout or interrupt.
     if (result == -ETIMEDOUT || result == -EINTR) {
+      __sem_remove_waiter(sem);
       errno = -result;
       return -1;
     }
@@ -286,23 +365,164 @@ int sem_clockwait(sem_t* sem, clockid_t clock, const timespec* abs_timeout) {
   }
 }
 
-int sem_post(sem_t* sem) {
+// Without futex_waitv(), sleep on the first semaphore and poll the others, backing off from 1ms
+// to 16ms between polls. abs_timeout is a CLOCK_MONOTONIC time here.
+static int __sem_wait_any_poll(sem_t* const* sems, atomic_uint* const* sem_count_ptrs,
+                               size_t count, const timespec* abs_timeout) {
+  unsigned int shared = SEM_GET_SHARED(sem_count_ptrs[0]);
+  int64_t poll_ns = 1000000;
+  bool woken = false;
+  __sem_add_waiter(sems[0]);
+  while (true) {
+    for (size_t i = 1; i < count; ++i) {
+      if (__sem_trydec(sem_count_ptrs[i]) > 0) {
+        __sem_remove_waiter(sems[0]);
+        // A post to the first semaphore may have woken us rather than another waiter.
+        if (woken) {
+          __futex_wake_ex(sem_count_ptrs[0], shared, 1);
+        }
+        return i;
+      }
+    }
+    if (__sem_dec(sem_count_ptrs[0]) > 0) {
+      __sem_remove_waiter(sems[0]);
+      return 0;
+    }
+
+    timespec poll_timeout;
+    clock_gettime(CLOCK_MONOTONIC, &poll_timeout);
+    poll_timeout.tv_nsec += poll_ns;
+    if (poll_timeout.tv_nsec >= NS_PER_S) {
+      poll_timeout.tv_sec++;
+      poll_timeout.tv_nsec -= NS_PER_S;
+    }
+    bool last_poll = abs_timeout != nullptr && to_ns(*abs_timeout) <= to_ns(poll_timeout);
+    int result = __futex_wait_ex(sem_count_ptrs[0], shared, shared | SEMCOUNT_MINUS_ONE, false,
+                                 last_poll ? abs_timeout : &poll_timeout);
+    if (result == -EINTR || (result == -ETIMEDOUT && last_poll)) {
+      __sem_remove_waiter(sems[0]);
+      return result;
+    }
+    woken = (result == 0);
+    if (poll_ns < 16000000) {
+      poll_ns *= 2;
+    }
+  }
+}
+
+static atomic_bool g_have_futex_waitv = true;
+
+int sem_clockwait_any_np(sem_t* const* sems, size_t count, clockid_t clock,
+                         const timespec* abs_timeout) {
+  if (count == 0 || count > FUTEX_WAITV_MAX ||
+      (clock != CLOCK_MONOTONIC && clock != CLOCK_REALTIME)) {
+    errno = EINVAL;
+    return -1;
+  }
+  bool use_realtime_clock = (clock == CLOCK_REALTIME);
+
+  atomic_uint* sem_count_ptrs[FUTEX_WAITV_MAX];
+  for (size_t i = 0; i < count; ++i) {
+    sem_count_ptrs[i] = SEM_TO_ATOMIC_POINTER(sems[i]);
+    // As with sem_timedwait(), try first and only then check the timeout.
+    if (__sem_trydec(sem_count_ptrs[i]) > 0) {
+      return i;
+    }
+  }
+  int result = check_timespec(abs_timeout, true);
+  if (result != 0) {
+    errno = result;
+    return -1;
+  }
+
+  if (atomic_load_explicit(&g_have_futex_waitv, memory_order_relaxed)) {
+    futex_waitv waiters[FUTEX_WAITV_MAX];
+    for (size_t i = 0; i < count; ++i) {
+      unsigned int shared = SEM_GET_SHARED(sem_count_ptrs[i]);
+      waiters[i] = {.val = shared | SEMCOUNT_MINUS_ONE,
+                    .uaddr = reinterpret_cast<uintptr_t>(sem_count_ptrs[i]),
+                    .flags = FUTEX_32 | (shared ? 0 : FUTEX_PRIVATE_FLAG)};
+      __sem_add_waiter(sems[i]);
+    }
+    int woken = -1;
+    while (true) {
+      // Take any semaphore that's available, marking the others as contended so that a post will
+      // wake us.
+      for (size_t i = 0; i < count; ++i) {
+        if (__sem_dec(sem_count_ptrs[i]) > 0) {
+          for (size_t j = 0; j < count; ++j) {
+            __sem_remove_waiter(sems[j]);
+          }
+          // A post only wakes as many waiters as it has units for, so if we were woken for another
+          // semaphore, pass that wake up on to one of its other waiters.
+          if (woken >= 0 && static_cast<size_t>(woken) != i) {
+            __futex_wake_ex(sem_count_ptrs[woken], SEM_GET_SHARED(sem_count_ptrs[woken]), 1);
+          }
+          return i;
+        }
+      }
+      result = __futex_waitv_ex(waiters, count, use_realtime_clock, abs_timeout);
+      if (result >= 0) {
+        woken = result;
+        continue;
+      }
+      if (result == -EAGAIN) {
+        // One of the values changed before we slept.
+        continue;
+      }
+      for (size_t j = 0; j < count; ++j) {
+        __sem_remove_waiter(sems[j]);
+      }
+      if (result != -ENOSYS) {
+        errno = -result;
+        return -1;
+      }
+      atomic_store_explicit(&g_have_futex_waitv, false, memory_order_relaxed);
+      break;
+    }
+  }
+
+  timespec monotonic_timeout;
+  if (abs_timeout != nullptr && use_realtime_clock) {
+    monotonic_time_from_realtime_time(monotonic_timeout, *abs_timeout);
+    abs_timeout = &monotonic_timeout;
+  }
+  result = __sem_wait_any_poll(sems, sem_count_ptrs, count, abs_timeout);
+  if (result < 0) {
+    errno = -result;
+    return -1;
+  }
+  return result;
+}
+
+static int __sem_post(sem_t* sem, unsigned int n) {
   atomic_uint* sem_count_ptr = SEM_TO_ATOMIC_POINTER(sem);
-  unsigned int shared = SEM_GET_SHARED(sem_count_ptr);
 
-  int old_value = __sem_inc(sem_count_ptr);
-  if (old_value < 0) {
-    // Contention on the semaphore. Wake up all waiters.
-    __futex_wake_ex(sem_count_ptr, shared, INT_MAX);
-  } else if (old_value == SEM_VALUE_MAX) {
+  int old_value = __sem_inc(sem_count_ptr, n);
+  if (old_value > static_cast<int>(SEM_VALUE_MAX - n)) {
     // Overflow detected.
     errno = EOVERFLOW;
     return -1;
   }
-
+  __sem_wake(sem, old_value, n);
   return 0;
 }
 
+int sem_post(sem_t* sem) {
+  return __sem_post(sem, 1);
+}
+
+int android_sem_post_n(sem_t* sem, unsigned int n) {
+  if (n > SEM_VALUE_MAX) {
+    errno = EOVERFLOW;
+    return -1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  return __sem_post(sem, n);
+}
+
 int sem_trywait(sem_t* sem) {
   atomic_uint* sem_count_ptr = SEM_TO_ATOMIC_POINTER(sem);
   if (__sem_trydec(sem_count_ptr) > 0) {
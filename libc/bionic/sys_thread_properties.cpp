@@ -131,10 +131,15 @@ void __libc_iterate_dynamic_tls(pid_t tid,
   bionic_tcb* const tcb = __get_bionic_tcb_for_thread(tid);
   TlsDtv* const dtv = __get_tcb_dtv(tcb);
   BionicAllocator& allocator = __libc_shared_globals()->tls_allocator;
+  const StaticTlsLayout& layout = __libc_shared_globals()->static_tls_layout;
+  char* const stls_begin = reinterpret_cast<char*>(tcb) - layout.offset_bionic_tcb();
+  char* const stls_end = stls_begin + layout.size();
 
   for (size_t i = modules.static_module_count; i < dtv->count; ++i) {
     void* dtls_begin = dtv->modules[i];
     if (dtls_begin == nullptr) continue;
+    // Skip dlopen'ed modules that were allocated from the static TLS surplus.
+    if (dtls_begin >= stls_begin && dtls_begin < stls_end) continue;
     void* dtls_end =
         static_cast<void*>(static_cast<char*>(dtls_begin) + allocator.get_chunk_size(dtls_begin));
     size_t dso_id = __tls_module_idx_to_id(i);
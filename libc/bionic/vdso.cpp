@@ -14,10 +14,12 @@
  * limitations under the License.
  */
 
+#include "private/bionic_constants.h"
 #include "private/bionic_globals.h"
 #include "private/bionic_vdso.h"
 
 #include <limits.h>
+#include <stdatomic.h>
 #include <link.h>
 #include <string.h>
 #include <sys/auxv.h>
@@ -40,6 +42,12 @@ static inline int vdso_return(int result) {
 }
 
 int clock_gettime(int clock_id, timespec* tp) {
+  // The vdso only reads the clocks that the kernel keeps in its data page, so for the CPU-time
+  // clocks (including the negative ids from clock_getcpuclockid() and pthread_getcpuclockid())
+  // it just makes the system call itself. Make it directly instead.
+  if (clock_id < 0 || clock_id == CLOCK_PROCESS_CPUTIME_ID || clock_id == CLOCK_THREAD_CPUTIME_ID) {
+    return __clock_gettime(clock_id, tp);
+  }
   auto vdso_clock_gettime = reinterpret_cast<decltype(&clock_gettime)>(
     __libc_globals->vdso[VDSO_CLOCK_GETTIME].fn);
   if (__predict_true(vdso_clock_gettime)) {
@@ -66,6 +74,25 @@ int gettimeofday(timeval* tv, struct timezone* tz) {
   return __gettimeofday(tv, tz);
 }
 
+static _Atomic(int64_t) g_coarse_resolution_ns;
+
+int __bionic_clock_gettime_coarse(clockid_t clock_id, int64_t max_stale_ns, timespec* ts) {
+  // The coarse clocks are only updated once a tick, so are as stale as their resolution.
+  int64_t resolution_ns = atomic_load_explicit(&g_coarse_resolution_ns, memory_order_relaxed);
+  if (resolution_ns == 0) {
+    timespec res;
+    resolution_ns = (clock_getres(CLOCK_MONOTONIC_COARSE, &res) == 0)
+                        ? res.tv_sec * NS_PER_S + res.tv_nsec
+                        : INT64_MAX;
+    atomic_store_explicit(&g_coarse_resolution_ns, resolution_ns, memory_order_relaxed);
+  }
+  if (resolution_ns <= max_stale_ns) {
+    if (clock_id == CLOCK_REALTIME) clock_id = CLOCK_REALTIME_COARSE;
+    if (clock_id == CLOCK_MONOTONIC) clock_id = CLOCK_MONOTONIC_COARSE;
+  }
+  return clock_gettime(clock_id, ts);
+}
+
 time_t time(time_t* t) {
   // Only x86/x86-64 actually have time() in the vdso.
 #if defined(VDSO_TIME_SYMBOL)
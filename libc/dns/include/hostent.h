@@ -44,6 +44,12 @@ void sethostent_r(FILE **);
 struct hostent	*netbsd_gethostent_r(FILE *, struct hostent *, char *, size_t, int *);
 void endhostent_r(FILE **);
 
+/*
+ * Opens a stream over the lines of the hosts file that might mention
+ * name, in file order, using an index of the file. Close it with fclose.
+ */
+FILE *_hosts_open_matching(const char *) __LIBC_HIDDEN__;
+
 /*
  * The following are internal API's and are used only for testing.
  */
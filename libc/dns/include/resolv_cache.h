@@ -43,7 +43,9 @@ typedef enum {
     RESOLV_CACHE_UNSUPPORTED,  /* the cache can't handle that kind of queries */
                                /* or the answer buffer is too small */
     RESOLV_CACHE_NOTFOUND,     /* the cache doesn't know about this query */
-    RESOLV_CACHE_FOUND         /* the cache found the answer */
+    RESOLV_CACHE_FOUND,        /* the cache found the answer */
+    RESOLV_CACHE_STALE         /* the cache found an expired answer, and the */
+                               /* caller should refresh it in the background */
 } ResolvCacheStatus;
 
 __LIBC_HIDDEN__
@@ -56,7 +58,7 @@ _resolv_cache_lookup( unsigned              netid,
                       int                  *answerlen );
 
 /* add a (query,answer) to the cache, only call if _resolv_cache_lookup
- * did return RESOLV_CACHE_NOTFOUND
+ * did return RESOLV_CACHE_NOTFOUND, or RESOLV_CACHE_STALE when refreshing
  */
 __LIBC_HIDDEN__
 extern void
@@ -66,6 +68,11 @@ _resolv_cache_add( unsigned              netid,
                    const void*           answer,
                    int                   answerlen );
 
+/* the number of answers the network's cache can hold; 0 if it has none */
+__LIBC_HIDDEN__
+extern int
+_resolv_cache_size_for_net( unsigned  netid );
+
 /* Notify the cache a request failed */
 __LIBC_HIDDEN__
 extern void
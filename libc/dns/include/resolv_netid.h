@@ -94,7 +94,18 @@ struct hostent *android_gethostbynamefornetcontext(const char *, int, const stru
 int android_getaddrinfofornetcontext(const char *, const char *, const struct addrinfo *,
     const struct android_net_context *, struct addrinfo **) __used_in_netd;
 
-/* set name servers for a network */
+/*
+ * android_getaddrinfo_batch() and android_getaddrinfo_batch_start() from
+ * <netdb.h> for a given network, for the tests' stub nameserver.
+ */
+struct android_getaddrinfo_request;
+struct android_getaddrinfo_batch;
+void android_getaddrinfo_batchfornetcontext(struct android_getaddrinfo_request *, size_t,
+    const struct android_net_context *);
+struct android_getaddrinfo_batch *android_getaddrinfo_batch_startfornetcontext(
+    struct android_getaddrinfo_request *, size_t, const struct android_net_context *);
+
+/* set name servers for a network; each is an address, "ipv4:port", "[ipv6]" or "[ipv6]:port" */
 extern int _resolv_set_nameservers_for_net(unsigned netid, const char** servers,
         unsigned numservers, const char *domains, const struct __res_params* params) __used_in_netd;
 
@@ -211,6 +211,16 @@ _resolv_cache_add_resolver_stats_sample( unsigned netid, int revision_id, int ns
 
 /* End of stats related definitions */
 
+/* One of the queries passed to res_nsendmulti(). */
+struct res_sendq {
+	const u_char	*buf;		/* the query */
+	int		buflen;
+	u_char		*ans;		/* buffer for the answer */
+	int		anssiz;
+	int		resplen;	/* out: answer length, or -1 */
+	int		error;		/* out: errno if there was no answer */
+};
+
 union res_sockaddr_union {
 	struct sockaddr_in	sin;
 #ifdef IN6ADDR_ANY_INIT
@@ -393,6 +403,7 @@ __LIBC_HIDDEN__ extern const struct res_sym __p_rcode_syms[];
 #define res_nsearch		__res_nsearch
 #define res_nsend		__res_nsend
 #define res_nsendsigned		__res_nsendsigned
+#define res_nsendmulti		__res_nsendmulti
 #define res_nisourserver	__res_nisourserver
 #define res_ownok		__res_ownok
 #define res_queriesmatch	__res_queriesmatch
@@ -471,6 +482,7 @@ int		res_nmkquery(res_state, int, const char *, int, int,
 int		res_nsend(res_state, const u_char *, int, u_char *, int);
 int		res_nsendsigned(res_state, const u_char *, int,
 				     ns_tsig_key *, u_char *, int);
+__LIBC_HIDDEN__ int		res_nsendmulti(res_state, struct res_sendq *, int);
 int		res_findzonecut(res_state, const char *, ns_class, int,
 				     char *, size_t, struct in_addr *, int);
 int		res_findzonecut2(res_state, const char *, ns_class, int,
@@ -84,6 +84,7 @@
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/eventfd.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -92,7 +93,9 @@
 #include <ctype.h>
 #include <errno.h>
 #include <netdb.h>
+#include <pthread.h>
 #include "NetdClientDispatch.h"
+#include "hostent.h"
 #include "resolv_cache.h"
 #include "resolv_netid.h"
 #include "resolv_private.h"
@@ -102,6 +105,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <syslog.h>
@@ -115,6 +119,20 @@ typedef union sockaddr_union {
     struct sockaddr_in6 in6;
 } sockaddr_union;
 
+/*
+ * Every addrinfo that getaddrinfo() returns is the first member of an
+ * addrinfo_node, so that getanswer() can put all of the nodes for one
+ * answer, their addresses and the canonical name in a single allocation.
+ * freeaddrinfo() frees such a block when the last of its nodes is freed.
+ */
+struct addrinfo_node {
+	struct addrinfo ai;
+	sockaddr_union addr;
+	uint16_t slot;		/* index of this node in its block */
+	uint16_t live;		/* slot 0 only: nodes not yet freed */
+	uint32_t size;		/* slot 0 only: bytes in the block */
+};
+
 #define SUCCESS 0
 #define ANY 0
 #define YES 1
@@ -200,6 +218,7 @@ static const ns_src default_dns_files[] = {
 };
 
 #define MAXPACKET	(8*1024)
+#define MAXPARALLEL	2	/* AAAA and A */
 
 typedef union {
 	HEADER hdr;
@@ -226,6 +245,9 @@ static int explore_numeric_scope(const struct addrinfo *, const char *,
 	const char *, struct addrinfo **);
 static int get_canonname(const struct addrinfo *,
 	struct addrinfo *, const char *);
+static struct addrinfo_node *alloc_ai_block(size_t, size_t);
+static void set_ai(struct addrinfo_node *, const struct addrinfo *,
+	const struct afd *, const char *);
 static struct addrinfo *get_ai(const struct addrinfo *,
 	const struct afd *, const char *);
 static int get_portmatch(const struct addrinfo *, const char *);
@@ -238,13 +260,15 @@ static int ip6_str2scopeid(char *, struct sockaddr_in6 *, u_int32_t *);
 static struct addrinfo *getanswer(const querybuf *, int, const char *, int,
 	const struct addrinfo *);
 static int _dns_getaddrinfo(void *, void *, va_list);
-static void _sethtent(FILE **);
 static void _endhtent(FILE **);
 static struct addrinfo *_gethtent(FILE **, const char *,
     const struct addrinfo *);
 static int _files_getaddrinfo(void *, void *, va_list);
 static int _find_src_addr(const struct sockaddr *, struct sockaddr *, unsigned , uid_t);
 
+static int getaddrinfo_netcontext(const char *, const char *,
+	const struct addrinfo *, const struct android_net_context *, FILE **,
+	struct addrinfo **);
 static int res_queryN(const char *, struct res_target *, res_state);
 static int res_searchN(const char *, struct res_target *, res_state);
 static int res_querydomainN(const char *, const char *,
@@ -333,11 +357,18 @@ freeaddrinfo(struct addrinfo *ai)
 #endif
 
 	do {
+		struct addrinfo_node *node = (struct addrinfo_node *)(void *)ai;
+		struct addrinfo_node *block = node - node->slot;
+		char *canon = ai->ai_canonname;
+
 		next = ai->ai_next;
-		if (ai->ai_canonname)
-			free(ai->ai_canonname);
+		/* a canonical name inside the block goes with the block */
+		if (canon != NULL && (canon < (char *)(void *)block ||
+		    canon >= (char *)(void *)block + block->size))
+			free(canon);
 		/* no need to free(ai->ai_addr) */
-		free(ai);
+		if (--block->live == 0)
+			free(block);
 		ai = next;
 	} while (ai);
 }
@@ -401,30 +432,26 @@ bool readBE32(FILE* fp, int32_t* result) {
 }
 
 #if defined(__ANDROID__)
-// Returns 0 on success, else returns on error.
-static int
-android_getaddrinfo_proxy(
+// Sends the request to the proxy. Returns the stream to read the answer
+// from with android_getaddrinfo_proxy_recv(), or NULL with *error set.
+static FILE *
+android_getaddrinfo_proxy_send(
     const char *hostname, const char *servname,
-    const struct addrinfo *hints, struct addrinfo **res, unsigned netid)
+    const struct addrinfo *hints, unsigned netid, int *error)
 {
-	int success = 0;
-
-	// Clear this at start, as we use its non-NULLness later (in the
-	// error path) to decide if we have to free up any memory we
-	// allocated in the process (before failing).
-	*res = NULL;
-
 	// Bogus things we can't serialize.  Don't use the proxy.  These will fail - let them.
 	if ((hostname != NULL &&
 	     strcspn(hostname, " \n\r\t^'\"") != strlen(hostname)) ||
 	    (servname != NULL &&
 	     strcspn(servname, " \n\r\t^'\"") != strlen(servname))) {
-		return EAI_NODATA;
+		*error = EAI_NODATA;
+		return NULL;
 	}
 
 	FILE* proxy = fdopen(__netdClientDispatch.dnsOpenProxy(), "r+");
 	if (proxy == NULL) {
-		return EAI_SYSTEM;
+		*error = EAI_SYSTEM;
+		return NULL;
 	}
 	netid = __netdClientDispatch.netIdForResolv(netid);
 
@@ -437,13 +464,32 @@ android_getaddrinfo_proxy(
 		    hints == NULL ? -1 : hints->ai_socktype,
 		    hints == NULL ? -1 : hints->ai_protocol,
 		    netid) < 0) {
-		goto exit;
+		goto fail;
 	}
 	// literal NULL byte at end, required by FrameworkListener
 	if (fputc(0, proxy) == EOF ||
 	    fflush(proxy) != 0) {
-		goto exit;
+		goto fail;
 	}
+	return proxy;
+
+fail:
+	fclose(proxy);
+	*error = EAI_NODATA;
+	return NULL;
+}
+
+// Reads the proxy's answer to a request, and closes the stream.
+// Returns 0 on success, else returns on error.
+static int
+android_getaddrinfo_proxy_recv(FILE *proxy, struct addrinfo **res)
+{
+	int success = 0;
+
+	// Clear this at start, as we use its non-NULLness later (in the
+	// error path) to decide if we have to free up any memory we
+	// allocated in the process (before failing).
+	*res = NULL;
 
 	char buf[4];
 	// read result code for gethostbyaddr
@@ -470,11 +516,11 @@ android_getaddrinfo_proxy(
 			break;
 		}
 
-		ai = calloc(1, sizeof(struct addrinfo) + sizeof(struct sockaddr_storage));
-		if (ai == NULL) {
+		struct addrinfo_node* node = alloc_ai_block(1, 0);
+		if (node == NULL) {
 			break;
 		}
-		ai->ai_addr = (struct sockaddr*)(ai + 1);
+		ai = &node->ai;
 
 		// struct addrinfo {
 		//	int	ai_flags;	/* AI_PASSIVE, AI_CANONNAME, AI_NUMERICHOST */
@@ -503,7 +549,7 @@ android_getaddrinfo_proxy(
 		// Set ai_addrlen and read the ai_addr data.
 		ai->ai_addrlen = addr_len;
 		if (addr_len != 0) {
-			if ((size_t) addr_len > sizeof(struct sockaddr_storage)) {
+			if ((size_t) addr_len > sizeof(node->addr)) {
 				// Bogus; too big.
 				break;
 			}
@@ -556,6 +602,23 @@ exit:
 	}
 	return EAI_NODATA;
 }
+
+// Returns 0 on success, else returns on error.
+static int
+android_getaddrinfo_proxy(
+    const char *hostname, const char *servname,
+    const struct addrinfo *hints, struct addrinfo **res, unsigned netid)
+{
+	int error;
+
+	*res = NULL;
+	FILE* proxy = android_getaddrinfo_proxy_send(hostname, servname, hints,
+	    netid, &error);
+	if (proxy == NULL) {
+		return error;
+	}
+	return android_getaddrinfo_proxy_recv(proxy, res);
+}
 #endif
 
 __BIONIC_WEAK_FOR_NATIVE_BRIDGE
@@ -586,6 +649,20 @@ int
 android_getaddrinfofornetcontext(const char *hostname, const char *servname,
     const struct addrinfo *hints, const struct android_net_context *netcontext,
     struct addrinfo **res)
+{
+	return getaddrinfo_netcontext(hostname, servname, hints, netcontext, NULL,
+	    res);
+}
+
+/*
+ * If *proxy isn't NULL, the request has already been sent to the proxy,
+ * and the answer is read from there.  *proxy is set to NULL if the stream
+ * was used (and closed); otherwise the caller has to close it.
+ */
+static int
+getaddrinfo_netcontext(const char *hostname, const char *servname,
+    const struct addrinfo *hints, const struct android_net_context *netcontext,
+    FILE **proxy, struct addrinfo **res)
 {
 	struct addrinfo sentinel;
 	struct addrinfo *cur;
@@ -730,8 +807,14 @@ android_getaddrinfofornetcontext(const char *hostname, const char *servname,
 		ERR(EAI_NONAME);
 
 #if defined(__ANDROID__)
-	int gai_error = android_getaddrinfo_proxy(
-		hostname, servname, hints, res, netcontext->app_netid);
+	int gai_error;
+	if (proxy != NULL && *proxy != NULL) {
+		gai_error = android_getaddrinfo_proxy_recv(*proxy, res);
+		*proxy = NULL;
+	} else {
+		gai_error = android_getaddrinfo_proxy(
+			hostname, servname, hints, res, netcontext->app_netid);
+	}
 	if (gai_error != EAI_SYSTEM) {
 		return gai_error;
 	}
@@ -792,6 +875,266 @@ android_getaddrinfofornetcontext(const char *hostname, const char *servname,
 	return error;
 }
 
+/*
+ * android_getaddrinfo_batch() works on BATCH_WINDOW requests at a time:
+ * it starts all of their lookups, then collects the answers in order.
+ */
+#define BATCH_WINDOW	32
+
+struct android_getaddrinfo_batch {
+	struct android_getaddrinfo_request *reqs;
+	size_t n;
+	struct android_net_context netcontext;
+	pthread_t thread;
+	int fd;
+};
+
+/* Whether the request might need a DNS lookup. */
+static int
+_batch_wants_dns(const struct android_getaddrinfo_request *req)
+{
+	struct in6_addr addr;
+
+	if (req->hostname == NULL || req->hostname[0] == '\0')
+		return 0;
+	if (req->hints != NULL && (req->hints->ai_flags & AI_NUMERICHOST))
+		return 0;
+	if (inet_pton(AF_INET, req->hostname, &addr) == 1 ||
+	    inet_pton(AF_INET6, req->hostname, &addr) == 1)
+		return 0;
+	return 1;
+}
+
+/*
+ * Sends the A and AAAA queries for all of the requests without a proxy
+ * stream at once, so that the getaddrinfo calls that follow find their
+ * answers in the cache.  Only names that res_searchN() would look up as
+ * they are before trying the search domains are sent.  Without a cache
+ * with room for all of the answers, the getaddrinfo calls would only ask
+ * again, so nothing is sent.
+ */
+static void
+_dns_prefetch(const struct android_getaddrinfo_request *reqs, size_t n,
+    FILE * const *proxies, const struct android_net_context *netcontext)
+{
+	u_char (*qbuf)[PACKETSZ] = NULL;
+	querybuf *abuf = NULL;
+	struct res_sendq *q = NULL;
+	res_state res;
+	const char *cp;
+	size_t i, j, nq;
+	int types[2], nt, k, len, dots, family, cache_size;
+
+	res = __res_get_state();
+	if (res == NULL)
+		return;
+	res_setnetcontext(res, netcontext);
+	cache_size = _resolv_cache_size_for_net(res->netid);
+	if (cache_size == 0)
+		goto done;
+
+	q = calloc(2 * n, sizeof(*q));
+	qbuf = malloc(2 * n * sizeof(*qbuf));
+	abuf = malloc(2 * n * sizeof(*abuf));
+	if (q == NULL || qbuf == NULL || abuf == NULL)
+		goto done;
+
+	nq = 0;
+	for (i = 0; i < n; i++) {
+		if (proxies[i] != NULL || !_batch_wants_dns(&reqs[i]))
+			continue;
+		dots = 0;
+		for (cp = reqs[i].hostname; *cp; cp++)
+			dots += (*cp == '.');
+		if (dots < (int)res->ndots && cp[-1] != '.')
+			continue;
+
+		family = reqs[i].hints ? reqs[i].hints->ai_family : AF_UNSPEC;
+		nt = 0;
+		if (family != AF_INET)
+			types[nt++] = T_AAAA;
+		if (family != AF_INET6)
+			types[nt++] = T_A;
+		for (k = 0; k < nt; k++) {
+			/* Build the query exactly as res_queryN() would. */
+			len = res_nmkquery(res, QUERY, reqs[i].hostname, C_IN,
+			    types[k], NULL, 0, NULL, qbuf[nq], sizeof(qbuf[nq]));
+#ifdef RES_USE_EDNS0
+			if (len > 0 && (res->_flags & RES_F_EDNS0ERR) == 0 &&
+			    (res->options & (RES_USE_EDNS0|RES_USE_DNSSEC)) != 0)
+				len = res_nopt(res, len, qbuf[nq],
+				    sizeof(qbuf[nq]), sizeof(abuf[nq].buf));
+#endif
+			if (len <= 0)
+				continue;
+
+			/* The same question twice would wait on itself in the cache. */
+			for (j = 0; j < nq; j++) {
+				if (q[j].buflen == len &&
+				    memcmp(q[j].buf + 2, qbuf[nq] + 2, len - 2) == 0)
+					break;
+			}
+			if (j < nq)
+				continue;
+			/* res_nsendmulti() matches the answers up by ID. */
+ newid:
+			for (j = 0; j < nq; j++) {
+				if (((const HEADER *)(const void *)q[j].buf)->id ==
+				    ((HEADER *)(void *)qbuf[nq])->id) {
+					((HEADER *)(void *)qbuf[nq])->id =
+					    htons(res_randomid());
+					goto newid;
+				}
+			}
+
+			q[nq].buf = qbuf[nq];
+			q[nq].buflen = len;
+			q[nq].ans = abuf[nq].buf;
+			q[nq].anssiz = sizeof(abuf[nq].buf);
+			nq++;
+		}
+	}
+	if (nq > 0 && nq <= (size_t)cache_size)
+		(void)res_nsendmulti(res, q, (int)nq);
+
+ done:
+	free(q);
+	free(qbuf);
+	free(abuf);
+	__res_put_state(res);
+}
+
+void
+android_getaddrinfo_batch(struct android_getaddrinfo_request *reqs, size_t n)
+{
+	struct android_net_context netcontext = {
+		.app_netid = NETID_UNSET,
+		.app_mark = MARK_UNSET,
+		.dns_netid = NETID_UNSET,
+		.dns_mark = MARK_UNSET,
+		.uid = NET_CONTEXT_INVALID_UID,
+	};
+	android_getaddrinfo_batchfornetcontext(reqs, n, &netcontext);
+}
+
+void
+android_getaddrinfo_batchfornetcontext(struct android_getaddrinfo_request *reqs,
+    size_t n, const struct android_net_context *netcontext)
+{
+	FILE *proxies[BATCH_WINDOW];
+	size_t i, j, end;
+	int local;
+
+	assert(reqs != NULL || n == 0);
+	assert(netcontext != NULL);
+
+	for (i = 0; i < n; i = end) {
+		end = (n - i > BATCH_WINDOW) ? i + BATCH_WINDOW : n;
+
+		/*
+		 * Send every request to the proxy before reading any answer,
+		 * so that the proxy works on all of them at once.  Without
+		 * a proxy, send all of the queries ourselves.
+		 */
+		local = 0;
+		for (j = i; j < end; j++) {
+			proxies[j - i] = NULL;
+			if (!_batch_wants_dns(&reqs[j]))
+				continue;
+#if defined(__ANDROID__)
+			int error;
+			proxies[j - i] = android_getaddrinfo_proxy_send(
+			    reqs[j].hostname, reqs[j].servname, reqs[j].hints,
+			    netcontext->app_netid, &error);
+			if (proxies[j - i] == NULL && error == EAI_SYSTEM)
+				local = 1;
+#else
+			local = 1;
+#endif
+		}
+		if (local)
+			_dns_prefetch(reqs + i, end - i, proxies, netcontext);
+
+		for (j = i; j < end; j++) {
+			reqs[j].result = NULL;
+			reqs[j].error = getaddrinfo_netcontext(reqs[j].hostname,
+			    reqs[j].servname, reqs[j].hints, netcontext,
+			    &proxies[j - i], &reqs[j].result);
+			if (proxies[j - i] != NULL)
+				fclose(proxies[j - i]);
+		}
+	}
+}
+
+static void *
+_getaddrinfo_batch_thread(void *arg)
+{
+	struct android_getaddrinfo_batch *batch = arg;
+
+	android_getaddrinfo_batchfornetcontext(batch->reqs, batch->n,
+	    &batch->netcontext);
+	(void)eventfd_write(batch->fd, 1);
+	return NULL;
+}
+
+struct android_getaddrinfo_batch *
+android_getaddrinfo_batch_start(struct android_getaddrinfo_request *reqs,
+    size_t n)
+{
+	struct android_net_context netcontext = {
+		.app_netid = NETID_UNSET,
+		.app_mark = MARK_UNSET,
+		.dns_netid = NETID_UNSET,
+		.dns_mark = MARK_UNSET,
+		.uid = NET_CONTEXT_INVALID_UID,
+	};
+	return android_getaddrinfo_batch_startfornetcontext(reqs, n, &netcontext);
+}
+
+struct android_getaddrinfo_batch *
+android_getaddrinfo_batch_startfornetcontext(
+    struct android_getaddrinfo_request *reqs, size_t n,
+    const struct android_net_context *netcontext)
+{
+	struct android_getaddrinfo_batch *batch;
+	int error;
+
+	batch = calloc(1, sizeof(*batch));
+	if (batch == NULL)
+		return NULL;
+	batch->reqs = reqs;
+	batch->n = n;
+	batch->netcontext = *netcontext;
+	batch->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (batch->fd == -1) {
+		free(batch);
+		return NULL;
+	}
+	error = pthread_create(&batch->thread, NULL, _getaddrinfo_batch_thread,
+	    batch);
+	if (error != 0) {
+		close(batch->fd);
+		free(batch);
+		errno = error;
+		return NULL;
+	}
+	return batch;
+}
+
+int
+android_getaddrinfo_batch_fd(const struct android_getaddrinfo_batch *batch)
+{
+	return batch->fd;
+}
+
+void
+android_getaddrinfo_batch_finish(struct android_getaddrinfo_batch *batch)
+{
+	pthread_join(batch->thread, NULL);
+	close(batch->fd);
+	free(batch);
+}
+
 /*
  * FQDN hostname, DNS lookup
  */
@@ -1095,23 +1438,40 @@ get_canonname(const struct addrinfo *pai, struct addrinfo *ai, const char *str)
 	return 0;
 }
 
-static struct addrinfo *
-get_ai(const struct addrinfo *pai, const struct afd *afd, const char *addr)
+/*
+ * Allocates a block of n zeroed nodes, followed by extra bytes for the
+ * caller.  Each node's ai_addr points at its own address.
+ */
+static struct addrinfo_node *
+alloc_ai_block(size_t n, size_t extra)
 {
-	char *p;
-	struct addrinfo *ai;
+	struct addrinfo_node *block;
+	size_t i, size;
 
-	assert(pai != NULL);
-	assert(afd != NULL);
-	assert(addr != NULL);
+	assert(n > 0 && n <= UINT16_MAX);
 
-	ai = (struct addrinfo *)malloc(sizeof(struct addrinfo)
-		+ (afd->a_socklen));
-	if (ai == NULL)
+	size = n * sizeof(*block) + extra;
+	block = calloc(1, size);
+	if (block == NULL)
 		return NULL;
+	for (i = 0; i < n; i++) {
+		block[i].ai.ai_addr = &block[i].addr.generic;
+		block[i].slot = (uint16_t)i;
+	}
+	block[0].live = (uint16_t)n;
+	block[0].size = (uint32_t)size;
+	return block;
+}
+
+static void
+set_ai(struct addrinfo_node *node, const struct addrinfo *pai,
+    const struct afd *afd, const char *addr)
+{
+	char *p;
+	struct addrinfo *ai = &node->ai;
 
 	memcpy(ai, pai, sizeof(struct addrinfo));
-	ai->ai_addr = (struct sockaddr *)(void *)(ai + 1);
+	ai->ai_addr = &node->addr.generic;
 	memset(ai->ai_addr, 0, (size_t)afd->a_socklen);
 
 #ifdef HAVE_SA_LEN
@@ -1125,7 +1485,22 @@ get_ai(const struct addrinfo *pai, const struct afd *afd, const char *addr)
 	ai->ai_addr->sa_family = ai->ai_family = afd->a_af;
 	p = (char *)(void *)(ai->ai_addr);
 	memcpy(p + afd->a_off, addr, (size_t)afd->a_addrlen);
-	return ai;
+}
+
+static struct addrinfo *
+get_ai(const struct addrinfo *pai, const struct afd *afd, const char *addr)
+{
+	struct addrinfo_node *node;
+
+	assert(pai != NULL);
+	assert(afd != NULL);
+	assert(addr != NULL);
+
+	node = alloc_ai_block(1, 0);
+	if (node == NULL)
+		return NULL;
+	set_ai(node, pai, afd, addr);
+	return &node->ai;
 }
 
 static int
@@ -1303,24 +1678,39 @@ static const char AskedForGot[] =
 
 #define BOUNDS_CHECK(ptr, count) \
 	do { \
-		if (eom - (ptr) < (count)) { h_errno = NO_RECOVERY; return NULL; } \
+		if (eom - (ptr) < (count)) { h_errno = NO_RECOVERY; goto out; } \
 	} while (/*CONSTCOND*/0)
 
+#define MAXANSWERS	128	/* addresses noted on the stack; more go on the heap */
+/* the smallest A record: root owner name, fixed part, address */
+#define MINARRSZ	(1 + RRFIXEDSZ + INADDRSZ)
+
+struct answer_addr {
+	const u_char *addr;
+	int family;
+};
+
 static struct addrinfo *
 getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
     const struct addrinfo *pai)
 {
-	struct addrinfo sentinel, *cur;
+	struct addrinfo_node *block;
 	struct addrinfo ai;
 	const struct afd *afd;
+	struct answer_addr addrbuf[MAXANSWERS];
+	struct answer_addr *addrs;
+	int maxaddrs;
+	struct addrinfo *res;
 	char *canonname;
 	const HEADER *hp;
 	const u_char *cp;
-	int n;
+	int n, i, naddrs;
 	const u_char *eom;
 	char *bp, *ep;
 	int type, class, ancount, qdcount;
 	int haveanswer, had_error;
+	int canon_off, owner_is_canon;
+	size_t canonlen;
 	char tbuf[MAXDNAME];
 	int (*name_ok) (const char *);
 	char hostbuf[8*1024];
@@ -1329,10 +1719,10 @@ getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
 	assert(qname != NULL);
 	assert(pai != NULL);
 
-	memset(&sentinel, 0, sizeof(sentinel));
-	cur = &sentinel;
-
 	canonname = NULL;
+	addrs = addrbuf;
+	maxaddrs = MAXANSWERS;
+	res = NULL;
 	eom = answer->buf + anslen;
 	switch (qtype) {
 	case T_A:
@@ -1378,13 +1768,39 @@ getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
 		/* The qname can be abbreviated, but h_name is now absolute. */
 		qname = canonname;
 	}
+	/*
+	 * Note every address, not just the first MAXANSWERS.  The size of
+	 * the answer bounds how many there can be, whatever ancount says.
+	 */
+	if (ancount > MAXANSWERS && (eom - cp) / MINARRSZ > MAXANSWERS) {
+		maxaddrs = MIN(ancount, (int)((eom - cp) / MINARRSZ));
+		addrs = malloc(maxaddrs * sizeof(*addrs));
+		if (addrs == NULL) {
+			h_errno = NETDB_INTERNAL;
+			return NULL;
+		}
+	}
 	haveanswer = 0;
 	had_error = 0;
+	naddrs = 0;
+	canon_off = HFIXEDSZ;	/* where the name in canonname was read from */
 	while (ancount-- > 0 && cp < eom && !had_error) {
-		n = dn_expand(answer->buf, eom, cp, bp, ep - bp);
-		if ((n < 0) || !(*name_ok)(bp)) {
-			had_error++;
-			continue;
+		/*
+		 * Owner names are almost always a pointer back to the question
+		 * or to the last CNAME, which is canonname; don't expand those.
+		 */
+		if (eom - cp >= INT16SZ &&
+		    (cp[0] & NS_CMPRSFLGS) == NS_CMPRSFLGS &&
+		    (((cp[0] & ~NS_CMPRSFLGS) << 8) | cp[1]) == canon_off) {
+			owner_is_canon = 1;
+			n = INT16SZ;
+		} else {
+			n = dn_expand(answer->buf, eom, cp, bp, ep - bp);
+			if ((n < 0) || !(*name_ok)(bp)) {
+				had_error++;
+				continue;
+			}
+			owner_is_canon = 0;
 		}
 		cp += n;			/* name */
 		BOUNDS_CHECK(cp, 3 * INT16SZ + INT32SZ);
@@ -1402,6 +1818,7 @@ getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
 		}
 		if ((qtype == T_A || qtype == T_AAAA || qtype == T_ANY) &&
 		    type == T_CNAME) {
+			canon_off = cp - answer->buf;
 			n = dn_expand(answer->buf, eom, cp, tbuf, sizeof tbuf);
 			if ((n < 0) || !(*name_ok)(tbuf)) {
 				had_error++;
@@ -1436,7 +1853,7 @@ getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
 		switch (type) {
 		case T_A:
 		case T_AAAA:
-			if (strcasecmp(canonname, bp) != 0) {
+			if (!owner_is_canon && strcasecmp(canonname, bp) != 0) {
 				syslog(LOG_NOTICE|LOG_AUTH,
 				       AskedForGot, canonname, bp);
 				cp += n;
@@ -1458,7 +1875,7 @@ getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
 					continue;
 				}
 			}
-			if (!haveanswer) {
+			if (!haveanswer && !owner_is_canon) {
 				int nn;
 
 				canonname = bp;
@@ -1466,19 +1883,12 @@ getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
 				bp += nn;
 			}
 
-			/* don't overwrite pai */
-			ai = *pai;
-			ai.ai_family = (type == T_A) ? AF_INET : AF_INET6;
-			afd = find_afd(ai.ai_family);
-			if (afd == NULL) {
-				cp += n;
-				continue;
+			/* the nodes are built below, all at once */
+			if (naddrs < maxaddrs) {
+				addrs[naddrs].family =
+				    (type == T_A) ? AF_INET : AF_INET6;
+				addrs[naddrs++].addr = cp;
 			}
-			cur->ai_next = get_ai(&ai, afd, (const char *)cp);
-			if (cur->ai_next == NULL)
-				had_error++;
-			while (cur && cur->ai_next)
-				cur = cur->ai_next;
 			cp += n;
 			break;
 		default:
@@ -1487,17 +1897,39 @@ getanswer(const querybuf *answer, int anslen, const char *qname, int qtype,
 		if (!had_error)
 			haveanswer++;
 	}
-	if (haveanswer) {
-		if (!canonname)
-			(void)get_canonname(pai, sentinel.ai_next, qname);
-		else
-			(void)get_canonname(pai, sentinel.ai_next, canonname);
+	if (haveanswer && naddrs > 0) {
+		if (canonname)
+			qname = canonname;
+		canonlen = (pai->ai_flags & AI_CANONNAME) ?
+		    strlen(qname) + 1 : 0;
+		block = alloc_ai_block((size_t)naddrs, canonlen);
+		if (block == NULL) {
+			h_errno = NETDB_INTERNAL;
+			goto out;
+		}
+		for (i = 0; i < naddrs; i++) {
+			/* don't overwrite pai */
+			ai = *pai;
+			ai.ai_family = addrs[i].family;
+			afd = find_afd(ai.ai_family);
+			set_ai(&block[i], &ai, afd, (const char *)addrs[i].addr);
+			block[i].ai.ai_next =
+			    (i + 1 < naddrs) ? &block[i + 1].ai : NULL;
+		}
+		if (canonlen != 0) {
+			block[0].ai.ai_canonname = (char *)(void *)(block + naddrs);
+			memcpy(block[0].ai.ai_canonname, qname, canonlen);
+		}
 		h_errno = NETDB_SUCCESS;
-		return sentinel.ai_next;
+		res = &block[0].ai;
+		goto out;
 	}
 
 	h_errno = NO_RECOVERY;
-	return NULL;
+out:
+	if (addrs != addrbuf)
+		free(addrs);
+	return res;
 }
 
 struct addrinfo_sort_elem {
@@ -1505,6 +1937,11 @@ struct addrinfo_sort_elem {
 	int has_src_addr;
 	sockaddr_union src_addr;
 	int original_order;
+	/* policy table lookups, done once per address rather than per comparison */
+	int scope_src, scope_dst;
+	int label_src, label_dst;
+	int precedence;
+	int prefixlen;		/* rule 9; only for IPv6 with a source address */
 };
 
 /*ARGSUSED*/
@@ -1695,12 +2132,12 @@ _rfc6724_compare(const void *ptr1, const void* ptr2)
 	}
 
 	/* Rule 2: Prefer matching scope. */
-	scope_src1 = _get_scope(&a1->src_addr.generic);
-	scope_dst1 = _get_scope(a1->ai->ai_addr);
+	scope_src1 = a1->scope_src;
+	scope_dst1 = a1->scope_dst;
 	scope_match1 = (scope_src1 == scope_dst1);
 
-	scope_src2 = _get_scope(&a2->src_addr.generic);
-	scope_dst2 = _get_scope(a2->ai->ai_addr);
+	scope_src2 = a2->scope_src;
+	scope_dst2 = a2->scope_dst;
 	scope_match2 = (scope_src2 == scope_dst2);
 
 	if (scope_match1 != scope_match2) {
@@ -1718,12 +2155,12 @@ _rfc6724_compare(const void *ptr1, const void* ptr2)
 	 */
 
 	/* Rule 5: Prefer matching label. */
-	label_src1 = _get_label(&a1->src_addr.generic);
-	label_dst1 = _get_label(a1->ai->ai_addr);
+	label_src1 = a1->label_src;
+	label_dst1 = a1->label_dst;
 	label_match1 = (label_src1 == label_dst1);
 
-	label_src2 = _get_label(&a2->src_addr.generic);
-	label_dst2 = _get_label(a2->ai->ai_addr);
+	label_src2 = a2->label_src;
+	label_dst2 = a2->label_dst;
 	label_match2 = (label_src2 == label_dst2);
 
 	if (label_match1 != label_match2) {
@@ -1731,8 +2168,8 @@ _rfc6724_compare(const void *ptr1, const void* ptr2)
 	}
 
 	/* Rule 6: Prefer higher precedence. */
-	precedence1 = _get_precedence(a1->ai->ai_addr);
-	precedence2 = _get_precedence(a2->ai->ai_addr);
+	precedence1 = a1->precedence;
+	precedence2 = a2->precedence;
 	if (precedence1 != precedence2) {
 		return precedence2 - precedence1;
 	}
@@ -1753,14 +2190,9 @@ _rfc6724_compare(const void *ptr1, const void* ptr2)
          * to work very well directly applied to IPv4. (glibc uses information from
          * the routing table for a custom IPv4 implementation here.)
 	 */
-	if (a1->has_src_addr && a1->ai->ai_addr->sa_family == AF_INET6 &&
-	    a2->has_src_addr && a2->ai->ai_addr->sa_family == AF_INET6) {
-		const struct sockaddr_in6 *a1_src = &a1->src_addr.in6;
-		const struct sockaddr_in6 *a1_dst = (const struct sockaddr_in6 *)a1->ai->ai_addr;
-		const struct sockaddr_in6 *a2_src = &a2->src_addr.in6;
-		const struct sockaddr_in6 *a2_dst = (const struct sockaddr_in6 *)a2->ai->ai_addr;
-		prefixlen1 = _common_prefix_len(&a1_src->sin6_addr, &a1_dst->sin6_addr);
-		prefixlen2 = _common_prefix_len(&a2_src->sin6_addr, &a2_dst->sin6_addr);
+	if (a1->prefixlen >= 0 && a2->prefixlen >= 0) {
+		prefixlen1 = a1->prefixlen;
+		prefixlen2 = a2->prefixlen;
 		if (prefixlen1 != prefixlen2) {
 			return prefixlen2 - prefixlen1;
 		}
@@ -1784,7 +2216,7 @@ _rfc6724_compare(const void *ptr1, const void* ptr2)
 
 /*ARGSUSED*/
 static int
-_find_src_addr(const struct sockaddr *addr, struct sockaddr *src_addr, unsigned mark, uid_t uid)
+_probe_src_addr(const struct sockaddr *addr, struct sockaddr *src_addr, unsigned mark, uid_t uid)
 {
 	int sock;
 	int ret;
@@ -1835,6 +2267,133 @@ _find_src_addr(const struct sockaddr *addr, struct sockaddr *src_addr, unsigned
 	return 1;
 }
 
+/*
+ * The source address that the kernel picks for a destination only changes
+ * when the routes do, so remember it for a couple of seconds rather than
+ * connecting a socket for every address of every lookup.  Entries are per
+ * destination prefix (the whole address for IPv4, the /64 for IPv6), mark
+ * and uid.
+ */
+#define SRC_CACHE_SIZE		64	/* a power of two */
+#define SRC_CACHE_TTL_MS	2000
+
+struct src_cache_entry {
+	int64_t expires_ms;	/* 0 if the entry is empty */
+	unsigned mark;
+	uid_t uid;
+	sa_family_t family;
+	uint32_t scope_id;
+	uint8_t prefix[8];
+	int has_src_addr;
+	sockaddr_union src_addr;
+};
+
+static pthread_mutex_t src_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct src_cache_entry src_cache[SRC_CACHE_SIZE];
+
+static int
+_src_cache_key(const struct sockaddr *addr, unsigned mark, uid_t uid,
+    struct src_cache_entry *key)
+{
+	memset(key, 0, sizeof(*key));
+	key->mark = mark;
+	key->uid = uid;
+	key->family = addr->sa_family;
+	switch (addr->sa_family) {
+	case AF_INET:
+		memcpy(key->prefix,
+		    &((const struct sockaddr_in *)(const void *)addr)->sin_addr, 4);
+		return 1;
+	case AF_INET6:
+		memcpy(key->prefix,
+		    &((const struct sockaddr_in6 *)(const void *)addr)->sin6_addr, 8);
+		key->scope_id =
+		    ((const struct sockaddr_in6 *)(const void *)addr)->sin6_scope_id;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static struct src_cache_entry *
+_src_cache_slot(const struct src_cache_entry *key)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < sizeof(key->prefix); i++)
+		h = (h ^ key->prefix[i]) * 16777619u;
+	h = (h ^ key->mark) * 16777619u;
+	h = (h ^ (uint32_t)key->uid) * 16777619u;
+	h = (h ^ key->scope_id) * 16777619u;
+	return &src_cache[h & (SRC_CACHE_SIZE - 1)];
+}
+
+static int
+_src_cache_matches(const struct src_cache_entry *e,
+    const struct src_cache_entry *key)
+{
+	return e->mark == key->mark && e->uid == key->uid &&
+	    e->family == key->family && e->scope_id == key->scope_id &&
+	    memcmp(e->prefix, key->prefix, sizeof(key->prefix)) == 0;
+}
+
+static int64_t
+_src_cache_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Returns 1 and the source address if addr is reachable, 0 if it isn't,
+ * or -1 on error.  src_addr may be NULL.
+ */
+static int
+_find_src_addr(const struct sockaddr *addr, struct sockaddr *src_addr, unsigned mark, uid_t uid)
+{
+	struct src_cache_entry key, *e;
+	sockaddr_union src;
+	int64_t now;
+	int ret;
+
+	if (!_src_cache_key(addr, mark, uid, &key))
+		return _probe_src_addr(addr, src_addr, mark, uid);
+
+	now = _src_cache_now_ms();
+	e = _src_cache_slot(&key);
+	pthread_mutex_lock(&src_cache_lock);
+	if (e->expires_ms > now && _src_cache_matches(e, &key)) {
+		ret = e->has_src_addr;
+		src = e->src_addr;
+		pthread_mutex_unlock(&src_cache_lock);
+		if (ret == 1 && src_addr != NULL)
+			memcpy(src_addr, &src, (src.generic.sa_family == AF_INET6) ?
+			    sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+		return ret;
+	}
+	pthread_mutex_unlock(&src_cache_lock);
+
+	memset(&src, 0, sizeof(src));
+	ret = _probe_src_addr(addr, &src.generic, mark, uid);
+	if (ret == -1)
+		return ret;
+
+	key.expires_ms = now + SRC_CACHE_TTL_MS;
+	key.has_src_addr = ret;
+	key.src_addr = src;
+	pthread_mutex_lock(&src_cache_lock);
+	*e = key;
+	pthread_mutex_unlock(&src_cache_lock);
+
+	if (ret == 1 && src_addr != NULL)
+		memcpy(src_addr, &src, (addr->sa_family == AF_INET6) ?
+		    sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+	return ret;
+}
+
 /*
  * Sort the linked list starting at sentinel->ai_next in RFC6724 order.
  * Will leave the list unchanged if an error occurs.
@@ -1869,11 +2428,24 @@ _rfc6724_sort(struct addrinfo *list_sentinel, unsigned mark, uid_t uid)
 		elems[i].ai = cur;
 		elems[i].original_order = i;
 
+		memset(&elems[i].src_addr, 0, sizeof(elems[i].src_addr));
 		has_src_addr = _find_src_addr(cur->ai_addr, &elems[i].src_addr.generic, mark, uid);
 		if (has_src_addr == -1) {
 			goto error;
 		}
 		elems[i].has_src_addr = has_src_addr;
+
+		elems[i].scope_src = _get_scope(&elems[i].src_addr.generic);
+		elems[i].scope_dst = _get_scope(cur->ai_addr);
+		elems[i].label_src = _get_label(&elems[i].src_addr.generic);
+		elems[i].label_dst = _get_label(cur->ai_addr);
+		elems[i].precedence = _get_precedence(cur->ai_addr);
+		elems[i].prefixlen = -1;
+		if (has_src_addr && cur->ai_addr->sa_family == AF_INET6) {
+			elems[i].prefixlen = _common_prefix_len(
+			    &elems[i].src_addr.in6.sin6_addr,
+			    &((const struct sockaddr_in6 *)(const void *)cur->ai_addr)->sin6_addr);
+		}
 	}
 
 	/* Sort the addresses, and rearrange the linked list so it matches the sorted order. */
@@ -2026,16 +2598,6 @@ _dns_getaddrinfo(void *rv, void	*cb_data, va_list ap)
 	return NS_SUCCESS;
 }
 
-static void
-_sethtent(FILE **hostf)
-{
-
-	if (!*hostf)
-		*hostf = fopen(_PATH_HOSTS, "re");
-	else
-		rewind(*hostf);
-}
-
 static void
 _endhtent(FILE **hostf)
 {
@@ -2129,8 +2691,8 @@ _files_getaddrinfo(void *rv, void *cb_data, va_list ap)
 	memset(&sentinel, 0, sizeof(sentinel));
 	cur = &sentinel;
 
-	_sethtent(&hostf);
-	while ((p = _gethtent(&hostf, name, pai)) != NULL) {
+	hostf = _hosts_open_matching(name);
+	while (hostf && (p = _gethtent(&hostf, name, pai)) != NULL) {
 		cur->ai_next = p;
 		while (cur && cur->ai_next)
 			cur = cur->ai_next;
@@ -2145,6 +2707,72 @@ _files_getaddrinfo(void *rv, void *cb_data, va_list ap)
 
 /* resolver logic */
 
+/*
+ * Sends the queries for all of the targets at once, so that looking up
+ * both AAAA and A records costs a single round trip.  Returns a mask of
+ * the targets that are finished with; res_queryN() sends the others one
+ * at a time, which also takes care of retrying without EDNS0.
+ */
+static u_int
+res_queryN_parallel(const char *name, struct res_target *target,
+    res_state res, int *rcode, int *ancount)
+{
+	u_char buf[MAXPARALLEL][PACKETSZ];
+	struct res_sendq q[MAXPARALLEL];
+	struct res_target *t;
+	HEADER *hp;
+	u_int oflags, done;
+	int i, n, nq;
+
+	nq = 0;
+	for (t = target; t; t = t->next) {
+		if (nq == MAXPARALLEL)
+			return 0;
+		hp = (HEADER *)(void *)t->answer;
+		hp->rcode = NOERROR;	/* default */
+		n = res_nmkquery(res, QUERY, name, t->qclass, t->qtype, NULL,
+		    0, NULL, buf[nq], sizeof(buf[nq]));
+#ifdef RES_USE_EDNS0
+		if (n > 0 && (res->_flags & RES_F_EDNS0ERR) == 0 &&
+		    (res->options & (RES_USE_EDNS0|RES_USE_DNSSEC)) != 0)
+			n = res_nopt(res, n, buf[nq], sizeof(buf[nq]),
+			    t->anslen);
+#endif
+		if (n <= 0)
+			return 0;	/* let res_queryN() report it */
+		q[nq].buf = buf[nq];
+		q[nq].buflen = n;
+		q[nq].ans = t->answer;
+		q[nq].anssiz = t->anslen;
+		nq++;
+	}
+
+	oflags = res->_flags;
+	if (res_nsendmulti(res, q, nq) < 0)
+		return 0;
+
+	done = 0;
+	for (i = 0, t = target; t; i++, t = t->next) {
+		hp = (HEADER *)(void *)t->answer;
+		if (q[i].resplen < 0 || hp->rcode != NOERROR ||
+		    ntohs(hp->ancount) == 0) {
+#ifdef RES_USE_EDNS0
+			/* if the query choked with EDNS0, retry without EDNS0 */
+			if ((res->options & (RES_USE_EDNS0|RES_USE_DNSSEC)) != 0 &&
+			    ((oflags ^ res->_flags) & RES_F_EDNS0ERR) != 0)
+				continue;
+#endif
+			*rcode = hp->rcode;	/* record most recent error */
+			done |= 1U << i;
+			continue;
+		}
+		*ancount += ntohs(hp->ancount);
+		t->n = q[i].resplen;
+		done |= 1U << i;
+	}
+	return done;
+}
+
 /*
  * Formulate a normal query, send, and await answer.
  * Returned answer is placed in supplied buffer "answer".
@@ -2165,6 +2793,8 @@ res_queryN(const char *name, /* domain name */ struct res_target *target,
 	struct res_target *t;
 	int rcode;
 	int ancount;
+	u_int done;
+	int i;
 
 	assert(name != NULL);
 	/* XXX: target may be NULL??? */
@@ -2172,12 +2802,19 @@ res_queryN(const char *name, /* domain name */ struct res_target *target,
 	rcode = NOERROR;
 	ancount = 0;
 
-	for (t = target; t; t = t->next) {
+	done = 0;
+	if (target != NULL && target->next != NULL)
+		done = res_queryN_parallel(name, target, res, &rcode, &ancount);
+
+	for (i = 0, t = target; t; i++, t = t->next) {
 		int class, type;
 		u_char *answer;
 		int anslen;
 		u_int oflags;
 
+		if (i < MAXPARALLEL && (done & (1U << i)) != 0)
+			continue;
+
 		hp = (HEADER *)(void *)t->answer;
 		oflags = res->_flags;
 
@@ -29,12 +29,68 @@
 #include <netdb.h>
 
 #include <endian.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "resolv_static.h"
 #include "services.h"
 
+// Hash indexes over _services, built on first use, so that getservbyname()
+// and getservbyport() don't scan the whole table. Each slot holds the offset
+// of an entry plus one, or 0 if it's empty. Linear probing finds entries
+// with the same key in table order, so the first match is the one that a
+// scan of the table would have found.
+#define SERVICES_INDEX_SIZE 2048  // A power of two, at least twice the entry count.
+
+_Static_assert(sizeof(_services) < UINT16_MAX, "services index offsets are 16 bits");
+
+static uint16_t g_services_by_name[SERVICES_INDEX_SIZE];
+static uint16_t g_services_by_port[SERVICES_INDEX_SIZE];
+static int g_services_indexed;
+static pthread_once_t g_services_index_once = PTHREAD_ONCE_INIT;
+
+static uint32_t services_hash(const char* s, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+
+static const char* services_next(const char* p) {
+  p += 1 + p[0] + 3;  // name + port + proto
+  int count = *p++;
+  while (count-- > 0) p += 1 + p[0];
+  return p;
+}
+
+static int services_port(const char* p) {
+  const unsigned char* q = (const unsigned char*)p + 1 + p[0];
+  return (q[0] << 8) | q[1];
+}
+
+static int services_proto_matches(const char* p, const char* proto) {
+  return proto == NULL || strcmp(proto, p[1 + p[0] + 2] == 't' ? "tcp" : "udp") == 0;
+}
+
+static void services_insert(uint16_t* index, uint32_t h, const char* p) {
+  while (index[h & (SERVICES_INDEX_SIZE - 1)] != 0) h++;
+  index[h & (SERVICES_INDEX_SIZE - 1)] = (p - _services) + 1;
+}
+
+static void services_index_init(void) {
+  size_t count = 0;
+  for (const char* p = _services; p[0] != 0; p = services_next(p)) count++;
+  // Leave the table to the linear scans if someone regenerates a bigger one.
+  if (count * 2 > SERVICES_INDEX_SIZE) return;
+
+  for (const char* p = _services; p[0] != 0; p = services_next(p)) {
+    services_insert(g_services_by_name, services_hash(p + 1, p[0]), p);
+    services_insert(g_services_by_port, services_port(p) * 2654435761u >> 21, p);
+  }
+  g_services_indexed = 1;
+}
+
 struct servent* getservent_r(struct res_static* rs) {
     const char*  p;
     const char*  q;
@@ -104,6 +160,15 @@ struct servent* getservent_r(struct res_static* rs) {
     return &rs->servent;
 }
 
+// Fills in rs->servent from the entry at p, leaving rs->servent_ptr alone.
+static struct servent* services_get(struct res_static* rs, const char* p) {
+  const char* old_servent_ptr = rs->servent_ptr;
+  rs->servent_ptr = p;
+  struct servent* s = getservent_r(rs);
+  rs->servent_ptr = old_servent_ptr;
+  return s;
+}
+
 void setservent(int stayopen) {
   endservent();
 }
@@ -122,6 +187,19 @@ struct servent* getservbyname(const char* name, const char* proto) {
   struct res_static* rs = __res_get_static();
   if (rs == NULL) return NULL;
 
+  pthread_once(&g_services_index_once, services_index_init);
+  if (g_services_indexed) {
+    size_t len = strlen(name);
+    for (uint32_t h = services_hash(name, len);; h++) {
+      uint16_t slot = g_services_by_name[h & (SERVICES_INDEX_SIZE - 1)];
+      if (slot == 0) return NULL;
+      const char* p = _services + slot - 1;
+      if ((size_t)p[0] == len && memcmp(p + 1, name, len) == 0 && services_proto_matches(p, proto)) {
+        return services_get(rs, p);
+      }
+    }
+  }
+
   const char* old_servent_ptr = rs->servent_ptr;
   rs->servent_ptr = NULL;
   struct servent* s;
@@ -138,6 +216,21 @@ struct servent* getservbyport(int port, const char* proto) {
   struct res_static* rs = __res_get_static();
   if (rs == NULL) return NULL;
 
+  pthread_once(&g_services_index_once, services_index_init);
+  if (g_services_indexed) {
+    // port is in network byte order, and every entry's port fits in 16 bits.
+    if (port < 0 || port > UINT16_MAX) return NULL;
+    int host_port = ntohs(port);
+    for (uint32_t h = host_port * 2654435761u >> 21;; h++) {
+      uint16_t slot = g_services_by_port[h & (SERVICES_INDEX_SIZE - 1)];
+      if (slot == 0) return NULL;
+      const char* p = _services + slot - 1;
+      if (services_port(p) == host_port && services_proto_matches(p, proto)) {
+        return services_get(rs, p);
+      }
+    }
+  }
+
   const char* old_servent_ptr = rs->servent_ptr;
   rs->servent_ptr = NULL;
   struct servent* s;
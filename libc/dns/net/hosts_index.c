@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * An index of the hosts file by host name, so that looking up a name
+ * doesn't mean parsing every line of a file that can be very large.
+ *
+ * The index records, for the hash of each name (or alias) in the file,
+ * where the line that the name is on starts and how long it is. A lookup
+ * reads just the lines whose names hash like the one it wants into a
+ * buffer, and the usual line parser reads them from there, in file order.
+ * The index is rebuilt when the file's inode, size or modification time
+ * changes.
+ *
+ * The file is read with pread() rather than mapped, so that a file that
+ * is truncated while it's being read gives short reads instead of SIGBUS.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hostent.h"
+
+struct hosts_entry {
+  uint32_t hash;
+  uint32_t line;  // Offset of the start of the line in the file.
+  uint32_t len;   // Length of the line, with its newline.
+};
+
+struct hosts_index {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  uint32_t mask;             // The number of buckets, minus one.
+  uint32_t* bucket_start;    // mask + 2 entries; bucket b is [start[b], start[b + 1]).
+  struct hosts_entry* entries;
+};
+
+static pthread_mutex_t g_hosts_index_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct hosts_index* g_hosts_index;
+
+// Case-insensitive FNV-1a, since host names are compared with strcasecmp.
+static uint32_t hosts_hash(const char* s, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    h = (h ^ c) * 16777619u;
+  }
+  return h;
+}
+
+// Calls fn for each name on each line that the line parsers would read.
+// The parsers skip comment lines, and lines that end without a newline.
+static void hosts_for_each_name(const char* map, size_t size,
+                                void (*fn)(void*, uint32_t, uint32_t, uint32_t), void* arg) {
+  const char* end = map + size;
+  const char* line = map;
+  while (line < end) {
+    const char* nl = memchr(line, '\n', end - line);
+    const char* eol = (nl != NULL) ? nl : end;
+    const char* hash = memchr(line, '#', eol - line);
+    if (hash != NULL) eol = hash;
+    if (*line != '#' && (nl != NULL || hash != NULL)) {
+      // Skip the address, then index every name after it.
+      const char* p = line;
+      while (p < eol && *p != ' ' && *p != '\t') p++;
+      while (p < eol) {
+        while (p < eol && (*p == ' ' || *p == '\t')) p++;
+        const char* name = p;
+        while (p < eol && *p != ' ' && *p != '\t') p++;
+        if (p > name) {
+          fn(arg, hosts_hash(name, p - name), line - map, ((nl != NULL) ? nl + 1 : end) - line);
+        }
+      }
+    }
+    if (nl == NULL) break;
+    line = nl + 1;
+  }
+}
+
+struct hosts_build {
+  struct hosts_index* index;
+  size_t count;
+};
+
+static void hosts_count_name(void* arg, uint32_t hash, uint32_t line, uint32_t len) {
+  struct hosts_build* b = arg;
+  (void)line;
+  (void)len;
+  if (b->index->bucket_start != NULL) b->index->bucket_start[(hash & b->index->mask) + 1]++;
+  b->count++;
+}
+
+static void hosts_add_name(void* arg, uint32_t hash, uint32_t line, uint32_t len) {
+  struct hosts_build* b = arg;
+  uint32_t slot = b->index->bucket_start[hash & b->index->mask]++;
+  b->index->entries[slot].hash = hash;
+  b->index->entries[slot].line = line;
+  b->index->entries[slot].len = len;
+}
+
+// Reads exactly n bytes at offset, failing if the file is now shorter.
+static int hosts_pread_all(int fd, char* buf, size_t n, off_t offset) {
+  while (n > 0) {
+    ssize_t rc = TEMP_FAILURE_RETRY(pread(fd, buf, n, offset));
+    if (rc <= 0) return -1;
+    buf += rc;
+    n -= rc;
+    offset += rc;
+  }
+  return 0;
+}
+
+static void hosts_index_free(struct hosts_index* index) {
+  if (index == NULL) return;
+  free(index->bucket_start);
+  free(index->entries);
+  free(index);
+}
+
+static struct hosts_index* hosts_index_build(int fd, const struct stat* st) {
+  struct hosts_index* index = calloc(1, sizeof(*index));
+  if (index == NULL) return NULL;
+  char* map = NULL;
+  index->dev = st->st_dev;
+  index->ino = st->st_ino;
+  index->size = st->st_size;
+  index->mtime = st->st_mtim;
+  if (st->st_size == 0) return index;
+  if ((uint64_t)st->st_size > UINT32_MAX) goto fail;
+
+  // The file is only needed while the index is built.
+  map = malloc(st->st_size);
+  if (map == NULL || hosts_pread_all(fd, map, st->st_size, 0) == -1) goto fail;
+
+  // Count the names first, to size the table at about one name per bucket.
+  struct hosts_build b = {.index = index, .count = 0};
+  hosts_for_each_name(map, index->size, hosts_count_name, &b);
+  size_t buckets = 1;
+  while (buckets < b.count) buckets <<= 1;
+  index->mask = buckets - 1;
+  index->bucket_start = calloc(buckets + 1, sizeof(uint32_t));
+  index->entries = malloc((b.count + 1) * sizeof(struct hosts_entry));
+  if (index->bucket_start == NULL || index->entries == NULL) goto fail;
+
+  // Count again per bucket, then place each name after the ones before it
+  // in its bucket, so that every bucket stays in file order.
+  b.count = 0;
+  hosts_for_each_name(map, index->size, hosts_count_name, &b);
+  for (size_t i = 1; i <= buckets; i++) index->bucket_start[i] += index->bucket_start[i - 1];
+  hosts_for_each_name(map, index->size, hosts_add_name, &b);
+  // Filling moved each start to the next bucket's start; shift them back.
+  memmove(index->bucket_start + 1, index->bucket_start, buckets * sizeof(uint32_t));
+  index->bucket_start[0] = 0;
+  free(map);
+  return index;
+
+fail:
+  free(map);
+  hosts_index_free(index);
+  return NULL;
+}
+
+static int hosts_index_is_current(const struct hosts_index* index, const struct stat* st) {
+  return index != NULL && index->dev == st->st_dev && index->ino == st->st_ino &&
+         index->size == st->st_size && index->mtime.tv_sec == st->st_mtim.tv_sec &&
+         index->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+struct hosts_lines {
+  char* buf;
+  size_t len;
+  size_t pos;
+};
+
+static int hosts_lines_read(void* cookie, char* buf, int n) {
+  struct hosts_lines* lines = cookie;
+  size_t count = lines->len - lines->pos;
+  if ((size_t)n < count) count = n;
+  if (count > 0) memcpy(buf, lines->buf + lines->pos, count);
+  lines->pos += count;
+  return count;
+}
+
+static int hosts_lines_close(void* cookie) {
+  struct hosts_lines* lines = cookie;
+  free(lines->buf);
+  free(lines);
+  return 0;
+}
+
+struct hosts_range {
+  uint32_t line;
+  uint32_t len;
+};
+
+// Finds the lines that might mention name, in file order. Called with the
+// lock held, so it only notes where they are; they're read after unlocking.
+static int hosts_index_find(const struct hosts_index* index, const char* name,
+                            struct hosts_range** ranges, size_t* count) {
+  *ranges = NULL;
+  *count = 0;
+  if (index->entries == NULL) return 0;
+
+  uint32_t hash = hosts_hash(name, strlen(name));
+  uint32_t b = hash & index->mask;
+  size_t max = index->bucket_start[b + 1] - index->bucket_start[b];
+  if (max == 0) return 0;
+  *ranges = malloc(max * sizeof(**ranges));
+  if (*ranges == NULL) return -1;
+
+  uint32_t last_line = UINT32_MAX;
+  for (uint32_t i = index->bucket_start[b]; i < index->bucket_start[b + 1]; i++) {
+    const struct hosts_entry* e = &index->entries[i];
+    // A line that lists the name twice must still only be read once.
+    if (e->hash != hash || e->line == last_line) continue;
+    last_line = e->line;
+    (*ranges)[*count].line = e->line;
+    (*ranges)[*count].len = e->len;
+    (*count)++;
+  }
+  return 0;
+}
+
+// Reads the lines found by hosts_index_find() into a buffer. Returns NULL if
+// they can't all be read, as when the file has been truncated since.
+static struct hosts_lines* hosts_lines_load(int fd, const struct hosts_range* ranges,
+                                            size_t count) {
+  struct hosts_lines* lines = calloc(1, sizeof(*lines));
+  if (lines == NULL) return NULL;
+
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) total += ranges[i].len;
+  if (total == 0) return lines;
+  lines->buf = malloc(total);
+  if (lines->buf == NULL) goto fail;
+  for (size_t i = 0; i < count; i++) {
+    if (hosts_pread_all(fd, lines->buf + lines->len, ranges[i].len, ranges[i].line) == -1) {
+      goto fail;
+    }
+    lines->len += ranges[i].len;
+  }
+  return lines;
+
+fail:
+  hosts_lines_close(lines);
+  return NULL;
+}
+
+FILE* _hosts_open_matching(const char* name) {
+  int fd = open(_PATH_HOSTS, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&g_hosts_index_lock);
+  if (!hosts_index_is_current(g_hosts_index, &st)) {
+    struct hosts_index* index = hosts_index_build(fd, &st);
+    if (index != NULL) {
+      hosts_index_free(g_hosts_index);
+      g_hosts_index = index;
+    }
+  }
+  struct hosts_range* ranges = NULL;
+  size_t count = 0;
+  int found = -1;
+  if (hosts_index_is_current(g_hosts_index, &st)) {
+    found = hosts_index_find(g_hosts_index, name, &ranges, &count);
+  }
+  pthread_mutex_unlock(&g_hosts_index_lock);
+
+  struct hosts_lines* lines = NULL;
+  if (found == 0) lines = hosts_lines_load(fd, ranges, count);
+  free(ranges);
+
+  if (lines == NULL) {
+    // No index, or the file changed under it; fall back to reading the
+    // whole file. pread() left the offset at the start.
+    FILE* fp = fdopen(fd, "re");
+    if (fp == NULL) close(fd);
+    return fp;
+  }
+  close(fd);
+
+  FILE* fp = funopen(lines, hosts_lines_read, NULL, NULL, hosts_lines_close);
+  if (fp == NULL) hosts_lines_close(lines);
+  return fp;
+}
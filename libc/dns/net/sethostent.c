@@ -147,8 +147,7 @@ _hf_gethtbyname2(const char *name, int af, struct getnamaddr *info)
 
 	_DIAGASSERT(name != NULL);
 
-	hf = NULL;
-	sethostent_r(&hf);
+	hf = _hosts_open_matching(name);
 	if (hf == NULL) {
 		errno = EINVAL;
 		*info->he = NETDB_INTERNAL;
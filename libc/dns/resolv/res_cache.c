@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdatomic.h>
 #include "pthread.h"
 
 #include <errno.h>
@@ -71,7 +72,9 @@
  *    (and should be solved by the later full DNS cache process).
  *
  *  - the implementation is just a (query-data) => (answer-data) hash table
- *    with a trivial least-recently-used expiration policy.
+ *    with a CLOCK (second chance) expiration policy. the table is split
+ *    into independently locked stripes, so lookups of different names
+ *    from different threads don't contend with each other.
  *
  * Doing this keeps the code simple and avoids to deal with a lot of things
  * that a full DNS cache is expected to do.
@@ -94,6 +97,12 @@
  *     if the function returns RESOLV_CACHE_UNSUPPORTED, the client should
  *     perform a request normally, and *not* call _resolv_cache_add()
  *
+ *     if the function returns RESOLV_CACHE_STALE, an expired answer has been
+ *     copied into the answer buffer. the client should use it, but also
+ *     perform the request in the background and call _resolv_cache_add()
+ *     (or _resolv_cache_query_failed()) with the result. only one client
+ *     is told to do this for each expiry.
+ *
  *     note that RESOLV_CACHE_UNSUPPORTED is also returned if the answer buffer
  *     is too short to accomodate the cached result.
  */
@@ -131,6 +140,26 @@
  */
 #define  CONFIG_MAX_ENTRIES    64 * 2 * 5
 
+/* the proxy can change the number of entries with the ANDROID_DNS_CACHE_SIZE
+ * environment variable, up to this limit.
+ */
+#define  CONFIG_MAX_CACHE_SIZE  65536
+
+/* the cache is split into at most this many stripes, but a stripe is never
+ * made smaller than CONFIG_MIN_STRIPE_ENTRIES, so small caches use fewer.
+ */
+#define  CONFIG_MAX_STRIPES        16
+#define  CONFIG_MIN_STRIPE_ENTRIES 8
+
+/* the proxy can also ask for expired answers to be served for up to
+ * ANDROID_DNS_CACHE_STALE_TTL seconds while they are refreshed (RFC 8767),
+ * and for NXDOMAIN and NODATA answers to be kept for at least
+ * ANDROID_DNS_CACHE_NEGATIVE_TTL seconds even without an SOA record.
+ * both are off by default.
+ */
+#define  CONFIG_MAX_STALE_TTL     (3 * 24 * 60 * 60)
+#define  CONFIG_MAX_NEGATIVE_TTL  (3 * 60 * 60)
+
 /****************************************************************************/
 /****************************************************************************/
 /*****                                                                  *****/
@@ -1044,13 +1073,16 @@ _dnsPacket_isEqualQuery( DnsPacket*  pack1, DnsPacket*  pack2 )
 /* cache entry. for simplicity, 'hash' and 'hlink' are inlined in this
  * structure though they are conceptually part of the hash table.
  *
- * similarly, mru_next and mru_prev are part of the global MRU list
+ * similarly, clock_next and clock_prev are part of the stripe's CLOCK list,
+ * and 'referenced' is set whenever a lookup finds the entry.
  */
 typedef struct Entry {
     unsigned int     hash;   /* hash value */
     struct Entry*    hlink;  /* next in collision chain */
-    struct Entry*    mru_prev;
-    struct Entry*    mru_next;
+    struct Entry*    clock_prev;
+    struct Entry*    clock_next;
+    int              referenced;
+    int              refreshing; /* a client is refreshing this stale entry */
 
     const uint8_t*   query;
     int              querylen;
@@ -1119,12 +1151,15 @@ answer_getNegativeTTL(ns_msg handle) {
  *
  * In case of parse error zero (0) is returned which
  * indicates that the answer shall not be cached.
+ *
+ * NXDOMAIN and NODATA answers are kept for at least
+ * negative_ttl seconds.
  */
 static u_long
-answer_getTTL(const void* answer, int answerlen)
+answer_getTTL(const void* answer, int answerlen, u_long negative_ttl)
 {
     ns_msg handle;
-    int ancount, n;
+    int ancount, n, rcode;
     u_long result, ttl;
     ns_rr rr;
 
@@ -1136,6 +1171,11 @@ answer_getTTL(const void* answer, int answerlen)
         if (ancount == 0) {
             // a response with no answers?  Cache this negative result.
             result = answer_getNegativeTTL(handle);
+            // but not a server failure, which is worth asking about again.
+            rcode = ns_msg_getflag(handle, ns_f_rcode);
+            if ((rcode == ns_r_nxdomain || rcode == ns_r_noerror) && result < negative_ttl) {
+                result = negative_ttl;
+            }
         } else {
             for (n = 0; n < ancount; n++) {
                 if (ns_parserr(&handle, ns_s_an, n, &rr) == 0) {
@@ -1166,19 +1206,18 @@ entry_free( Entry*  e )
     }
 }
 
-static __inline__ void entry_mru_remove(Entry* e) {
-  e->mru_prev->mru_next = e->mru_next;
-  e->mru_next->mru_prev = e->mru_prev;
+static __inline__ void entry_clock_remove(Entry* e) {
+  e->clock_prev->clock_next = e->clock_next;
+  e->clock_next->clock_prev = e->clock_prev;
 }
 
-static __inline__ void entry_mru_add(Entry* e, Entry* list) {
-  Entry* first = list->mru_next;
-
-  e->mru_next = first;
-  e->mru_prev = list;
+/* insert 'e' just before 'pos' */
+static __inline__ void entry_clock_insert(Entry* e, Entry* pos) {
+  e->clock_next = pos;
+  e->clock_prev = pos->clock_prev;
 
-  list->mru_next = e;
-  first->mru_prev = e;
+  pos->clock_prev->clock_next = e;
+  pos->clock_prev = e;
 }
 
 /* compute the hash of a given entry, this is a hash of most
@@ -1272,13 +1311,36 @@ typedef struct pending_req_info {
     struct pending_req_info*    next;
 } PendingReqInfo;
 
-typedef struct resolv_cache {
+/* A query always maps to the same stripe, which holds its entry as well as
+ * any pending request for it, all protected by the stripe's lock.
+ *
+ * Every entry of the stripe is also on its CLOCK list. New entries go just
+ * behind the hand, and a hit only sets the entry's 'referenced' flag, so
+ * lookups never reorder the list. When the stripe is full, the hand sweeps
+ * forward, clearing the flags it finds set, and evicts the first entry that
+ * is either unreferenced or expired.
+ */
+typedef struct cache_stripe {
+    pthread_mutex_t  lock;
     int              max_entries;
     int              num_entries;
-    Entry            mru_list;
+    Entry**          buckets;
+    int              num_buckets;
+    Entry            clock_list;
+    Entry*           clock_hand;
     int              last_id;
-    Entry*           entries;
     PendingReqInfo   pending_requests;
+} __attribute__((aligned(64))) CacheStripe;
+
+typedef struct resolv_cache {
+    /* one reference for the cache list, and one for each thread using it */
+    atomic_int       refs;
+    int              max_entries;
+    int              stale_ttl;     /* how long past expiry to serve an answer */
+    int              negative_ttl;  /* minimum TTL for NXDOMAIN and NODATA */
+    int              num_stripes;
+    CacheStripe*     stripes;
+    Entry**          buckets;   /* storage for all of the stripes' buckets */
 } Cache;
 
 struct resolv_cache_info {
@@ -1301,67 +1363,100 @@ static pthread_once_t        _res_cache_once = PTHREAD_ONCE_INIT;
 static void _res_cache_init(void);
 
 // lock protecting everything in the _resolve_cache_info structs (next ptr, etc)
-static pthread_mutex_t _res_cache_list_lock;
+// the entries of each cache are protected by the locks of its stripes instead.
+static pthread_rwlock_t _res_cache_list_lock;
 
 /* gets cache associated with a network, or NULL if none exists */
 static struct resolv_cache* _find_named_cache_locked(unsigned netid);
 
+static CacheStripe*
+_cache_get_stripe( Cache*  cache, unsigned  hash )
+{
+    return &cache->stripes[hash % cache->num_stripes];
+}
+
+/* gets the cache associated with a network and takes a reference to it,
+ * so that it stays valid without holding _res_cache_list_lock. returns
+ * NULL if there is no cache. release it with _cache_put(). */
+static Cache*
+_cache_get_for_net( unsigned  netid )
+{
+    Cache*  cache;
+
+    pthread_once(&_res_cache_once, _res_cache_init);
+    pthread_rwlock_rdlock(&_res_cache_list_lock);
+
+    cache = _find_named_cache_locked(netid);
+    if (cache != NULL) {
+        atomic_fetch_add_explicit(&cache->refs, 1, memory_order_relaxed);
+    }
+
+    pthread_rwlock_unlock(&_res_cache_list_lock);
+    return cache;
+}
+
+static void _resolv_cache_free( Cache*  cache );
+static Entry** _cache_lookup_p( Cache* cache, CacheStripe* stripe, Entry* key );
+
 static void
-_cache_flush_pending_requests_locked( struct resolv_cache* cache )
+_cache_put( Cache*  cache )
+{
+    if (atomic_fetch_sub_explicit(&cache->refs, 1, memory_order_acq_rel) == 1) {
+        _resolv_cache_free(cache);
+    }
+}
+
+static void
+_cache_flush_pending_requests_locked( CacheStripe*  stripe )
 {
     struct pending_req_info *ri, *tmp;
-    if (cache) {
-        ri = cache->pending_requests.next;
 
-        while (ri) {
-            tmp = ri;
-            ri = ri->next;
-            pthread_cond_broadcast(&tmp->cond);
+    ri = stripe->pending_requests.next;
 
-            pthread_cond_destroy(&tmp->cond);
-            free(tmp);
-        }
+    while (ri) {
+        tmp = ri;
+        ri = ri->next;
+        pthread_cond_broadcast(&tmp->cond);
 
-        cache->pending_requests.next = NULL;
+        pthread_cond_destroy(&tmp->cond);
+        free(tmp);
     }
+
+    stripe->pending_requests.next = NULL;
 }
 
 /* Return 0 if no pending request is found matching the key.
  * If a matching request is found the calling thread will wait until
- * the matching request completes, then update *cache and return 1. */
+ * the matching request completes, then return 1. */
 static int
-_cache_check_pending_request_locked( struct resolv_cache** cache, Entry* key, unsigned netid )
+_cache_check_pending_request_locked( CacheStripe*  stripe, Entry*  key )
 {
     struct pending_req_info *ri, *prev;
     int exist = 0;
 
-    if (*cache && key) {
-        ri = (*cache)->pending_requests.next;
-        prev = &(*cache)->pending_requests;
-        while (ri) {
-            if (ri->hash == key->hash) {
-                exist = 1;
-                break;
-            }
-            prev = ri;
-            ri = ri->next;
+    ri = stripe->pending_requests.next;
+    prev = &stripe->pending_requests;
+    while (ri) {
+        if (ri->hash == key->hash) {
+            exist = 1;
+            break;
         }
+        prev = ri;
+        ri = ri->next;
+    }
 
-        if (!exist) {
-            ri = calloc(1, sizeof(struct pending_req_info));
-            if (ri) {
-                ri->hash = key->hash;
-                pthread_cond_init(&ri->cond, NULL);
-                prev->next = ri;
-            }
-        } else {
-            struct timespec ts = {0,0};
-            XLOG("Waiting for previous request");
-            ts.tv_sec = _time_now() + PENDING_REQUEST_TIMEOUT;
-            pthread_cond_timedwait(&ri->cond, &_res_cache_list_lock, &ts);
-            /* Must update *cache as it could have been deleted. */
-            *cache = _find_named_cache_locked(netid);
+    if (!exist) {
+        ri = calloc(1, sizeof(struct pending_req_info));
+        if (ri) {
+            ri->hash = key->hash;
+            pthread_cond_init(&ri->cond, NULL);
+            prev->next = ri;
         }
+    } else {
+        struct timespec ts = {0,0};
+        XLOG("Waiting for previous request");
+        ts.tv_sec = _time_now() + PENDING_REQUEST_TIMEOUT;
+        pthread_cond_timedwait(&ri->cond, &stripe->lock, &ts);
     }
 
     return exist;
@@ -1370,28 +1465,26 @@ _cache_check_pending_request_locked( struct resolv_cache** cache, Entry* key, un
 /* notify any waiting thread that waiting on a request
  * matching the key has been added to the cache */
 static void
-_cache_notify_waiting_tid_locked( struct resolv_cache* cache, Entry* key )
+_cache_notify_waiting_tid_locked( CacheStripe*  stripe, Entry*  key )
 {
     struct pending_req_info *ri, *prev;
 
-    if (cache && key) {
-        ri = cache->pending_requests.next;
-        prev = &cache->pending_requests;
-        while (ri) {
-            if (ri->hash == key->hash) {
-                pthread_cond_broadcast(&ri->cond);
-                break;
-            }
-            prev = ri;
-            ri = ri->next;
+    ri = stripe->pending_requests.next;
+    prev = &stripe->pending_requests;
+    while (ri) {
+        if (ri->hash == key->hash) {
+            pthread_cond_broadcast(&ri->cond);
+            break;
         }
+        prev = ri;
+        ri = ri->next;
+    }
 
-        // remove item from list and destroy
-        if (ri) {
-            prev->next = ri->next;
-            pthread_cond_destroy(&ri->cond);
-            free(ri);
-        }
+    // remove item from list and destroy
+    if (ri) {
+        prev->next = ri->next;
+        pthread_cond_destroy(&ri->cond);
+        free(ri);
     }
 }
 
@@ -1401,53 +1494,101 @@ _resolv_cache_query_failed( unsigned    netid,
                    const void* query,
                    int         querylen)
 {
-    Entry    key[1];
-    Cache*   cache;
+    Entry         key[1];
+    Cache*        cache;
+    CacheStripe*  stripe;
 
     if (!entry_init_key(key, query, querylen))
         return;
 
-    pthread_mutex_lock(&_res_cache_list_lock);
+    cache = _cache_get_for_net(netid);
+    if (cache == NULL)
+        return;
 
-    cache = _find_named_cache_locked(netid);
+    stripe = _cache_get_stripe(cache, key->hash);
+    pthread_mutex_lock(&stripe->lock);
+    _cache_notify_waiting_tid_locked(stripe, key);
 
-    if (cache) {
-        _cache_notify_waiting_tid_locked(cache, key);
+    /* if this was a refresh, let the next lookup try again */
+    Entry*  e = *_cache_lookup_p(cache, stripe, key);
+    if (e != NULL) {
+        e->refreshing = 0;
     }
+    pthread_mutex_unlock(&stripe->lock);
+
+    _cache_put(cache);
+}
+
+/* the number of answers the network's cache can hold; 0 if it has none */
+int
+_resolv_cache_size_for_net( unsigned  netid )
+{
+    Cache*  cache = _cache_get_for_net(netid);
+    int     size = 0;
 
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    if (cache != NULL) {
+        size = cache->max_entries;
+        _cache_put(cache);
+    }
+    return size;
 }
 
 static struct resolv_cache_info* _find_cache_info_locked(unsigned netid);
 
 static void
-_cache_flush_locked( Cache*  cache )
+_cache_flush( Cache*  cache )
 {
-    int     nn;
+    int     nn, mm;
 
-    for (nn = 0; nn < cache->max_entries; nn++)
-    {
-        Entry**  pnode = (Entry**) &cache->entries[nn];
+    for (nn = 0; nn < cache->num_stripes; nn++) {
+        CacheStripe*  stripe = &cache->stripes[nn];
 
-        while (*pnode != NULL) {
-            Entry*  node = *pnode;
-            *pnode = node->hlink;
-            entry_free(node);
+        pthread_mutex_lock(&stripe->lock);
+        for (mm = 0; mm < stripe->num_buckets; mm++) {
+            Entry**  pnode = &stripe->buckets[mm];
+
+            while (*pnode != NULL) {
+                Entry*  node = *pnode;
+                *pnode = node->hlink;
+                entry_free(node);
+            }
         }
-    }
 
-    // flush pending request
-    _cache_flush_pending_requests_locked(cache);
+        // flush pending request
+        _cache_flush_pending_requests_locked(stripe);
 
-    cache->mru_list.mru_next = cache->mru_list.mru_prev = &cache->mru_list;
-    cache->num_entries       = 0;
-    cache->last_id           = 0;
+        stripe->clock_list.clock_next = stripe->clock_list.clock_prev = &stripe->clock_list;
+        stripe->clock_hand  = &stripe->clock_list;
+        stripe->num_entries = 0;
+        stripe->last_id     = 0;
+        pthread_mutex_unlock(&stripe->lock);
+    }
 
     XLOG("*************************\n"
          "*** DNS CACHE FLUSHED ***\n"
          "*************************");
 }
 
+/* returns the value of the environment variable 'name' if it is a number
+ * between 0 and 'max', or 'def' otherwise. */
+static int
+_res_cache_getenv_int( const char*  name, int  def, int  max )
+{
+    const char* value = getenv(name);
+    char* end;
+    long n;
+
+    if (value == NULL || *value == '\0') {
+        return def;
+    }
+    n = strtol(value, &end, 10);
+    if (*end != '\0' || n < 0 || n > max) {
+        XLOG("ignoring bad %s: %s", name, value);
+        return def;
+    }
+    return (int) n;
+}
+
 static int
 _res_cache_get_max_entries( void )
 {
@@ -1457,6 +1598,9 @@ _res_cache_get_max_entries( void )
     if (cache_mode == NULL || strcmp(cache_mode, "local") != 0) {
         // Don't use the cache in local mode. This is used by the proxy itself.
         cache_size = 0;
+    } else {
+        cache_size = _res_cache_getenv_int("ANDROID_DNS_CACHE_SIZE", cache_size,
+                                           CONFIG_MAX_CACHE_SIZE);
     }
 
     XLOG("cache size: %d", cache_size);
@@ -1467,22 +1611,65 @@ static struct resolv_cache*
 _resolv_cache_create( void )
 {
     struct resolv_cache*  cache;
+    int                   nn, stripe_entries, num_buckets;
 
     cache = calloc(sizeof(*cache), 1);
-    if (cache) {
-        cache->max_entries = _res_cache_get_max_entries();
-        cache->entries = calloc(sizeof(*cache->entries), cache->max_entries);
-        if (cache->entries) {
-            cache->mru_list.mru_prev = cache->mru_list.mru_next = &cache->mru_list;
-            XLOG("%s: cache created\n", __FUNCTION__);
-        } else {
-            free(cache);
-            cache = NULL;
-        }
-    }
+    if (cache == NULL)
+        return NULL;
+
+    cache->max_entries  = _res_cache_get_max_entries();
+    cache->stale_ttl    = _res_cache_getenv_int("ANDROID_DNS_CACHE_STALE_TTL", 0,
+                                                CONFIG_MAX_STALE_TTL);
+    cache->negative_ttl = _res_cache_getenv_int("ANDROID_DNS_CACHE_NEGATIVE_TTL", 0,
+                                                CONFIG_MAX_NEGATIVE_TTL);
+    cache->num_stripes  = CONFIG_MAX_STRIPES;
+    while (cache->num_stripes > 1 &&
+           cache->max_entries / cache->num_stripes < CONFIG_MIN_STRIPE_ENTRIES) {
+        cache->num_stripes /= 2;
+    }
+    /* round up, so that the stripes can hold max_entries between them */
+    stripe_entries = (cache->max_entries + cache->num_stripes - 1) / cache->num_stripes;
+    num_buckets    = stripe_entries > 0 ? stripe_entries : 1;
+
+    cache->stripes = calloc(sizeof(*cache->stripes), cache->num_stripes);
+    cache->buckets = calloc(sizeof(*cache->buckets), cache->num_stripes * num_buckets);
+    if (cache->stripes == NULL || cache->buckets == NULL) {
+        free(cache->stripes);
+        free(cache->buckets);
+        free(cache);
+        return NULL;
+    }
+
+    for (nn = 0; nn < cache->num_stripes; nn++) {
+        CacheStripe*  stripe = &cache->stripes[nn];
+
+        pthread_mutex_init(&stripe->lock, NULL);
+        stripe->max_entries = stripe_entries;
+        stripe->buckets     = cache->buckets + nn * num_buckets;
+        stripe->num_buckets = num_buckets;
+        stripe->clock_list.clock_prev = stripe->clock_list.clock_next = &stripe->clock_list;
+        stripe->clock_hand  = &stripe->clock_list;
+    }
+    atomic_init(&cache->refs, 1);
+    XLOG("%s: cache created (%d stripes)\n", __FUNCTION__, cache->num_stripes);
     return cache;
 }
 
+/* called when the last reference to the cache is dropped */
+static void
+_resolv_cache_free( Cache*  cache )
+{
+    int  nn;
+
+    _cache_flush(cache);
+    for (nn = 0; nn < cache->num_stripes; nn++) {
+        pthread_mutex_destroy(&cache->stripes[nn].lock);
+    }
+    free(cache->buckets);
+    free(cache->stripes);
+    free(cache);
+}
+
 
 #if DEBUG
 static void
@@ -1497,14 +1684,14 @@ _dump_query( const uint8_t*  query, int  querylen )
 }
 
 static void
-_cache_dump_mru( Cache*  cache )
+_cache_dump_clock( CacheStripe*  stripe )
 {
     char    temp[512], *p=temp, *end=p+sizeof(temp);
     Entry*  e;
 
-    p = _bprint(temp, end, "MRU LIST (%2d): ", cache->num_entries);
-    for (e = cache->mru_list.mru_next; e != &cache->mru_list; e = e->mru_next)
-        p = _bprint(p, end, " %d", e->id);
+    p = _bprint(temp, end, "CLOCK LIST (%2d): ", stripe->num_entries);
+    for (e = stripe->clock_list.clock_next; e != &stripe->clock_list; e = e->clock_next)
+        p = _bprint(p, end, " %d%s", e->id, e == stripe->clock_hand ? "*" : "");
 
     XLOG("%s", temp);
 }
@@ -1552,7 +1739,7 @@ _dump_answer(const void* answer, int answerlen)
 #  define  XLOG_ANSWER(a,len)  ((void)0)
 #endif
 
-/* This function tries to find a key within the hash table
+/* This function tries to find a key within the stripe's hash table
  * In case of success, it will return a *pointer* to the hashed key.
  * In case of failure, it will return a *pointer* to NULL
  *
@@ -1567,11 +1754,13 @@ _dump_answer(const void* answer, int answerlen)
  * table.
  */
 static Entry**
-_cache_lookup_p( Cache*   cache,
-                 Entry*   key )
+_cache_lookup_p( Cache*        cache,
+                 CacheStripe*  stripe,
+                 Entry*        key )
 {
-    int      index = key->hash % cache->max_entries;
-    Entry**  pnode = (Entry**) &cache->entries[ index ];
+    /* the low bits of the hash were used to pick the stripe */
+    int      index = (key->hash / cache->num_stripes) % stripe->num_buckets;
+    Entry**  pnode = &stripe->buckets[ index ];
 
     while (*pnode != NULL) {
         Entry*  node = *pnode;
@@ -1593,17 +1782,18 @@ _cache_lookup_p( Cache*   cache,
  * newly created entry
  */
 static void
-_cache_add_p( Cache*   cache,
-              Entry**  lookup,
-              Entry*   e )
+_cache_add_p( CacheStripe*  stripe,
+              Entry**       lookup,
+              Entry*        e )
 {
     *lookup = e;
-    e->id = ++cache->last_id;
-    entry_mru_add(e, &cache->mru_list);
-    cache->num_entries += 1;
+    e->id = ++stripe->last_id;
+    /* the new entry is the last one the hand will come back to */
+    entry_clock_insert(e, stripe->clock_hand);
+    stripe->num_entries += 1;
 
     XLOG("%s: entry %d added (count=%d)", __FUNCTION__,
-         e->id, cache->num_entries);
+         e->id, stripe->num_entries);
 }
 
 /* Remove an existing entry from the hash table,
@@ -1611,58 +1801,59 @@ _cache_add_p( Cache*   cache,
  * and succesful _lookup_p() call.
  */
 static void
-_cache_remove_p( Cache*   cache,
-                 Entry**  lookup )
+_cache_remove_p( CacheStripe*  stripe,
+                 Entry**       lookup )
 {
     Entry*  e  = *lookup;
 
     XLOG("%s: entry %d removed (count=%d)", __FUNCTION__,
-         e->id, cache->num_entries-1);
+         e->id, stripe->num_entries-1);
 
-    entry_mru_remove(e);
+    if (stripe->clock_hand == e) {
+        stripe->clock_hand = e->clock_next;
+    }
+    entry_clock_remove(e);
     *lookup = e->hlink;
     entry_free(e);
-    cache->num_entries -= 1;
+    stripe->num_entries -= 1;
 }
 
-/* Remove the oldest entry from the hash table.
+/* Remove one entry from the stripe to make room for another: the first one
+ * the hand finds expired, or not used since the hand last went past it.
  */
 static void
-_cache_remove_oldest( Cache*  cache )
+_cache_remove_one( Cache*        cache,
+                   CacheStripe*  stripe )
 {
-    Entry*   oldest = cache->mru_list.mru_prev;
-    Entry**  lookup = _cache_lookup_p(cache, oldest);
+    time_t  now = _time_now();
 
-    if (*lookup == NULL) { /* should not happen */
-        XLOG("%s: OLDEST NOT IN HTABLE ?", __FUNCTION__);
-        return;
-    }
-    if (DEBUG) {
-        XLOG("Cache full - removing oldest");
-        XLOG_QUERY(oldest->query, oldest->querylen);
-    }
-    _cache_remove_p(cache, lookup);
-}
+    while (stripe->num_entries > 0) {
+        Entry*   e = stripe->clock_hand;
+        Entry**  lookup;
 
-/* Remove all expired entries from the hash table.
- */
-static void _cache_remove_expired(Cache* cache) {
-    Entry* e;
-    time_t now = _time_now();
-
-    for (e = cache->mru_list.mru_next; e != &cache->mru_list;) {
-        // Entry is old, remove
-        if (now >= e->expires) {
-            Entry** lookup = _cache_lookup_p(cache, e);
-            if (*lookup == NULL) { /* should not happen */
-                XLOG("%s: ENTRY NOT IN HTABLE ?", __FUNCTION__);
-                return;
-            }
-            e = e->mru_next;
-            _cache_remove_p(cache, lookup);
-        } else {
-            e = e->mru_next;
+        if (e == &stripe->clock_list) {
+            stripe->clock_hand = e->clock_next;
+            continue;
         }
+        if (e->referenced && now < e->expires) {
+            /* give it a second chance */
+            e->referenced = 0;
+            stripe->clock_hand = e->clock_next;
+            continue;
+        }
+
+        lookup = _cache_lookup_p(cache, stripe, e);
+        if (*lookup == NULL) { /* should not happen */
+            XLOG("%s: VICTIM NOT IN HTABLE ?", __FUNCTION__);
+            return;
+        }
+        if (DEBUG) {
+            XLOG("Cache full - removing %s entry",
+                 now >= e->expires ? "expired" : "unreferenced");
+            XLOG_QUERY(e->query, e->querylen);
+        }
+        _cache_remove_p(stripe, lookup);
+        return;
     }
 }
 
@@ -1674,11 +1865,12 @@ _resolv_cache_lookup( unsigned              netid,
                       int                   answersize,
                       int                  *answerlen )
 {
-    Entry      key[1];
-    Entry**    lookup;
-    Entry*     e;
-    time_t     now;
-    Cache*     cache;
+    Entry         key[1];
+    Entry**       lookup;
+    Entry*        e;
+    time_t        now;
+    Cache*        cache;
+    CacheStripe*  stripe;
 
     ResolvCacheStatus  result = RESOLV_CACHE_NOTFOUND;
 
@@ -1691,29 +1883,27 @@ _resolv_cache_lookup( unsigned              netid,
         return RESOLV_CACHE_UNSUPPORTED;
     }
     /* lookup cache */
-    pthread_once(&_res_cache_once, _res_cache_init);
-    pthread_mutex_lock(&_res_cache_list_lock);
-
-    cache = _find_named_cache_locked(netid);
+    cache = _cache_get_for_net(netid);
     if (cache == NULL) {
-        result = RESOLV_CACHE_UNSUPPORTED;
-        goto Exit;
+        return RESOLV_CACHE_UNSUPPORTED;
     }
+    stripe = _cache_get_stripe(cache, key->hash);
+    pthread_mutex_lock(&stripe->lock);
 
     /* see the description of _lookup_p to understand this.
      * the function always return a non-NULL pointer.
      */
-    lookup = _cache_lookup_p(cache, key);
+    lookup = _cache_lookup_p(cache, stripe, key);
     e      = *lookup;
 
     if (e == NULL) {
         XLOG( "NOT IN CACHE");
         // calling thread will wait if an outstanding request is found
         // that matching this query
-        if (!_cache_check_pending_request_locked(&cache, key, netid) || cache == NULL) {
+        if (!_cache_check_pending_request_locked(stripe, key)) {
             goto Exit;
         } else {
-            lookup = _cache_lookup_p(cache, key);
+            lookup = _cache_lookup_p(cache, stripe, key);
             e = *lookup;
             if (e == NULL) {
                 goto Exit;
@@ -1723,11 +1913,11 @@ _resolv_cache_lookup( unsigned              netid,
 
     now = _time_now();
 
-    /* remove stale entries here */
-    if (now >= e->expires) {
+    /* remove stale entries here, unless we can still serve them */
+    if (now >= e->expires + cache->stale_ttl) {
         XLOG( " NOT IN CACHE (STALE ENTRY %p DISCARDED)", *lookup );
         XLOG_QUERY(e->query, e->querylen);
-        _cache_remove_p(cache, lookup);
+        _cache_remove_p(stripe, lookup);
         goto Exit;
     }
 
@@ -1741,17 +1931,22 @@ _resolv_cache_lookup( unsigned              netid,
 
     memcpy( answer, e->answer, e->answerlen );
 
-    /* bump up this entry to the top of the MRU list */
-    if (e != cache->mru_list.mru_next) {
-        entry_mru_remove( e );
-        entry_mru_add( e, &cache->mru_list );
-    }
+    /* keep this entry for another sweep of the CLOCK hand */
+    e->referenced = 1;
 
-    XLOG( "FOUND IN CACHE entry=%p", e );
     result = RESOLV_CACHE_FOUND;
+    if (now >= e->expires && !e->refreshing) {
+        /* the first client to see the stale entry refreshes it */
+        XLOG( "STALE IN CACHE entry=%p", e );
+        e->refreshing = 1;
+        result = RESOLV_CACHE_STALE;
+    } else {
+        XLOG( "FOUND IN CACHE entry=%p", e );
+    }
 
 Exit:
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_mutex_unlock(&stripe->lock);
+    _cache_put(cache);
     return result;
 }
 
@@ -1763,11 +1958,12 @@ _resolv_cache_add( unsigned              netid,
                    const void*           answer,
                    int                   answerlen )
 {
-    Entry    key[1];
-    Entry*   e;
-    Entry**  lookup;
-    u_long   ttl;
-    Cache*   cache = NULL;
+    Entry         key[1];
+    Entry*        e;
+    Entry**       lookup;
+    u_long        ttl;
+    Cache*        cache;
+    CacheStripe*  stripe;
 
     /* don't assume that the query has already been cached
      */
@@ -1776,12 +1972,12 @@ _resolv_cache_add( unsigned              netid,
         return;
     }
 
-    pthread_mutex_lock(&_res_cache_list_lock);
-
-    cache = _find_named_cache_locked(netid);
+    cache = _cache_get_for_net(netid);
     if (cache == NULL) {
-        goto Exit;
+        return;
     }
+    stripe = _cache_get_stripe(cache, key->hash);
+    pthread_mutex_lock(&stripe->lock);
 
     XLOG( "%s: query:", __FUNCTION__ );
     XLOG_QUERY(query,querylen);
@@ -1791,22 +1987,29 @@ _resolv_cache_add( unsigned              netid,
     XLOG_BYTES(answer,answerlen);
 #endif
 
-    lookup = _cache_lookup_p(cache, key);
+    lookup = _cache_lookup_p(cache, stripe, key);
     e      = *lookup;
 
+    if (e != NULL && _time_now() >= e->expires) {
+        /* this refreshes an answer we served stale */
+        _cache_remove_p(stripe, lookup);
+        e = NULL;
+    }
+
     if (e != NULL) { /* should not happen */
         XLOG("%s: ALREADY IN CACHE (%p) ? IGNORING ADD",
              __FUNCTION__, e);
         goto Exit;
     }
 
-    if (cache->num_entries >= cache->max_entries) {
-        _cache_remove_expired(cache);
-        if (cache->num_entries >= cache->max_entries) {
-            _cache_remove_oldest(cache);
-        }
+    if (stripe->max_entries == 0) {
+        goto Exit;
+    }
+
+    if (stripe->num_entries >= stripe->max_entries) {
+        _cache_remove_one(cache, stripe);
         /* need to lookup again */
-        lookup = _cache_lookup_p(cache, key);
+        lookup = _cache_lookup_p(cache, stripe, key);
         e      = *lookup;
         if (e != NULL) {
             XLOG("%s: ALREADY IN CACHE (%p) ? IGNORING ADD",
@@ -1815,22 +2018,21 @@ _resolv_cache_add( unsigned              netid,
         }
     }
 
-    ttl = answer_getTTL(answer, answerlen);
+    ttl = answer_getTTL(answer, answerlen, cache->negative_ttl);
     if (ttl > 0) {
         e = entry_alloc(key, answer, answerlen);
         if (e != NULL) {
             e->expires = ttl + _time_now();
-            _cache_add_p(cache, lookup, e);
+            _cache_add_p(stripe, lookup, e);
         }
     }
 #if DEBUG
-    _cache_dump_mru(cache);
+    _cache_dump_clock(stripe);
 #endif
 Exit:
-    if (cache != NULL) {
-      _cache_notify_waiting_tid_locked(cache, key);
-    }
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    _cache_notify_waiting_tid_locked(stripe, key);
+    pthread_mutex_unlock(&stripe->lock);
+    _cache_put(cache);
 }
 
 /****************************************************************************/
@@ -1867,7 +2069,7 @@ static void
 _res_cache_init(void)
 {
     memset(&_res_cache_list, 0, sizeof(_res_cache_list));
-    pthread_mutex_init(&_res_cache_list_lock, NULL);
+    pthread_rwlock_init(&_res_cache_list_lock, NULL);
 }
 
 static struct resolv_cache*
@@ -1894,11 +2096,11 @@ void
 _resolv_flush_cache_for_net(unsigned netid)
 {
     pthread_once(&_res_cache_once, _res_cache_init);
-    pthread_mutex_lock(&_res_cache_list_lock);
+    pthread_rwlock_wrlock(&_res_cache_list_lock);
 
     _flush_cache_for_net_locked(netid);
 
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_rwlock_unlock(&_res_cache_list_lock);
 }
 
 static void
@@ -1906,7 +2108,7 @@ _flush_cache_for_net_locked(unsigned netid)
 {
     struct resolv_cache* cache = _find_named_cache_locked(netid);
     if (cache) {
-        _cache_flush_locked(cache);
+        _cache_flush(cache);
     }
 
     // Also clear the NS statistics.
@@ -1917,7 +2119,7 @@ _flush_cache_for_net_locked(unsigned netid)
 void _resolv_delete_cache_for_net(unsigned netid)
 {
     pthread_once(&_res_cache_once, _res_cache_init);
-    pthread_mutex_lock(&_res_cache_list_lock);
+    pthread_rwlock_wrlock(&_res_cache_list_lock);
 
     struct resolv_cache_info* prev_cache_info = &_res_cache_list;
 
@@ -1926,9 +2128,10 @@ void _resolv_delete_cache_for_net(unsigned netid)
 
         if (cache_info->netid == netid) {
             prev_cache_info->next = cache_info->next;
-            _cache_flush_locked(cache_info->cache);
-            free(cache_info->cache->entries);
-            free(cache_info->cache);
+            // Wake up anyone waiting on a pending request now. The memory
+            // goes away when the last thread using the cache lets go of it.
+            _cache_flush(cache_info->cache);
+            _cache_put(cache_info->cache);
             _free_nameservers_locked(cache_info);
             free(cache_info);
             break;
@@ -1937,7 +2140,7 @@ void _resolv_delete_cache_for_net(unsigned netid)
         prev_cache_info = prev_cache_info->next;
     }
 
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_rwlock_unlock(&_res_cache_list_lock);
 }
 
 static struct resolv_cache_info*
@@ -1994,10 +2197,51 @@ _resolv_set_default_params(struct __res_params* params) {
     params->base_timeout_msec = 0;  // 0 = legacy algorithm
 }
 
+/* Splits a nameserver into its address and port. Netd only ever passes an
+ * address (IPv4, or IPv6 with an optional %scope), which gets
+ * NAMESERVER_PORT as before. "ipv4:port", "[ipv6]" and "[ipv6]:port" let a
+ * nameserver run on an unprivileged port, as the tests' stub server does.
+ * Returns -1 if the string is malformed or doesn't fit. */
+static int
+_resolv_split_nameserver(const char* server, char* host, size_t host_size,
+                         char* port, size_t port_size)
+{
+    const char* colon = strchr(server, ':');
+    size_t host_len;
+
+    if (server[0] == '[') {
+        const char* end = strchr(server, ']');
+        if (end == NULL || (end[1] != ':' && end[1] != '\0')) {
+            return -1;
+        }
+        server++;
+        host_len = end - server;
+        colon = (end[1] == ':') ? end + 1 : NULL;
+    } else if (colon == NULL || strchr(colon + 1, ':') != NULL) {
+        /* no port, and perhaps an IPv6 address */
+        host_len = strlen(server);
+        colon = NULL;
+    } else {
+        host_len = colon - server;
+    }
+    if (host_len == 0 || host_len >= host_size) {
+        return -1;
+    }
+    if (colon == NULL) {
+        snprintf(port, port_size, "%u", NAMESERVER_PORT);
+    } else if (colon[1] == '\0' || strlcpy(port, colon + 1, port_size) >= port_size) {
+        return -1;
+    }
+    memcpy(host, server, host_len);
+    host[host_len] = '\0';
+    return 0;
+}
+
 int
 _resolv_set_nameservers_for_net(unsigned netid, const char** servers, unsigned numservers,
         const char *domains, const struct __res_params* params)
 {
+    char hbuf[NI_MAXHOST];
     char sbuf[NI_MAXSERV];
     register char *cp;
     int *offset;
@@ -2013,12 +2257,14 @@ _resolv_set_nameservers_for_net(unsigned netid, const char** servers, unsigned n
     struct addrinfo hints = {
         .ai_family = AF_UNSPEC,
         .ai_socktype = SOCK_DGRAM,
-        .ai_flags = AI_NUMERICHOST
+        .ai_flags = AI_NUMERICHOST | AI_NUMERICSERV
     };
-    snprintf(sbuf, sizeof(sbuf), "%u", NAMESERVER_PORT);
     for (unsigned i = 0; i < numservers; i++) {
         // The addrinfo structures allocated here are freed in _free_nameservers_locked().
-        int rt = getaddrinfo(servers[i], sbuf, &hints, &nsaddrinfo[i]);
+        int rt = EAI_NONAME;
+        if (_resolv_split_nameserver(servers[i], hbuf, sizeof(hbuf), sbuf, sizeof(sbuf)) == 0) {
+            rt = getaddrinfo(hbuf, sbuf, &hints, &nsaddrinfo[i]);
+        }
         if (rt != 0) {
             for (unsigned j = 0 ; j < i ; j++) {
                 freeaddrinfo(nsaddrinfo[j]);
@@ -2030,7 +2276,7 @@ _resolv_set_nameservers_for_net(unsigned netid, const char** servers, unsigned n
     }
 
     pthread_once(&_res_cache_once, _res_cache_init);
-    pthread_mutex_lock(&_res_cache_list_lock);
+    pthread_rwlock_wrlock(&_res_cache_list_lock);
 
     // creates the cache if not created
     _get_res_cache_for_net_locked(netid);
@@ -2107,7 +2353,7 @@ _resolv_set_nameservers_for_net(unsigned netid, const char** servers, unsigned n
         *offset = -1; /* cache_info->dnsrch_offset has MAXDNSRCH+1 items */
     }
 
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_rwlock_unlock(&_res_cache_list_lock);
     return 0;
 }
 
@@ -2166,7 +2412,7 @@ _resolv_populate_res_for_net(res_state statp)
     }
 
     pthread_once(&_res_cache_once, _res_cache_init);
-    pthread_mutex_lock(&_res_cache_list_lock);
+    pthread_rwlock_rdlock(&_res_cache_list_lock);
 
     struct resolv_cache_info* info = _find_cache_info_locked(statp->netid);
     if (info != NULL) {
@@ -2207,7 +2453,7 @@ _resolv_populate_res_for_net(res_state statp)
             *pp++ = &statp->defdname[0] + *p++;
         }
     }
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_rwlock_unlock(&_res_cache_list_lock);
 }
 
 /* Resolver reachability statistics. */
@@ -2242,12 +2488,12 @@ android_net_res_stats_get_info_for_net(unsigned netid, int* nscount,
         struct sockaddr_storage servers[MAXNS], int* dcount, char domains[MAXDNSRCH][MAXDNSRCHPATH],
         struct __res_params* params, struct __res_stats stats[MAXNS]) {
     int revision_id = -1;
-    pthread_mutex_lock(&_res_cache_list_lock);
+    pthread_rwlock_rdlock(&_res_cache_list_lock);
 
     struct resolv_cache_info* info = _find_cache_info_locked(netid);
     if (info) {
         if (info->nscount > MAXNS) {
-            pthread_mutex_unlock(&_res_cache_list_lock);
+            pthread_rwlock_unlock(&_res_cache_list_lock);
             XLOG("%s: nscount %d > MAXNS %d", __FUNCTION__, info->nscount, MAXNS);
             errno = EFAULT;
             return -1;
@@ -2261,19 +2507,19 @@ android_net_res_stats_get_info_for_net(unsigned netid, int* nscount,
             int addrlen = info->nsaddrinfo[i]->ai_addrlen;
             if (addrlen < (int) sizeof(struct sockaddr) ||
                     addrlen > (int) sizeof(servers[0])) {
-                pthread_mutex_unlock(&_res_cache_list_lock);
+                pthread_rwlock_unlock(&_res_cache_list_lock);
                 XLOG("%s: nsaddrinfo[%d].ai_addrlen == %d", __FUNCTION__, i, addrlen);
                 errno = EMSGSIZE;
                 return -1;
             }
             if (info->nsaddrinfo[i]->ai_addr == NULL) {
-                pthread_mutex_unlock(&_res_cache_list_lock);
+                pthread_rwlock_unlock(&_res_cache_list_lock);
                 XLOG("%s: nsaddrinfo[%d].ai_addr == NULL", __FUNCTION__, i);
                 errno = ENOENT;
                 return -1;
             }
             if (info->nsaddrinfo[i]->ai_next != NULL) {
-                pthread_mutex_unlock(&_res_cache_list_lock);
+                pthread_rwlock_unlock(&_res_cache_list_lock);
                 XLOG("%s: nsaddrinfo[%d].ai_next != NULL", __FUNCTION__, i);
                 errno = ENOTUNIQ;
                 return -1;
@@ -2301,7 +2547,7 @@ android_net_res_stats_get_info_for_net(unsigned netid, int* nscount,
         revision_id = info->revision_id;
     }
 
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_rwlock_unlock(&_res_cache_list_lock);
     return revision_id;
 }
 
@@ -2309,7 +2555,7 @@ int
 _resolv_cache_get_resolver_stats( unsigned netid, struct __res_params* params,
         struct __res_stats stats[MAXNS]) {
     int revision_id = -1;
-    pthread_mutex_lock(&_res_cache_list_lock);
+    pthread_rwlock_rdlock(&_res_cache_list_lock);
 
     struct resolv_cache_info* info = _find_cache_info_locked(netid);
     if (info) {
@@ -2318,7 +2564,7 @@ _resolv_cache_get_resolver_stats( unsigned netid, struct __res_params* params,
         revision_id = info->revision_id;
     }
 
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_rwlock_unlock(&_res_cache_list_lock);
     return revision_id;
 }
 
@@ -2327,7 +2573,7 @@ _resolv_cache_add_resolver_stats_sample( unsigned netid, int revision_id, int ns
        const struct __res_sample* sample, int max_samples) {
     if (max_samples <= 0) return;
 
-    pthread_mutex_lock(&_res_cache_list_lock);
+    pthread_rwlock_wrlock(&_res_cache_list_lock);
 
     struct resolv_cache_info* info = _find_cache_info_locked(netid);
 
@@ -2335,5 +2581,5 @@ _resolv_cache_add_resolver_stats_sample( unsigned netid, int revision_id, int ns
         _res_cache_add_stats_sample_locked(&info->nsstats[ns], sample, max_samples);
     }
 
-    pthread_mutex_unlock(&_res_cache_list_lock);
+    pthread_rwlock_unlock(&_res_cache_list_lock);
 }
@@ -98,6 +98,7 @@ __RCSID("$NetBSD: res_send.c,v 1.9 2006/01/24 17:41:25 christos Exp $");
 #include <fcntl.h>
 #include <netdb.h>
 #include <poll.h>
+#include <pthread.h>
 #ifdef ANDROID_CHANGES
 #include "resolv_netid.h"
 #include "resolv_private.h"
@@ -142,6 +143,17 @@ static int		send_vc(res_state, struct __res_params *params, const u_char *, int,
 				u_char *, int, int *, int, time_t *, int *, int *);
 static int		send_dg(res_state, struct __res_params *params, const u_char *, int,
 				u_char *, int, int *, int, int *, int *, time_t *, int *, int *);
+static int		dg_socket(res_state, const struct sockaddr *, int, int *, int *);
+struct sendq_state;
+static int		send_dg_multi(res_state, struct __res_params *params,
+				struct res_sendq *, struct sendq_state *, int, int *, int,
+				int *, time_t *);
+static void		res_nsend_prepare(res_state);
+static void		res_refresh_stale(res_state, const u_char *, int);
+static int		vc_pool_get(struct sockaddr *, unsigned);
+static void		vc_pool_put(res_state, struct sockaddr *);
+static int		res_nsend_servers(res_state, const u_char *, int, u_char *, int,
+				ResolvCacheStatus, int);
 static void		Aerror(const res_state, FILE *, const char *, int,
 			       const struct sockaddr *, int);
 static void		Perror(const res_state, FILE *, const char *, int);
@@ -351,8 +363,6 @@ int
 res_nsend(res_state statp,
 	  const u_char *buf, int buflen, u_char *ans, int anssiz)
 {
-	int gotsomewhere, terrno, try, v_circuit, resplen, ns, n;
-	char abuf[NI_MAXHOST];
 	ResolvCacheStatus     cache_status = RESOLV_CACHE_UNSUPPORTED;
 
 	if (anssiz < HFIXEDSZ) {
@@ -361,9 +371,6 @@ res_nsend(res_state statp,
 	}
 	DprintQ((statp->options & RES_DEBUG) || (statp->pfcode & RES_PRF_QUERY),
 		(stdout, ";; res_send()\n"), buf, buflen);
-	v_circuit = (statp->options & RES_USEVC) || buflen > PACKETSZ;
-	gotsomewhere = 0;
-	terrno = ETIMEDOUT;
 
 	int  anslen = 0;
 	cache_status = _resolv_cache_lookup(
@@ -372,6 +379,9 @@ res_nsend(res_state statp,
 
 	if (cache_status == RESOLV_CACHE_FOUND) {
 		return anslen;
+	} else if (cache_status == RESOLV_CACHE_STALE) {
+		res_refresh_stale(statp, buf, buflen);
+		return anslen;
 	} else if (cache_status != RESOLV_CACHE_UNSUPPORTED) {
 		// had a cache miss for a known network, so populate the thread private
 		// data so the normal resolve path can do its thing
@@ -386,6 +396,96 @@ res_nsend(res_state statp,
 		return (-1);
 	}
 
+	res_nsend_prepare(statp);
+	return (res_nsend_servers(statp, buf, buflen, ans, anssiz, cache_status,
+	    (statp->options & RES_USEVC) || buflen > PACKETSZ));
+}
+
+/*
+ * The cache served an expired answer; ask the nameservers again on a
+ * thread of our own, so the caller doesn't wait for the refresh.
+ */
+struct stale_refresh {
+	unsigned	netid;
+	unsigned	mark;
+	res_send_qhook	qhook;
+	u_long		options;
+	int		buflen;
+	u_char		buf[];
+};
+
+static void *
+res_refresh_stale_thread(void *arg)
+{
+	struct stale_refresh *r = arg;
+	res_state statp;
+	u_char *ans;
+
+	statp = __res_get_state();
+	ans = malloc(NS_MAXMSG);
+	if (statp == NULL || ans == NULL) {
+		_resolv_cache_query_failed(r->netid, r->buf, r->buflen);
+		goto done;
+	}
+	statp->netid = r->netid;
+	statp->_mark = r->mark;
+	statp->qhook = r->qhook;
+	statp->options |= r->options & (RES_USEVC | RES_USE_EDNS0 | RES_USE_DNSSEC);
+	_resolv_populate_res_for_net(statp);
+	if (statp->nscount == 0) {
+		/* See res_nsend(). */
+		_resolv_cache_query_failed(r->netid, r->buf, r->buflen);
+		goto done;
+	}
+	res_nsend_prepare(statp);
+	/* This adds the answer to the cache, or reports the failure. */
+	(void)res_nsend_servers(statp, r->buf, r->buflen, ans, NS_MAXMSG,
+	    RESOLV_CACHE_NOTFOUND,
+	    (statp->options & RES_USEVC) || r->buflen > PACKETSZ);
+ done:
+	if (statp != NULL)
+		__res_put_state(statp);
+	free(ans);
+	free(r);
+	return (NULL);
+}
+
+static void
+res_refresh_stale(res_state statp, const u_char *buf, int buflen)
+{
+	struct stale_refresh *r;
+	pthread_attr_t attr;
+	pthread_t t;
+	int error;
+
+	r = malloc(sizeof(*r) + buflen);
+	if (r == NULL) {
+		_resolv_cache_query_failed(statp->netid, buf, buflen);
+		return;
+	}
+	r->netid = statp->netid;
+	r->mark = statp->_mark;
+	r->qhook = statp->qhook;
+	r->options = statp->options;
+	r->buflen = buflen;
+	memcpy(r->buf, buf, buflen);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	error = pthread_create(&t, &attr, res_refresh_stale_thread, r);
+	pthread_attr_destroy(&attr);
+	if (error != 0) {
+		/* Let the next lookup try the refresh. */
+		_resolv_cache_query_failed(r->netid, r->buf, r->buflen);
+		free(r);
+	}
+}
+
+static void
+res_nsend_prepare(res_state statp)
+{
+	int ns;
+
 	/*
 	 * If the ns_addr_list in the resolver context has changed, then
 	 * invalidate our cached copy and the associated timing data.
@@ -473,6 +573,22 @@ res_nsend(res_state statp,
 		EXT(statp).nssocks[lastns] = fd;
 		EXT(statp).nstimes[lastns] = nstime;
 	}
+}
+
+/*
+ * Sends the query to each usable nameserver in turn, RETRY times, or until
+ * one of them answers.  The caller has already looked the query up in the
+ * cache; cache_status says whether to add the answer to it.
+ */
+static int
+res_nsend_servers(res_state statp, const u_char *buf, int buflen, u_char *ans,
+	int anssiz, ResolvCacheStatus cache_status, int v_circuit)
+{
+	int gotsomewhere, terrno, try, resplen, ns, n;
+	char abuf[NI_MAXHOST];
+
+	gotsomewhere = 0;
+	terrno = ETIMEDOUT;
 
 	/*
 	 * Send request, RETRY times, or until successful.
@@ -619,10 +735,13 @@ res_nsend(res_state statp,
 		/*
 		 * If we have temporarily opened a virtual circuit,
 		 * or if we haven't been asked to keep a socket open,
-		 * close the socket.
+		 * close the socket.  A virtual circuit goes back to
+		 * the pool for the next query to this server.
 		 */
 		if ((v_circuit && (statp->options & RES_USEVC) == 0U) ||
 		    (statp->options & RES_STAYOPEN) == 0U) {
+			if (v_circuit)
+				vc_pool_put(statp, get_nsaddr(statp, (size_t)ns));
 			res_nclose(statp);
 		}
 		if (statp->rhook) {
@@ -677,6 +796,213 @@ res_nsend(res_state statp,
 	return (-1);
 }
 
+/* Per-query state for res_nsendmulti(). */
+struct sendq_state {
+	ResolvCacheStatus	cache_status;
+	int	state;		/* SQ_DONE, SQ_DG or SQ_SERIAL */
+	int	v_circuit;	/* for SQ_SERIAL: go straight to TCP */
+	int	sent;		/* sent to the current nameserver */
+	int	replied;	/* the current nameserver replied */
+	int	rcode;
+	int	delay;
+};
+
+#define	SQ_DONE		0	/* answered, or failed for good */
+#define	SQ_DG		1	/* sent to every nameserver at once */
+#define	SQ_SERIAL	2	/* sent on its own by res_nsend_servers() */
+
+/* Orders queries by their question section, ignoring the header. */
+static int
+sendq_cmp(const struct res_sendq *a, const struct res_sendq *b)
+{
+	int alen = a->buflen - HFIXEDSZ, blen = b->buflen - HFIXEDSZ;
+	int n;
+
+	if (alen <= 0 || blen <= 0)
+		return (alen - blen);
+	n = memcmp(a->buf + HFIXEDSZ, b->buf + HFIXEDSZ,
+	    (size_t)(alen < blen ? alen : blen));
+	return (n != 0 ? n : alen - blen);
+}
+
+/*
+ * Sends several queries at once, such as the AAAA and A queries for one
+ * getaddrinfo() call.  Each nameserver is sent every query that is still
+ * unanswered, and the replies are collected from a single socket, so the
+ * lookup costs one round trip instead of one per query.  Truncated answers
+ * are then retried over TCP one query at a time, as is everything when the
+ * resolver uses virtual circuits or hooks.
+ *
+ * Fills in resplen, and error if there was no answer, for every query.
+ * Returns the number of queries that were answered, or -1 if there was
+ * nothing to send or no memory to track the queries with.
+ */
+int
+res_nsendmulti(res_state statp, struct res_sendq *q, int nq)
+{
+	struct sendq_state *st;
+	int *order;
+	int gotsomewhere, terrno, try, ns, i, j, n, waiting, answered;
+	int populated;
+
+	if (nq <= 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+	st = calloc((size_t)nq, sizeof(*st) + sizeof(*order));
+	if (st == NULL)
+		return (-1);
+	order = (int *)(void *)(st + nq);
+
+	/*
+	 * Look the queries up in the same order whoever is asking.  A cache
+	 * miss makes other threads asking the same question wait for our
+	 * answer, so two threads that each waited on a query the other had
+	 * already missed would stall until the pending request timed out.
+	 */
+	for (i = 0; i < nq; i++) {
+		for (j = i; j > 0 && sendq_cmp(&q[order[j - 1]], &q[i]) > 0; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	waiting = 0;
+	populated = 0;
+	for (j = 0; j < nq; j++) {
+		int anslen = 0;
+
+		i = order[j];
+		q[i].resplen = -1;
+		q[i].error = 0;
+		st[i].state = SQ_DONE;
+		if (q[i].anssiz < HFIXEDSZ) {
+			q[i].error = EINVAL;
+			continue;
+		}
+		DprintQ((statp->options & RES_DEBUG) ||
+			(statp->pfcode & RES_PRF_QUERY),
+			(stdout, ";; res_send()\n"), q[i].buf, q[i].buflen);
+		st[i].cache_status = _resolv_cache_lookup(statp->netid,
+		    q[i].buf, q[i].buflen, q[i].ans, q[i].anssiz, &anslen);
+		if (st[i].cache_status == RESOLV_CACHE_STALE) {
+			res_refresh_stale(statp, q[i].buf, q[i].buflen);
+			st[i].cache_status = RESOLV_CACHE_FOUND;
+		}
+		if (st[i].cache_status == RESOLV_CACHE_FOUND) {
+			q[i].resplen = anslen;
+			continue;
+		}
+		if (st[i].cache_status != RESOLV_CACHE_UNSUPPORTED &&
+		    !populated) {
+			_resolv_populate_res_for_net(statp);
+			populated = 1;
+		}
+		st[i].v_circuit = (statp->options & RES_USEVC) ||
+		    q[i].buflen > PACKETSZ;
+		/* The hooks only know how to deal with one query at a time. */
+		if (st[i].v_circuit || statp->qhook || statp->rhook)
+			st[i].state = SQ_SERIAL;
+		else
+			st[i].state = SQ_DG;
+		waiting++;
+	}
+	if (waiting == 0)
+		goto done;
+	if (statp->nscount == 0) {
+		/* See res_nsend(). */
+		for (i = 0; i < nq; i++) {
+			if (st[i].state == SQ_DONE)
+				continue;
+			_resolv_cache_query_failed(statp->netid, q[i].buf,
+			    q[i].buflen);
+			q[i].error = ESRCH;
+		}
+		goto done;
+	}
+	res_nsend_prepare(statp);
+
+	gotsomewhere = 0;
+	terrno = ETIMEDOUT;
+	for (waiting = 0, i = 0; i < nq; i++)
+		waiting += (st[i].state == SQ_DG);
+	for (try = 0; try < statp->retry && waiting > 0; try++) {
+	    struct __res_stats stats[MAXNS];
+	    struct __res_params params;
+	    int revision_id = _resolv_cache_get_resolver_stats(statp->netid, &params, stats);
+	    bool usable_servers[MAXNS];
+	    android_net_res_stats_get_usable_servers(&params, stats, statp->nscount,
+		    usable_servers);
+
+	    for (ns = 0; ns < statp->nscount && waiting > 0; ns++) {
+		time_t now = 0;
+
+		if (!usable_servers[ns]) continue;
+		statp->_flags &= ~RES_F_LASTMASK;
+		statp->_flags |= (ns << RES_F_LASTSHIFT);
+
+		n = send_dg_multi(statp, &params, q, st, nq, &terrno, ns,
+		    &gotsomewhere, &now);
+		if (n < 0) {
+			for (i = 0; i < nq; i++) {
+				if (st[i].state != SQ_DG)
+					continue;
+				_resolv_cache_query_failed(statp->netid,
+				    q[i].buf, q[i].buflen);
+				q[i].error = terrno;
+				st[i].state = SQ_DONE;
+			}
+			waiting = 0;
+			break;
+		}
+		waiting = 0;
+		for (i = 0; i < nq; i++) {
+			if (!st[i].sent)
+				continue;
+			/* Only record stats the first time we try a query. See res_nsend_servers(). */
+			if (try == 0) {
+				struct __res_sample sample;
+				_res_stats_set_sample(&sample, now, st[i].rcode, st[i].delay);
+				_resolv_cache_add_resolver_stats_sample(statp->netid, revision_id,
+					ns, &sample, params.max_samples);
+			}
+			if (st[i].state == SQ_DG) {
+				waiting++;
+			} else if (st[i].state == SQ_DONE &&
+			    st[i].cache_status == RESOLV_CACHE_NOTFOUND) {
+				_resolv_cache_add(statp->netid, q[i].buf,
+				    q[i].buflen, q[i].ans, q[i].resplen);
+			}
+		}
+	    } /*foreach ns*/
+	} /*foreach retry*/
+
+	for (i = 0; i < nq; i++) {
+		if (st[i].state != SQ_DG)
+			continue;
+		/* No nameserver gave a usable answer; see res_nsend_servers(). */
+		_resolv_cache_query_failed(statp->netid, q[i].buf, q[i].buflen);
+		q[i].error = gotsomewhere ? ETIMEDOUT : ECONNREFUSED;
+		st[i].state = SQ_DONE;
+	}
+	for (i = 0; i < nq; i++) {
+		if (st[i].state != SQ_SERIAL)
+			continue;
+		n = res_nsend_servers(statp, q[i].buf, q[i].buflen, q[i].ans,
+		    q[i].anssiz, st[i].cache_status, st[i].v_circuit);
+		if (n < 0)
+			q[i].error = errno;
+		else
+			q[i].resplen = n;
+	}
+
+ done:
+	answered = 0;
+	for (i = 0; i < nq; i++)
+		answered += (q[i].resplen >= 0);
+	free(st);
+	return (answered);
+}
+
 /* Private */
 
 static int
@@ -749,6 +1075,130 @@ static struct timespec get_timeout(const res_state statp, const struct __res_par
 	return result;
 }
 
+/*
+ * Idle TCP connections to nameservers, shared by every thread in the
+ * process.  Answers that are too big for UDP are retried over TCP, and
+ * without these each retry would pay for a new handshake.  A thread takes
+ * a connection out of the pool for the whole exchange, so requests on a
+ * connection never interleave, and puts it back when the answer is read.
+ */
+#define VC_POOL_SIZE	8	/* idle connections kept, for all servers */
+#define VC_POOL_IDLE	30	/* seconds before an idle connection is closed */
+
+struct vc_pool_entry {
+	int			sock;		/* -1 if the slot is empty */
+	unsigned		mark;
+	time_t			idle_since;
+	struct sockaddr_storage	peer;
+};
+
+static pthread_mutex_t vc_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct vc_pool_entry vc_pool[VC_POOL_SIZE];
+static pid_t vc_pool_pid;	/* the pool is empty if this isn't getpid() */
+
+static void
+vc_pool_check_locked(void)
+{
+	pid_t pid = getpid();
+	int i;
+
+	if (vc_pool_pid == pid)
+		return;
+	/*
+	 * This is a new child: the connections are shared with our parent,
+	 * so drop our copies of them.
+	 */
+	for (i = 0; i < VC_POOL_SIZE; i++) {
+		if (vc_pool_pid != 0 && vc_pool[i].sock >= 0)
+			(void) close(vc_pool[i].sock);
+		vc_pool[i].sock = -1;
+	}
+	vc_pool_pid = pid;
+}
+
+/*
+ * Returns an idle connection to nsap that was set up with mark, or -1.
+ */
+static int
+vc_pool_get(struct sockaddr *nsap, unsigned mark)
+{
+	time_t now = time(NULL);
+	struct pollfd pfd;
+	int i, sock = -1;
+
+	pthread_mutex_lock(&vc_pool_lock);
+	vc_pool_check_locked();
+	for (i = 0; i < VC_POOL_SIZE; i++) {
+		struct vc_pool_entry *e = &vc_pool[i];
+
+		if (e->sock < 0)
+			continue;
+		if (now - e->idle_since >= VC_POOL_IDLE) {
+			(void) close(e->sock);
+			e->sock = -1;
+			continue;
+		}
+		if (sock < 0 && e->mark == mark &&
+		    sock_eq((struct sockaddr *)(void *)&e->peer, nsap)) {
+			sock = e->sock;
+			e->sock = -1;
+		}
+	}
+	pthread_mutex_unlock(&vc_pool_lock);
+
+	/*
+	 * An idle connection has nothing to read, unless the server has
+	 * closed it.
+	 */
+	if (sock >= 0) {
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 0) != 0) {
+			(void) close(sock);
+			sock = -1;
+		}
+	}
+	return (sock);
+}
+
+/*
+ * Moves statp's virtual circuit to nsap into the pool, replacing the
+ * connection that has been idle the longest if the pool is full.
+ */
+static void
+vc_pool_put(res_state statp, struct sockaddr *nsap)
+{
+	struct vc_pool_entry *e = NULL;
+	int i, victim = -1;
+
+	if (statp->_vcsock < 0 || (statp->_flags & RES_F_VC) == 0)
+		return;
+
+	pthread_mutex_lock(&vc_pool_lock);
+	vc_pool_check_locked();
+	for (i = 0; i < VC_POOL_SIZE; i++) {
+		if (vc_pool[i].sock < 0) {
+			e = &vc_pool[i];
+			break;
+		}
+		if (e == NULL || vc_pool[i].idle_since < e->idle_since)
+			e = &vc_pool[i];
+	}
+	victim = e->sock;
+	e->sock = statp->_vcsock;
+	e->mark = statp->_mark;
+	e->idle_since = time(NULL);
+	memset(&e->peer, 0, sizeof(e->peer));
+	memcpy(&e->peer, nsap, (size_t)get_salen(nsap));
+	pthread_mutex_unlock(&vc_pool_lock);
+
+	if (victim >= 0)
+		(void) close(victim);
+	statp->_vcsock = -1;
+	statp->_flags &= ~(RES_F_VC | RES_F_CONN);
+}
+
 static int
 send_vc(res_state statp, struct __res_params* params,
 	const u_char *buf, int buflen, u_char *ans, int anssiz,
@@ -761,7 +1211,7 @@ send_vc(res_state statp, struct __res_params* params,
 	HEADER *anhp = (HEADER *)(void *)ans;
 	struct sockaddr *nsap;
 	int nsaplen;
-	int truncating, connreset, resplen, n;
+	int truncating, connreset, pooled, resplen, n;
 	struct iovec iov[2];
 	u_short len;
 	u_char *cp;
@@ -777,6 +1227,7 @@ send_vc(res_state statp, struct __res_params* params,
 	connreset = 0;
  same_ns:
 	truncating = 0;
+	pooled = 0;
 
 	struct timespec now = evNowTime();
 
@@ -796,6 +1247,15 @@ send_vc(res_state statp, struct __res_params* params,
 		}
 	}
 
+	/* Reuse an idle connection to this server if there is one. */
+	if (statp->_vcsock < 0 && !connreset) {
+		statp->_vcsock = vc_pool_get(nsap, statp->_mark);
+		if (statp->_vcsock >= 0) {
+			statp->_flags |= RES_F_VC;
+			pooled = 1;
+		}
+	}
+
 	if (statp->_vcsock < 0 || (statp->_flags & RES_F_VC) == 0) {
 		if (statp->_vcsock >= 0)
 			res_nclose(statp);
@@ -864,6 +1324,11 @@ send_vc(res_state statp, struct __res_params* params,
 		*terrno = errno;
 		Perror(statp, stderr, "write failed", errno);
 		res_nclose(statp);
+		/* The server may have closed an idle connection; try a new one. */
+		if (pooled && !connreset) {
+			connreset = 1;
+			goto same_ns;
+		}
 		return (0);
 	}
 	/*
@@ -888,9 +1353,10 @@ send_vc(res_state statp, struct __res_params* params,
 		 * trying a new one.  When there is only one
 		 * server, this means that a query might work
 		 * instead of failing.  We only allow one reset
-		 * per query to prevent looping.
+		 * per query to prevent looping.  The same goes for
+		 * a connection that was idle in the pool.
 		 */
-		if (*terrno == ECONNRESET && !connreset) {
+		if ((*terrno == ECONNRESET || pooled) && !connreset) {
 			connreset = 1;
 			res_nclose(statp);
 			goto same_ns;
@@ -945,6 +1411,9 @@ send_vc(res_state statp, struct __res_params* params,
 			else
 				break;
 		}
+		/* Don't keep a connection that is out of step. */
+		if (len != 0)
+			res_nclose(statp);
 		// return size should never exceed container size
 		resplen = anssiz;
 	}
@@ -1065,6 +1534,71 @@ retry:
 	return n;
 }
 
+/*
+ * Opens a datagram socket for talking to the nameserver at nsap, and stores
+ * it in *sp.  Returns 1 on success, 0 if the next nameserver should be tried,
+ * or -1 on a fatal error.
+ */
+static int
+dg_socket(res_state statp, const struct sockaddr *nsap, int nsaplen,
+	int *terrno, int *sp)
+{
+	int s;
+
+	s = socket(nsap->sa_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (s < 0) {
+		switch (errno) {
+		case EPROTONOSUPPORT:
+#ifdef EPFNOSUPPORT
+		case EPFNOSUPPORT:
+#endif
+		case EAFNOSUPPORT:
+			Perror(statp, stderr, "socket(dg)", errno);
+			return (0);
+		default:
+			*terrno = errno;
+			Perror(statp, stderr, "socket(dg)", errno);
+			return (-1);
+		}
+	}
+
+	fchown(s, AID_DNS, -1);
+	if (statp->_mark != MARK_UNSET) {
+		if (setsockopt(s, SOL_SOCKET,
+				SO_MARK, &(statp->_mark), sizeof(statp->_mark)) < 0) {
+			close(s);
+			return -1;
+		}
+	}
+#ifndef CANNOT_CONNECT_DGRAM
+	/*
+	 * On a 4.3BSD+ machine (client and server,
+	 * actually), sending to a nameserver datagram
+	 * port with no nameserver will cause an
+	 * ICMP port unreachable message to be returned.
+	 * If our datagram socket is "connected" to the
+	 * server, we get an ECONNREFUSED error on the next
+	 * socket operation, and select returns if the
+	 * error message is received.  We can thus detect
+	 * the absence of a nameserver without timing out.
+	 */
+	if (random_bind(s, nsap->sa_family) < 0) {
+		Aerror(statp, stderr, "bind(dg)", errno, nsap,
+		    nsaplen);
+		close(s);
+		return (0);
+	}
+	if (__connect(s, nsap, (socklen_t)nsaplen) < 0) {
+		Aerror(statp, stderr, "connect(dg)", errno, nsap,
+		    nsaplen);
+		close(s);
+		return (0);
+	}
+#endif /* !CANNOT_CONNECT_DGRAM */
+	*sp = s;
+	return (1);
+}
+
 static int
 send_dg(res_state statp, struct __res_params* params,
 	const u_char *buf, int buflen, u_char *ans, int anssiz,
@@ -1086,56 +1620,11 @@ send_dg(res_state statp, struct __res_params* params,
 	nsap = get_nsaddr(statp, (size_t)ns);
 	nsaplen = get_salen(nsap);
 	if (EXT(statp).nssocks[ns] == -1) {
-		EXT(statp).nssocks[ns] = socket(nsap->sa_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
-		if (EXT(statp).nssocks[ns] < 0) {
-			switch (errno) {
-			case EPROTONOSUPPORT:
-#ifdef EPFNOSUPPORT
-			case EPFNOSUPPORT:
-#endif
-			case EAFNOSUPPORT:
-				Perror(statp, stderr, "socket(dg)", errno);
-				return (0);
-			default:
-				*terrno = errno;
-				Perror(statp, stderr, "socket(dg)", errno);
-				return (-1);
-			}
-		}
-
-		fchown(EXT(statp).nssocks[ns], AID_DNS, -1);
-		if (statp->_mark != MARK_UNSET) {
-			if (setsockopt(EXT(statp).nssocks[ns], SOL_SOCKET,
-					SO_MARK, &(statp->_mark), sizeof(statp->_mark)) < 0) {
-				res_nclose(statp);
-				return -1;
-			}
-		}
-#ifndef CANNOT_CONNECT_DGRAM
-		/*
-		 * On a 4.3BSD+ machine (client and server,
-		 * actually), sending to a nameserver datagram
-		 * port with no nameserver will cause an
-		 * ICMP port unreachable message to be returned.
-		 * If our datagram socket is "connected" to the
-		 * server, we get an ECONNREFUSED error on the next
-		 * socket operation, and select returns if the
-		 * error message is received.  We can thus detect
-		 * the absence of a nameserver without timing out.
-		 */
-		if (random_bind(EXT(statp).nssocks[ns], nsap->sa_family) < 0) {
-			Aerror(statp, stderr, "bind(dg)", errno, nsap,
-			    nsaplen);
+		n = dg_socket(statp, nsap, nsaplen, terrno, &EXT(statp).nssocks[ns]);
+		if (n <= 0) {
 			res_nclose(statp);
-			return (0);
+			return (n);
 		}
-		if (__connect(EXT(statp).nssocks[ns], nsap, (socklen_t)nsaplen) < 0) {
-			Aerror(statp, stderr, "connect(dg)", errno, nsap,
-			    nsaplen);
-			res_nclose(statp);
-			return (0);
-		}
-#endif /* !CANNOT_CONNECT_DGRAM */
 		Dprint(statp->options & RES_DEBUG,
 		       (stdout, ";; new DG socket\n"))
 
@@ -1288,6 +1777,172 @@ retry:
 	return (resplen);
 }
 
+/*
+ * Sends every query in state SQ_DG to nameserver ns over one datagram
+ * socket, then collects replies until each query has one or the timeout
+ * expires.  A query that gets a final answer moves to SQ_DONE, and one that
+ * gets a truncated answer moves to SQ_SERIAL so it can be retried over TCP.
+ * Returns -1 on a fatal error, or 0.
+ */
+static int
+send_dg_multi(res_state statp, struct __res_params *params,
+	struct res_sendq *q, struct sendq_state *st, int nq, int *terrno,
+	int ns, int *gotsomewhere, time_t *at)
+{
+	const struct sockaddr *nsap;
+	struct timespec now, timeout, finish, done;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	u_char hdr[HFIXEDSZ];
+	HEADER *anhp;
+	int i, j, n, s, nsaplen, resplen, waiting;
+
+	*at = time(NULL);
+	for (i = 0; i < nq; i++) {
+		st[i].sent = (st[i].state == SQ_DG);
+		st[i].replied = 0;
+		st[i].rcode = RCODE_INTERNAL_ERROR;
+		st[i].delay = 0;
+	}
+
+	nsap = get_nsaddr(statp, (size_t)ns);
+	nsaplen = get_salen(nsap);
+	n = dg_socket(statp, nsap, nsaplen, terrno, &s);
+	if (n <= 0)
+		return (n);
+	waiting = 0;
+	for (i = 0; i < nq; i++) {
+		if (!st[i].sent)
+			continue;
+		if (send(s, (const char*)q[i].buf, (size_t)q[i].buflen, 0) !=
+		    q[i].buflen) {
+			Perror(statp, stderr, "send", errno);
+			close(s);
+			return (0);
+		}
+		waiting++;
+	}
+
+	/*
+	 * Wait for replies.
+	 */
+	timeout = get_timeout(statp, params, ns);
+	now = evNowTime();
+	finish = evAddTime(now, timeout);
+	while (waiting > 0) {
+		n = retrying_poll(s, POLLIN, &finish);
+		if (n == 0) {
+			Dprint(statp->options & RES_DEBUG, (stdout, ";; timeout\n"));
+			*gotsomewhere = 1;
+			for (i = 0; i < nq; i++) {
+				if (st[i].sent && !st[i].replied)
+					st[i].rcode = RCODE_TIMEOUT;
+			}
+			break;
+		}
+		if (n < 0) {
+			Perror(statp, stderr, "poll", errno);
+			break;
+		}
+
+		/*
+		 * Peek at the header to find out which query this answers,
+		 * so that it can be received straight into its buffer.
+		 */
+		n = recv(s, hdr, sizeof(hdr), MSG_PEEK);
+		if (n <= 0) {
+			Perror(statp, stderr, "recvfrom", errno);
+			break;
+		}
+		*gotsomewhere = 1;
+		anhp = (HEADER *)(void *)hdr;
+		for (i = 0; i < nq; i++) {
+			if (st[i].sent && !st[i].replied &&
+			    ((const HEADER *)(const void *)q[i].buf)->id == anhp->id)
+				break;
+		}
+		if (n < HFIXEDSZ || i == nq) {
+			/*
+			 * Undersized, or a response to an old query.
+			 * Discard it.
+			 */
+			(void)recv(s, hdr, sizeof(hdr), 0);
+			continue;
+		}
+		fromlen = sizeof(from);
+		resplen = recvfrom(s, (char*)q[i].ans, (size_t)q[i].anssiz, 0,
+				   (struct sockaddr *)(void *)&from, &fromlen);
+		if (resplen <= 0) {
+			Perror(statp, stderr, "recvfrom", errno);
+			break;
+		}
+		if (!(statp->options & RES_INSECURE1) &&
+		    !res_ourserver_p(statp, (struct sockaddr *)(void *)&from)) {
+			/* Response from the wrong server?  Ignore it. */
+			continue;
+		}
+		anhp = (HEADER *)(void *)q[i].ans;
+#ifdef RES_USE_EDNS0
+		if (anhp->rcode == FORMERR && (statp->options & RES_USE_EDNS0) != 0U) {
+			/* See send_dg(). */
+			statp->_flags |= RES_F_EDNS0ERR;
+			st[i].replied = 1;
+			waiting--;
+			continue;
+		}
+#endif
+		/*
+		 * IDs are random, so two queries can share one.  The reply
+		 * answers the first unreplied query with its ID that also
+		 * asked its question; it was received into the buffer of the
+		 * first with its ID, so move it if that was another.
+		 */
+		for (j = i; j < nq; j++) {
+			if (!st[j].sent || st[j].replied ||
+			    ((const HEADER *)(const void *)q[j].buf)->id != anhp->id)
+				continue;
+			if ((statp->options & RES_INSECURE2) ||
+			    res_queriesmatch(q[j].buf, q[j].buf + q[j].buflen,
+					     q[i].ans, q[i].ans + resplen))
+				break;
+		}
+		if (j == nq) {
+			/* Response contains the wrong query?  Ignore it. */
+			continue;
+		}
+		if (j != i) {
+			if (resplen > q[j].anssiz)
+				resplen = q[j].anssiz;
+			memcpy(q[j].ans, q[i].ans, (size_t)resplen);
+			i = j;
+			anhp = (HEADER *)(void *)q[i].ans;
+		}
+		done = evNowTime();
+		st[i].delay = _res_stats_calculate_rtt(&done, &now);
+		st[i].replied = 1;
+		waiting--;
+		if ((anhp->rcode == SERVFAIL ||
+		     anhp->rcode == NOTIMP ||
+		     anhp->rcode == REFUSED) && !statp->pfcode) {
+			/* Try the next nameserver. */
+			st[i].rcode = anhp->rcode;
+			continue;
+		}
+		if (!(statp->options & RES_IGNTC) && anhp->tc) {
+			Dprint(statp->options & RES_DEBUG,
+			       (stdout, ";; truncated answer\n"));
+			st[i].state = SQ_SERIAL;
+			st[i].v_circuit = 1;
+			continue;
+		}
+		st[i].rcode = anhp->rcode;
+		st[i].state = SQ_DONE;
+		q[i].resplen = resplen;
+	}
+	close(s);
+	return (0);
+}
+
 static void
 Aerror(const res_state statp, FILE *file, const char *string, int error,
        const struct sockaddr *address, int alen)
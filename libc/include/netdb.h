@@ -202,6 +202,68 @@ __BEGIN_DECLS
 int getaddrinfo(const char* _Nullable __node, const char* _Nullable __service, const struct addrinfo* _Nullable __hints, struct addrinfo* _Nullable * _Nonnull __result);
 void freeaddrinfo(struct addrinfo* _Nullable __ptr);
 
+/**
+ * A request for android_getaddrinfo_batch() or android_getaddrinfo_batch_start().
+ * The caller fills in the first three fields, which have the same meaning as
+ * getaddrinfo()'s arguments. `error` is set to 0 or an `EAI_*` error, and on
+ * success `result` is set to a list that the caller frees with freeaddrinfo().
+ */
+struct android_getaddrinfo_request {
+  const char* _Nullable hostname;
+  const char* _Nullable servname;
+  const struct addrinfo* _Nullable hints;
+  int error;
+  struct addrinfo* _Nullable result;
+};
+
+/** A batch started by android_getaddrinfo_batch_start(). */
+struct android_getaddrinfo_batch;
+
+/**
+ * android_getaddrinfo_batch() resolves the `__n` requests in `__requests`,
+ * and returns when they are all done. The DNS queries for all of the requests
+ * are sent at once rather than one after the other, so resolving many names
+ * takes about one round trip instead of one per name. Each request gets the
+ * result or error that getaddrinfo() would give it.
+ *
+ * Available since API level 37.
+ */
+
+#if __BIONIC_AVAILABILITY_GUARD(37)
+void android_getaddrinfo_batch(struct android_getaddrinfo_request* _Nullable __requests, size_t __n) __INTRODUCED_IN(37);
+
+/**
+ * android_getaddrinfo_batch_start() runs android_getaddrinfo_batch() on a
+ * thread of its own, for callers with an event loop. The requests must not be
+ * touched until the batch's fd (see android_getaddrinfo_batch_fd()) becomes
+ * readable, or until android_getaddrinfo_batch_finish() returns.
+ *
+ * Returns the batch on success, and returns NULL and sets `errno` on failure.
+ *
+ * Available since API level 37.
+ */
+struct android_getaddrinfo_batch* _Nullable android_getaddrinfo_batch_start(struct android_getaddrinfo_request* _Nullable __requests, size_t __n) __INTRODUCED_IN(37);
+
+/**
+ * android_getaddrinfo_batch_fd() returns a file descriptor that becomes
+ * readable when all of the batch's requests are done. The file descriptor
+ * belongs to the batch: don't read from it or close it.
+ *
+ * Available since API level 37.
+ */
+int android_getaddrinfo_batch_fd(const struct android_getaddrinfo_batch* _Nonnull __batch) __INTRODUCED_IN(37);
+
+/**
+ * android_getaddrinfo_batch_finish() waits for all of the batch's requests
+ * to be done, if they aren't already, and frees the batch. Every batch must
+ * be finished exactly once, and the results are the caller's to free.
+ *
+ * Available since API level 37.
+ */
+void android_getaddrinfo_batch_finish(struct android_getaddrinfo_batch* _Nonnull __batch) __INTRODUCED_IN(37);
+#endif /* __BIONIC_AVAILABILITY_GUARD(37) */
+
+
 /* Android ABI error: POSIX getnameinfo(3) uses socklen_t rather than size_t. */
 int getnameinfo(const struct sockaddr* _Nonnull __sa, socklen_t __sa_length, char* _Nullable __host, size_t __host_length, char* _Nullable __service, size_t __service_length, int __flags);
 const char* _Nonnull gai_strerror(int __error);
@@ -67,6 +67,14 @@ enum {
 enum {
   PTHREAD_RWLOCK_PREFER_READER_NP = 0,
   PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP = 1,
+  /*
+   * Like PTHREAD_RWLOCK_PREFER_READER_NP, but readers on different CPUs
+   * don't contend with each other, at the cost of slower writers. For
+   * read-mostly locks. Ignored for process-shared locks.
+   * pthread_rwlockattr_setkind_np() returns EINVAL for this kind
+   * before API level 37.
+   */
+  PTHREAD_RWLOCK_SCALABLE_READER_NP = 2,
 };
 
 #define PTHREAD_ONCE_INIT 0
@@ -45,6 +45,19 @@ typedef struct {
 
 #define SEM_FAILED __BIONIC_CAST(reinterpret_cast, sem_t*, 0)
 
+/**
+ * android_sem_post_n() increments the semaphore `__sem` by `__n`, waking up to `__n` waiters.
+ * This is equivalent to calling sem_post() `__n` times, but with a single wake up.
+ *
+ * Returns 0 on success, and returns -1 and sets `errno` to EOVERFLOW if the value would exceed
+ * SEM_VALUE_MAX, in which case the value is unchanged.
+ *
+ * Available since API level 37.
+ */
+
+#if __BIONIC_AVAILABILITY_GUARD(37)
+int android_sem_post_n(sem_t* _Nonnull __sem, unsigned int __n) __INTRODUCED_IN(37);
+#endif /* __BIONIC_AVAILABILITY_GUARD(37) */
 
 #if __BIONIC_AVAILABILITY_GUARD(30)
 int sem_clockwait(sem_t* _Nonnull __sem, clockid_t __clock, const struct timespec* _Nonnull __ts) __INTRODUCED_IN(30);
@@ -68,6 +81,22 @@ int sem_timedwait(sem_t* _Nonnull __sem, const struct timespec* _Nonnull __ts);
 int sem_timedwait_monotonic_np(sem_t* _Nonnull __sem, const struct timespec* _Nonnull __ts) __INTRODUCED_IN(28);
 #endif /* __BIONIC_AVAILABILITY_GUARD(28) */
 
+/**
+ * sem_clockwait_any_np() decrements whichever of the `__count` semaphores in `__sems` becomes
+ * available first, waiting until the absolute time `__ts` on `__clock` (CLOCK_MONOTONIC or
+ * CLOCK_REALTIME), or forever if `__ts` is null. If several are available, the one with the lowest
+ * index is taken. At most 128 semaphores can be waited on at once.
+ *
+ * Returns the index of the semaphore that was decremented, and returns -1 and sets `errno` on
+ * failure (ETIMEDOUT, EINTR, or EINVAL).
+ *
+ * Available since API level 37.
+ */
+
+#if __BIONIC_AVAILABILITY_GUARD(37)
+int sem_clockwait_any_np(sem_t* _Nonnull const* _Nonnull __sems, size_t __count, clockid_t __clock, const struct timespec* _Nullable __ts) __INTRODUCED_IN(37);
+#endif /* __BIONIC_AVAILABILITY_GUARD(37) */
+
 int sem_trywait(sem_t* _Nonnull __sem);
 int sem_wait(sem_t* _Nonnull __sem);
 
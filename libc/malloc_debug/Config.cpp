@@ -58,6 +58,9 @@ static constexpr size_t DEFAULT_BACKTRACE_FRAMES = 16;
 static constexpr size_t MAX_BACKTRACE_FRAMES = 256;
 static constexpr const char DEFAULT_BACKTRACE_DUMP_PREFIX[] = "/data/local/tmp/backtrace_heap";
 
+static constexpr size_t DEFAULT_BACKTRACE_SAMPLE_RATE = 4096;
+static constexpr size_t MAX_BACKTRACE_SAMPLE_RATE = 64 * 1024 * 1024;
+
 static constexpr size_t DEFAULT_EXPAND_BYTES = 16;
 static constexpr size_t MAX_EXPAND_BYTES = 16384;
 
@@ -68,6 +71,11 @@ static constexpr size_t DEFAULT_RECORD_ALLOCS = 8000000;
 static constexpr size_t MAX_RECORD_ALLOCS = 50000000;
 static constexpr const char DEFAULT_RECORD_ALLOCS_FILE[] = "/data/local/tmp/record_allocs.txt";
 
+static constexpr size_t DEFAULT_RECORD_ALLOCS_RING_ENTRIES = 4096;
+static constexpr size_t MAX_RECORD_ALLOCS_RING_ENTRIES = 1048576;
+static constexpr size_t DEFAULT_RECORD_ALLOCS_RING_THREADS = 64;
+static constexpr size_t MAX_RECORD_ALLOCS_RING_THREADS = 4096;
+
 const std::unordered_map<std::string, Config::OptionInfo> Config::kOptions = {
     {
         "guard",
@@ -106,6 +114,14 @@ const std::unordered_map<std::string, Config::OptionInfo> Config::kOptions = {
         "bt_max_sz",
         {BACKTRACE_SPECIFIC_SIZES, &Config::SetBacktraceMaxSize},
     },
+    {
+        "backtrace_sample_rate",
+        {BACKTRACE_SAMPLED, &Config::SetBacktraceSampleRate},
+    },
+    {
+        "bt_smp_rate",
+        {BACKTRACE_SAMPLED, &Config::SetBacktraceSampleRate},
+    },
     {
         "backtrace",
         {BACKTRACE | TRACK_ALLOCS, &Config::SetBacktrace},
@@ -146,6 +162,14 @@ const std::unordered_map<std::string, Config::OptionInfo> Config::kOptions = {
         "bt_full",
         {BACKTRACE_FULL, &Config::VerifyValueEmpty},
     },
+    {
+        "backtrace_fp",
+        {BACKTRACE_FP, &Config::VerifyValueEmpty},
+    },
+    {
+        "bt_fp",
+        {BACKTRACE_FP, &Config::VerifyValueEmpty},
+    },
 
     {
         "fill",
@@ -191,6 +215,14 @@ const std::unordered_map<std::string, Config::OptionInfo> Config::kOptions = {
         "record_allocs_on_exit",
         {0, &Config::SetRecordAllocsOnExit},
     },
+    {
+        "record_allocs_ring",
+        {RECORD_ALLOCS | RECORD_ALLOCS_RING, &Config::SetRecordAllocsRing},
+    },
+    {
+        "record_allocs_ring_threads",
+        {0, &Config::SetRecordAllocsRingThreads},
+    },
 
     {
         "verify_pointers",
@@ -369,6 +401,11 @@ bool Config::SetBacktraceMaxSize(const std::string& option, const std::string& v
   return ParseValue(option, value, 1, SIZE_MAX, &backtrace_max_size_bytes_);
 }
 
+bool Config::SetBacktraceSampleRate(const std::string& option, const std::string& value) {
+  return ParseValue(option, value, DEFAULT_BACKTRACE_SAMPLE_RATE, 1, MAX_BACKTRACE_SAMPLE_RATE,
+                    &backtrace_sample_rate_);
+}
+
 bool Config::SetExpandAlloc(const std::string& option, const std::string& value) {
   return ParseValue(option, value, DEFAULT_EXPAND_BYTES, 1, MAX_EXPAND_BYTES, &expand_alloc_bytes_);
 }
@@ -417,6 +454,20 @@ bool Config::SetRecordAllocsOnExit(const std::string& option, const std::string&
   return false;
 }
 
+bool Config::SetRecordAllocsRing(const std::string& option, const std::string& value) {
+  if (record_allocs_file_.empty()) {
+    record_allocs_file_ = DEFAULT_RECORD_ALLOCS_FILE;
+  }
+  // In ring mode, the number of entries is per thread.
+  return ParseValue(option, value, DEFAULT_RECORD_ALLOCS_RING_ENTRIES, 1,
+                    MAX_RECORD_ALLOCS_RING_ENTRIES, &record_allocs_num_entries_);
+}
+
+bool Config::SetRecordAllocsRingThreads(const std::string& option, const std::string& value) {
+  return ParseValue(option, value, DEFAULT_RECORD_ALLOCS_RING_THREADS, 1,
+                    MAX_RECORD_ALLOCS_RING_THREADS, &record_allocs_ring_threads_);
+}
+
 bool Config::VerifyValueEmpty(const std::string& option, const std::string& value) {
   if (!value.empty()) {
     // This is not valid.
@@ -479,6 +530,7 @@ bool Config::Init(const char* options_str) {
   record_allocs_signal_ = SIGRTMAX - 18;
   free_track_backtrace_num_frames_ = 0;
   record_allocs_file_.clear();
+  record_allocs_ring_threads_ = DEFAULT_RECORD_ALLOCS_RING_THREADS;
   fill_on_free_bytes_ = 0;
   backtrace_enable_on_signal_ = false;
   backtrace_enabled_ = false;
@@ -50,6 +50,9 @@ constexpr uint64_t CHECK_UNREACHABLE_ON_SIGNAL = 0x2000;
 constexpr uint64_t BACKTRACE_SPECIFIC_SIZES = 0x4000;
 constexpr uint64_t LOG_ALLOCATOR_STATS_ON_SIGNAL = 0x8000;
 constexpr uint64_t LOG_ALLOCATOR_STATS_ON_EXIT = 0x10000;
+constexpr uint64_t RECORD_ALLOCS_RING = 0x20000;
+constexpr uint64_t BACKTRACE_SAMPLED = 0x40000;
+constexpr uint64_t BACKTRACE_FP = 0x80000;
 
 // In order to guarantee posix compliance, set the minimum alignment
 // to 8 bytes for 32 bit systems and 16 bytes for 64 bit systems.
@@ -95,11 +98,13 @@ class Config {
 
   size_t backtrace_min_size_bytes() const { return backtrace_min_size_bytes_; }
   size_t backtrace_max_size_bytes() const { return backtrace_max_size_bytes_; }
+  size_t backtrace_sample_rate() const { return backtrace_sample_rate_; }
 
   int record_allocs_signal() const { return record_allocs_signal_; }
   size_t record_allocs_num_entries() const { return record_allocs_num_entries_; }
   const std::string& record_allocs_file() const { return record_allocs_file_; }
   bool record_allocs_on_exit() const { return record_allocs_on_exit_; }
+  size_t record_allocs_ring_threads() const { return record_allocs_ring_threads_; }
 
   int check_unreachable_signal() const { return check_unreachable_signal_; }
 
@@ -133,6 +138,7 @@ class Config {
   bool SetBacktraceSize(const std::string& option, const std::string& value);
   bool SetBacktraceMinSize(const std::string& option, const std::string& value);
   bool SetBacktraceMaxSize(const std::string& option, const std::string& value);
+  bool SetBacktraceSampleRate(const std::string& option, const std::string& value);
 
   bool SetExpandAlloc(const std::string& option, const std::string& value);
 
@@ -142,6 +148,8 @@ class Config {
   bool SetRecordAllocs(const std::string& option, const std::string& value);
   bool SetRecordAllocsFile(const std::string& option, const std::string& value);
   bool SetRecordAllocsOnExit(const std::string& option, const std::string& value);
+  bool SetRecordAllocsRing(const std::string& option, const std::string& value);
+  bool SetRecordAllocsRingThreads(const std::string& option, const std::string& value);
 
   bool VerifyValueEmpty(const std::string& option, const std::string& value);
 
@@ -161,6 +169,7 @@ class Config {
   std::string backtrace_dump_prefix_;
   size_t backtrace_min_size_bytes_ = 0;
   size_t backtrace_max_size_bytes_ = 0;
+  size_t backtrace_sample_rate_ = 0;
 
   size_t fill_on_alloc_bytes_ = 0;
   size_t fill_on_free_bytes_ = 0;
@@ -174,6 +183,7 @@ class Config {
   size_t record_allocs_num_entries_ = 0;
   std::string record_allocs_file_;
   bool record_allocs_on_exit_ = false;
+  size_t record_allocs_ring_threads_ = 0;
 
   uint64_t options_ = 0;
   uint8_t fill_alloc_value_;
@@ -102,4 +102,7 @@ void DebugData::PostForkChild() {
   if (pointer != nullptr) {
     pointer->PostForkChild();
   }
+  if (record != nullptr) {
+    record->PostForkChild();
+  }
 }
@@ -29,6 +29,8 @@
 #include <cxxabi.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -49,6 +51,7 @@
 
 #include "Config.h"
 #include "DebugData.h"
+#include "Nanotime.h"
 #include "PointerData.h"
 #include "backtrace.h"
 #include "debug_log.h"
@@ -58,6 +61,9 @@
 std::atomic_uint8_t PointerData::backtrace_enabled_;
 std::atomic_bool PointerData::backtrace_dump_;
 
+size_t PointerData::sample_rate_;
+pthread_key_t PointerData::sample_key_;
+
 std::mutex PointerData::pointer_mutex_;
 std::unordered_map<uintptr_t, PointerInfoType> PointerData::pointers_ GUARDED_BY(
     PointerData::pointer_mutex_);
@@ -79,6 +85,9 @@ std::deque<FreePointerInfoType> PointerData::free_pointers_ GUARDED_BY(
 static constexpr size_t kCompareBufferSize = 512 * 1024;
 static std::vector<uint8_t> g_cmp_mem(0);
 
+// State for the random number generator used to pick sample intervals.
+static std::atomic_uint64_t g_sample_seed;
+
 static void ToggleBacktraceEnable(int, siginfo_t*, void*) {
   g_debug->pointer->ToggleBacktraceEnabled();
 }
@@ -89,6 +98,13 @@ static void EnableDump(int, siginfo_t*, void*) {
 
 PointerData::PointerData(DebugData* debug_data) : OptionData(debug_data) {}
 
+PointerData::~PointerData() {
+  if (sample_rate_ != 0) {
+    pthread_key_delete(sample_key_);
+    sample_rate_ = 0;
+  }
+}
+
 bool PointerData::Initialize(const Config& config) NO_THREAD_SAFETY_ANALYSIS {
   pointers_.clear();
   key_to_index_.clear();
@@ -129,6 +145,17 @@ bool PointerData::Initialize(const Config& config) NO_THREAD_SAFETY_ANALYSIS {
 
   backtrace_dump_ = false;
 
+  sample_rate_ = 0;
+  if ((config.options() & BACKTRACE_SAMPLED) && (config.options() & BACKTRACE)) {
+    int error = pthread_key_create(&sample_key_, nullptr);
+    if (error != 0) {
+      error_log("Unable to create backtrace sample key: %s", strerror(error));
+      return false;
+    }
+    sample_rate_ = config.backtrace_sample_rate();
+    g_sample_seed = Nanotime() ^ getpid();
+  }
+
   if (config.options() & FREE_TRACK) {
     g_cmp_mem.resize(kCompareBufferSize, config.fill_free_value());
   }
@@ -146,6 +173,64 @@ static inline bool ShouldBacktraceAllocSize(size_t size_bytes) {
   return size_bytes >= min_size_bytes && size_bytes <= max_size_bytes;
 }
 
+// splitmix64, which is good enough to pick sample intervals and is lock free.
+static uint64_t NextSampleRandom() {
+  constexpr uint64_t kGamma = 0x9e3779b97f4a7c15ULL;
+  uint64_t z = g_sample_seed.fetch_add(kGamma, std::memory_order_relaxed) + kGamma;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Returns the number of bytes until the next sample. The intervals are
+// exponentially distributed, so that every byte allocated has the same
+// 1/rate chance of being the one that is sampled.
+static intptr_t NextSampleInterval(size_t rate) {
+  // A uniform value in (0, 1].
+  double uniform = (static_cast<double>(NextSampleRandom() >> 11) + 1.0) * 0x1.0p-53;
+  double interval = -log(uniform) * rate;
+  if (interval < 1.0) {
+    return 1;
+  }
+  if (interval >= static_cast<double>(INTPTR_MAX)) {
+    return INTPTR_MAX;
+  }
+  return static_cast<intptr_t>(interval);
+}
+
+bool PointerData::ShouldSample(size_t size_bytes) {
+  // The countdown lives in the key's value rather than in memory the key
+  // points to, so the common case is a decrement and a branch. A value of
+  // zero means the thread has not allocated yet.
+  intptr_t remaining = reinterpret_cast<intptr_t>(pthread_getspecific(sample_key_));
+  if (remaining == 0) {
+    remaining = NextSampleInterval(sample_rate_);
+  }
+  if (static_cast<size_t>(remaining) > size_bytes) {
+    pthread_setspecific(sample_key_, reinterpret_cast<void*>(remaining - size_bytes));
+    return false;
+  }
+  // The process is memoryless, so starting a fresh interval after the
+  // sampled allocation doesn't bias the following samples.
+  pthread_setspecific(sample_key_, reinterpret_cast<void*>(NextSampleInterval(sample_rate_)));
+  return true;
+}
+
+size_t PointerData::ScaleSampledSize(size_t size_bytes) {
+  if (size_bytes == 0) {
+    return 0;
+  }
+  // An allocation of this size is sampled with probability
+  // 1 - e^(-size/rate), so dividing by that gives an unbiased estimate of
+  // the bytes that each sample stands for.
+  double probability = -expm1(-static_cast<double>(size_bytes) / sample_rate_);
+  double scaled = static_cast<double>(size_bytes) / probability;
+  if (scaled >= static_cast<double>(PointerInfoType::MaxSize())) {
+    return PointerInfoType::MaxSize();
+  }
+  return static_cast<size_t>(scaled + 0.5);
+}
+
 size_t PointerData::AddBacktrace(size_t num_frames, size_t size_bytes) {
   if (!ShouldBacktraceAllocSize(size_bytes)) {
     return kBacktraceEmptyIndex;
@@ -159,7 +244,11 @@ size_t PointerData::AddBacktrace(size_t num_frames, size_t size_bytes) {
     }
   } else {
     frames.resize(num_frames);
-    num_frames = backtrace_get(frames.data(), frames.size());
+    if (g_debug->config().options() & BACKTRACE_FP) {
+      num_frames = backtrace_get_fp(frames.data(), frames.size());
+    } else {
+      num_frames = backtrace_get(frames.data(), frames.size());
+    }
     if (num_frames == 0) {
       return kBacktraceEmptyIndex;
     }
@@ -210,6 +299,10 @@ void PointerData::RemoveBacktrace(size_t hash_index) {
 }
 
 void PointerData::Add(const void* ptr, size_t pointer_size) {
+  if (sample_rate_ != 0 && !ShouldSample(pointer_size)) {
+    return;
+  }
+
   size_t hash_index = 0;
   if (backtrace_enabled_) {
     hash_index = AddBacktrace(g_debug->config().backtrace_frames(), pointer_size);
@@ -228,6 +321,10 @@ void PointerData::Remove(const void* ptr) {
     uintptr_t mangled_ptr = ManglePointer(reinterpret_cast<uintptr_t>(ptr));
     auto entry = pointers_.find(mangled_ptr);
     if (entry == pointers_.end()) {
+      if (sample_rate_ != 0) {
+        // This allocation was not sampled.
+        return;
+      }
       // Attempt to remove unknown pointer.
       error_log("No tracked pointer found for 0x%" PRIxPTR, DemanglePointer(mangled_ptr));
       return;
@@ -477,6 +574,14 @@ void PointerData::GetUniqueList(std::vector<ListInfoType>* list, bool only_with_
     REQUIRES(pointer_mutex_, frame_mutex_) {
   GetList(list, only_with_backtrace);
 
+  if (sample_rate_ != 0) {
+    // Report the bytes each sampled allocation represents. The scaling only
+    // depends on the size, so the list stays sorted.
+    for (auto& info : *list) {
+      info.size = ScaleSampledSize(info.size);
+    }
+  }
+
   // Remove duplicates of size/backtraces.
   for (auto iter = list->begin(); iter != list->end();) {
     auto dup_iter = iter + 1;
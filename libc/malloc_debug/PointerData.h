@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -116,7 +117,7 @@ struct ListInfoType {
 class PointerData : public OptionData {
  public:
   explicit PointerData(DebugData* debug_data);
-  virtual ~PointerData() = default;
+  virtual ~PointerData();
 
   bool Initialize(const Config& config);
 
@@ -143,6 +144,10 @@ class PointerData : public OptionData {
   static void Add(const void* pointer, size_t size);
   static void Remove(const void* pointer);
 
+  // True when only a sample of the allocations is tracked, so a pointer
+  // missing from the table is not an error.
+  static bool Sampling() { return sample_rate_ != 0; }
+
   static void* AddFreed(const void* pointer, size_t size_bytes);
   static void LogFreeError(const FreePointerInfoType& info, size_t usable_size);
   static void LogFreeBacktrace(const void* ptr);
@@ -170,6 +175,9 @@ class PointerData : public OptionData {
   static std::string GetHashString(uintptr_t* frames, size_t num_frames);
   static void LogBacktrace(size_t hash_index);
 
+  static bool ShouldSample(size_t size_bytes);
+  static size_t ScaleSampledSize(size_t size_bytes);
+
   static void GetList(std::vector<ListInfoType>* list, bool only_with_backtrace);
   static void GetUniqueList(std::vector<ListInfoType>* list, bool only_with_backtrace);
 
@@ -180,6 +188,12 @@ class PointerData : public OptionData {
 
   static std::atomic_bool backtrace_dump_;
 
+  // The mean number of bytes between sampled allocations, or zero if every
+  // allocation is tracked.
+  static size_t sample_rate_;
+  // Holds the number of bytes left until the thread takes its next sample.
+  static pthread_key_t sample_key_;
+
   static std::mutex pointer_mutex_;
   static std::unordered_map<uintptr_t, PointerInfoType> pointers_;
 
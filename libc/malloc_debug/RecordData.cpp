@@ -52,8 +52,24 @@ struct ThreadData {
 
   RecordData* record_data = nullptr;
   size_t count = 0;
+
+  // Only used by record_allocs_ring. The entry is filled in by the caller
+  // and then copied into the thread's ring by CommitEntry.
+  memory_trace::Entry entry;
+  size_t ring = RecordRing::kNoRing;
+  uint64_t ring_generation = 0;
 };
 
+static void WriteToRing(RecordRing* ring, ThreadData* thread_data,
+                        const memory_trace::Entry& entry) {
+  if (thread_data->ring == RecordRing::kNoRing ||
+      thread_data->ring_generation != ring->generation()) {
+    thread_data->ring = ring->Acquire(gettid());
+    thread_data->ring_generation = ring->generation();
+  }
+  ring->Write(thread_data->ring, entry);
+}
+
 void RecordData::ThreadKeyDelete(void* data) {
   ThreadData* thread_data = reinterpret_cast<ThreadData*>(data);
 
@@ -63,10 +79,19 @@ void RecordData::ThreadKeyDelete(void* data) {
   if (thread_data->count == 4) {
     ScopedDisableDebugCalls disable;
 
-    memory_trace::Entry* entry = thread_data->record_data->InternalReserveEntry();
-    if (entry != nullptr) {
-      *entry = memory_trace::Entry{
-          .tid = gettid(), .type = memory_trace::THREAD_DONE, .end_ns = Nanotime()};
+    const memory_trace::Entry done_entry{
+        .tid = gettid(), .type = memory_trace::THREAD_DONE, .end_ns = Nanotime()};
+    RecordRing* ring = thread_data->record_data->ring_.get();
+    if (ring != nullptr) {
+      WriteToRing(ring, thread_data, done_entry);
+      if (thread_data->ring_generation == ring->generation()) {
+        ring->Release(thread_data->ring);
+      }
+    } else {
+      memory_trace::Entry* entry = thread_data->record_data->InternalReserveEntry();
+      if (entry != nullptr) {
+        *entry = done_entry;
+      }
     }
     delete thread_data;
   } else {
@@ -95,8 +120,31 @@ void RecordData::WriteEntries() {
   WriteEntries(file_);
 }
 
+bool RecordData::WriteRingEntry(const memory_trace::Entry& entry, void* arg) {
+  if (entry.type == memory_trace::UNKNOWN) {
+    return true;
+  }
+  if (!memory_trace::WriteEntryToFd(*reinterpret_cast<int*>(arg), entry)) {
+    error_log("Failed to write record alloc information: %s", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
 void RecordData::WriteEntries(const std::string& file) {
   std::lock_guard<std::mutex> entries_lock(entries_lock_);
+  if (ring_ != nullptr) {
+    // Drain whatever an external reader hasn't consumed yet.
+    int dump_fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0755);
+    if (dump_fd == -1) {
+      error_log("Cannot create record alloc file %s: %s", file.c_str(), strerror(errno));
+      return;
+    }
+    ring_->Drain(WriteRingEntry, &dump_fd);
+    close(dump_fd);
+    return;
+  }
+
   if (cur_index_ == 0) {
     info_log("No alloc entries to write.");
     return;
@@ -145,9 +193,21 @@ bool RecordData::Initialize(const Config& config) {
              config.record_allocs_signal(), getpid());
   }
 
-  entries_.resize(config.record_allocs_num_entries());
   cur_index_ = 0U;
   file_ = config.record_allocs_file();
+  if (config.options() & RECORD_ALLOCS_RING) {
+    ring_.reset(new RecordRing());
+    if (!ring_->Initialize(config.record_allocs_ring_threads(),
+                           config.record_allocs_num_entries())) {
+      return false;
+    }
+    if (config.options() & VERBOSE) {
+      info_log("%s: Recording allocations to ring buffers readable at /proc/%d/fd/%d",
+               getprogname(), getpid(), ring_->fd());
+    }
+  } else {
+    entries_.resize(config.record_allocs_num_entries());
+  }
 
   pagemap_fd_ = TEMP_FAILURE_RETRY(open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC));
   if (pagemap_fd_ == -1) {
@@ -181,15 +241,38 @@ memory_trace::Entry* RecordData::InternalReserveEntry() {
 }
 
 memory_trace::Entry* RecordData::ReserveEntry() {
-  void* data = pthread_getspecific(key_);
-  if (data == nullptr) {
-    ThreadData* thread_data = new ThreadData(this);
+  ThreadData* thread_data = reinterpret_cast<ThreadData*>(pthread_getspecific(key_));
+  if (thread_data == nullptr) {
+    thread_data = new ThreadData(this);
     pthread_setspecific(key_, thread_data);
   }
 
+  if (ring_ != nullptr) {
+    // Nothing is shared until the entry is committed, so no lock is needed.
+    thread_data->entry.type = memory_trace::UNKNOWN;
+    return &thread_data->entry;
+  }
   return InternalReserveEntry();
 }
 
+void RecordData::CommitEntry(memory_trace::Entry* entry) {
+  if (ring_ == nullptr) {
+    // The entry was written in place.
+    return;
+  }
+  ThreadData* thread_data = reinterpret_cast<ThreadData*>(pthread_getspecific(key_));
+  if (thread_data != nullptr && entry == &thread_data->entry) {
+    WriteToRing(ring_.get(), thread_data, *entry);
+  }
+}
+
+void RecordData::PostForkChild() {
+  // The child must not write into the rings the parent's reader is draining.
+  if (ring_ != nullptr && !ring_->Reinitialize()) {
+    error_log("Unable to create record allocs ring in forked child, records will be dropped.");
+  }
+}
+
 static inline bool IsPagePresent(uint64_t page_data) {
   // Page Present is bit 63
   return (page_data & (1ULL << 63)) != 0;
@@ -42,6 +42,8 @@
 #include <memory_trace/MemoryTrace.h>
 #include <platform/bionic/macros.h>
 
+#include "RecordRing.h"
+
 class Config;
 
 class RecordData {
@@ -52,6 +54,8 @@ class RecordData {
   bool Initialize(const Config& config);
 
   memory_trace::Entry* ReserveEntry();
+  // Must be called once a reserved entry has been filled in.
+  void CommitEntry(memory_trace::Entry* entry);
 
   const std::string& file() { return file_; }
   pthread_key_t key() { return key_; }
@@ -60,6 +64,8 @@ class RecordData {
 
   static void WriteEntriesOnExit();
 
+  void PostForkChild();
+
  private:
   static void WriteData(int, siginfo_t*, void*);
   static RecordData* record_obj_;
@@ -71,6 +77,11 @@ class RecordData {
 
   memory_trace::Entry* InternalReserveEntry();
 
+  static bool WriteRingEntry(const memory_trace::Entry& entry, void* arg);
+
+  // Set when record_allocs_ring is enabled. The entries_ vector is unused.
+  std::unique_ptr<RecordRing> ring_;
+
   std::mutex entries_lock_;
   pthread_key_t key_;
   std::vector<memory_trace::Entry> entries_;
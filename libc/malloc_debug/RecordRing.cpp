@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <memory_trace/MemoryTrace.h>
+
+#include "RecordRing.h"
+#include "debug_log.h"
+
+RecordRing::~RecordRing() {
+  Unmap();
+}
+
+bool RecordRing::Initialize(size_t num_rings, size_t entries_per_ring) {
+  num_rings_ = num_rings;
+  // Round up so the slot can be found with a mask.
+  entries_per_ring_ = 1;
+  while (entries_per_ring_ < entries_per_ring) {
+    entries_per_ring_ <<= 1;
+  }
+  return Map();
+}
+
+bool RecordRing::Reinitialize() {
+  Unmap();
+  generation_++;
+  return Map();
+}
+
+bool RecordRing::Map() {
+  region_size_ = sizeof(RecordRingHeader) + num_rings_ * sizeof(RecordRingControl) +
+                 num_rings_ * entries_per_ring_ * sizeof(RecordRingEntry);
+
+  fd_ = memfd_create("malloc_debug_record_allocs_ring", MFD_CLOEXEC);
+  if (fd_ == -1) {
+    error_log("Unable to create record allocs ring memfd: %s", strerror(errno));
+    return false;
+  }
+  if (ftruncate(fd_, region_size_) == -1) {
+    error_log("Unable to size record allocs ring to %zu bytes: %s", region_size_, strerror(errno));
+    Unmap();
+    return false;
+  }
+  // The pages are only touched as records are written, so an idle ring costs
+  // no memory.
+  region_ = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (region_ == MAP_FAILED) {
+    region_ = nullptr;
+    error_log("Unable to map record allocs ring: %s", strerror(errno));
+    Unmap();
+    return false;
+  }
+
+  // The memfd is zero filled, so every ring starts out unclaimed and empty.
+  RecordRingHeader* header = reinterpret_cast<RecordRingHeader*>(region_);
+  header->version = RECORD_RING_VERSION;
+  header->header_size = sizeof(RecordRingHeader);
+  header->entry_size = sizeof(RecordRingEntry);
+  header->num_rings = num_rings_;
+  header->entries_per_ring = entries_per_ring_;
+  // Publish the magic last, so a reader never sees a partial header.
+  __atomic_store_n(&header->magic, RECORD_RING_MAGIC, __ATOMIC_RELEASE);
+  return true;
+}
+
+void RecordRing::Unmap() {
+  if (region_ != nullptr) {
+    munmap(region_, region_size_);
+    region_ = nullptr;
+  }
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+RecordRingControl* RecordRing::control(size_t ring) const {
+  uintptr_t base = reinterpret_cast<uintptr_t>(region_) + sizeof(RecordRingHeader);
+  return reinterpret_cast<RecordRingControl*>(base) + ring;
+}
+
+RecordRingEntry* RecordRing::entries(size_t ring) const {
+  uintptr_t base = reinterpret_cast<uintptr_t>(control(num_rings_));
+  return reinterpret_cast<RecordRingEntry*>(base) + ring * entries_per_ring_;
+}
+
+size_t RecordRing::Acquire(pid_t tid) {
+  if (region_ == nullptr) {
+    return kNoRing;
+  }
+  for (size_t i = 0; i < num_rings_; i++) {
+    // Check before the compare-exchange so that a thread that finds every
+    // ring claimed doesn't keep taking their cache lines exclusive.
+    if (control(i)->owner_tid.load(std::memory_order_relaxed) != 0) {
+      continue;
+    }
+    int32_t expected = 0;
+    if (control(i)->owner_tid.compare_exchange_strong(expected, tid, std::memory_order_acquire)) {
+      return i;
+    }
+  }
+  return kNoRing;
+}
+
+void RecordRing::Release(size_t ring) {
+  if (ring == kNoRing || region_ == nullptr) {
+    return;
+  }
+  // Any unread records stay in the ring; the next owner appends after them.
+  control(ring)->owner_tid.store(0, std::memory_order_release);
+}
+
+void RecordRing::Write(size_t ring, const memory_trace::Entry& entry) {
+  if (region_ == nullptr) {
+    return;
+  }
+  if (ring == kNoRing) {
+    reinterpret_cast<RecordRingHeader*>(region_)->unowned_drops.fetch_add(
+        1, std::memory_order_relaxed);
+    return;
+  }
+
+  RecordRingControl* ctl = control(ring);
+  uint64_t write_index = ctl->write_index.load(std::memory_order_relaxed);
+  if (write_index - ctl->read_index.load(std::memory_order_acquire) >= entries_per_ring_) {
+    ctl->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  RecordRingEntry* slot = &entries(ring)[write_index & (entries_per_ring_ - 1)];
+  *slot = RecordRingEntry{.ptr = entry.ptr,
+                          .size = entry.size,
+                          .arg = entry.u.old_ptr,
+                          .present_bytes = entry.present_bytes,
+                          .start_ns = entry.start_ns,
+                          .end_ns = entry.end_ns,
+                          .tid = entry.tid,
+                          .type = static_cast<uint32_t>(entry.type)};
+  ctl->write_index.store(write_index + 1, std::memory_order_release);
+}
+
+bool RecordRing::Drain(bool (*func)(const memory_trace::Entry& entry, void* arg), void* arg) {
+  if (region_ == nullptr) {
+    return true;
+  }
+  for (size_t i = 0; i < num_rings_; i++) {
+    RecordRingControl* ctl = control(i);
+    uint64_t read_index = ctl->read_index.load(std::memory_order_acquire);
+    while (read_index != ctl->write_index.load(std::memory_order_acquire)) {
+      // Copy the record before claiming it. The writer can't reuse the slot
+      // until read_index moves past it, so if the claim succeeds the copy is
+      // intact. If it fails, another reader advanced read_index (and the
+      // writer may have overwritten the slot since), so drop the copy and
+      // retry from the index the compare-exchange loaded.
+      RecordRingEntry slot = entries(i)[read_index & (entries_per_ring_ - 1)];
+      if (!ctl->read_index.compare_exchange_weak(read_index, read_index + 1,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) {
+        continue;
+      }
+      read_index++;
+      memory_trace::Entry entry{.tid = slot.tid,
+                                .type = static_cast<memory_trace::TypeEnum>(slot.type),
+                                .ptr = slot.ptr,
+                                .size = slot.size,
+                                .u.old_ptr = slot.arg,
+                                .present_bytes = slot.present_bytes,
+                                .start_ns = slot.start_ns,
+                                .end_ns = slot.end_ns};
+      if (!func(entry, arg)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
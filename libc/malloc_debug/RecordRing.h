@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+#include <memory_trace/MemoryTrace.h>
+#include <platform/bionic/macros.h>
+
+// The record_allocs_ring option writes allocation records into a shared
+// memory region (a memfd) instead of a private vector. The region is split
+// into a number of single-producer/single-consumer rings. Each thread that
+// allocates claims a ring, so writing a record never takes a lock. A reader,
+// either another process that maps /proc/<pid>/fd/<fd> or the record dump
+// signal handler, drains the rings while the process keeps running.
+//
+// Layout of the region:
+//   RecordRingHeader
+//   RecordRingControl[num_rings]
+//   RecordRingEntry[num_rings][entries_per_ring]
+//
+// All fields are little-endian and the layout is versioned, so that an
+// external reader can validate it before draining.
+
+constexpr uint32_t RECORD_RING_MAGIC = 0x5252444d;  // "MDRR"
+constexpr uint32_t RECORD_RING_VERSION = 1;
+
+struct RecordRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t entry_size;
+  uint32_t num_rings;
+  uint32_t reserved;
+  uint64_t entries_per_ring;  // Always a power of two.
+  // Records dropped because every ring was already claimed by another thread.
+  std::atomic<uint64_t> unowned_drops;
+} __attribute__((aligned(64)));
+
+struct RecordRingControl {
+  // The fields written by the thread that owns the ring share one cache line,
+  // and read_index has a line of its own, so that committing a record and
+  // draining one don't keep stealing the same line from each other.
+
+  // The tid of the thread writing to this ring, or 0 if it is unclaimed.
+  alignas(64) std::atomic<int32_t> owner_tid;
+  // Only the owner advances write_index. Both indices only increase; the
+  // slot is (index & (entries - 1)).
+  std::atomic<uint64_t> write_index;
+  // Records dropped because the reader didn't keep up.
+  std::atomic<uint64_t> dropped;
+
+  // A reader consumes the record at read_index by copying it and then
+  // advancing read_index with a compare-exchange. If the compare-exchange
+  // fails, another reader took the record first and the copy is discarded,
+  // so readers in different processes can drain the same ring.
+  alignas(64) std::atomic<uint64_t> read_index;
+};
+
+struct RecordRingEntry {
+  uint64_t ptr;
+  uint64_t size;
+  // The old pointer for realloc, the alignment for memalign, the number of
+  // elements for calloc.
+  uint64_t arg;
+  int64_t present_bytes;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  int32_t tid;
+  uint32_t type;  // A memory_trace::TypeEnum value.
+  uint64_t reserved;
+};
+
+static_assert(sizeof(RecordRingHeader) == 64, "RecordRingHeader is part of the ABI");
+static_assert(sizeof(RecordRingControl) == 128, "RecordRingControl is part of the ABI");
+static_assert(offsetof(RecordRingControl, read_index) == 64, "RecordRingControl is part of the ABI");
+static_assert(sizeof(RecordRingEntry) == 64, "RecordRingEntry is part of the ABI");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring indices must be lock free");
+
+class RecordRing {
+ public:
+  static constexpr size_t kNoRing = SIZE_MAX;
+
+  RecordRing() = default;
+  ~RecordRing();
+
+  bool Initialize(size_t num_rings, size_t entries_per_ring);
+
+  // Replaces the region with a new, empty one. Used in a forked child so it
+  // doesn't write into its parent's rings.
+  bool Reinitialize();
+
+  // Claims an unused ring for the thread. Returns kNoRing if none is free.
+  size_t Acquire(pid_t tid);
+  void Release(size_t ring);
+
+  // Never blocks. Drops the record if the ring is full.
+  void Write(size_t ring, const memory_trace::Entry& entry);
+
+  // Drains every unread record, oldest first within each ring. Records from
+  // different rings are ordered by their timestamps, not by the drain order.
+  // Returns false if func returns false; the record passed to that call is
+  // consumed. Safe to call while other readers drain the same region: each
+  // record goes to exactly one of them.
+  bool Drain(bool (*func)(const memory_trace::Entry& entry, void* arg), void* arg);
+
+  int fd() const { return fd_; }
+  // Incremented by Reinitialize, so threads know to claim a new ring.
+  uint64_t generation() const { return generation_; }
+
+ private:
+  bool Map();
+  void Unmap();
+
+  RecordRingControl* control(size_t ring) const;
+  RecordRingEntry* entries(size_t ring) const;
+
+  int fd_ = -1;
+  void* region_ = nullptr;
+  size_t region_size_ = 0;
+  size_t num_rings_ = 0;
+  size_t entries_per_ring_ = 0;
+  uint64_t generation_ = 0;
+
+  BIONIC_DISALLOW_COPY_AND_ASSIGN(RecordRing);
+};
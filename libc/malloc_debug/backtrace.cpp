@@ -37,6 +37,8 @@
 #include <unistd.h>
 #include <unwind.h>
 
+#include <platform/bionic/android_unsafe_frame_pointer_chase.h>
+
 #include "MapData.h"
 #include "backtrace.h"
 #include "debug_log.h"
@@ -81,16 +83,12 @@ struct stack_crawl_state_t {
       : frames(frames), frame_count(frame_count) {}
 };
 
-static _Unwind_Reason_Code trace_function(__unwind_context* context, void* arg) {
-  stack_crawl_state_t* state = static_cast<stack_crawl_state_t*>(arg);
-
-  uintptr_t ip = _Unwind_GetIP(context);
-
-  // `ip` is the address of the instruction *after* the call site in
-  // `context`, so we want to back up by one instruction. This is hard for
-  // every architecture except arm64, so we just make sure we're *inside*
-  // that instruction, not necessarily at the start of it. (If the value
-  // is too low to be valid, we just leave it alone.)
+static uintptr_t call_site_pc(uintptr_t ip) {
+  // `ip` is the address of the instruction *after* the call site, so we
+  // want to back up by one instruction. This is hard for every architecture
+  // except arm64, so we just make sure we're *inside* that instruction, not
+  // necessarily at the start of it. (If the value is too low to be valid, we
+  // just leave it alone.)
   if (ip >= 4096) {
 #if defined(__aarch64__)
     ip -= 4;  // Exactly.
@@ -100,10 +98,21 @@ static _Unwind_Reason_Code trace_function(__unwind_context* context, void* arg)
     ip -= 1;  // At least.
 #endif
   }
+  return ip;
+}
+
+static bool in_current_code_map(uintptr_t ip) {
+  return g_current_code_map.start() != 0 && ip >= g_current_code_map.start() &&
+         ip < g_current_code_map.end();
+}
+
+static _Unwind_Reason_Code trace_function(__unwind_context* context, void* arg) {
+  stack_crawl_state_t* state = static_cast<stack_crawl_state_t*>(arg);
+
+  uintptr_t ip = call_site_pc(_Unwind_GetIP(context));
 
   // Do not record the frames that fall in our own shared library.
-  if (g_current_code_map.start() != 0 && (ip >= g_current_code_map.start()) &&
-      ip < g_current_code_map.end()) {
+  if (in_current_code_map(ip)) {
     return _URC_NO_REASON;
   }
 
@@ -117,6 +126,36 @@ size_t backtrace_get(uintptr_t* frames, size_t frame_count) {
   return state.cur_frame;
 }
 
+size_t backtrace_get_fp(uintptr_t* frames, size_t frame_count) {
+  // The first few frames are always in our own shared library and get
+  // dropped, so chase a few more than were asked for.
+  constexpr size_t kMaxChasedFrames = 272;
+  constexpr size_t kExtraFrames = 16;
+  uintptr_t chased[kMaxChasedFrames];
+  size_t max_chased = frame_count + kExtraFrames;
+  if (max_chased > kMaxChasedFrames) {
+    max_chased = kMaxChasedFrames;
+  }
+
+  // The chase stops at the top of the thread's stack (or the alternate
+  // signal stack), so a frame without a frame pointer can't walk it off
+  // into unrelated memory.
+  size_t num_chased = android_unsafe_frame_pointer_chase(chased, max_chased);
+  if (num_chased > max_chased) {
+    num_chased = max_chased;
+  }
+
+  size_t cur_frame = 0;
+  for (size_t i = 0; i < num_chased && cur_frame < frame_count; i++) {
+    uintptr_t ip = call_site_pc(chased[i]);
+    if (in_current_code_map(ip)) {
+      continue;
+    }
+    frames[cur_frame++] = ip;
+  }
+  return cur_frame;
+}
+
 std::string backtrace_string(const uintptr_t* frames, size_t frame_count) {
   if (g_map_data.NumMaps() == 0) {
     g_map_data.ReadMaps();
@@ -36,5 +36,8 @@
 void backtrace_startup();
 void backtrace_shutdown();
 size_t backtrace_get(uintptr_t* frames, size_t frame_count);
+// Only valid for code built with frame pointers, but much cheaper than
+// backtrace_get. The frames are not symbolized until they are logged.
+size_t backtrace_get_fp(uintptr_t* frames, size_t frame_count);
 void backtrace_log(const uintptr_t* frames, size_t frame_count);
 std::string backtrace_string(const uintptr_t* frames, size_t frame_count);
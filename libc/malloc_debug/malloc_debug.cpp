@@ -336,7 +336,7 @@ static bool VerifyPointer(const void* pointer, const char* function_name) {
     }
   }
 
-  if (g_debug->TrackPointers()) {
+  if (g_debug->TrackPointers() && !PointerData::Sampling()) {
     if (!PointerData::Exists(pointer)) {
       std::string error_str(std::string("UNKNOWN POINTER (") + function_name + ")");
       LogError(pointer, error_str.c_str());
@@ -606,6 +606,7 @@ void* debug_malloc(size_t size) {
                                  .size = size,
                                  .start_ns = result.GetStartTimeNS(),
                                  .end_ns = result.GetEndTimeNS()};
+    g_debug->record->CommitEntry(entry);
   }
 
   return result.getValue<void*>();
@@ -718,6 +719,7 @@ void debug_free(void* pointer) {
                                  .present_bytes = present_bytes,
                                  .start_ns = result.GetStartTimeNS(),
                                  .end_ns = result.GetEndTimeNS()};
+    g_debug->record->CommitEntry(entry);
   }
 }
 
@@ -817,6 +819,7 @@ void* debug_memalign(size_t alignment, size_t bytes) {
                                  .u.align = alignment,
                                  .start_ns = result.GetStartTimeNS(),
                                  .end_ns = result.GetEndTimeNS()};
+    g_debug->record->CommitEntry(entry);
   }
 
   return pointer;
@@ -857,6 +860,7 @@ void* debug_realloc(void* pointer, size_t bytes) {
                                    .u.old_ptr = 0,
                                    .start_ns = result.GetStartTimeNS(),
                                    .end_ns = result.GetEndTimeNS()};
+      g_debug->record->CommitEntry(entry);
     }
     return pointer;
   }
@@ -884,6 +888,7 @@ void* debug_realloc(void* pointer, size_t bytes) {
                                    .present_bytes = present_bytes,
                                    .start_ns = result.GetStartTimeNS(),
                                    .end_ns = result.GetEndTimeNS()};
+      g_debug->record->CommitEntry(entry);
     }
 
     return nullptr;
@@ -988,6 +993,7 @@ void* debug_realloc(void* pointer, size_t bytes) {
                                  .present_bytes = present_bytes,
                                  .start_ns = result.GetStartTimeNS(),
                                  .end_ns = result.GetEndTimeNS()};
+    g_debug->record->CommitEntry(entry);
   }
 
   return new_pointer;
@@ -1057,6 +1063,7 @@ void* debug_calloc(size_t nmemb, size_t bytes) {
                                  .u.n_elements = nmemb,
                                  .start_ns = result.GetStartTimeNS(),
                                  .end_ns = result.GetEndTimeNS()};
+    g_debug->record->CommitEntry(entry);
   }
 
   if (pointer != nullptr && g_debug->TrackPointers()) {
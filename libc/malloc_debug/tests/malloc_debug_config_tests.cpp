@@ -377,6 +377,30 @@ TEST_F(MallocDebugConfigTest, backtrace_full_fail) {
   ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
 }
 
+TEST_F(MallocDebugConfigTest, backtrace_fp) {
+  ASSERT_TRUE(InitConfig("backtrace_fp")) << getFakeLogPrint();
+  ASSERT_EQ(BACKTRACE_FP, config->options());
+
+  ASSERT_TRUE(InitConfig("bt_fp")) << getFakeLogPrint();
+  ASSERT_EQ(BACKTRACE_FP, config->options());
+
+  ASSERT_TRUE(InitConfig("backtrace backtrace_fp")) << getFakeLogPrint();
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | BACKTRACE_FP, config->options());
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, backtrace_fp_fail) {
+  ASSERT_FALSE(InitConfig("backtrace_fp=200")) << getFakeLogPrint();
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(
+      "6 malloc_debug malloc_testing: value set for option 'backtrace_fp' "
+      "which does not take a value\n");
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugConfigTest, fill_on_alloc) {
   ASSERT_TRUE(InitConfig("fill_on_alloc=64")) << getFakeLogPrint();
   ASSERT_EQ(FILL_ON_ALLOC, config->options());
@@ -590,6 +614,32 @@ TEST_F(MallocDebugConfigTest, record_allocs_on_exit_error) {
   ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
 }
 
+TEST_F(MallocDebugConfigTest, record_allocs_ring) {
+  ASSERT_TRUE(InitConfig("record_allocs_ring=1234")) << getFakeLogPrint();
+  ASSERT_EQ(RECORD_ALLOCS | RECORD_ALLOCS_RING, config->options());
+  ASSERT_EQ(1234U, config->record_allocs_num_entries());
+  ASSERT_EQ(64U, config->record_allocs_ring_threads());
+  ASSERT_STREQ("/data/local/tmp/record_allocs.txt", config->record_allocs_file().c_str());
+
+  ASSERT_TRUE(InitConfig("record_allocs_ring record_allocs_ring_threads=8")) << getFakeLogPrint();
+  ASSERT_EQ(RECORD_ALLOCS | RECORD_ALLOCS_RING, config->options());
+  ASSERT_EQ(4096U, config->record_allocs_num_entries());
+  ASSERT_EQ(8U, config->record_allocs_ring_threads());
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugConfigTest, record_allocs_ring_max_error) {
+  ASSERT_FALSE(InitConfig("record_allocs_ring=1048577"));
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(
+      "6 malloc_debug malloc_testing: bad value for option 'record_allocs_ring', "
+      "value must be <= 1048576: 1048577\n");
+  ASSERT_STREQ((log_msg + usage_string).c_str(), getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugConfigTest, guard_min_error) {
   ASSERT_FALSE(InitConfig("guard=0"));
 
@@ -933,6 +983,33 @@ TEST_F(MallocDebugConfigTest, min_size) {
   ASSERT_STREQ(log_msg.c_str(), getFakeLogPrint().c_str());
 }
 
+TEST_F(MallocDebugConfigTest, sample_rate) {
+  ASSERT_TRUE(InitConfig("backtrace_sample_rate")) << getFakeLogPrint();
+  ASSERT_EQ(BACKTRACE_SAMPLED, config->options());
+  ASSERT_EQ(4096U, config->backtrace_sample_rate());
+
+  ASSERT_TRUE(InitConfig("bt_smp_rate=65536")) << getFakeLogPrint();
+  ASSERT_EQ(BACKTRACE_SAMPLED, config->options());
+  ASSERT_EQ(65536U, config->backtrace_sample_rate());
+
+  ASSERT_TRUE(InitConfig("backtrace backtrace_sample_rate=100")) << getFakeLogPrint();
+  ASSERT_EQ(BACKTRACE | TRACK_ALLOCS | BACKTRACE_SAMPLED, config->options());
+  ASSERT_EQ(100U, config->backtrace_sample_rate());
+
+  ASSERT_FALSE(InitConfig("backtrace_sample_rate=0")) << getFakeLogPrint();
+  ASSERT_FALSE(InitConfig("backtrace_sample_rate=67108865")) << getFakeLogPrint();
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string log_msg(
+      "6 malloc_debug malloc_testing: bad value for option 'backtrace_sample_rate', "
+      "value must be >= 1: 0\n" +
+      usage_string +
+      "6 malloc_debug malloc_testing: bad value for option 'backtrace_sample_rate', "
+      "value must be <= 67108864: 67108865\n" +
+      usage_string);
+  ASSERT_STREQ(log_msg.c_str(), getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugConfigTest, max_size) {
   ASSERT_TRUE(InitConfig("backtrace_max_size=13")) << getFakeLogPrint();
   ASSERT_EQ(BACKTRACE_SPECIFIC_SIZES, config->options());
@@ -18,10 +18,15 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include "Config.h"
 #include "RecordData.h"
+#include "RecordRing.h"
 
 #include "log_fake.h"
 
@@ -119,3 +124,69 @@ TEST_F(MallocDebugRecordDataTest, get_present_bytes_large) {
   EXPECT_EQ(page_size_ * (kMaxReadPages + 1) - 50,
             record_.GetPresentBytes(ptr, page_size_ * (kMaxReadPages + 1) - 50));
 }
+
+static bool CollectRingEntry(const memory_trace::Entry& entry, void* arg) {
+  reinterpret_cast<std::vector<uint64_t>*>(arg)->push_back(entry.ptr);
+  return true;
+}
+
+TEST(MallocDebugRecordRingTest, concurrent_drains) {
+  RecordRing ring;
+  ASSERT_TRUE(ring.Initialize(1, 16));
+
+  // Map the region the way an external reader would, to read the drop count.
+  size_t region_size =
+      sizeof(RecordRingHeader) + sizeof(RecordRingControl) + 16 * sizeof(RecordRingEntry);
+  void* region = mmap(nullptr, region_size, PROT_READ, MAP_SHARED, ring.fd(), 0);
+  ASSERT_NE(MAP_FAILED, region);
+  const RecordRingControl* ctl = reinterpret_cast<const RecordRingControl*>(
+      reinterpret_cast<uintptr_t>(region) + sizeof(RecordRingHeader));
+
+  constexpr uint64_t kRecords = 200000;
+  std::atomic<bool> done = false;
+  std::thread writer([&]() {
+    size_t index = ring.Acquire(gettid());
+    ASSERT_EQ(0U, index);
+    for (uint64_t i = 1; i <= kRecords; i++) {
+      memory_trace::Entry entry{.tid = gettid(), .type = memory_trace::MALLOC, .ptr = i, .size = 1};
+      ring.Write(index, entry);
+    }
+    done = true;
+  });
+
+  // Two readers draining at once must never see the same record twice.
+  std::vector<uint64_t> seen[2];
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < 2; i++) {
+    readers.emplace_back([&, i]() {
+      while (!done) {
+        ring.Drain(CollectRingEntry, &seen[i]);
+      }
+      ring.Drain(CollectRingEntry, &seen[i]);
+    });
+  }
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  std::vector<bool> found(kRecords + 1);
+  size_t total = 0;
+  for (auto& ptrs : seen) {
+    // Each reader sees the records it claimed in the order they were written.
+    for (size_t i = 0; i < ptrs.size(); i++) {
+      ASSERT_TRUE(ptrs[i] >= 1 && ptrs[i] <= kRecords);
+      ASSERT_FALSE(found[ptrs[i]]) << "record " << ptrs[i] << " drained twice";
+      found[ptrs[i]] = true;
+      if (i != 0) {
+        ASSERT_LT(ptrs[i - 1], ptrs[i]);
+      }
+    }
+    total += ptrs.size();
+  }
+  // Every record was either drained or counted as dropped.
+  ASSERT_EQ(kRecords, total + ctl->dropped.load());
+  ASSERT_EQ(total, ctl->read_index.load());
+
+  munmap(region, region_size);
+}
@@ -2324,6 +2324,86 @@ TEST_F(MallocDebugTest, record_allocs_with_header) {
   VerifyRecordAllocs(record_filename);
 }
 
+TEST_F(MallocDebugTest, record_allocs_ring) {
+  InitRecordAllocs("record_allocs_ring");
+
+  VerifyRecordAllocs(record_filename);
+}
+
+TEST_F(MallocDebugTest, record_allocs_ring_full) {
+  InitRecordAllocs("record_allocs_ring=2");
+
+  std::vector<std::string> expected;
+
+  void* pointer = debug_malloc(10);
+  ASSERT_TRUE(pointer != nullptr);
+  expected.push_back(android::base::StringPrintf("%d: malloc %p 10", getpid(), pointer));
+  debug_free(pointer);
+  expected.push_back(android::base::StringPrintf("%d: free %p", getpid(), pointer));
+
+  // The ring is full, so these are dropped.
+  pointer = debug_malloc(20);
+  ASSERT_TRUE(pointer != nullptr);
+  debug_free(pointer);
+
+  // Dump all of the data accumulated so far, which empties the ring.
+  ASSERT_TRUE(kill(getpid(), SIGRTMAX - 18) == 0);
+
+  std::string actual;
+  ASSERT_TRUE(android::base::ReadFileToString(record_filename, &actual));
+  VerifyRecords(expected, actual);
+
+  expected.clear();
+  pointer = debug_malloc(30);
+  ASSERT_TRUE(pointer != nullptr);
+  expected.push_back(android::base::StringPrintf("%d: malloc %p 30", getpid(), pointer));
+  debug_free(pointer);
+  expected.push_back(android::base::StringPrintf("%d: free %p", getpid(), pointer));
+
+  ASSERT_TRUE(kill(getpid(), SIGRTMAX - 18) == 0);
+
+  ASSERT_TRUE(android::base::ReadFileToString(record_filename, &actual));
+  VerifyRecords(expected, actual);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugTest, record_allocs_ring_thread_done) {
+  InitRecordAllocs("record_allocs_ring record_allocs_ring_threads=1");
+
+  // Each thread releases the only ring when it finishes, so the next thread
+  // can claim it.
+  std::vector<std::string> expected;
+  for (size_t i = 0; i < 2; i++) {
+    static pid_t tid = 0;
+    static void* pointer = nullptr;
+    std::thread thread([]() {
+      tid = gettid();
+      pointer = debug_malloc(100);
+      write(0, pointer, 0);
+      debug_free(pointer);
+    });
+    thread.join();
+
+    expected.push_back(android::base::StringPrintf("%d: malloc %p 100", tid, pointer));
+    expected.push_back(android::base::StringPrintf("%d: free %p", tid, pointer));
+    expected.push_back(android::base::StringPrintf("%d: thread_done 0x0", tid));
+  }
+
+  // Dump all of the data accumulated so far.
+  ASSERT_TRUE(kill(getpid(), SIGRTMAX - 18) == 0);
+
+  // Read all of the contents.
+  std::string actual;
+  ASSERT_TRUE(android::base::ReadFileToString(record_filename, &actual));
+
+  VerifyRecords(expected, actual);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
 TEST_F(MallocDebugTest, record_allocs_max) {
   InitRecordAllocs("record_allocs=5");
 
@@ -3184,3 +3264,107 @@ TEST_F(MallocDebugTest, backtrace_only_some_sizes_with_backtrace_min_max_size) {
 
   ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
 }
+
+TEST_F(MallocDebugTest, backtrace_fp) {
+  Init("leak_track backtrace backtrace_fp");
+
+  backtrace_fake_add(std::vector<uintptr_t>{0x1000, 0x2000, 0x3000});
+
+  void* pointer = debug_malloc(100);
+  ASSERT_TRUE(pointer != nullptr);
+
+  debug_finalize();
+  initialized = false;
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  std::string expected_log = android::base::StringPrintf(
+      "6 malloc_debug +++ malloc_testing leaked block of size 100 at %p (leak 1 of 1)\n", pointer);
+  expected_log += "6 malloc_debug Backtrace at time of allocation:\n";
+  expected_log += "6 malloc_debug   #00 pc 0x1000\n";
+  expected_log += "6 malloc_debug   #01 pc 0x2000\n";
+  expected_log += "6 malloc_debug   #02 pc 0x3000\n";
+  ASSERT_STREQ(expected_log.c_str(), getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugTest, backtrace_sample_rate_large_allocations) {
+  // Every sample interval is far smaller than the allocation, so every
+  // allocation is sampled and the sizes are not scaled.
+  Init("backtrace bt_smp_rate=1");
+
+  size_t individual_size = GetInfoEntrySize(16);
+  std::vector<uint8_t> expected_info(individual_size);
+  memset(expected_info.data(), 0, individual_size);
+
+  InfoEntry* entry = reinterpret_cast<InfoEntry*>(expected_info.data());
+  entry->size = 200;
+  entry->num_allocations = 1;
+  entry->frames[0] = 0xf;
+  entry->frames[1] = 0xe;
+  entry->frames[2] = 0xd;
+
+  backtrace_fake_add(std::vector<uintptr_t>{0xf, 0xe, 0xd});
+
+  void* pointer = debug_malloc(entry->size);
+  ASSERT_TRUE(pointer != nullptr);
+
+  uint8_t* info;
+  size_t overall_size;
+  size_t info_size;
+  size_t total_memory;
+  size_t backtrace_size;
+
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(individual_size, overall_size);
+  ASSERT_EQ(200U, total_memory);
+  ASSERT_TRUE(memcmp(expected_info.data(), info, overall_size) == 0)
+      << ShowDiffs(expected_info.data(), info, overall_size);
+  debug_free_malloc_leak_info(info);
+
+  debug_free(pointer);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
+
+TEST_F(MallocDebugTest, backtrace_sample_rate_scaled) {
+  Init("backtrace backtrace_sample_rate=1024");
+
+  // Each allocation is sampled with probability 1 - e^-1, so only a part of
+  // them are tracked, but the scaled total should be close to the real one.
+  constexpr size_t kNumAllocs = 4096;
+  constexpr size_t kAllocSize = 1024;
+  std::vector<void*> pointers;
+  for (size_t i = 0; i < kNumAllocs; i++) {
+    void* pointer = debug_malloc(kAllocSize);
+    ASSERT_TRUE(pointer != nullptr);
+    pointers.push_back(pointer);
+  }
+
+  uint8_t* info;
+  size_t overall_size;
+  size_t info_size;
+  size_t total_memory;
+  size_t backtrace_size;
+
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(info_size, overall_size);
+  InfoEntry* entry = reinterpret_cast<InfoEntry*>(info);
+  ASSERT_EQ(1620U, entry->size);
+  ASSERT_GT(entry->num_allocations, 0U);
+  ASSERT_LT(entry->num_allocations, kNumAllocs);
+  ASSERT_EQ(entry->size * entry->num_allocations, total_memory);
+  ASSERT_NEAR(kNumAllocs * kAllocSize, total_memory, kNumAllocs * kAllocSize / 10);
+  debug_free_malloc_leak_info(info);
+
+  // Freeing allocations that were not sampled is not an error.
+  for (void* pointer : pointers) {
+    debug_free(pointer);
+  }
+  debug_get_malloc_leak_info(&info, &overall_size, &info_size, &total_memory, &backtrace_size);
+  ASSERT_TRUE(info == nullptr);
+
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+  ASSERT_STREQ("", getFakeLogPrint().c_str());
+}
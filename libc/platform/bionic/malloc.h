@@ -49,6 +49,40 @@ typedef struct {
   size_t backtrace_size;
 } android_mallopt_leak_info_t;
 #pragma clang diagnostic pop
+
+#define ANDROID_MALLOPT_HEAP_STATS_VERSION 2
+#define ANDROID_MALLOPT_HEAP_STATS_MAX_SIZE_CLASSES 64
+
+typedef struct {
+  // The size of every allocation in this class.
+  uint64_t size;
+  // The bytes currently allocated from this class.
+  uint64_t allocated_bytes;
+  // The total number of allocations and frees from this class.
+  uint64_t nmalloc;
+  uint64_t ndalloc;
+} android_mallopt_heap_size_class_t;
+
+typedef struct {
+  // Set to ANDROID_MALLOPT_HEAP_STATS_VERSION. Fields are only ever added
+  // to the end of this struct, and only when the version changes.
+  uint32_t version;
+  // The number of valid entries in size_classes. Zero if the native
+  // allocator does not report per size class statistics.
+  uint32_t num_size_classes;
+  // The bytes the allocator has mapped from the kernel.
+  uint64_t mapped_bytes;
+  // The bytes currently handed out to callers, including rounding up to
+  // the size class.
+  uint64_t allocated_bytes;
+  // The mapped bytes that are not allocated: free blocks, thread caches
+  // and allocator metadata.
+  uint64_t cached_bytes;
+  // cached_bytes as a fraction of mapped_bytes, in thousandths.
+  uint32_t fragmentation_permille;
+  uint32_t reserved;
+  android_mallopt_heap_size_class_t size_classes[ANDROID_MALLOPT_HEAP_STATS_MAX_SIZE_CLASSES];
+} android_mallopt_heap_stats_t;
 // Opcodes for android_mallopt.
 
 enum {
@@ -111,6 +145,13 @@ enum {
   //   arg_size = sizeof(bool)
   M_GET_DECAY_TIME_ENABLED = 12,
 #define M_GET_DECAY_TIME_ENABLED M_GET_DECAY_TIME_ENABLED
+  // Fill in a snapshot of the native heap statistics. Unlike malloc_info(),
+  // this does not format any text or allocate, so it is cheap enough to
+  // call at a high frequency.
+  //   arg = android_mallopt_heap_stats_t*
+  //   arg_size = sizeof(android_mallopt_heap_stats_t)
+  M_GET_HEAP_STATS_V2 = 13,
+#define M_GET_HEAP_STATS_V2 M_GET_HEAP_STATS_V2
 };
 
 #pragma clang diagnostic push
@@ -83,8 +83,11 @@ public:
   size_t reserve_exe_segment_and_tcb(const TlsSegment* exe_segment, const char* progname);
   size_t reserve_bionic_tls();
   size_t reserve_solib_segment(const TlsSegment& segment) { return reserve(segment.aligned_size); }
+  void reserve_surplus(size_t size);
   void finish_layout();
 
+  size_t allocate_from_surplus(const TlsSegment& segment);
+
 #if !defined(STATIC_TLS_LAYOUT_TEST)
  private:
 #endif
@@ -97,6 +100,11 @@ public:
 
   size_t offset_exe_ = SIZE_MAX;
 
+  // Static TLS memory in [surplus_cursor_, surplus_end_) is reserved for
+  // modules loaded after startup (i.e. by dlopen).
+  size_t surplus_cursor_ = 0;
+  size_t surplus_end_ = 0;
+
   struct TpAllocations {
     size_t before;
     size_t tp;
@@ -127,9 +135,16 @@ static inline size_t __tls_module_idx_to_id(size_t idx) { return idx + 1; }
 struct TlsModule {
   TlsSegment segment;
 
-  // Offset into the static TLS block or SIZE_MAX for a dynamic module.
+  // Offset into the static TLS block or SIZE_MAX for a dynamic module. A
+  // module loaded after startup can also have a static offset if it was
+  // allocated from the static TLS surplus.
   size_t static_offset = SIZE_MAX;
 
+  // Set for a module in the static TLS surplus from its registration until its
+  // initialization image is relocated and copied into the existing threads.
+  // Until then, new threads don't copy the image either.
+  bool static_image_pending = false;
+
   // The generation in which this module was loaded. Dynamic TLS lookups use
   // this field to detect when a module has been unloaded.
   size_t first_generation = kTlsGenerationNone;
@@ -142,6 +157,10 @@ struct TlsModule {
 // before DTLS destruction.
 typedef void (*dtls_listener_t)(void* dynamic_tls_begin, void* dynamic_tls_end);
 
+// Signature of the callback that copies a module's initialization image into
+// the static TLS memory of every existing thread.
+typedef void (*static_tls_init_cb_t)(size_t static_offset, const TlsSegment* segment);
+
 // Signature of the thread-exit callbacks.
 typedef void (*thread_exit_cb_t)(void);
 
@@ -176,6 +195,10 @@ struct TlsModules {
   // Callback to be invoked before a dynamic TLS deallocation.
   dtls_listener_t on_destruction_cb = nullptr;
 
+  // Callback used by the dynamic linker to initialize a module allocated from
+  // the static TLS surplus. libc.so registers it during its initialization.
+  static_tls_init_cb_t static_tls_init_cb = nullptr;
+
   // The first thread-exit callback; inlined to avoid allocation.
   thread_exit_cb_t first_thread_exit_callback = nullptr;
 
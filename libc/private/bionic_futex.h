@@ -58,6 +58,20 @@ static inline int __futex_wake_ex(volatile void* ftx, bool shared, int count) {
   return __futex(ftx, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, count, nullptr, 0);
 }
 
+// Wakes up to wake_count waiters on ftx and moves up to requeue_count of the rest to ftx2, if ftx
+// still holds value. Returns the number of waiters woken or moved, or -EAGAIN.
+static inline int __futex_cmp_requeue_ex(volatile void* ftx, bool shared, int wake_count,
+                                         int requeue_count, volatile void* ftx2, int value) {
+  int saved_errno = errno;
+  int result = syscall(__NR_futex, ftx, shared ? FUTEX_CMP_REQUEUE : FUTEX_CMP_REQUEUE_PRIVATE,
+                       wake_count, static_cast<long>(requeue_count), ftx2, value);
+  if (__predict_false(result == -1)) {
+    result = -errno;
+    errno = saved_errno;
+  }
+  return result;
+}
+
 static inline int __futex_wait(volatile void* ftx, int value, const timespec* timeout) {
   return __futex(ftx, FUTEX_WAIT, value, timeout, 0);
 }
@@ -74,6 +88,13 @@ static inline int __futex_pi_unlock(volatile void* ftx, bool shared) {
   return __futex(ftx, shared ? FUTEX_UNLOCK_PI : FUTEX_UNLOCK_PI_PRIVATE, 0, nullptr, 0);
 }
 
+// Waits until any of the futexes described by waiters (at most FUTEX_WAITV_MAX) is woken, or no
+// longer holds its expected value. Returns the index of the futex that was woken, or -EAGAIN if
+// one of the values had changed, or -ENOSYS if the kernel doesn't support futex_waitv (before
+// Linux 5.16).
+__LIBC_HIDDEN__ int __futex_waitv_ex(futex_waitv* waiters, size_t count, bool use_realtime_clock,
+                                     const timespec* abs_timeout);
+
 __LIBC_HIDDEN__ int __futex_pi_lock_ex(volatile void* ftx, bool shared, bool use_realtime_clock,
                                        const timespec* abs_timeout);
 
@@ -56,6 +56,11 @@ class Lock {
                         LockedWithoutWaiter, memory_order_acquire, memory_order_relaxed));
   }
 
+  // Returns true if the lock is currently free, without trying to take it.
+  bool is_unlocked() {
+    return atomic_load_explicit(&state, memory_order_relaxed) == Unlocked;
+  }
+
   void lock() {
     LockState old_state = Unlocked;
     if (__predict_true(atomic_compare_exchange_strong_explicit(&state, &old_state,
@@ -28,8 +28,10 @@
 
 #pragma once
 
+#include <limits.h>
 #include <locale.h>
 #include <mntent.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/cdefs.h>
 #include <sys/param.h>
@@ -96,9 +98,24 @@ struct bionic_tcb {
 
 /*
  * Maximum number of pthread keys allocated.
- * This includes pthread keys used internally and externally.
+ * This includes pthread keys used internally and externally, and is more than
+ * the PTHREAD_KEYS_MAX that callers are guaranteed.
  */
-#define BIONIC_PTHREAD_KEY_COUNT (BIONIC_PTHREAD_KEY_RESERVED_COUNT + PTHREAD_KEYS_MAX)
+#define BIONIC_PTHREAD_KEY_COUNT 4096
+static_assert(BIONIC_PTHREAD_KEY_COUNT >= BIONIC_PTHREAD_KEY_RESERVED_COUNT + PTHREAD_KEYS_MAX);
+
+/*
+ * Each thread stores the data for the first keys inline, enough for libc's own
+ * keys and the PTHREAD_KEYS_MAX that callers are guaranteed. The data for the
+ * rest lives in a single overflow mapping that is only created when the thread
+ * first sets one of those keys, and whose pages are only touched as keys in
+ * them are set.
+ */
+#define BIONIC_PTHREAD_KEY_INLINE_COUNT (BIONIC_PTHREAD_KEY_RESERVED_COUNT + PTHREAD_KEYS_MAX)
+#define BIONIC_PTHREAD_KEY_OVERFLOW_COUNT (BIONIC_PTHREAD_KEY_COUNT - BIONIC_PTHREAD_KEY_INLINE_COUNT)
+#define BIONIC_PTHREAD_KEYS_PER_SET_WORD (sizeof(uintptr_t) * 8)
+#define BIONIC_PTHREAD_KEY_SET_WORDS(count) \
+  (((count) + BIONIC_PTHREAD_KEYS_PER_SET_WORD - 1) / BIONIC_PTHREAD_KEYS_PER_SET_WORD)
 
 class pthread_key_data_t {
  public:
@@ -106,10 +123,21 @@ class pthread_key_data_t {
   void* data;
 };
 
+struct pthread_key_overflow_t {
+  // Bit i of word w is set when key_data[w * BIONIC_PTHREAD_KEYS_PER_SET_WORD + i] has been set
+  // since thread exit last looked at it.
+  uintptr_t key_data_set[BIONIC_PTHREAD_KEY_SET_WORDS(BIONIC_PTHREAD_KEY_OVERFLOW_COUNT)];
+  pthread_key_data_t key_data[BIONIC_PTHREAD_KEY_OVERFLOW_COUNT];
+};
+
 // ~3 pages. This struct is allocated as static TLS memory (i.e. at a fixed
 // offset from the thread pointer).
 struct bionic_tls {
-  pthread_key_data_t key_data[BIONIC_PTHREAD_KEY_COUNT];
+  pthread_key_data_t key_data[BIONIC_PTHREAD_KEY_INLINE_COUNT];
+  // Bit i of word w is set when key_data[w * BIONIC_PTHREAD_KEYS_PER_SET_WORD + i] has been set
+  // since thread exit last looked at it.
+  uintptr_t key_data_set[BIONIC_PTHREAD_KEY_SET_WORDS(BIONIC_PTHREAD_KEY_INLINE_COUNT)];
+  pthread_key_overflow_t* key_overflow;
 
   locale_t locale;
 
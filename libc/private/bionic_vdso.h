@@ -28,6 +28,10 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <time.h>
+
 #if defined(__aarch64__)
 #define VDSO_CLOCK_GETTIME_SYMBOL "__kernel_clock_gettime"
 #define VDSO_CLOCK_GETRES_SYMBOL "__kernel_clock_getres"
@@ -61,3 +65,12 @@ enum {
 #endif
   VDSO_END
 };
+
+__BEGIN_DECLS
+
+// Reads clock_id, which must be CLOCK_REALTIME or CLOCK_MONOTONIC, for a caller that can use a
+// time up to max_stale_ns old. Such callers get the cheaper coarse clock when it is fine enough.
+__LIBC_HIDDEN__ int __bionic_clock_gettime_coarse(clockid_t clock_id, int64_t max_stale_ns,
+                                                  struct timespec* ts);
+
+__END_DECLS
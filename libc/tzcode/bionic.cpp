@@ -29,17 +29,24 @@
 #include <arpa/inet.h> // For ntohl(3).
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include "private/CachedProperty.h"
 
 extern "C" void tzset_unlocked(void);
 extern "C" void __bionic_get_system_tz(char* buf, size_t n);
-extern "C" int __bionic_open_tzdata(const char*, int32_t*);
+extern "C" uint32_t __bionic_system_tz_serial(void);
+extern "C" int __bionic_find_tzdata(const char*, const char**, int32_t*);
 
 extern "C" void tzsetlcl(char const*);
+extern "C" void tzset_publish(uint32_t);
 
 void __bionic_get_system_tz(char* buf, size_t n) {
   static CachedProperty persist_sys_timezone("persist.sys.timezone");
@@ -75,18 +82,44 @@ void __bionic_get_system_tz(char* buf, size_t n) {
   }
 }
 
+// Unlike __bionic_get_system_tz, this is safe to call without the tzcode
+// lock, so localtime.c uses it to check that its zone is still current.
+// A missing property reads as 0.
+uint32_t __bionic_system_tz_serial() {
+  static std::atomic<const prop_info*> g_prop_info;
+  static std::atomic<uint32_t> g_area_serial;
+
+  const prop_info* pi = g_prop_info.load(std::memory_order_acquire);
+  if (pi == nullptr) {
+    // `__system_property_find` is expensive, so only retry if a property
+    // has been created since last time we checked.
+    uint32_t area_serial = __system_property_area_serial();
+    if (area_serial == g_area_serial.load(std::memory_order_relaxed)) return 0;
+    pi = __system_property_find("persist.sys.timezone");
+    g_area_serial.store(area_serial, std::memory_order_relaxed);
+    if (pi == nullptr) return 0;
+    g_prop_info.store(pi, std::memory_order_release);
+  }
+  return __system_property_serial(pi);
+}
+
 void tzset_unlocked() {
   // The TZ environment variable is meant to override the system-wide setting.
   const char* name = getenv("TZ");
   char buf[PROP_VALUE_MAX];
+  uint32_t serial = UINT32_MAX;
 
   // If that's not set, look at the "persist.sys.timezone" system property.
+  // Read its serial first, so that a change while we read the value can only
+  // make the serial look out of date.
   if (name == nullptr) {
+    serial = __bionic_system_tz_serial();
     __bionic_get_system_tz(buf, sizeof(buf));
     name = buf;
   }
 
   tzsetlcl(name);
+  tzset_publish(serial);
 }
 
 #if !defined(__ANDROID__)
@@ -124,158 +157,187 @@ struct index_entry_t {
   int32_t unused; // Was raw GMT offset; always 0 since tzdata2014f (L).
 };
 
-// Returns -2 for a soft failure (where the caller should try another file),
-// -1 for a hard failure (where the caller should give up), and >= 0 is a
-// file descriptor whose offset points to the data for the given olson id in
-// the given file (and *entry_length is the size of the data).
-static int __bionic_open_tzdata_path(const char* path,
-                                     const char* olson_id,
-                                     int32_t* entry_length) {
+// A tzdata file, mapped for the life of the process.
+struct tzdata_file_t {
+  const char* map;
+  size_t size;
+  const index_entry_t* index;
+  size_t id_count;
+  uint32_t data_offset;
+  bool sorted;  // Whether the index can be binary searched.
+};
+
+// Compares an index entry's id, which is only NUL-terminated if it's
+// shorter than NAME_LENGTH, with a NUL-terminated id.
+static int compare_id(const char* entry_id, const char* olson_id) {
+  int result = strncmp(entry_id, olson_id, NAME_LENGTH);
+  if (result == 0 && strnlen(olson_id, NAME_LENGTH + 1) > NAME_LENGTH) result = -1;
+  return result;
+}
+
+// Returns false if there's no usable tzdata file at the given path.
+static bool __bionic_map_tzdata_path(const char* path, tzdata_file_t* file) {
   int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
   if (fd == -1) {
     // We don't log here, because this is quite common --- current devices
     // aren't expected to have the old APK tzdata, for example.
-    return -2;
+    return false;
   }
 
-  bionic_tzdata_header_t header = {};
-  ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header)));
-  if (bytes_read != sizeof(header)) {
-    fprintf(stderr, "%s: could not read header of \"%s\": %s\n",
-            __FUNCTION__, path, (bytes_read == -1) ? strerror(errno) : "short read");
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    fprintf(stderr, "%s: could not stat \"%s\": %s\n", __FUNCTION__, path, strerror(errno));
     close(fd);
-    return -2;
+    return false;
   }
-
-  if (strncmp(header.tzdata_version, "tzdata", 6) != 0 || header.tzdata_version[11] != 0) {
-    fprintf(stderr, "%s: bad magic in \"%s\": \"%.6s\"\n", __FUNCTION__, path, header.tzdata_version);
+  if (static_cast<size_t>(sb.st_size) < sizeof(bionic_tzdata_header_t)) {
+    fprintf(stderr, "%s: could not read header of \"%s\": short read\n", __FUNCTION__, path);
     close(fd);
-    return -2;
+    return false;
+  }
+  void* map = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: could not map \"%s\": %s\n", __FUNCTION__, path, strerror(errno));
+    return false;
   }
 
-  if (TEMP_FAILURE_RETRY(lseek(fd, ntohl(header.index_offset), SEEK_SET)) == -1) {
-    fprintf(stderr, "%s: couldn't seek to index in \"%s\": %s\n", __FUNCTION__, path, strerror(errno));
-    close(fd);
-    return -2;
+  bionic_tzdata_header_t header;
+  memcpy(&header, map, sizeof(header));
+  if (strncmp(header.tzdata_version, "tzdata", 6) != 0 || header.tzdata_version[11] != 0) {
+    fprintf(stderr, "%s: bad magic in \"%s\": \"%.6s\"\n", __FUNCTION__, path, header.tzdata_version);
+    munmap(map, sb.st_size);
+    return false;
   }
 
-  if (ntohl(header.index_offset) > ntohl(header.data_offset)) {
+  uint32_t index_offset = ntohl(header.index_offset);
+  uint32_t data_offset = ntohl(header.data_offset);
+  if (index_offset > data_offset || data_offset > static_cast<size_t>(sb.st_size)) {
     fprintf(stderr, "%s: invalid data and index offsets in \"%s\": %u %u\n",
-            __FUNCTION__, path, ntohl(header.data_offset), ntohl(header.index_offset));
-    close(fd);
-    return -2;
+            __FUNCTION__, path, data_offset, index_offset);
+    munmap(map, sb.st_size);
+    return false;
   }
-  const size_t index_size = ntohl(header.data_offset) - ntohl(header.index_offset);
-  if ((index_size % sizeof(index_entry_t)) != 0) {
+  const size_t index_size = data_offset - index_offset;
+  if ((index_size % sizeof(index_entry_t)) != 0 || (index_offset % alignof(index_entry_t)) != 0) {
     fprintf(stderr, "%s: invalid index size in \"%s\": %zd\n", __FUNCTION__, path, index_size);
-    close(fd);
-    return -2;
+    munmap(map, sb.st_size);
+    return false;
   }
 
-  char* index = reinterpret_cast<char*>(malloc(index_size));
-  if (index == nullptr) {
-    fprintf(stderr, "%s: couldn't allocate %zd-byte index for \"%s\"\n", __FUNCTION__, index_size, path);
-    close(fd);
-    return -2;
-  }
-  if (TEMP_FAILURE_RETRY(read(fd, index, index_size)) != static_cast<ssize_t>(index_size)) {
-    fprintf(stderr, "%s: could not read index of \"%s\": %s\n",
-            __FUNCTION__, path, (bytes_read == -1) ? strerror(errno) : "short read");
-    free(index);
-    close(fd);
-    return -2;
-  }
-
-  off_t specific_zone_offset = -1;
-  size_t id_count = index_size / sizeof(index_entry_t);
-  index_entry_t* entry = reinterpret_cast<index_entry_t*>(index);
-  for (size_t i = 0; i < id_count; ++i) {
-    char this_id[NAME_LENGTH + 1];
-    memcpy(this_id, entry->buf, NAME_LENGTH);
-    this_id[NAME_LENGTH] = '\0';
-
-    if (strcmp(this_id, olson_id) == 0) {
-      specific_zone_offset = ntohl(entry->start) + ntohl(header.data_offset);
-      *entry_length = ntohl(entry->length);
+  file->map = static_cast<const char*>(map);
+  file->size = sb.st_size;
+  file->index = reinterpret_cast<const index_entry_t*>(file->map + index_offset);
+  file->id_count = index_size / sizeof(index_entry_t);
+  file->data_offset = data_offset;
+  // The index is written in sorted order, but check rather than assume.
+  file->sorted = true;
+  for (size_t i = 1; i < file->id_count; ++i) {
+    if (strncmp(file->index[i - 1].buf, file->index[i].buf, NAME_LENGTH) >= 0) {
+      file->sorted = false;
       break;
     }
-
-    ++entry;
-  }
-  free(index);
-
-  if (specific_zone_offset == -1) {
-    // We found a valid tzdata file, but didn't find the requested id in it.
-    // Give up now, and don't try fallback tzdata files. We don't log here
-    // because for all we know the given olson id was nonsense.
-    close(fd);
-    // This file descriptor (-1) is passed to localtime.c. In invalid fd case
-    // upstream passes errno value around methods and having 0 there will
-    // indicate that timezone was found and read successfully and localtime's
-    // internal state was properly initialized (which wasn't as we couldn't find
-    // requested timezone in the tzdata file).
-    // If we reached this point errno is unlikely to be touched. It is only
-    // close(fd) which can do it, but that is very unlikely to happen. And
-    // even if it happens we can't extract any useful insights from it.
-    // We are overriding it to ENOENT as it matches upstream expectations -
-    // timezone is absent in the tzdata file == there is no TZif file in
-    // /usr/share/zoneinfo.
-    errno = ENOENT;
-    return -1;
   }
-
-  if (TEMP_FAILURE_RETRY(lseek(fd, specific_zone_offset, SEEK_SET)) == -1) {
-    fprintf(stderr, "%s: could not seek to %ld in \"%s\": %s\n",
-            __FUNCTION__, specific_zone_offset, path, strerror(errno));
-    close(fd);
-    return -2;
-  }
-
-  return fd;
+  return true;
 }
 
-int __bionic_open_tzdata(const char* olson_id, int32_t* entry_length) {
-  int fd;
-
-  // Try the two locations for the tzdata file in a strict order:
-  // 1: The timezone data module which contains the main copy. This is the
-  //    common case for current devices.
-  // 2: The ultimate fallback: the non-updatable copy in /system.
-
+// Maps the first tzdata file that exists, the first time it's needed.
+static const tzdata_file_t* __bionic_map_tzdata() {
+  static std::atomic<const tzdata_file_t*> g_tzdata;
+  static pthread_mutex_t g_tzdata_lock = PTHREAD_MUTEX_INITIALIZER;
+  static tzdata_file_t g_tzdata_file;
+
+  const tzdata_file_t* file = g_tzdata.load(std::memory_order_acquire);
+  if (file != nullptr) return file;
+
+  pthread_mutex_lock(&g_tzdata_lock);
+  file = g_tzdata.load(std::memory_order_relaxed);
+  if (file == nullptr) {
+    // Try the two locations for the tzdata file in a strict order:
+    // 1: The timezone data module which contains the main copy. This is the
+    //    common case for current devices.
+    // 2: The ultimate fallback: the non-updatable copy in /system.
 #if defined(__ANDROID__)
-  // On Android devices, bionic has to work even if exec takes place without
-  // environment variables set. So, all paths are hardcoded here.
-  fd = __bionic_open_tzdata_path("/apex/com.android.tzdata/etc/tz/tzdata",
-                                 olson_id, entry_length);
-  if (fd >= -1) return fd;
-
-  fd = __bionic_open_tzdata_path("/system/usr/share/zoneinfo/tzdata",
-                                 olson_id, entry_length);
-  if (fd >= -1) return fd;
+    // On Android devices, bionic has to work even if exec takes place without
+    // environment variables set. So, all paths are hardcoded here.
+    if (__bionic_map_tzdata_path("/apex/com.android.tzdata/etc/tz/tzdata", &g_tzdata_file) ||
+        __bionic_map_tzdata_path("/system/usr/share/zoneinfo/tzdata", &g_tzdata_file)) {
+      file = &g_tzdata_file;
+    }
 #else
-  // On the host, we don't expect the hard-coded locations above to exist, and
-  // we're not worried about security so we trust $ANDROID_TZDATA_ROOT, and
-  // $ANDROID_ROOT to point us in the right direction instead.
-
-  char* path = make_path("ANDROID_TZDATA_ROOT", "/etc/tz/tzdata");
-  fd = __bionic_open_tzdata_path(path, olson_id, entry_length);
-  free(path);
-  if (fd >= -1) return fd;
-
-  path = make_path("ANDROID_ROOT", "/usr/share/zoneinfo/tzdata");
-  fd = __bionic_open_tzdata_path(path, olson_id, entry_length);
-  free(path);
-  if (fd >= -1) return fd;
+    // On the host, we don't expect the hard-coded locations above to exist, and
+    // we're not worried about security so we trust $ANDROID_TZDATA_ROOT, and
+    // $ANDROID_ROOT to point us in the right direction instead.
+    char* path = make_path("ANDROID_TZDATA_ROOT", "/etc/tz/tzdata");
+    bool found = __bionic_map_tzdata_path(path, &g_tzdata_file);
+    free(path);
+    if (!found) {
+      path = make_path("ANDROID_ROOT", "/usr/share/zoneinfo/tzdata");
+      found = __bionic_map_tzdata_path(path, &g_tzdata_file);
+      free(path);
+    }
+    if (found) file = &g_tzdata_file;
 #endif
+    // Only success is remembered: there may be tzdata next time.
+    if (file != nullptr) g_tzdata.store(file, std::memory_order_release);
+  }
+  pthread_mutex_unlock(&g_tzdata_lock);
+  return file;
+}
 
-  // Not finding any tzdata is more serious that not finding a specific zone,
-  // and worth logging.
-  if (fd == -2) {
+// Returns 0 and points *data at the data for the given olson id, which stays
+// valid for the life of the process, or returns an errno value.
+int __bionic_find_tzdata(const char* olson_id, const char** data, int32_t* entry_length) {
+  const tzdata_file_t* file = __bionic_map_tzdata();
+  if (file == nullptr) {
+    // Not finding any tzdata is more serious that not finding a specific zone,
+    // and worth logging.
     // The first thing that 'recovery' does is try to format the current time. It doesn't have
     // any tzdata available, so we must not abort here --- doing so breaks the recovery image!
     fprintf(stderr, "%s: couldn't find any tzdata when looking for %s!\n", __FUNCTION__, olson_id);
+    return ENOENT;
   }
 
-  // Otherwise we were successful.
-  return fd;
+  const index_entry_t* entry = nullptr;
+  if (file->sorted) {
+    size_t lo = 0;
+    size_t hi = file->id_count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      int result = compare_id(file->index[mid].buf, olson_id);
+      if (result == 0) {
+        entry = &file->index[mid];
+        break;
+      }
+      if (result < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+  } else {
+    for (size_t i = 0; i < file->id_count; ++i) {
+      if (compare_id(file->index[i].buf, olson_id) == 0) {
+        entry = &file->index[i];
+        break;
+      }
+    }
+  }
+
+  // We found a valid tzdata file, but didn't find the requested id in it.
+  // Don't try fallback tzdata files. We don't log here because for all we
+  // know the given olson id was nonsense. ENOENT matches upstream
+  // expectations: the zone is absent from the tzdata file == there is no
+  // TZif file in /usr/share/zoneinfo.
+  if (entry == nullptr) return ENOENT;
+
+  uint64_t start = static_cast<uint64_t>(file->data_offset) + ntohl(entry->start);
+  uint32_t length = ntohl(entry->length);
+  if (start > file->size || length > file->size - start || length > INT32_MAX) {
+    fprintf(stderr, "%s: invalid entry for %s\n", __FUNCTION__, olson_id);
+    return EINVAL;
+  }
+  *data = file->map + start;
+  *entry_length = length;
+  return 0;
 }
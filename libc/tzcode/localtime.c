@@ -273,6 +273,17 @@ detzcode64(const char *const codep)
 static void
 update_tzname_etc(struct state const *sp, struct ttinfo const *ttisp)
 {
+#if defined(__BIONIC__)
+  // Android-changed: localtime and mktime call this without locallock, from
+  // any number of threads at once. Only store what changed, so that those
+  // threads aren't all writing the same cache line.
+  char *name = (char *) &sp->chars[ttisp->tt_desigidx];
+  if (__atomic_load_n(&tzname[ttisp->tt_isdst], __ATOMIC_RELAXED) != name)
+    __atomic_store_n(&tzname[ttisp->tt_isdst], name, __ATOMIC_RELAXED);
+  if (!ttisp->tt_isdst
+      && __atomic_load_n(&timezone, __ATOMIC_RELAXED) != - ttisp->tt_utoff)
+    __atomic_store_n(&timezone, - ttisp->tt_utoff, __ATOMIC_RELAXED);
+#else
 #if HAVE_TZNAME
   tzname[ttisp->tt_isdst] = (char *) &sp->chars[ttisp->tt_desigidx];
 #endif
@@ -280,6 +291,7 @@ update_tzname_etc(struct state const *sp, struct ttinfo const *ttisp)
   if (!ttisp->tt_isdst)
     timezone = - ttisp->tt_utoff;
 #endif
+#endif
 #if ALTZONE
   if (ttisp->tt_isdst)
     altzone = - ttisp->tt_utoff;
@@ -314,6 +326,13 @@ settzname(void)
 	   When STDDST_MASK becomes zero we can stop looking.  */
 	int stddst_mask = 0;
 
+#if defined(__BIONIC__)
+	// Android-changed: see update_tzname_etc.
+	__atomic_store_n(&tzname[0], (char *) (sp ? wildabbr : utc), __ATOMIC_RELAXED);
+	__atomic_store_n(&tzname[1], (char *) (sp ? wildabbr : utc), __ATOMIC_RELAXED);
+	__atomic_store_n(&timezone, 0, __ATOMIC_RELAXED);
+	stddst_mask = 3;
+#else
 #if HAVE_TZNAME
 	tzname[0] = tzname[1] = (char *) (sp ? wildabbr : utc);
 	stddst_mask = 3;
@@ -322,6 +341,7 @@ settzname(void)
 	timezone = 0;
 	stddst_mask = 3;
 #endif
+#endif
 #if ALTZONE
 	altzone = 0;
 	stddst_mask |= 2;
@@ -335,7 +355,9 @@ settzname(void)
 	  for (i = sp->typecnt - 1; stddst_mask && 0 <= i; i--)
 	    stddst_mask = may_update_tzname_etc(stddst_mask, sp, i);
 	}
-#if USG_COMPAT
+#if defined(__BIONIC__)
+	__atomic_store_n(&daylight, stddst_mask >> 1 ^ 1, __ATOMIC_RELAXED);
+#elif USG_COMPAT
 	daylight = stddst_mask >> 1 ^ 1;
 #endif
 }
@@ -377,6 +399,7 @@ union input_buffer {
 #if defined(__BIONIC__)
 // Android: there is no directory with one file per timezone on Android,
 // but we do have a system property instead.
+#include <stdatomic.h>
 #include <sys/system_properties.h>
 #else
 /* TZDIR with a trailing '/' rather than a trailing '\0'.  */
@@ -409,7 +432,9 @@ tzloadbody(char const *name, struct state *sp, bool doextend,
 	   union local_storage *lsp)
 {
 	register int			i;
+#if !defined(__BIONIC__)
 	register int			fid;
+#endif
 	register int			stored;
 	register ssize_t		nread;
 #if !defined(__BIONIC__)
@@ -435,9 +460,17 @@ tzloadbody(char const *name, struct state *sp, bool doextend,
 	}
 
 #if defined(__BIONIC__)
-	extern int __bionic_open_tzdata(const char*, int32_t*);
+	// Android-changed: the zone's data is in a mapping of the tzdata file.
+	extern int __bionic_find_tzdata(const char*, const char**, int32_t*);
+	const char *data;
 	int32_t entry_length;
-	fid = __bionic_open_tzdata(name, &entry_length);
+	int err = __bionic_find_tzdata(name, &data, &entry_length);
+	if (err != 0)
+	  return err;
+	nread = min(entry_length, (int32_t) sizeof up->buf);
+	memcpy(up->buf, data, nread);
+	if (nread < tzheadsize)
+	  return EINVAL;
 #else
 	if (name[0] == ':')
 		++name;
@@ -474,15 +507,10 @@ tzloadbody(char const *name, struct state *sp, bool doextend,
 	if (doaccess && access(name, R_OK) != 0)
 	  return errno;
   fid = open(name, O_RDONLY | O_BINARY);
-#endif
 	if (fid < 0)
 	  return errno;
 
-#if defined(__BIONIC__)
-	nread = TEMP_FAILURE_RETRY(read(fid, up->buf, entry_length));
-#else
 	nread = read(fid, up->buf, sizeof up->buf);
-#endif
 	if (nread < tzheadsize) {
 	  int err = nread < 0 ? errno : EINVAL;
 	  close(fid);
@@ -490,6 +518,7 @@ tzloadbody(char const *name, struct state *sp, bool doextend,
 	}
 	if (close(fid) < 0)
 	  return errno;
+#endif
 	for (stored = 4; stored <= 8; stored *= 2) {
 	    char version = up->tzhead.tzh_version[0];
 	    bool skip_datablock = stored == 4 && version;
@@ -1451,6 +1480,92 @@ zoneinit(struct state *sp, char const *name)
   }
 }
 
+#if defined(__BIONIC__)
+/*
+** Android-added: finding the local time zone doesn't take locallock.
+** Each zone that tzsetlcl loads becomes a snapshot that is never changed
+** or freed (tzname and tm_zone point into it), and tzset_publish makes
+** the current one visible to other threads through lcl_published.
+** A reader can use the published snapshot without the lock for as long
+** as TZ still names it or, with TZ unset, persist.sys.timezone hasn't
+** changed since it was published. Otherwise the reader takes the lock
+** and goes through tzset_unlocked as before. Zones past the first
+** TZ_MAX_SNAPSHOTS are loaded into lclbuf instead, as upstream would,
+** and while one of those is current every reader takes the lock.
+*/
+#define TZ_MAX_SNAPSHOTS 16
+
+struct tz_snapshot {
+  struct tz_snapshot *next;
+  /* A persist.sys.timezone serial at which the property named this zone.
+     UINT32_MAX is never a serial, since its top byte is the length of
+     the value.  */
+  _Atomic uint32_t prop_serial;
+  struct state state;
+  char name[];
+};
+
+static struct tz_snapshot *tz_snapshots;
+static int tz_snapshot_count;
+static struct tz_snapshot *lcl_snapshot;	/* The one lclptr points into. */
+static struct tz_snapshot *_Atomic lcl_published;
+static struct state *lclbuf;
+
+extern uint32_t __bionic_system_tz_serial(void);
+
+/* Returns the snapshot for NAME, loading it if need be, or NULL if there
+   isn't room for another one. Called with the lock held.  */
+static struct tz_snapshot *
+tz_snapshot_get(char const *name)
+{
+  struct tz_snapshot *s;
+  for (s = tz_snapshots; s; s = s->next)
+    if (strcmp(s->name, name) == 0)
+      return s;
+  if (tz_snapshot_count == TZ_MAX_SNAPSHOTS)
+    return NULL;
+  s = malloc(sizeof *s + strlen(name) + 1);
+  if (!s)
+    return NULL;
+  atomic_init(&s->prop_serial, UINT32_MAX);
+  if (zoneinit(&s->state, name) != 0)
+    zoneinit(&s->state, "");
+  strcpy(s->name, name);
+  s->next = tz_snapshots;
+  tz_snapshots = s;
+  tz_snapshot_count++;
+  return s;
+}
+
+/* Makes the zone that tzsetlcl just set up the published one. PROP_SERIAL
+   is the serial of persist.sys.timezone that named it, or UINT32_MAX if TZ
+   did. Called with the lock held.  */
+void
+tzset_publish(uint32_t prop_serial)
+{
+  struct tz_snapshot *s = lcl_snapshot;
+  if (s && prop_serial != UINT32_MAX)
+    atomic_store_explicit(&s->prop_serial, prop_serial, memory_order_relaxed);
+  atomic_store_explicit(&lcl_published, s, memory_order_release);
+}
+
+/* Returns the published zone if it is still the local one, or NULL.  */
+static struct state *
+lcl_current(void)
+{
+  struct tz_snapshot *s = atomic_load_explicit(&lcl_published,
+					       memory_order_acquire);
+  if (!s)
+    return NULL;
+  char const *name = getenv("TZ");
+  if (name ? strcmp(name, s->name) == 0
+      : (__bionic_system_tz_serial()
+	 == atomic_load_explicit(&s->prop_serial, memory_order_relaxed)))
+    return &s->state;
+  return NULL;
+}
+#endif
+
 void
 tzsetlcl(char const *name)
 {
@@ -1460,6 +1575,22 @@ tzsetlcl(char const *name)
       ? lcl_is_set < 0
       : 0 < lcl_is_set && strcmp(lcl_TZname, name) == 0)
     return;
+#if defined(__BIONIC__)
+  // Android-changed: share a snapshot of the zone when there's room for
+  // one, and otherwise load it into lclbuf; see tz_snapshot.
+  lcl_snapshot = 0 < lcl ? tz_snapshot_get(name) : NULL;
+  if (lcl_snapshot) {
+    lclptr = sp = &lcl_snapshot->state;
+  } else {
+    if (! lclbuf)
+      lclbuf = malloc(sizeof *lclbuf);
+    lclptr = sp = lclbuf;
+    if (sp && zoneinit(sp, name) != 0)
+      zoneinit(sp, "");
+  }
+  if (sp && 0 < lcl)
+    strcpy(lcl_TZname, name);
+#else
 #ifdef ALL_STATE
   if (! sp)
     lclptr = sp = malloc(sizeof *lclptr);
@@ -1470,6 +1601,7 @@ tzsetlcl(char const *name)
     if (0 < lcl)
       strcpy(lcl_TZname, name);
   }
+#endif
   settzname();
   lcl_is_set = lcl;
 }
@@ -1487,6 +1619,10 @@ tzset_unlocked(void)
 void
 tzset(void)
 {
+#if defined(__BIONIC__)
+  if (lcl_current())
+    return;
+#endif
   if (lock() != 0)
     return;
   tzset_unlocked();
@@ -1497,6 +1633,11 @@ static void
 gmtcheck(void)
 {
   static bool gmt_is_set;
+#if defined(__BIONIC__)
+  // Android-added: gmtptr never changes once it's loaded.
+  if (__atomic_load_n(&gmt_is_set, __ATOMIC_ACQUIRE))
+    return;
+#endif
   if (lock() != 0)
     return;
   if (! gmt_is_set) {
@@ -1505,16 +1646,132 @@ gmtcheck(void)
 #endif
     if (gmtptr)
       gmtload(gmtptr);
-    gmt_is_set = true;
+    __atomic_store_n(&gmt_is_set, true, __ATOMIC_RELEASE);
   }
   unlock();
 }
 
 #if NETBSD_INSPIRED
 
+#if defined(__BIONIC__)
+/*
+** Android-added: tzalloc shares the zones it loads by name, and keeps
+** the TZ_MAX_CACHED most recently used ones loaded after their last
+** tzfree, so that code that formats times in several zones doesn't
+** reload them every time. Nothing modifies a timezone_t once it's loaded.
+*/
+#define TZ_MAX_CACHED 8
+
+struct tz_cached {
+  struct tz_cached *prev;
+  struct tz_cached *next;	/* Toward the least recently used.  */
+  long refs;			/* Callers, plus one while cached.  */
+  struct state state;
+  char name[];
+};
+
+static struct tz_cached *tz_cache_head;
+static struct tz_cached *tz_cache_tail;
+static int tz_cache_count;
+
+static struct tz_cached *
+tz_cached_of(timezone_t sp)
+{
+  return (struct tz_cached *) ((char *) sp - offsetof(struct tz_cached, state));
+}
+
+/* The functions below are called with the lock held.  */
+
+static void
+tz_cache_unlink(struct tz_cached *c)
+{
+  if (c->prev) c->prev->next = c->next; else tz_cache_head = c->next;
+  if (c->next) c->next->prev = c->prev; else tz_cache_tail = c->prev;
+}
+
+static void
+tz_cache_push(struct tz_cached *c)
+{
+  c->prev = NULL;
+  c->next = tz_cache_head;
+  if (tz_cache_head) tz_cache_head->prev = c; else tz_cache_tail = c;
+  tz_cache_head = c;
+}
+
+/* Returns a new reference to the cached zone NAME, or NULL.  */
+static timezone_t
+tz_cache_get(char const *name)
+{
+  struct tz_cached *c;
+  for (c = tz_cache_head; c; c = c->next)
+    if (strcmp(c->name, name) == 0) {
+      c->refs++;
+      tz_cache_unlink(c);
+      tz_cache_push(c);
+      return &c->state;
+    }
+  return NULL;
+}
+
+/* Caches C, and returns the zone evicted to make room that now needs
+   freeing, if any.  */
+static struct tz_cached *
+tz_cache_add(struct tz_cached *c)
+{
+  struct tz_cached *victim = tz_cache_tail;
+  c->refs++;
+  tz_cache_push(c);
+  if (++tz_cache_count <= TZ_MAX_CACHED)
+    return NULL;
+  tz_cache_unlink(victim);
+  tz_cache_count--;
+  return --victim->refs == 0 ? victim : NULL;
+}
+#endif
+
 timezone_t
 tzalloc(char const *name)
 {
+#if defined(__BIONIC__)
+  // Android-changed: share zones; see tz_cached. The system zone (a null
+  // NAME) can change, so it's always loaded afresh and never cached.
+  timezone_t sp;
+  if (name && lock() == 0) {
+    sp = tz_cache_get(name);
+    unlock();
+    if (sp)
+      return sp;
+  }
+  struct tz_cached *c = malloc(sizeof *c + (name ? strlen(name) + 1 : 0));
+  if (!c) {
+    if (!HAVE_MALLOC_ERRNO)
+      errno = ENOMEM;
+    return NULL;
+  }
+  int err = zoneinit(&c->state, name);
+  if (err != 0) {
+    free(c);
+    errno = err;
+    return NULL;
+  }
+  c->refs = 1;
+  if (name && lock() == 0) {
+    /* Another thread may have loaded the same zone meanwhile.  */
+    struct tz_cached *victim;
+    sp = tz_cache_get(name);
+    if (sp) {
+      victim = c;
+    } else {
+      strcpy(c->name, name);
+      victim = tz_cache_add(c);
+      sp = &c->state;
+    }
+    unlock();
+    free(victim);
+    return sp;
+  }
+  return &c->state;
+#else
   timezone_t sp = malloc(sizeof *sp);
   if (sp) {
     int err = zoneinit(sp, name);
@@ -1526,12 +1783,24 @@ tzalloc(char const *name)
   } else if (!HAVE_MALLOC_ERRNO)
     errno = ENOMEM;
   return sp;
+#endif
 }
 
 void
 tzfree(timezone_t sp)
 {
+#if defined(__BIONIC__)
+  struct tz_cached *c;
+  if (!sp || lock() != 0)
+    return;
+  c = tz_cached_of(sp);
+  if (--c->refs != 0)
+    c = NULL;
+  unlock();
+  free(c);
+#else
   free(sp);
+#endif
 }
 
 /*
@@ -1669,6 +1938,12 @@ localtime_rz(struct state *restrict sp, time_t const *restrict timep,
 static struct tm *
 localtime_tzset(time_t const *timep, struct tm *tmp)
 {
+#if defined(__BIONIC__)
+  struct state *sp = lcl_current();
+  if (sp)
+    return localsub(sp, timep, true, tmp);
+#endif
+
   int err = lock();
   if (err) {
     errno = err;
@@ -2349,6 +2624,14 @@ mktime(struct tm *tmp)
 #endif
 
   time_t t;
+#if defined(__BIONIC__)
+  struct state *sp = lcl_current();
+  if (sp) {
+    t = mktime_tzname(sp, tmp, true);
+    errno = (t == -1) ? EOVERFLOW : saved_errno;
+    return t;
+  }
+#endif
   int err = lock();
   if (err) {
     errno = err;
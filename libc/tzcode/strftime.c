@@ -124,6 +124,9 @@ static char *   _conv(int, const char *, char *, const char *);
 static char *   _fmt(const char *, const struct tm *, char *, const char *,
             enum warn *);
 static char *   _yconv(int, int, bool, bool, char *, const char *, int);
+#if defined TM_GMTOFF && defined TM_ZONE
+static int      _fmt_fixed(const char *, const struct tm *, char *, size_t);
+#endif
 
 #ifndef YEAR_2000_NAME
 # define YEAR_2000_NAME  "CHECK_STRFTIME_FORMATS_FOR_TWO_DIGIT_YEARS"
@@ -151,6 +154,13 @@ strftime(char *restrict s, size_t maxsize, char const *restrict format,
     enum warn warn = IN_NONE;
 
     tzset();
+#if defined TM_GMTOFF && defined TM_ZONE
+    {
+        int len = _fmt_fixed(format, t, s, maxsize);
+        if (len >= 0)
+            return len;
+    }
+#endif
     p = _fmt(format, t, s, s + maxsize, &warn);
     if (!p) {
        errno = EOVERFLOW;
@@ -213,6 +223,113 @@ static const char* _safe_tm_zone(const struct tm* tm) {
 }
 #endif
 
+#if defined TM_GMTOFF && defined TM_ZONE
+/*
+** Android-added: formatters for the timestamp formats that logs and
+** network protocols use most, which avoid interpreting the format one
+** conversion at a time. Returns the length of the result, or -1 to leave
+** the format, the fields, or a buffer that is too small to _fmt.
+*/
+
+static const char two_digits[] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+static char *
+_put2(int n, char *p)
+{
+    memcpy(p, &two_digits[2 * n], 2);
+    return p + 2;
+}
+
+static int
+_fmt_fixed(const char *format, const struct tm *t, char *s, size_t maxsize)
+{
+    char buf[sizeof "Sun, 06 Nov 1994 08:49:37 +0000"];
+    char *p = buf;
+    char sep = 'T';
+    bool rfc2822 = false;
+    bool zone = false;
+    long diff = 0;
+    bool negative = false;
+
+    if (strcmp(format, "%Y-%m-%dT%H:%M:%S") == 0) {
+    } else if (strcmp(format, "%Y-%m-%d %H:%M:%S") == 0) {
+        sep = ' ';
+    } else if (strcmp(format, "%Y-%m-%dT%H:%M:%S%z") == 0) {
+        zone = true;
+    } else if (strcmp(format, "%a, %d %b %Y %H:%M:%S %z") == 0) {
+        rfc2822 = zone = true;
+    } else {
+        return -1;
+    }
+
+    /* Anything that _fmt wouldn't print as exactly two or four digits. */
+    if (t->tm_year < -TM_YEAR_BASE || t->tm_year > 9999 - TM_YEAR_BASE
+        || t->tm_mon < 0 || t->tm_mon >= MONSPERYEAR
+        || t->tm_mday < 0 || t->tm_mday > 99
+        || t->tm_hour < 0 || t->tm_hour > 99
+        || t->tm_min < 0 || t->tm_min > 99
+        || t->tm_sec < 0 || t->tm_sec > 99
+        || (rfc2822 && (t->tm_wday < 0 || t->tm_wday >= DAYSPERWEEK)))
+        return -1;
+    if (zone) {
+        /* As %z in _fmt. */
+        diff = t->TM_GMTOFF;
+        negative = diff < 0;
+        if (diff == 0)
+            negative = _safe_tm_zone(t)[0] == '-';
+        if (negative)
+            diff = -diff;
+        diff /= SECSPERMIN;
+        diff = (diff / MINSPERHOUR) * 100 + (diff % MINSPERHOUR);
+        if (diff > 9999)
+            return -1;
+    }
+
+    if (rfc2822) {
+        memcpy(p, C_time_locale.wday[t->tm_wday], 3);
+        p[3] = ',';
+        p[4] = ' ';
+        p = _put2(t->tm_mday, p + 5);
+        *p++ = ' ';
+        memcpy(p, C_time_locale.mon[t->tm_mon], 3);
+        p[3] = ' ';
+        p += 4;
+    }
+    p = _put2((t->tm_year + TM_YEAR_BASE) / 100, p);
+    p = _put2((t->tm_year + TM_YEAR_BASE) % 100, p);
+    if (!rfc2822) {
+        *p++ = '-';
+        p = _put2(t->tm_mon + 1, p);
+        *p++ = '-';
+        p = _put2(t->tm_mday, p);
+    }
+    *p++ = rfc2822 ? ' ' : sep;
+    p = _put2(t->tm_hour, p);
+    *p++ = ':';
+    p = _put2(t->tm_min, p);
+    *p++ = ':';
+    p = _put2(t->tm_sec, p);
+    if (zone) {
+        if (rfc2822)
+            *p++ = ' ';
+        *p++ = negative ? '-' : '+';
+        p = _put2(diff / 100, p);
+        p = _put2(diff % 100, p);
+    }
+
+    if ((size_t) (p - buf) >= maxsize)
+        return -1;
+    memcpy(s, buf, p - buf);
+    s[p - buf] = '\0';
+    return p - buf;
+}
+#endif
+
 static char *
 _fmt(const char *format, const struct tm *t, char *pt,
         const char *ptlim, enum warn *warnp)
@@ -91,9 +91,197 @@ static	const u_char *_find_string(const u_char *, int *, const char * const *,
 	    const char * const *, int);
 
 
+/*
+ * Android-added: parsers for the timestamp formats that logs and network
+ * protocols use most, which avoid interpreting the format one conversion
+ * at a time. They only accept input laid out exactly as strftime() would
+ * print it, and leave any other input to _strptime(), which gives the same
+ * result for everything they do accept.
+ */
+#define FIXED_NAME(a, b, c)	(((a) << 16) | ((b) << 8) | (c))
+
+/* The C locale's abbreviated day and month names, lower-cased and packed. */
+static const int fixed_abday[DAYSPERWEEK] = {
+	FIXED_NAME('s', 'u', 'n'), FIXED_NAME('m', 'o', 'n'),
+	FIXED_NAME('t', 'u', 'e'), FIXED_NAME('w', 'e', 'd'),
+	FIXED_NAME('t', 'h', 'u'), FIXED_NAME('f', 'r', 'i'),
+	FIXED_NAME('s', 'a', 't'),
+};
+static const int fixed_abmon[MONSPERYEAR] = {
+	FIXED_NAME('j', 'a', 'n'), FIXED_NAME('f', 'e', 'b'),
+	FIXED_NAME('m', 'a', 'r'), FIXED_NAME('a', 'p', 'r'),
+	FIXED_NAME('m', 'a', 'y'), FIXED_NAME('j', 'u', 'n'),
+	FIXED_NAME('j', 'u', 'l'), FIXED_NAME('a', 'u', 'g'),
+	FIXED_NAME('s', 'e', 'p'), FIXED_NAME('o', 'c', 't'),
+	FIXED_NAME('n', 'o', 'v'), FIXED_NAME('d', 'e', 'c'),
+};
+
+/* Returns the two digits at bp, or -1. */
+static int
+_fixed_num2(const unsigned char *bp)
+{
+	if (!isdigit(bp[0]) || !isdigit(bp[1]))
+		return (-1);
+	return ((bp[0] - '0') * 10 + (bp[1] - '0'));
+}
+
+/* Returns the index of the three letter name at bp in names, or -1. */
+static int
+_fixed_name(const unsigned char *bp, const int *names, int n)
+{
+	int i, key = 0;
+
+	for (i = 0; i < 3; i++) {
+		if (!isalpha(bp[i]))
+			return (-1);
+		key = (key << 8) | tolower(bp[i]);
+	}
+	for (i = 0; i < n; i++)
+		if (names[i] == key)
+			return (i);
+	return (-1);
+}
+
+/* Parses a four digit "%Y". */
+static const unsigned char *
+_fixed_year(const unsigned char *bp, struct tm *tm)
+{
+	int hi, lo;
+
+	hi = _fixed_num2(bp);
+	lo = (hi == -1) ? -1 : _fixed_num2(bp + 2);
+	if (lo == -1)
+		return (NULL);
+	tm->tm_year = hi * 100 + lo - TM_YEAR_BASE;
+	return (bp + 4);
+}
+
+/* Parses "%H:%M:%S". */
+static const unsigned char *
+_fixed_time(const unsigned char *bp, struct tm *tm)
+{
+	tm->tm_hour = _fixed_num2(bp);
+	if (tm->tm_hour < 0 || tm->tm_hour > 23 || bp[2] != ':')
+		return (NULL);
+	tm->tm_min = _fixed_num2(bp + 3);
+	if (tm->tm_min < 0 || tm->tm_min > 59 || bp[5] != ':')
+		return (NULL);
+	tm->tm_sec = _fixed_num2(bp + 6);
+	if (tm->tm_sec < 0 || tm->tm_sec > 60)
+		return (NULL);
+	return (bp + 8);
+}
+
+/* Parses "%Y-%m-%d", then sep, then "%H:%M:%S". */
+static const unsigned char *
+_fixed_datetime(const unsigned char *bp, int sep, struct tm *tm)
+{
+	if ((bp = _fixed_year(bp, tm)) == NULL || bp[0] != '-')
+		return (NULL);
+	tm->tm_mon = _fixed_num2(bp + 1) - 1;
+	if (tm->tm_mon < 0 || tm->tm_mon >= MONSPERYEAR || bp[3] != '-')
+		return (NULL);
+	tm->tm_mday = _fixed_num2(bp + 4);
+	if (tm->tm_mday < 1 || tm->tm_mday > 31 || bp[6] != sep)
+		return (NULL);
+	return (_fixed_time(bp + 7, tm));
+}
+
+/* Parses a numeric "%z", "+hhmm" or "-hhmm". */
+static const unsigned char *
+_fixed_offset(const unsigned char *bp, struct tm *tm)
+{
+	int hh, mm;
+
+	if (bp[0] != '+' && bp[0] != '-')
+		return (NULL);
+	hh = _fixed_num2(bp + 1);
+	mm = (hh == -1) ? -1 : _fixed_num2(bp + 3);
+	if (mm == -1)
+		return (NULL);
+	tm->tm_gmtoff = hh * SECSPERHOUR + mm * SECSPERMIN;
+	if (bp[0] == '-')
+		tm->tm_gmtoff = -tm->tm_gmtoff;
+	tm->tm_isdst = 0;
+	tm->tm_zone = NULL;
+	return (bp + 5);
+}
+
+static char *
+_strptime_fixed(const char *buf, const char *fmt, struct tm *out)
+{
+	const unsigned char *bp = (const unsigned char *)buf;
+	struct tm tm = *out;
+	int wday = -1;
+	int i;
+
+	if (_CurrentTimeLocale != &_DefaultTimeLocale)
+		return (NULL);
+
+	if (strcmp(fmt, "%Y-%m-%dT%H:%M:%S") == 0) {
+		bp = _fixed_datetime(bp, 'T', &tm);
+	} else if (strcmp(fmt, "%Y-%m-%d %H:%M:%S") == 0) {
+		bp = _fixed_datetime(bp, ' ', &tm);
+	} else if (strcmp(fmt, "%Y-%m-%dT%H:%M:%S%z") == 0) {
+		bp = _fixed_datetime(bp, 'T', &tm);
+		if (bp != NULL)
+			bp = _fixed_offset(bp, &tm);
+	} else if (strcmp(fmt, "%a, %d %b %Y %H:%M:%S %z") == 0) {
+		/* "Sun, 06 Nov 1994 08:49:37 +0000" */
+		wday = _fixed_name(bp, fixed_abday, DAYSPERWEEK);
+		if (wday == -1 || bp[3] != ',' || bp[4] != ' ')
+			return (NULL);
+		bp += 5;
+		tm.tm_mday = _fixed_num2(bp);
+		if (tm.tm_mday < 1 || tm.tm_mday > 31 || bp[2] != ' ')
+			return (NULL);
+		bp += 3;
+		tm.tm_mon = _fixed_name(bp, fixed_abmon, MONSPERYEAR);
+		if (tm.tm_mon == -1 || bp[3] != ' ')
+			return (NULL);
+		bp = _fixed_year(bp + 4, &tm);
+		if (bp == NULL || bp[0] != ' ')
+			return (NULL);
+		bp = _fixed_time(bp + 1, &tm);
+		if (bp == NULL || bp[0] != ' ')
+			return (NULL);
+		bp = _fixed_offset(bp + 1, &tm);
+	} else {
+		return (NULL);
+	}
+	if (bp == NULL)
+		return (NULL);
+
+	/* Fill in the day of the year and week as _strptime() would. */
+	const int year = tm.tm_year + TM_YEAR_BASE;
+	const int *mon_lens = mon_lengths[isleap(year)];
+	tm.tm_yday = tm.tm_mday - 1;
+	for (i = 0; i < tm.tm_mon; i++)
+		tm.tm_yday += mon_lens[i];
+	if (wday != -1) {
+		tm.tm_wday = wday;
+	} else {
+		tm.tm_wday = (EPOCH_WDAY +
+		    ((year - EPOCH_YEAR) % DAYSPERWEEK) *
+		    (DAYSPERNYEAR % DAYSPERWEEK) +
+		    leaps_thru_end_of(year - 1) -
+		    leaps_thru_end_of(EPOCH_YEAR - 1) +
+		    tm.tm_yday) % DAYSPERWEEK;
+		if (tm.tm_wday < 0)
+			tm.tm_wday += DAYSPERWEEK;
+	}
+	*out = tm;
+	return ((char *)bp);
+}
+
 char *
 strptime(const char *buf, const char *fmt, struct tm *tm)
 {
+	char *end;
+
+	/* Android-added: see _strptime_fixed(). */
+	if ((end = _strptime_fixed(buf, fmt, tm)) != NULL)
+		return (end);
 	return(_strptime(buf, fmt, tm, 1));
 }
 DEF_WEAK(strptime);
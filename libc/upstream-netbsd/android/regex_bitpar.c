@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * A bit-parallel matcher for the NetBSD regex code.
+ *
+ * A pattern that is just a chain of at most BPMAXPOS positions (see
+ * bpposition()), optionally between ^ and $, is matched by regexec() with
+ * one word of state (Shift-And, extended to optional and repeated
+ * positions) instead of by the engine.  That covers most of what log
+ * filters use: words, character classes, `.*'.
+ *
+ * This is Android's own code, kept out of the upstream files so that they
+ * can be synced; regcomp(), regexec() and regfree() each just call in here.
+ */
+
+#include <sys/types.h>
+#include <limits.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/libc/regex/utils.h"
+#include "../lib/libc/regex/regex2.h"
+
+#define	BPMAXPOS	64	/* bits in a uint64_t */
+
+/* flags for one bit-parallel position */
+#define	BPREP	01	/* x+ */
+#define	BPOPT	02	/* x? */
+
+/* anchors around the positions */
+#define	BPBOL	01	/* starts with ^ */
+#define	BPEOL	02	/* ends with $ */
+
+struct re_bitpar {
+	uint64_t mask[NC_MAX];	/* positions each char matches */
+	uint64_t rep;		/* positions that may repeat */
+	uint64_t opt;		/* positions that may be skipped */
+	sopno len;		/* number of positions */
+	int anchor;		/* BPBOL, BPEOL */
+	int mb;			/* mask holds in multibyte locales too */
+};
+
+/*
+ - bpposition - parse one position of a bit-parallel pattern
+ *
+ * A position is a single character, `.' or bracket expression, perhaps in
+ * parentheses, perhaps followed by ?, * or +.  Returns the strip index
+ * just past it, or 0 if the strip at pc is something else.
+ */
+static sopno
+bpposition(const struct re_guts *g, sopno pc, sopno *atom, int *flags)
+{
+	sop s = g->strip[pc];
+	sopno end;
+
+	switch (OP(s)) {
+	case OCHAR:
+		if (OPND(s) >= NC_MAX)
+			return(0);
+		/* FALLTHROUGH */
+	case OANY:
+	case OANYOF:
+		*atom = pc;
+		return(pc + 1);
+	case OLPAREN:
+		end = bpposition(g, pc + 1, atom, flags);
+		if (end == 0 || OP(g->strip[end]) != ORPAREN)
+			return(0);
+		return(end + 1);
+	case OPLUS_:		/* x+ */
+		end = bpposition(g, pc + 1, atom, flags);
+		if (end == 0 || OP(g->strip[end]) != O_PLUS)
+			return(0);
+		*flags |= BPREP;
+		return(end + 1);
+	case OQUEST_:		/* x* is emitted as (x+)? */
+		end = bpposition(g, pc + 1, atom, flags);
+		if (end == 0 || OP(g->strip[end]) != O_QUEST)
+			return(0);
+		*flags |= BPOPT;
+		return(end + 1);
+	case OCH_:		/* x? is emitted as (x|) */
+		end = bpposition(g, pc + 1, atom, flags);
+		if (end == 0 || OP(g->strip[end]) != OOR1 ||
+		    OP(g->strip[end + 1]) != OOR2 ||
+		    OP(g->strip[end + 2]) != O_CH)
+			return(0);
+		*flags |= BPOPT;
+		return(end + 3);
+	default:
+		return(0);
+	}
+}
+
+/*
+ - __regex_bitpar_compile - set up the bit-parallel matcher for a pattern
+ *
+ * Called by regcomp() once the strip is final.  Returns NULL if the
+ * pattern doesn't fit, or if there's no memory; neither is an error.
+ */
+struct re_bitpar *
+__regex_bitpar_compile(struct re_guts *g)
+{
+	sopno atoms[BPMAXPOS];
+	int flags[BPMAXPOS];
+	struct re_bitpar *bp;
+	sopno pc, npos;
+	sop s;
+	cset *cs;
+	uint64_t bit;
+	int anchor;
+	int ch;
+	int mb;
+
+	_DIAGASSERT(g != NULL);
+
+	if (g->backrefs)
+		return(NULL);
+
+	npos = 0;
+	anchor = 0;
+	for (pc = g->firststate + 1; pc < g->laststate; ) {
+		s = g->strip[pc];
+		switch (OP(s)) {
+		case OLPAREN:		/* only subexpressions care */
+		case ORPAREN:
+			pc++;
+			continue;
+		case OBOL:
+			if (npos != 0 || anchor != 0)
+				return(NULL);
+			anchor |= BPBOL;
+			pc++;
+			continue;
+		case OEOL:
+			if (anchor & BPEOL)
+				return(NULL);
+			anchor |= BPEOL;
+			pc++;
+			continue;
+		}
+		if ((anchor & BPEOL) || npos == BPMAXPOS)
+			return(NULL);
+		flags[npos] = 0;
+		pc = bpposition(g, pc, &atoms[npos], &flags[npos]);
+		if (pc == 0)
+			return(NULL);
+		npos++;
+	}
+	if (npos == 0)
+		return(NULL);
+
+	bp = calloc(1, sizeof(*bp));
+	if (bp == NULL)
+		return(NULL);
+	/*
+	 * These masks are right when characters are bytes.  In a multibyte
+	 * locale the engine still steps a byte at a time, but it tests a
+	 * byte >= 128 against a set's wide characters, ranges and classes
+	 * rather than its bitmap (see CHIN()).  So the masks hold there too
+	 * only if no position can match such a byte: no `.', and no bracket
+	 * that is negated, case-insensitive or not all ASCII.
+	 */
+	mb = 1;
+	for (pc = 0; pc < npos; pc++) {
+		bit = (uint64_t)1 << pc;
+		s = g->strip[atoms[pc]];
+		switch (OP(s)) {
+		case OCHAR:
+			bp->mask[OPND(s)] |= bit;
+			break;
+		case OANY:
+			for (ch = 0; ch < NC_MAX; ch++)
+				bp->mask[ch] |= bit;
+			break;
+		case OANYOF:
+			cs = &g->sets[OPND(s)];
+			for (ch = 0; ch < NC_MAX; ch++)
+				if (CHIN(cs, ch))
+					bp->mask[ch] |= bit;
+			if (cs->invert || cs->icase || cs->nwides != 0 ||
+			    cs->nranges != 0 || cs->ntypes != 0)
+				mb = 0;
+			break;
+		}
+		for (ch = 0x80; ch < NC_MAX; ch++)
+			if (bp->mask[ch] & bit)
+				mb = 0;
+		if (flags[pc] & BPREP)
+			bp->rep |= bit;
+		if (flags[pc] & BPOPT)
+			bp->opt |= bit;
+	}
+	if (!mb && MB_CUR_MAX != 1) {
+		free(bp);
+		return(NULL);
+	}
+	bp->len = npos;
+	bp->anchor = anchor;
+	bp->mb = mb;
+	return(bp);
+}
+
+/*
+ - __regex_bitpar_exec - match with the bit-parallel matcher
+ *
+ * Called by regexec() when regcomp() set g->bitpar.  Bit i of the state is
+ * set when the text just read matches the first i+1 positions of the
+ * pattern, so each character costs a few word operations and nothing is
+ * allocated.  Every match of a pattern without optional or repeated
+ * positions has the same length, so the first match to end is also the
+ * leftmost one.  Otherwise only whether there is a match is known here;
+ * -1 asks the caller to find where with the engine.
+ */
+int				/* 0 success, REG_NOMATCH failure, -1 unsure */
+__regex_bitpar_exec(const struct re_guts *g,
+	const char *string,
+	size_t nmatch,
+	regmatch_t pmatch[],
+	int eflags)
+{
+	const struct re_bitpar *bp = g->bitpar;
+	const uint64_t *mask = bp->mask;
+	const uint64_t last = (uint64_t)1 << (bp->len - 1);
+	const uint64_t rep = bp->rep;
+	const uint64_t opt = bp->opt;
+	const int newline = (g->cflags&REG_NEWLINE) != 0;
+	const char *start;
+	const char *stop;
+	const char *p;
+	uint64_t d, prev;
+	uint64_t s;		/* 1 if a match may start here */
+	size_t i;
+	uch c;
+
+	if (MB_CUR_MAX != 1 && !bp->mb)
+		return(-1);
+
+	if (g->cflags&REG_NOSUB)
+		nmatch = 0;
+	if (eflags&REG_STARTEND) {
+		_DIAGASSERT(pmatch != NULL);
+		start = string + (size_t)pmatch[0].rm_so;
+		stop = string + (size_t)pmatch[0].rm_eo;
+	} else {
+		start = string;
+		stop = start + strlen(start);
+	}
+	if (stop < start)
+		return(REG_INVARG);
+
+	/* prescreening; a miss is usually ruled out here */
+	p = start;
+	if (g->must != NULL) {
+		p = memmem(start, (size_t)(stop - start), g->must, g->mlen);
+		if (p == NULL)
+			return(REG_NOMATCH);
+		/* no match can start more than moffset before the must */
+		if (g->moffset > -1 && p - start > g->moffset)
+			p -= g->moffset;
+		else
+			p = start;
+	}
+
+	if (bp->anchor == 0 && opt == 0) {
+		/* the common case, with nothing to check between characters */
+		d = 0;
+		while (p != stop) {
+			d = ((d << 1) | 1 | (d & rep)) & mask[(uch)*p++];
+			if (d & last)
+				goto found;
+		}
+		return(REG_NOMATCH);
+	}
+
+	/* the same rules for ^ as walk() */
+	if (!(bp->anchor&BPBOL))
+		s = 1;
+	else if (start == string || !(eflags&REG_NOTBOL))
+		s = !(eflags&REG_NOTBOL);
+	else
+		s = newline && start[-1] == '\n';
+
+	d = 0;
+	for (p = start;; p++) {
+		/* skip optional positions without reading anything */
+		if (opt != 0) {
+			do {
+				prev = d;
+				d |= ((d << 1) | s) & opt;
+			} while (d != prev);
+		}
+		if ((d & last) && (!(bp->anchor&BPEOL) ||
+		    (p == stop && !(eflags&REG_NOTEOL)) ||
+		    (p != stop && newline && *p == '\n')))
+			break;
+		if (p == stop)
+			return(REG_NOMATCH);
+		c = (uch)*p;
+		d = (((d << 1) | s) | (d & rep)) & mask[c];
+		if (bp->anchor&BPBOL) {
+			s = newline && c == '\n';
+			if (d == 0 && !newline)
+				return(REG_NOMATCH);
+		}
+	}
+
+found:
+	/* a match ends at p */
+	if (nmatch == 0)
+		return(0);
+	if (rep != 0 || opt != 0 || (nmatch > 1 && g->nsub > 0))
+		return(-1);
+	_DIAGASSERT(pmatch != NULL);
+	pmatch[0].rm_so = (p - string) - bp->len;
+	pmatch[0].rm_eo = p - string;
+	for (i = 1; i < nmatch; i++) {
+		pmatch[i].rm_so = (regoff_t)-1;
+		pmatch[i].rm_eo = (regoff_t)-1;
+	}
+	return(0);
+}
@@ -369,6 +369,7 @@ regcomp_internal(regex_t * __restrict preg,
 	g->mlen = 0;
 	g->nsub = 0;
 	g->backrefs = 0;
+	g->bitpar = NULL;
 
 	/* do it */
 	EMIT(OEND, 0);
@@ -395,6 +396,8 @@ regcomp_internal(regex_t * __restrict preg,
 		}
 	}
 	g->nplus = pluscount(p, g);
+	if (p->error == 0)	/* Android-added */
+		g->bitpar = __regex_bitpar_compile(g);
 	g->magic = MAGIC2;
 	preg->re_nsub = g->nsub;
 	preg->re_g = g;
@@ -196,8 +196,14 @@ struct re_guts {
 	size_t nsub;		/* copy of re_nsub */
 	int backrefs;		/* does it use back references? */
 	sopno nplus;		/* how deep does it nest +s? */
+	struct re_bitpar *bitpar;	/* Android-added: see regex_bitpar.c */
 };
 
+/* Android-added: the bit-parallel matcher in android/regex_bitpar.c */
+__LIBC_HIDDEN__ struct re_bitpar *__regex_bitpar_compile(struct re_guts *);
+__LIBC_HIDDEN__ int __regex_bitpar_exec(const struct re_guts *, const char *,
+    size_t, regmatch_t[], int);
+
 /* misc utilities */
 #define	OUT	(CHAR_MIN - 1)	/* a non-character value */
 #define	IGN	(CHAR_MIN - 2)
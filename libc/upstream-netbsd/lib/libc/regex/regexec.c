@@ -245,6 +245,13 @@ regexec(const regex_t * __restrict preg,
 		return(REG_BADPAT);
 	eflags = GOODFLAGS(eflags);
 
+	if (g->bitpar != NULL) {	/* Android-added */
+		int error = __regex_bitpar_exec(g, string, nmatch, pmatch, eflags);
+
+		if (error != -1)
+			return(error);
+	}
+
 	if (MB_CUR_MAX > 1)
 		return(mmatcher(g, string, nmatch, pmatch, eflags));
 	else if (g->nstates <= CHAR_BIT*sizeof(states1) && !(eflags&REG_LARGE))
@@ -100,5 +100,7 @@ regfree(regex_t *preg)
 		free(&g->charjump[CHAR_MIN]);
 	if (g->matchjump != NULL)
 		free(g->matchjump);
+	if (g->bitpar != NULL)	/* Android-added */
+		free(g->bitpar);
 	free(g);
 }
@@ -1814,6 +1814,7 @@ bool find_libraries(android_namespace_t* ns,
             !get_cfi_shadow()->AfterLoad(si, solist_get_head())) {
           return false;
         }
+        initialize_soinfo_static_tls(si);
       }
 
       return true;
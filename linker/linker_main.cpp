@@ -28,6 +28,7 @@
 
 #include "linker_main.h"
 
+#include <errno.h>
 #include <link.h>
 #include <stdlib.h>
 #include <sys/auxv.h>
@@ -164,6 +165,24 @@ static void parse_LD_PRELOAD(const char* path) {
   }
 }
 
+// The amount of static TLS reserved for dlopen'ed libraries. Zero by default,
+// so dlopen'ed libraries use dynamic TLS unless LD_STATIC_TLS_SURPLUS is set.
+static constexpr size_t kMaxStaticTlsSurplus = 1024 * 1024;
+static size_t g_static_tls_surplus = 0;
+
+static void parse_LD_STATIC_TLS_SURPLUS(const char* value) {
+  if (value == nullptr) return;
+  char* end;
+  errno = 0;
+  unsigned long long size = strtoull(value, &end, 0);
+  if (*value == '\0' || *end != '\0' || errno != 0 || size > kMaxStaticTlsSurplus) {
+    DL_WARN("ignoring invalid LD_STATIC_TLS_SURPLUS value \"%s\" (must be at most %zu)", value,
+            kMaxStaticTlsSurplus);
+    return;
+  }
+  g_static_tls_surplus = size;
+}
+
 // An empty list of soinfos
 static soinfo_list_t g_empty_list;
 
@@ -321,6 +340,7 @@ static ElfW(Addr) linker_main(KernelArgumentBlock& args, const char* exe_to_load
     if (ldpreload_env != nullptr) {
       LD_DEBUG(any, "[ LD_PRELOAD set to \"%s\" ]", ldpreload_env);
     }
+    parse_LD_STATIC_TLS_SURPLUS(getenv("LD_STATIC_TLS_SURPLUS"));
   }
 
   const ExecutableInfo exe_info = exe_to_load ? load_executable(exe_to_load) :
@@ -477,7 +497,7 @@ static ElfW(Addr) linker_main(KernelArgumentBlock& args, const char* exe_to_load
   __libc_init_mte_stack(args.argv);
 #endif
 
-  linker_finalize_static_tls();
+  linker_finalize_static_tls(g_static_tls_surplus);
   __libc_init_main_thread_final();
 
   if (!get_cfi_shadow()->InitialLinkDone(solist)) __linker_cannot_link(g_argv[0]);
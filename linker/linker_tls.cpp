@@ -56,6 +56,17 @@ static size_t get_unused_module_index() {
   return g_tls_modules.size() - 1;
 }
 
+// The lock on TlsModules must be held.
+static size_t bump_tls_generation() {
+  TlsModules& libc_modules = __libc_shared_globals()->tls_modules;
+  const size_t new_generation = ++libc_modules.generation;
+  __libc_tls_generation_copy = new_generation;
+  if (libc_modules.generation_libc_so != nullptr) {
+    *libc_modules.generation_libc_so = new_generation;
+  }
+  return new_generation;
+}
+
 static void register_tls_module(soinfo* si, size_t static_offset) {
   TlsModules& libc_modules = __libc_shared_globals()->tls_modules;
 
@@ -69,15 +80,12 @@ static void register_tls_module(soinfo* si, size_t static_offset) {
   soinfo_tls* si_tls = si->get_tls();
   si_tls->module_id = __tls_module_idx_to_id(module_idx);
 
-  const size_t new_generation = ++libc_modules.generation;
-  __libc_tls_generation_copy = new_generation;
-  if (libc_modules.generation_libc_so != nullptr) {
-    *libc_modules.generation_libc_so = new_generation;
-  }
+  const size_t new_generation = bump_tls_generation();
 
   g_tls_modules[module_idx] = {
     .segment = si_tls->segment,
     .static_offset = static_offset,
+    .static_image_pending = g_static_tls_finished && static_offset != SIZE_MAX,
     .first_generation = new_generation,
     .soinfo_ptr = si,
   };
@@ -89,7 +97,12 @@ static void unregister_tls_module(soinfo* si) {
 
   soinfo_tls* si_tls = si->get_tls();
   TlsModule& mod = g_tls_modules[__tls_module_id_to_idx(si_tls->module_id)];
-  CHECK(mod.static_offset == SIZE_MAX);
+  // Modules loaded before the static TLS layout was finished are never
+  // unloaded. A module in the static TLS surplus can be, but its memory isn't
+  // reused.
+  CHECK(mod.static_offset == SIZE_MAX ||
+        __tls_module_id_to_idx(si_tls->module_id) >=
+            __libc_shared_globals()->tls_modules.static_module_count);
   CHECK(mod.soinfo_ptr == si);
   mod = {};
   si_tls->module_id = kTlsUninitializedModuleId;
@@ -130,9 +143,11 @@ void linker_setup_exe_static_tls(const char* progname) {
   __linker_reserve_bionic_tls_in_static_tls();
 }
 
-void linker_finalize_static_tls() {
+void linker_finalize_static_tls(size_t surplus) {
   g_static_tls_finished = true;
-  __libc_shared_globals()->static_tls_layout.finish_layout();
+  StaticTlsLayout& layout = __libc_shared_globals()->static_tls_layout;
+  layout.reserve_surplus(surplus);
+  layout.finish_layout();
   TlsModules& modules = __libc_shared_globals()->tls_modules;
   modules.static_module_count = modules.module_count;
 }
@@ -148,11 +163,47 @@ void register_soinfo_tls(soinfo* si) {
     return;
   }
   size_t static_offset = SIZE_MAX;
+  StaticTlsLayout& layout = __libc_shared_globals()->static_tls_layout;
   if (!g_static_tls_finished) {
-    StaticTlsLayout& layout = __libc_shared_globals()->static_tls_layout;
     static_offset = layout.reserve_solib_segment(si_tls->segment);
+    register_tls_module(si, static_offset);
+    return;
+  }
+
+  // A dlopen'ed module can use the static TLS surplus, but only once libc.so
+  // can initialize the module's memory in every existing thread. That waits
+  // for initialize_soinfo_static_tls(), because the image isn't relocated yet.
+  if (__libc_shared_globals()->tls_modules.static_tls_init_cb != nullptr) {
+    static_offset = layout.allocate_from_surplus(si_tls->segment);
   }
   register_tls_module(si, static_offset);
+  if (static_offset != SIZE_MAX) {
+    LD_DEBUG(any, "[ \"%s\": TLS segment (%zu bytes) allocated from the static TLS surplus "
+             "at offset %zu ]", si->get_realpath(), si_tls->segment.aligned_size.size,
+             static_offset);
+  }
+}
+
+void initialize_soinfo_static_tls(soinfo* si) {
+  soinfo_tls* si_tls = si->get_tls();
+  if (si_tls == nullptr || si_tls->module_id == kTlsUninitializedModuleId) {
+    return;
+  }
+
+  TlsModules& libc_modules = __libc_shared_globals()->tls_modules;
+  size_t static_offset;
+  {
+    ScopedSignalBlocker ssb;
+    ScopedWriteLock locker(&libc_modules.rwlock);
+    TlsModule& mod = g_tls_modules[__tls_module_id_to_idx(si_tls->module_id)];
+    if (!mod.static_image_pending) return;
+    mod.static_image_pending = false;
+    static_offset = mod.static_offset;
+    // A thread that skipped the pending module while it was being created
+    // sees the new generation in pthread_create and initializes it then.
+    bump_tls_generation();
+  }
+  libc_modules.static_tls_init_cb(static_offset, &si_tls->segment);
 }
 
 void unregister_soinfo_tls(soinfo* si) {
@@ -36,9 +36,12 @@ struct TlsModule;
 struct soinfo;
 
 void linker_setup_exe_static_tls(const char* progname);
-void linker_finalize_static_tls();
+void linker_finalize_static_tls(size_t surplus);
 
 void register_soinfo_tls(soinfo* si);
+// Copies a relocated module's TLS image into the existing threads, if the
+// module was allocated from the static TLS surplus.
+void initialize_soinfo_static_tls(soinfo* si);
 void unregister_soinfo_tls(soinfo* si);
 
 const TlsModule& get_tls_module(size_t module_id);
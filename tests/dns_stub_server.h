@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__BIONIC__)
+#include "dns/include/resolv_netid.h"
+#endif
+
+// A resource record for DnsStubServer::Reply().
+struct DnsRecord {
+  uint16_t type;
+  std::vector<uint8_t> rdata;
+  uint32_t ttl = 3600;
+  std::string owner;  // Empty for the name in the question.
+
+  static std::vector<uint8_t> EncodeName(const std::string& name) {
+    std::vector<uint8_t> result;
+    size_t start = 0;
+    while (start < name.size()) {
+      size_t end = name.find('.', start);
+      if (end == std::string::npos) end = name.size();
+      result.push_back(end - start);
+      result.insert(result.end(), name.begin() + start, name.begin() + end);
+      start = end + 1;
+    }
+    result.push_back(0);
+    return result;
+  }
+
+  static DnsRecord A(const char* address, uint32_t ttl = 3600) {
+    DnsRecord record = {.type = ns_t_a, .rdata = std::vector<uint8_t>(4), .ttl = ttl};
+    inet_pton(AF_INET, address, record.rdata.data());
+    return record;
+  }
+
+  static DnsRecord AAAA(const char* address, uint32_t ttl = 3600) {
+    DnsRecord record = {.type = ns_t_aaaa, .rdata = std::vector<uint8_t>(16), .ttl = ttl};
+    inet_pton(AF_INET6, address, record.rdata.data());
+    return record;
+  }
+
+  static DnsRecord CNAME(const std::string& target, uint32_t ttl = 3600) {
+    return {.type = ns_t_cname, .rdata = EncodeName(target), .ttl = ttl};
+  }
+
+  // An SOA for the authority section of a negative answer, whose minimum
+  // field is the negative TTL (RFC 2308).
+  static DnsRecord SOA(const std::string& zone, uint32_t ttl, uint32_t minimum) {
+    DnsRecord record = {.type = ns_t_soa, .ttl = ttl, .owner = zone};
+    std::vector<uint8_t> mname = EncodeName("ns." + zone);
+    std::vector<uint8_t> rname = EncodeName("hostmaster." + zone);
+    record.rdata.insert(record.rdata.end(), mname.begin(), mname.end());
+    record.rdata.insert(record.rdata.end(), rname.begin(), rname.end());
+    for (uint32_t value : {1u, 3600u, 600u, 86400u, minimum}) {
+      for (int shift = 24; shift >= 0; shift -= 8) record.rdata.push_back(value >> shift);
+    }
+    return record;
+  }
+};
+
+// A nameserver on an unprivileged loopback port, answering over UDP and TCP,
+// so that the resolver can be tested without the network or root. A network
+// is pointed at it with UseForNet().
+class DnsStubServer {
+ public:
+  struct Query {
+    std::vector<uint8_t> packet;
+    std::string name;
+    uint16_t type;
+    bool tcp;
+    sockaddr_storage from;  // For SendUdp(), when !tcp.
+    socklen_t from_len;
+  };
+
+  // Returns the reply to a query, or nothing to not reply at all.
+  using Handler = std::function<std::vector<uint8_t>(const Query&)>;
+
+  explicit DnsStubServer(Handler handler) : handler_(handler) {
+    // Try a few ports, since the one picked for UDP may be taken for TCP.
+    for (int attempt = 0; attempt < 16 && !Bind(); attempt++) {
+      CloseSockets();
+    }
+    if (udp_fd_ == -1 || pipe2(wake_fds_, O_CLOEXEC) == -1) return;
+    thread_ = std::thread([this] { Serve(); });
+  }
+
+  ~DnsStubServer() {
+    if (thread_.joinable()) {
+      char c = 0;
+      write(wake_fds_[1], &c, 1);
+      thread_.join();
+    }
+    for (int fd : wake_fds_) {
+      if (fd != -1) close(fd);
+    }
+    CloseSockets();
+  }
+
+  bool ok() const { return thread_.joinable(); }
+  uint16_t port() const { return port_; }
+  // The nameserver string for _resolv_set_nameservers_for_net().
+  std::string address() const { return "127.0.0.1:" + std::to_string(port_); }
+
+  size_t udp_queries() const { return udp_queries_; }
+  size_t tcp_queries() const { return tcp_queries_; }
+  size_t tcp_connections() const { return tcp_connections_; }
+
+  // Hangs up on every TCP client, as a server that times out idle
+  // connections would.
+  void CloseTcpConnections() {
+    std::lock_guard<std::mutex> lock(tcp_lock_);
+    for (int fd : tcp_fds_) shutdown(fd, SHUT_RDWR);
+  }
+
+  // Sends a datagram to whoever sent `query`, for a handler that answers
+  // more than once, or answers queries out of order.
+  void SendUdp(const Query& query, const std::vector<uint8_t>& packet) const {
+    sendto(udp_fd_, packet.data(), packet.size(), 0,
+           reinterpret_cast<const sockaddr*>(&query.from), query.from_len);
+  }
+
+  // Builds a reply to `query` with the given answers and authority records.
+  static std::vector<uint8_t> Reply(const Query& query, int rcode,
+                                    const std::vector<DnsRecord>& answers,
+                                    const std::vector<DnsRecord>& authority = {},
+                                    bool truncated = false) {
+    // The header and the question, then the records.
+    size_t question_end = HFIXEDSZ;
+    while (question_end < query.packet.size() && query.packet[question_end] != 0) {
+      question_end += query.packet[question_end] + 1;
+    }
+    question_end += 1 + QFIXEDSZ;
+    std::vector<uint8_t> reply(query.packet.begin(), query.packet.begin() + question_end);
+    reply[2] = 0x80 | (reply[2] & 0x01) | (truncated ? 0x02 : 0);  // QR, RD, TC
+    reply[3] = 0x80 | rcode;                                       // RA, RCODE
+    reply[4] = 0;
+    reply[5] = 1;
+    reply[6] = answers.size() >> 8;
+    reply[7] = answers.size();
+    reply[8] = authority.size() >> 8;
+    reply[9] = authority.size();
+    reply[10] = reply[11] = 0;
+    for (const std::vector<DnsRecord>* section : {&answers, &authority}) {
+      for (const DnsRecord& record : *section) {
+        if (record.owner.empty()) {
+          reply.push_back(0xc0);  // A pointer to the question.
+          reply.push_back(HFIXEDSZ);
+        } else {
+          std::vector<uint8_t> owner = DnsRecord::EncodeName(record.owner);
+          reply.insert(reply.end(), owner.begin(), owner.end());
+        }
+        uint8_t fixed[] = {
+            static_cast<uint8_t>(record.type >> 8), static_cast<uint8_t>(record.type),
+            0, ns_c_in,
+            static_cast<uint8_t>(record.ttl >> 24), static_cast<uint8_t>(record.ttl >> 16),
+            static_cast<uint8_t>(record.ttl >> 8), static_cast<uint8_t>(record.ttl),
+            static_cast<uint8_t>(record.rdata.size() >> 8),
+            static_cast<uint8_t>(record.rdata.size()),
+        };
+        reply.insert(reply.end(), fixed, fixed + sizeof(fixed));
+        reply.insert(reply.end(), record.rdata.begin(), record.rdata.end());
+      }
+    }
+    return reply;
+  }
+
+#if defined(__BIONIC__)
+  // Sends `netid`'s lookups to this server, resolving in this process with a
+  // cache rather than asking netd. Call before anything else uses `netid`,
+  // since the cache settings are read from the environment when it's created.
+  bool UseForNet(unsigned netid, const __res_params* params = nullptr) const {
+    setenv("ANDROID_DNS_MODE", "local", 1);
+    std::string server = address();
+    const char* servers[] = {server.c_str()};
+    return _resolv_set_nameservers_for_net(netid, servers, 1, "", params) == 0;
+  }
+#endif
+
+ private:
+  bool Bind() {
+    udp_fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    tcp_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (udp_fd_ == -1 || tcp_fd_ == -1) return false;
+    sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(udp_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        getsockname(udp_fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len) == -1 ||
+        bind(tcp_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        listen(tcp_fd_, 8) == -1) {
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+    return true;
+  }
+
+  void CloseSockets() {
+    for (int* fd : {&udp_fd_, &tcp_fd_}) {
+      if (*fd != -1) close(*fd);
+      *fd = -1;
+    }
+    for (int fd : tcp_fds_) close(fd);
+    tcp_fds_.clear();
+  }
+
+  bool Handle(const uint8_t* packet, size_t length, bool tcp, std::vector<uint8_t>* reply,
+              const sockaddr_storage* from = nullptr, socklen_t from_len = 0) {
+    if (length < HFIXEDSZ + 1 + QFIXEDSZ) return false;
+    Query query = {.packet = std::vector<uint8_t>(packet, packet + length), .tcp = tcp};
+    if (from != nullptr) {
+      query.from = *from;
+      query.from_len = from_len;
+    }
+    size_t pos = HFIXEDSZ;
+    while (pos < length && packet[pos] != 0) {
+      if (!query.name.empty()) query.name += '.';
+      query.name.append(reinterpret_cast<const char*>(packet + pos + 1),
+                        std::min<size_t>(packet[pos], length - pos - 1));
+      pos += packet[pos] + 1;
+    }
+    if (pos + 1 + QFIXEDSZ > length) return false;
+    query.type = (packet[pos + 1] << 8) | packet[pos + 2];
+    *reply = handler_(query);
+    return !reply->empty();
+  }
+
+  void ServeTcp(int fd) {
+    uint8_t length[2];
+    std::vector<uint8_t> packet;
+    if (recv(fd, length, sizeof(length), MSG_WAITALL) == sizeof(length)) {
+      packet.resize((length[0] << 8) | length[1]);
+      if (recv(fd, packet.data(), packet.size(), MSG_WAITALL) ==
+          static_cast<ssize_t>(packet.size())) {
+        tcp_queries_++;
+        std::vector<uint8_t> reply;
+        if (Handle(packet.data(), packet.size(), true, &reply)) {
+          reply.insert(reply.begin(), {static_cast<uint8_t>(reply.size() >> 8),
+                                       static_cast<uint8_t>(reply.size())});
+          send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+        }
+        return;
+      }
+    }
+    // The client hung up, or we did.
+    std::lock_guard<std::mutex> lock(tcp_lock_);
+    std::erase(tcp_fds_, fd);
+    close(fd);
+  }
+
+  void Serve() {
+    while (true) {
+      std::vector<pollfd> fds = {{.fd = wake_fds_[0], .events = POLLIN},
+                                 {.fd = udp_fd_, .events = POLLIN},
+                                 {.fd = tcp_fd_, .events = POLLIN}};
+      {
+        std::lock_guard<std::mutex> lock(tcp_lock_);
+        for (int fd : tcp_fds_) fds.push_back({.fd = fd, .events = POLLIN});
+      }
+      if (poll(fds.data(), fds.size(), -1) == -1) continue;
+      if (fds[0].revents) return;
+      if (fds[1].revents & POLLIN) {
+        uint8_t packet[NS_MAXMSG];
+        sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(udp_fd_, packet, sizeof(packet), 0,
+                             reinterpret_cast<sockaddr*>(&from), &from_len);
+        std::vector<uint8_t> reply;
+        if (n > 0) {
+          udp_queries_++;
+          if (Handle(packet, n, false, &reply, &from, from_len)) {
+            sendto(udp_fd_, reply.data(), reply.size(), 0, reinterpret_cast<sockaddr*>(&from),
+                   from_len);
+          }
+        }
+      }
+      if (fds[2].revents & POLLIN) {
+        int fd = accept4(tcp_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd != -1) {
+          tcp_connections_++;
+          std::lock_guard<std::mutex> lock(tcp_lock_);
+          tcp_fds_.push_back(fd);
+        }
+      }
+      for (size_t i = 3; i < fds.size(); i++) {
+        if (fds[i].revents) ServeTcp(fds[i].fd);
+      }
+    }
+  }
+
+  Handler handler_;
+  uint16_t port_ = 0;
+  int udp_fd_ = -1;
+  int tcp_fd_ = -1;
+  int wake_fds_[2] = {-1, -1};
+  std::mutex tcp_lock_;
+  std::vector<int> tcp_fds_;
+  std::atomic<size_t> udp_queries_ = 0;
+  std::atomic<size_t> tcp_queries_ = 0;
+  std::atomic<size_t> tcp_connections_ = 0;
+  std::thread thread_;
+};
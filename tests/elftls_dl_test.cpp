@@ -85,6 +85,38 @@ TEST(elftls_dl, dlopen_ie_error) {
   eth.Run([&]() { execve(helper.c_str(), eth.GetArgs(), eth.GetEnv()); }, 0, error.c_str());
 }
 
+TEST(elftls_dl, dlopen_ie_static_tls_surplus) {
+#if defined(__BIONIC__)
+  // With a static TLS surplus, a dlopen'ed library can be placed in static TLS,
+  // so the IE access in libtest_elftls_shared_var_ie.so succeeds.
+  std::string helper = GetTestLibRoot() + "/elftls_dlopen_ie_error_helper";
+  ExecTestHelper eth;
+  eth.SetArgs({ helper.c_str(), nullptr });
+  eth.SetEnv({ "LD_STATIC_TLS_SURPLUS=4096", nullptr });
+  eth.Run([&]() { execve(helper.c_str(), eth.GetArgs(), eth.GetEnv()); }, 0, "success\n");
+#else
+  GTEST_SKIP() << "LD_STATIC_TLS_SURPLUS is bionic-specific";
+#endif
+}
+
+TEST(elftls_dl, dlopen_static_tls_surplus_relocated_init) {
+#if defined(__BIONIC__)
+  // A module in the static TLS surplus is copied into the existing threads
+  // only once its TLS image has been relocated, and before its constructors.
+  std::string helper = GetTestLibRoot() + "/elftls_relocated_init_helper";
+  ExecTestHelper eth;
+  eth.SetArgs({ helper.c_str(), nullptr });
+  eth.SetEnv({ "LD_STATIC_TLS_SURPLUS=4096", nullptr });
+  eth.Run([&]() { execve(helper.c_str(), eth.GetArgs(), eth.GetEnv()); }, 0,
+          "dlopen'ing thread: ok\n"
+          "constructor: ok\n"
+          "running thread: ok\n"
+          "new thread: ok\n");
+#else
+  GTEST_SKIP() << "LD_STATIC_TLS_SURPLUS is bionic-specific";
+#endif
+}
+
 // Use a GD access (__tls_get_addr or TLSDESC) to modify a variable in static
 // TLS memory.
 TEST(elftls_dl, access_static_tls) {
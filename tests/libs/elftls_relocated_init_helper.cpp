@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2025 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+
+#include <future>
+#include <thread>
+
+// This helper executable loads libtest_elftls_relocated_init.so while another
+// thread is running, then checks the library's thread_local pointer in the
+// dlopen'ing thread, in its constructor, in the thread that was already
+// running, and in a new thread.
+
+typedef bool (*check_fn)();
+
+int main() {
+  std::promise<check_fn> loaded;
+  std::future<check_fn> loaded_future = loaded.get_future();
+  std::promise<bool> checked;
+  std::future<bool> checked_future = checked.get_future();
+  std::thread running([&] {
+    check_fn check = loaded_future.get();
+    checked.set_value(check != nullptr && check());
+  });
+
+  void* lib = dlopen("libtest_elftls_relocated_init.so", RTLD_LOCAL | RTLD_NOW);
+  if (lib == nullptr) {
+    printf("dlerror: %s\n", dlerror());
+    loaded.set_value(nullptr);
+    running.join();
+    return 0;
+  }
+  auto check = reinterpret_cast<check_fn>(dlsym(lib, "elftls_has_relocated_ptr"));
+  auto constructor_check =
+      reinterpret_cast<check_fn>(dlsym(lib, "elftls_constructor_saw_relocated_ptr"));
+  loaded.set_value(check);
+  bool running_ok = checked_future.get();
+  running.join();
+
+  bool new_ok = false;
+  std::thread([&] { new_ok = check(); }).join();
+
+  printf("dlopen'ing thread: %s\n", check() ? "ok" : "bad");
+  printf("constructor: %s\n", constructor_check() ? "ok" : "bad");
+  printf("running thread: %s\n", running_ok ? "ok" : "bad");
+  printf("new thread: %s\n", new_ok ? "ok" : "bad");
+  return 0;
+}
@@ -1780,6 +1780,51 @@ TEST(android_mallopt, get_decay_time_enabled) {
 #endif
 }
 
+TEST(android_mallopt, get_heap_stats_v2_errors) {
+#if defined(__BIONIC__)
+  errno = 0;
+  EXPECT_FALSE(android_mallopt(M_GET_HEAP_STATS_V2, nullptr, sizeof(android_mallopt_heap_stats_t)));
+  EXPECT_ERRNO(EINVAL);
+
+  errno = 0;
+  android_mallopt_heap_stats_t stats;
+  EXPECT_FALSE(android_mallopt(M_GET_HEAP_STATS_V2, &stats, sizeof(stats) - 1));
+  EXPECT_ERRNO(EINVAL);
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(android_mallopt, get_heap_stats_v2) {
+#if defined(__BIONIC__)
+  SKIP_WITH_HWASAN << "hwasan does not implement mallinfo";
+
+  android_mallopt_heap_stats_t stats;
+  ASSERT_TRUE(android_mallopt(M_GET_HEAP_STATS_V2, &stats, sizeof(stats)));
+  EXPECT_EQ(static_cast<uint32_t>(ANDROID_MALLOPT_HEAP_STATS_VERSION), stats.version);
+  EXPECT_LE(stats.num_size_classes,
+            static_cast<uint32_t>(ANDROID_MALLOPT_HEAP_STATS_MAX_SIZE_CLASSES));
+  EXPECT_NE(0U, stats.allocated_bytes);
+  EXPECT_LE(stats.cached_bytes, stats.mapped_bytes);
+  EXPECT_LE(stats.fragmentation_permille, 1000U);
+
+  // Must match what mallinfo reports, since that is where the totals come from.
+  struct mallinfo mi = mallinfo();
+  ASSERT_TRUE(android_mallopt(M_GET_HEAP_STATS_V2, &stats, sizeof(stats)));
+  struct mallinfo mi_after = mallinfo();
+  if (mi.uordblks == mi_after.uordblks) {
+    EXPECT_EQ(static_cast<uint64_t>(mi.uordblks), stats.allocated_bytes);
+  }
+
+  // The size classes are in increasing order.
+  for (size_t i = 1; i < stats.num_size_classes; i++) {
+    EXPECT_LT(stats.size_classes[i - 1].size, stats.size_classes[i].size) << "Class " << i;
+  }
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
 TEST(android_mallopt, DISABLED_verify_decay_time_on) {
 #if defined(__BIONIC__)
   bool value;
@@ -20,10 +20,27 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <sched.h>
 #include <string.h>
 #include <sys/cdefs.h>
+#include <sys/mount.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+
+#include "dns_stub_server.h"
 
 // https://code.google.com/p/android/issues/detail?id=13228
 TEST(netdb, freeaddrinfo_NULL) {
@@ -108,6 +125,347 @@ TEST(netdb, getaddrinfo_ip6_localhost) {
   freeaddrinfo(ai);
 }
 
+// Counts the results. When canonname is requested the first result has it,
+// and so may others (one per socket type, or per address family).
+static size_t CheckAddrinfoList(addrinfo* ai, const char* canonname) {
+  size_t count = 0;
+  for (addrinfo* p = ai; p != nullptr; p = p->ai_next) {
+    if (canonname == nullptr) {
+      EXPECT_EQ(nullptr, p->ai_canonname);
+    } else if (count == 0 || p->ai_canonname != nullptr) {
+      EXPECT_STREQ(canonname, p->ai_canonname);
+    }
+    count++;
+  }
+  return count;
+}
+
+TEST(netdb, getaddrinfo_numeric_freeaddrinfo) {
+  // Numeric hosts are turned into lists without any lookup.
+  for (int flags : {AI_NUMERICHOST, AI_NUMERICHOST | AI_CANONNAME}) {
+    SCOPED_TRACE(flags);
+    addrinfo hints = {.ai_flags = flags};
+    addrinfo* ai = nullptr;
+    ASSERT_EQ(0, getaddrinfo("192.0.2.1", "80", &hints, &ai));
+    ASSERT_GE(CheckAddrinfoList(ai, (flags & AI_CANONNAME) ? "192.0.2.1" : nullptr), 2U);
+    freeaddrinfo(ai);
+  }
+}
+
+#if defined(__BIONIC__)
+// A network that no real configuration uses, for DnsStubServer::UseForNet().
+static constexpr unsigned kStubNetId = 65500;
+
+static std::vector<uint8_t> ManyAddressesHandler(const DnsStubServer::Query& query) {
+  if (query.type != ns_t_a) return DnsStubServer::Reply(query, ns_r_noerror, {});
+  // Too big for UDP, so the resolver retries over TCP.
+  if (!query.tcp) return DnsStubServer::Reply(query, ns_r_noerror, {}, {}, true);
+  std::vector<DnsRecord> answers;
+  for (int i = 0; i < 300; i++) {
+    std::string address = "10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256);
+    answers.push_back(DnsRecord::A(address.c_str()));
+  }
+  return DnsStubServer::Reply(query, ns_r_noerror, answers);
+}
+#endif
+
+TEST(netdb, getaddrinfo_dns_many_addresses) {
+#if defined(__BIONIC__)
+  DnsStubServer server(ManyAddressesHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kStubNetId));
+
+  // All of the addresses, not just the first 128, in one list per call.
+  for (int flags : {0, AI_CANONNAME}) {
+    SCOPED_TRACE(flags);
+    addrinfo hints = {.ai_flags = flags, .ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    addrinfo* ai = nullptr;
+    ASSERT_EQ(0, android_getaddrinfofornet("many.test", nullptr, &hints, kStubNetId, 0, &ai));
+    ASSERT_EQ(300U, CheckAddrinfoList(ai, (flags & AI_CANONNAME) ? "many.test" : nullptr));
+    std::set<in_addr_t> addresses;
+    for (addrinfo* p = ai; p != nullptr; p = p->ai_next) {
+      ASSERT_EQ(AF_INET, p->ai_family);
+      addresses.insert(reinterpret_cast<sockaddr_in*>(p->ai_addr)->sin_addr.s_addr);
+    }
+    ASSERT_EQ(300U, addresses.size());
+    freeaddrinfo(ai);
+  }
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, getaddrinfo_dns_cname) {
+#if defined(__BIONIC__)
+  DnsStubServer server([](const DnsStubServer::Query& query) {
+    DnsRecord cname = DnsRecord::CNAME("target.test");
+    DnsRecord a = DnsRecord::A("192.0.2.7");
+    a.owner = "target.test";
+    DnsRecord aaaa = DnsRecord::AAAA("2001:db8::7");
+    aaaa.owner = "target.test";
+    return DnsStubServer::Reply(query, ns_r_noerror, {cname, query.type == ns_t_a ? a : aaaa});
+  });
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kStubNetId));
+
+  // The canonical name is the end of the CNAME chain.
+  for (int flags : {0, AI_CANONNAME}) {
+    SCOPED_TRACE(flags);
+    addrinfo hints = {.ai_flags = flags, .ai_socktype = SOCK_STREAM};
+    addrinfo* ai = nullptr;
+    ASSERT_EQ(0, android_getaddrinfofornet("alias.test", nullptr, &hints, kStubNetId, 0, &ai));
+    ASSERT_EQ(2U, CheckAddrinfoList(ai, (flags & AI_CANONNAME) ? "target.test" : nullptr));
+    freeaddrinfo(ai);
+  }
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, getaddrinfo_proxy_freeaddrinfo) {
+#if defined(__BIONIC__)
+  // Without ANDROID_DNS_MODE=local, lookups are answered by netd, and each
+  // result is allocated on its own.
+  if (access("/dev/socket/dnsproxyd", F_OK) != 0) GTEST_SKIP() << "no dnsproxyd";
+  for (int flags : {0, AI_CANONNAME}) {
+    SCOPED_TRACE(flags);
+    addrinfo hints = {.ai_flags = flags};
+    addrinfo* ai = nullptr;
+    ASSERT_EQ(0, getaddrinfo("localhost", "80", &hints, &ai));
+    ASSERT_GE(CheckAddrinfoList(ai, (flags & AI_CANONNAME) ? "localhost" : nullptr), 1U);
+    freeaddrinfo(ai);
+  }
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, getaddrinfo_AF_UNSPEC_HOST_NOT_FOUND) {
+#if defined(__BIONIC__)
+  DnsStubServer server([](const DnsStubServer::Query& query) {
+    return DnsStubServer::Reply(query, ns_r_nxdomain, {}, {DnsRecord::SOA("test", 60, 60)});
+  });
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kStubNetId));
+
+  // The AAAA and A queries are sent together, and neither should find anything.
+  addrinfo hints = {.ai_family = AF_UNSPEC};
+  addrinfo* ai = nullptr;
+  ASSERT_EQ(EAI_NODATA,
+            android_getaddrinfofornet("does.not.exist.test", nullptr, &hints, kStubNetId, 0, &ai));
+  ASSERT_EQ(2U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, getaddrinfo_dns_replies_matched_by_id_and_question) {
+#if defined(__BIONIC__)
+  // Holds the first query. Then answers the second, first with a reply that
+  // has its ID but a question nobody asked, and then properly, and only then
+  // answers the first. When the two queries have the same ID, the second's
+  // reply must still be matched to the second.
+  DnsStubServer::Query first;
+  DnsStubServer* server = nullptr;
+  DnsStubServer stub([&](const DnsStubServer::Query& query) -> std::vector<uint8_t> {
+    auto answer = [](const DnsStubServer::Query& q) {
+      DnsRecord record =
+          (q.type == ns_t_a) ? DnsRecord::A("192.0.2.1") : DnsRecord::AAAA("2001:db8::1");
+      return DnsStubServer::Reply(q, ns_r_noerror, {record});
+    };
+    if (first.packet.empty()) {
+      first = query;
+      return {};
+    }
+    std::vector<uint8_t> wrong = answer(query);
+    wrong[HFIXEDSZ + 1] = 'x';  // "xoth.test"
+    server->SendUdp(query, wrong);
+    server->SendUdp(query, answer(query));
+    return answer(first);
+  });
+  server = &stub;
+  ASSERT_TRUE(stub.ok());
+  ASSERT_TRUE(stub.UseForNet(kStubNetId));
+
+  addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+  addrinfo* ai = nullptr;
+  ASSERT_EQ(0, android_getaddrinfofornet("both.test", nullptr, &hints, kStubNetId, 0, &ai));
+  std::set<int> families;
+  for (addrinfo* p = ai; p != nullptr; p = p->ai_next) families.insert(p->ai_family);
+  freeaddrinfo(ai);
+  ASSERT_EQ(std::set<int>({AF_INET, AF_INET6}), families);
+  // Each query was answered the first time it was sent.
+  ASSERT_EQ(2U, stub.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+#if defined(__BIONIC__)
+// Answers "one.test" and "two.test", and nothing else.
+static std::vector<uint8_t> BatchHandler(const DnsStubServer::Query& query) {
+  if (query.name == "one.test" && query.type == ns_t_a) {
+    return DnsStubServer::Reply(query, ns_r_noerror, {DnsRecord::A("192.0.2.1")});
+  }
+  if (query.name == "two.test" && query.type == ns_t_a) {
+    return DnsStubServer::Reply(query, ns_r_noerror, {DnsRecord::A("192.0.2.2")});
+  }
+  return DnsStubServer::Reply(query, ns_r_nxdomain, {}, {DnsRecord::SOA("test", 60, 60)});
+}
+
+static const android_net_context kStubNetContext = {
+    .app_netid = kStubNetId,
+    .dns_netid = kStubNetId,
+    .uid = NET_CONTEXT_INVALID_UID,
+};
+
+// Returns the only address in a request's result, or "" if there isn't one.
+static std::string BatchResult(const android_getaddrinfo_request& request) {
+  if (request.result == nullptr || request.result->ai_next != nullptr ||
+      request.result->ai_family != AF_INET) {
+    return "";
+  }
+  auto sin = reinterpret_cast<const sockaddr_in*>(request.result->ai_addr);
+  char buf[INET_ADDRSTRLEN];
+  return inet_ntop(AF_INET, &sin->sin_addr, buf, sizeof(buf)) + std::string(":") +
+         std::to_string(ntohs(sin->sin_port));
+}
+#endif
+
+TEST(netdb, getaddrinfo_batch) {
+#if defined(__BIONIC__)
+  DnsStubServer server(BatchHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kStubNetId));
+
+  // Each request gets its own result or error.
+  addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  android_getaddrinfo_request requests[] = {
+      {.hostname = "one.test", .servname = "80", .hints = &hints},
+      {.hostname = "192.0.2.9", .servname = "http", .hints = &hints},
+      {.hostname = "missing.test", .hints = &hints},
+      {.hostname = "two.test", .servname = "no-such-service", .hints = &hints},
+      {.hostname = "two.test", .servname = "53", .hints = &hints},
+  };
+  android_getaddrinfo_batchfornetcontext(requests, std::size(requests), &kStubNetContext);
+  ASSERT_EQ(0, requests[0].error);
+  ASSERT_EQ("192.0.2.1:80", BatchResult(requests[0]));
+  ASSERT_EQ(0, requests[1].error);
+  ASSERT_EQ("192.0.2.9:80", BatchResult(requests[1]));
+  ASSERT_EQ(EAI_NODATA, requests[2].error);
+  ASSERT_EQ(nullptr, requests[2].result);
+  ASSERT_EQ(EAI_SERVICE, requests[3].error);
+  ASSERT_EQ(nullptr, requests[3].result);
+  ASSERT_EQ(0, requests[4].error);
+  ASSERT_EQ("192.0.2.2:53", BatchResult(requests[4]));
+  for (auto& request : requests) {
+    if (request.result != nullptr) freeaddrinfo(request.result);
+  }
+
+  // Each name was asked about once: the lookups found the answers that the
+  // batch fetched ahead of them in the cache.
+  ASSERT_EQ(3U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, getaddrinfo_batch_default_network) {
+#if defined(__BIONIC__)
+  // Numeric hosts need no lookup, so this works whatever the default network.
+  addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  android_getaddrinfo_request requests[] = {
+      {.hostname = "192.0.2.1", .servname = "80", .hints = &hints},
+      {.hostname = "192.0.2.2", .servname = "no-such-service", .hints = &hints},
+  };
+  android_getaddrinfo_batch(requests, std::size(requests));
+  ASSERT_EQ(0, requests[0].error);
+  ASSERT_EQ("192.0.2.1:80", BatchResult(requests[0]));
+  ASSERT_EQ(EAI_SERVICE, requests[1].error);
+  freeaddrinfo(requests[0].result);
+
+  auto batch = android_getaddrinfo_batch_start(requests, 1);
+  ASSERT_NE(nullptr, batch);
+  pollfd pfd = {.fd = android_getaddrinfo_batch_fd(batch), .events = POLLIN};
+  ASSERT_EQ(1, poll(&pfd, 1, 5000));
+  android_getaddrinfo_batch_finish(batch);
+  ASSERT_EQ(0, requests[0].error);
+  ASSERT_EQ("192.0.2.1:80", BatchResult(requests[0]));
+  freeaddrinfo(requests[0].result);
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, getaddrinfo_batch_without_cache) {
+#if defined(__BIONIC__)
+  // With nowhere to keep answers fetched ahead, the batch doesn't fetch any.
+  setenv("ANDROID_DNS_CACHE_SIZE", "0", 1);
+  DnsStubServer server(BatchHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kStubNetId));
+
+  addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  android_getaddrinfo_request requests[] = {
+      {.hostname = "one.test", .servname = "80", .hints = &hints},
+      {.hostname = "two.test", .servname = "80", .hints = &hints},
+  };
+  android_getaddrinfo_batchfornetcontext(requests, std::size(requests), &kStubNetContext);
+  ASSERT_EQ(0, requests[0].error);
+  ASSERT_EQ("192.0.2.1:80", BatchResult(requests[0]));
+  ASSERT_EQ(0, requests[1].error);
+  ASSERT_EQ("192.0.2.2:80", BatchResult(requests[1]));
+  for (auto& request : requests) freeaddrinfo(request.result);
+  ASSERT_EQ(2U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, getaddrinfo_batch_start) {
+#if defined(__BIONIC__)
+  DnsStubServer server(BatchHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kStubNetId));
+
+  addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  android_getaddrinfo_request requests[] = {
+      {.hostname = "one.test", .servname = "80", .hints = &hints},
+      {.hostname = "missing.test", .hints = &hints},
+  };
+  auto batch = android_getaddrinfo_batch_startfornetcontext(requests, std::size(requests),
+                                                           &kStubNetContext);
+  ASSERT_NE(nullptr, batch);
+
+  // The fd becomes readable once the requests are done.
+  pollfd pfd = {.fd = android_getaddrinfo_batch_fd(batch), .events = POLLIN};
+  ASSERT_EQ(1, poll(&pfd, 1, 5000));
+  ASSERT_EQ(POLLIN, pfd.revents);
+  ASSERT_EQ(0, requests[0].error);
+  ASSERT_EQ("192.0.2.1:80", BatchResult(requests[0]));
+  ASSERT_EQ(EAI_NODATA, requests[1].error);
+  android_getaddrinfo_batch_finish(batch);
+  freeaddrinfo(requests[0].result);
+
+  // Finishing waits for a batch that hasn't been waited for, and an empty
+  // batch is done at once.
+  batch = android_getaddrinfo_batch_startfornetcontext(requests, 1, &kStubNetContext);
+  ASSERT_NE(nullptr, batch);
+  android_getaddrinfo_batch_finish(batch);
+  ASSERT_EQ(0, requests[0].error);
+  ASSERT_EQ("192.0.2.1:80", BatchResult(requests[0]));
+  freeaddrinfo(requests[0].result);
+
+  batch = android_getaddrinfo_batch_startfornetcontext(nullptr, 0, &kStubNetContext);
+  ASSERT_NE(nullptr, batch);
+  pollfd empty_pfd = {.fd = android_getaddrinfo_batch_fd(batch), .events = POLLIN};
+  ASSERT_EQ(1, poll(&empty_pfd, 1, 5000));
+  android_getaddrinfo_batch_finish(batch);
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
 TEST(netdb, getnameinfo_salen) {
   sockaddr_storage ss = {};
   sockaddr* sa = reinterpret_cast<sockaddr*>(&ss);
@@ -384,6 +742,61 @@ TEST(netdb, getservbyport) {
   ASSERT_STREQ("udp", s->s_proto);
 }
 
+TEST(netdb, getservbyname_getservbyport_match_getservent) {
+#if defined(__BIONIC__)
+  // The indexes must find what a walk of the table finds first. (bionic
+  // matches each entry's name, not its aliases.)
+  struct Service {
+    std::string name;
+    int port;
+    std::string proto;
+  };
+  std::vector<Service> services;
+  endservent();
+  for (servent* s = getservent(); s != nullptr; s = getservent()) {
+    services.push_back({s->s_name, s->s_port, s->s_proto});
+  }
+  endservent();
+  ASSERT_GT(services.size(), 100U);
+
+  for (const char* proto : {"tcp", "udp", static_cast<const char*>(nullptr)}) {
+    SCOPED_TRACE(proto ? proto : "any");
+    for (const Service& service : services) {
+      const Service* first_by_name = nullptr;
+      const Service* first_by_port = nullptr;
+      for (const Service& other : services) {
+        if (proto == nullptr || other.proto == proto) {
+          if (first_by_name == nullptr && other.name == service.name) first_by_name = &other;
+          if (first_by_port == nullptr && other.port == service.port) first_by_port = &other;
+        }
+      }
+
+      servent* s = getservbyname(service.name.c_str(), proto);
+      if (first_by_name == nullptr) {
+        EXPECT_EQ(nullptr, s) << service.name;
+      } else {
+        ASSERT_TRUE(s != nullptr) << service.name;
+        EXPECT_EQ(first_by_name->port, s->s_port) << service.name;
+        EXPECT_EQ(first_by_name->proto, s->s_proto) << service.name;
+      }
+
+      s = getservbyport(service.port, proto);
+      if (first_by_port == nullptr) {
+        EXPECT_EQ(nullptr, s) << ntohs(service.port);
+      } else {
+        ASSERT_TRUE(s != nullptr) << ntohs(service.port);
+        EXPECT_EQ(first_by_port->name, s->s_name) << ntohs(service.port);
+        EXPECT_EQ(first_by_port->proto, s->s_proto) << ntohs(service.port);
+      }
+    }
+  }
+  ASSERT_EQ(nullptr, getservbyname("no-such-service", nullptr));
+  ASSERT_EQ(nullptr, getservbyport(htons(65000), nullptr));
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
 TEST(netdb, endnetent_getnetent_setnetent) {
   setnetent(0);
   setnetent(1);
@@ -481,3 +894,189 @@ TEST(netdb, sethostent_resets) {
   sethostent(0);
   ASSERT_EQ(first_host, std::string(gethostent()->h_name));
 }
+
+#if defined(__BIONIC__)
+// Puts a file of the test's own in place of the hosts file, in a mount
+// namespace of its own, and answers every DNS query with NXDOMAIN, so that
+// lookups on kStubNetId see only that file.
+class ScopedHostsFile {
+ public:
+  ScopedHostsFile()
+      : server_([](const DnsStubServer::Query& query) {
+          return DnsStubServer::Reply(query, ns_r_nxdomain, {});
+        }) {}
+
+  bool Init(const std::string& contents) {
+    return Write(contents) && server_.ok() && server_.UseForNet(kStubNetId) &&
+           unshare(CLONE_NEWNS) == 0 &&
+           mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) == 0 &&
+           mount(file_.path, _PATH_HOSTS, nullptr, MS_BIND, nullptr) == 0;
+  }
+
+  // Rewrites the file in place, as an editor that doesn't rename would.
+  bool Write(const std::string& contents) {
+    return android::base::WriteStringToFile(contents, file_.path);
+  }
+
+  // Returns the addresses for name, in order, or nothing if it's not found.
+  std::vector<std::string> Lookup(const char* name, std::string* h_name = nullptr,
+                                  std::vector<std::string>* aliases = nullptr) {
+    std::vector<std::string> addresses;
+    hostent* hp = android_gethostbynamefornet(name, AF_INET, kStubNetId, 0);
+    if (hp == nullptr) return addresses;
+    if (h_name != nullptr) *h_name = hp->h_name;
+    for (char** alias = hp->h_aliases; aliases != nullptr && *alias != nullptr; alias++) {
+      aliases->push_back(*alias);
+    }
+    for (char** addr = hp->h_addr_list; *addr != nullptr; addr++) {
+      char buf[INET_ADDRSTRLEN];
+      addresses.push_back(inet_ntop(AF_INET, *addr, buf, sizeof(buf)));
+    }
+    return addresses;
+  }
+
+ private:
+  TemporaryFile file_;
+  DnsStubServer server_;
+};
+
+static const char kHostsFile[] =
+    "# 192.0.2.99 commented.test\n"
+    "127.0.0.1 localhost\n"
+    "192.0.2.1 first.test alias1.test alias2.test # 192.0.2.98 trailing.test\n"
+    "192.0.2.2\tsecond.test\tFIRST.test\n"
+    "#192.0.2.3 first.test\n"
+    "\n"
+    "192.0.2.4 first.test first.test\n"
+    "192.0.2.5 last.test";
+#endif
+
+TEST(netdb, hosts_file_aliases) {
+#if defined(__BIONIC__)
+  if (getuid() != 0) GTEST_SKIP() << "test requires root";
+  ScopedHostsFile hosts;
+  ASSERT_TRUE(hosts.Init(kHostsFile));
+
+  std::string h_name;
+  std::vector<std::string> aliases;
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.1"}), hosts.Lookup("alias2.test", &h_name, &aliases));
+  ASSERT_EQ("first.test", h_name);
+  ASSERT_EQ(std::vector<std::string>({"alias1.test", "alias2.test"}), aliases);
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.1"}), hosts.Lookup("ALIAS1.TEST"));
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.2"}), hosts.Lookup("second.test"));
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, hosts_file_lines_in_file_order) {
+#if defined(__BIONIC__)
+  if (getuid() != 0) GTEST_SKIP() << "test requires root";
+  ScopedHostsFile hosts;
+  ASSERT_TRUE(hosts.Init(kHostsFile));
+
+  // Every line naming the host, whether as its name or an alias, and a line
+  // that names it twice only once.
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.1", "192.0.2.2", "192.0.2.4"}),
+            hosts.Lookup("first.test"));
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, hosts_file_comments_and_last_line) {
+#if defined(__BIONIC__)
+  if (getuid() != 0) GTEST_SKIP() << "test requires root";
+  ScopedHostsFile hosts;
+  ASSERT_TRUE(hosts.Init(kHostsFile));
+
+  ASSERT_TRUE(hosts.Lookup("commented.test").empty());
+  ASSERT_TRUE(hosts.Lookup("trailing.test").empty());
+  // The line parser skips a last line without a newline, so the index does.
+  ASSERT_TRUE(hosts.Lookup("last.test").empty());
+  ASSERT_TRUE(hosts.Write(std::string(kHostsFile) + "\n"));
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.5"}), hosts.Lookup("last.test"));
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, hosts_file_matches_gethostent) {
+#if defined(__BIONIC__)
+  if (getuid() != 0) GTEST_SKIP() << "test requires root";
+  ScopedHostsFile hosts;
+  ASSERT_TRUE(hosts.Init(kHostsFile));
+
+  // gethostent() still reads the whole file, so every name it sees must be
+  // found with the same addresses, in the same order.
+  std::map<std::string, std::vector<std::string>> expected;
+  sethostent(0);
+  for (hostent* hp = gethostent(); hp != nullptr; hp = gethostent()) {
+    char buf[INET_ADDRSTRLEN];
+    std::string address = inet_ntop(AF_INET, hp->h_addr_list[0], buf, sizeof(buf));
+    std::vector<std::string> names = {hp->h_name};
+    for (char** alias = hp->h_aliases; *alias != nullptr; alias++) names.push_back(*alias);
+    std::set<std::string> seen;
+    for (std::string& name : names) {
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      if (seen.insert(name).second) expected[name].push_back(address);
+    }
+  }
+  endhostent();
+  ASSERT_EQ(5U, expected.size());
+  for (const auto& [name, addresses] : expected) {
+    ASSERT_EQ(addresses, hosts.Lookup(name.c_str())) << name;
+  }
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, hosts_file_rebuilt_when_changed) {
+#if defined(__BIONIC__)
+  if (getuid() != 0) GTEST_SKIP() << "test requires root";
+  ScopedHostsFile hosts;
+  ASSERT_TRUE(hosts.Init(kHostsFile));
+
+  ASSERT_TRUE(hosts.Lookup("new.test").empty());
+  ASSERT_TRUE(hosts.Write(std::string(kHostsFile) + "\n192.0.2.6 new.test\n"));
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.6"}), hosts.Lookup("new.test"));
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.1", "192.0.2.2", "192.0.2.4"}),
+            hosts.Lookup("first.test"));
+
+  // Shorter, with first.test on a line that used to hold something else.
+  ASSERT_TRUE(hosts.Write("192.0.2.7 first.test\n"));
+  ASSERT_EQ(std::vector<std::string>({"192.0.2.7"}), hosts.Lookup("first.test"));
+  ASSERT_TRUE(hosts.Lookup("new.test").empty());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(netdb, hosts_file_truncated_while_looking_up) {
+#if defined(__BIONIC__)
+  if (getuid() != 0) GTEST_SKIP() << "test requires root";
+  ScopedHostsFile hosts;
+  ASSERT_TRUE(hosts.Init(kHostsFile));
+
+  // A file shrinking under a lookup mustn't crash it, and each lookup sees
+  // either the long file or the short one.
+  std::string long_file(kHostsFile);
+  for (int i = 0; i < 1000; i++) long_file += "192.0.2.8 padding" + std::to_string(i) + ".test\n";
+  long_file += "192.0.2.9 end.test\n";
+  std::atomic<bool> done = false;
+  std::thread writer([&] {
+    for (int i = 0; !done; i++) hosts.Write((i % 2) ? long_file : "192.0.2.10 end.test\n");
+  });
+  for (int i = 0; i < 2000; i++) {
+    std::vector<std::string> addresses = hosts.Lookup("end.test");
+    if (!addresses.empty()) {
+      ASSERT_TRUE(addresses[0] == "192.0.2.9" || addresses[0] == "192.0.2.10") << addresses[0];
+    }
+  }
+  done = true;
+  writer.join();
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
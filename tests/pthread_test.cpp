@@ -37,6 +37,7 @@
 #include <future>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/macros.h>
 #include <android-base/parseint.h>
 #include <android-base/scopeguard.h>
@@ -134,9 +135,9 @@ TEST(pthread, pthread_key_not_exceed_PTHREAD_KEYS_MAX) {
   std::vector<pthread_key_t> keys;
   int rv = 0;
 
-  // Pthread keys are used by gtest, so PTHREAD_KEYS_MAX should
-  // be more than we are allowed to allocate now.
-  for (int i = 0; i < PTHREAD_KEYS_MAX; i++) {
+  // PTHREAD_KEYS_MAX is only the number of keys we're guaranteed, and bionic
+  // allows many more, but there should still be a limit.
+  for (int i = 0; i < 64 * 1024; i++) {
     pthread_key_t key;
     rv = pthread_key_create(&key, nullptr);
     if (rv == EAGAIN) {
@@ -192,6 +193,70 @@ TEST(pthread, pthread_key_fork) {
   ASSERT_EQ(0, pthread_key_delete(key));
 }
 
+static std::atomic<size_t> many_keys_destructor_count;
+static void many_keys_destructor(void*) {
+  ++many_keys_destructor_count;
+}
+
+#if defined(__BIONIC__)
+static size_t CountKeyDataMappings() {
+  std::string maps;
+  EXPECT_TRUE(android::base::ReadFileToString("/proc/self/maps", &maps));
+  size_t count = 0;
+  for (const auto& line : android::base::Split(maps, "\n")) {
+    if (android::base::EndsWith(line, "[anon:pthread key data]")) {
+      ++count;
+    }
+  }
+  return count;
+}
+#endif
+
+TEST(pthread, pthread_key_many_destructors) {
+  // More keys than the PTHREAD_KEYS_MAX that gtest already uses some of, so
+  // that the keys after the first few need more storage.
+  constexpr size_t kKeyCount = 4 * PTHREAD_KEYS_MAX;
+  std::vector<pthread_key_t> keys;
+
+  auto scope_guard = android::base::make_scope_guard([&keys] {
+    for (const auto& key : keys) {
+      EXPECT_EQ(0, pthread_key_delete(key));
+    }
+  });
+
+  for (size_t i = 0; i < kKeyCount; ++i) {
+    pthread_key_t key;
+    ASSERT_EQ(0, pthread_key_create(&key, many_keys_destructor)) << i << " of " << kKeyCount;
+    keys.push_back(key);
+  }
+
+  many_keys_destructor_count = 0;
+  std::thread([&keys]() {
+    // Only set every third key, and check that only those keys have values.
+    for (size_t i = 0; i < keys.size(); i += 3) {
+      ASSERT_EQ(0, pthread_setspecific(keys[i], reinterpret_cast<void*>(i + 1)));
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+      void* expected = (i % 3 == 0) ? reinterpret_cast<void*>(i + 1) : nullptr;
+      ASSERT_EQ(expected, pthread_getspecific(keys[i])) << i;
+    }
+#if defined(__BIONIC__)
+    // All the keys that don't fit in bionic_tls share one mapping.
+    ASSERT_EQ(1U, CountKeyDataMappings());
+#endif
+  }).join();
+  ASSERT_EQ((kKeyCount + 2) / 3, many_keys_destructor_count);
+#if defined(__BIONIC__)
+  // And the thread unmapped it when it exited.
+  ASSERT_EQ(0U, CountKeyDataMappings());
+#endif
+
+  // The values belong to the thread that set them.
+  for (const auto& key : keys) {
+    ASSERT_EQ(nullptr, pthread_getspecific(key));
+  }
+}
+
 static void* DirtyKeyFn(void* key) {
   return pthread_getspecific(*reinterpret_cast<pthread_key_t*>(key));
 }
@@ -1415,6 +1480,85 @@ TEST(pthread, pthread_rwlock_kind_PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP)
 #endif
 }
 
+TEST(pthread, pthread_rwlock_kind_PTHREAD_RWLOCK_SCALABLE_READER_NP) {
+#if defined(__BIONIC__)
+  RwlockKindTestHelper helper(PTHREAD_RWLOCK_SCALABLE_READER_NP);
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&helper.lock));
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&helper.lock));
+  ASSERT_EQ(EBUSY, pthread_rwlock_trywrlock(&helper.lock));
+  ASSERT_EQ(EBUSY, pthread_rwlock_destroy(&helper.lock));
+  timespec ts;
+  ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &ts));
+  ts.tv_nsec += 10 * 1000 * 1000;
+  if (ts.tv_nsec >= NS_PER_S) {
+    ts.tv_sec++;
+    ts.tv_nsec -= NS_PER_S;
+  }
+  ASSERT_EQ(ETIMEDOUT, pthread_rwlock_timedwrlock(&helper.lock, &ts));
+
+  // A writer has to wait for both read locks to be released.
+  pthread_t writer_thread;
+  std::atomic<pid_t> writer_tid;
+  helper.CreateWriterThread(writer_thread, writer_tid);
+  WaitUntilThreadSleep(writer_tid);
+  ASSERT_EQ(0, pthread_rwlock_unlock(&helper.lock));
+  WaitUntilThreadSleep(writer_tid);
+  ASSERT_EQ(0, pthread_rwlock_unlock(&helper.lock));
+  ASSERT_EQ(0, pthread_join(writer_thread, nullptr));
+
+  // Readers on other threads still exclude writers.
+  ASSERT_EQ(0, pthread_rwlock_wrlock(&helper.lock));
+  ASSERT_EQ(EBUSY, pthread_rwlock_tryrdlock(&helper.lock));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&helper.lock));
+  pthread_t reader_thread;
+  std::atomic<pid_t> reader_tid;
+  helper.CreateReaderThread(reader_thread, reader_tid);
+  ASSERT_EQ(0, pthread_join(reader_thread, nullptr));
+#else
+  GTEST_SKIP() << "PTHREAD_RWLOCK_SCALABLE_READER_NP is bionic-specific";
+#endif
+}
+
+TEST(pthread, pthread_rwlock_SCALABLE_READER_NP_stress) {
+#if defined(__BIONIC__)
+  RwlockKindTestHelper helper(PTHREAD_RWLOCK_SCALABLE_READER_NP);
+  // The writers keep both halves equal; a reader that sees them differ ran alongside a writer.
+  static volatile int halves[2];
+  static std::atomic<bool> torn;
+  halves[0] = halves[1] = 0;
+  torn = false;
+  auto reader = [](void* arg) -> void* {
+    pthread_rwlock_t* lock = reinterpret_cast<pthread_rwlock_t*>(arg);
+    for (size_t i = 0; i < 20000; ++i) {
+      pthread_rwlock_rdlock(lock);
+      if (halves[0] != halves[1]) torn = true;
+      pthread_rwlock_unlock(lock);
+    }
+    return nullptr;
+  };
+  auto writer = [](void* arg) -> void* {
+    pthread_rwlock_t* lock = reinterpret_cast<pthread_rwlock_t*>(arg);
+    for (size_t i = 0; i < 1000; ++i) {
+      pthread_rwlock_wrlock(lock);
+      halves[0] = halves[0] + 1;
+      sched_yield();
+      halves[1] = halves[1] + 1;
+      pthread_rwlock_unlock(lock);
+    }
+    return nullptr;
+  };
+  pthread_t threads[6];
+  for (size_t i = 0; i < 6; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], nullptr, (i < 2) ? writer : reader, &helper.lock));
+  }
+  for (pthread_t thread : threads) ASSERT_EQ(0, pthread_join(thread, nullptr));
+  ASSERT_FALSE(torn);
+  ASSERT_EQ(2000, halves[0]);
+#else
+  GTEST_SKIP() << "PTHREAD_RWLOCK_SCALABLE_READER_NP is bionic-specific";
+#endif
+}
+
 static int g_once_fn_call_count = 0;
 static void OnceFn() {
   ++g_once_fn_call_count;
@@ -1737,6 +1881,84 @@ TEST_F(pthread_CondWakeupTest, signal_clockwait_realtime_realtime) {
 #endif  // __BIONIC__
 }
 
+// Every waiter must see every broadcast, whether or not the broadcaster holds the mutex, and
+// whatever kind of mutex the waiters use.
+static void pthread_cond_broadcast_many_waiters_helper(int mutex_type) {
+  constexpr size_t kWaiters = 8;
+  constexpr size_t kRounds = 200;
+  struct State {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t done;
+    size_t generation = 0;
+    size_t acked = 0;
+    bool stop = false;
+  } state;
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  ASSERT_EQ(0, pthread_mutexattr_settype(&attr, mutex_type));
+  ASSERT_EQ(0, pthread_mutex_init(&state.mutex, &attr));
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+  ASSERT_EQ(0, pthread_cond_init(&state.cond, nullptr));
+  ASSERT_EQ(0, pthread_cond_init(&state.done, nullptr));
+
+  auto waiter = [](void* arg) -> void* {
+    State* state = reinterpret_cast<State*>(arg);
+    size_t seen = 0;
+    pthread_mutex_lock(&state->mutex);
+    while (true) {
+      while (state->generation == seen && !state->stop) {
+        pthread_cond_wait(&state->cond, &state->mutex);
+      }
+      if (state->stop) break;
+      seen = state->generation;
+      if (++state->acked == kWaiters) pthread_cond_signal(&state->done);
+    }
+    pthread_mutex_unlock(&state->mutex);
+    return nullptr;
+  };
+  pthread_t threads[kWaiters];
+  for (pthread_t& thread : threads) {
+    ASSERT_EQ(0, pthread_create(&thread, nullptr, waiter, &state));
+  }
+
+  for (size_t i = 0; i < kRounds; ++i) {
+    ASSERT_EQ(0, pthread_mutex_lock(&state.mutex));
+    state.generation++;
+    state.acked = 0;
+    if (i % 2 == 0) {
+      ASSERT_EQ(0, pthread_cond_broadcast(&state.cond));
+    } else {
+      ASSERT_EQ(0, pthread_mutex_unlock(&state.mutex));
+      ASSERT_EQ(0, pthread_cond_broadcast(&state.cond));
+      ASSERT_EQ(0, pthread_mutex_lock(&state.mutex));
+    }
+    while (state.acked != kWaiters) {
+      ASSERT_EQ(0, pthread_cond_wait(&state.done, &state.mutex));
+    }
+    ASSERT_EQ(0, pthread_mutex_unlock(&state.mutex));
+  }
+
+  ASSERT_EQ(0, pthread_mutex_lock(&state.mutex));
+  state.stop = true;
+  ASSERT_EQ(0, pthread_cond_broadcast(&state.cond));
+  ASSERT_EQ(0, pthread_mutex_unlock(&state.mutex));
+  for (pthread_t thread : threads) {
+    ASSERT_EQ(0, pthread_join(thread, nullptr));
+  }
+  ASSERT_EQ(0, pthread_cond_destroy(&state.done));
+  ASSERT_EQ(0, pthread_cond_destroy(&state.cond));
+  ASSERT_EQ(0, pthread_mutex_destroy(&state.mutex));
+}
+
+TEST(pthread, pthread_cond_broadcast_many_waiters_NORMAL) {
+  pthread_cond_broadcast_many_waiters_helper(PTHREAD_MUTEX_NORMAL);
+}
+
+TEST(pthread, pthread_cond_broadcast_many_waiters_RECURSIVE) {
+  pthread_cond_broadcast_many_waiters_helper(PTHREAD_MUTEX_RECURSIVE);
+}
+
 static void pthread_cond_timedwait_timeout_helper(bool init_monotonic, clockid_t clock,
                                                   int (*wait_function)(pthread_cond_t* __cond,
                                                                        pthread_mutex_t* __mutex,
@@ -2952,6 +3174,31 @@ TEST(pthread, pthread_spinlock_smoke) {
   ASSERT_EQ(0, pthread_spin_destroy(&lock));
 }
 
+TEST(pthread, pthread_spinlock_contended) {
+  pthread_spinlock_t lock;
+  ASSERT_EQ(0, pthread_spin_init(&lock, 0));
+  constexpr size_t kThreadCount = 8;
+  constexpr size_t kRounds = 20000;
+  size_t counter = 0;
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&lock, &counter, i]() {
+      for (size_t j = 0; j < kRounds; ++j) {
+        ASSERT_EQ(0, pthread_spin_lock(&lock));
+        ++counter;
+        // Sometimes hold the lock long enough for the waiters to sleep.
+        if (j % 5000 == i) usleep(1000);
+        ASSERT_EQ(0, pthread_spin_unlock(&lock));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  ASSERT_EQ(kThreadCount * kRounds, counter);
+  ASSERT_EQ(0, pthread_spin_destroy(&lock));
+}
+
 TEST(pthread, pthread_attr_getdetachstate__pthread_attr_setdetachstate) {
   pthread_attr_t attr;
   ASSERT_EQ(0, pthread_attr_init(&attr));
@@ -16,9 +16,12 @@
 
 #include <gtest/gtest.h>
 
+#include <locale.h>
 #include <sys/types.h>
 #include <regex.h>
 
+#include <string>
+
 TEST(regex, smoke) {
   // A quick test of all the regex functions.
   regex_t re;
@@ -57,3 +60,119 @@ TEST(regex, regerror_NULL_0) {
   int error_length = regerror(error, &re, nullptr, 0);
   ASSERT_GT(error_length, 0);
 }
+
+// Runs a test body with `locale_name` as the thread's locale.
+class ScopedLocale {
+ public:
+  explicit ScopedLocale(const char* locale_name)
+      : locale_(newlocale(LC_ALL_MASK, locale_name, nullptr)), old_locale_(uselocale(locale_)) {}
+  ~ScopedLocale() {
+    uselocale(old_locale_);
+    freelocale(locale_);
+  }
+
+ private:
+  locale_t locale_;
+  locale_t old_locale_;
+};
+
+static void CheckSimplePatterns() {
+  regex_t re;
+  regmatch_t matches[2];
+  ASSERT_EQ(0, regcomp(&re, "[0-9]+x[0-9]+", REG_EXTENDED));
+  ASSERT_EQ(0, regexec(&re, "mode 1080x2400@120Hz", 1, matches, 0));
+  ASSERT_EQ(5, matches[0].rm_so);
+  ASSERT_EQ(14, matches[0].rm_eo);
+  ASSERT_EQ(REG_NOMATCH, regexec(&re, "mode 1080 x 2400", 0, nullptr, 0));
+  regfree(&re);
+
+  ASSERT_EQ(0, regcomp(&re, "t.me", REG_EXTENDED));
+  ASSERT_EQ(0, regexec(&re, "a timeout", 2, matches, 0));
+  ASSERT_EQ(2, matches[0].rm_so);
+  ASSERT_EQ(6, matches[0].rm_eo);
+  ASSERT_EQ(-1, matches[1].rm_so);
+  ASSERT_EQ(-1, matches[1].rm_eo);
+  regfree(&re);
+
+  ASSERT_EQ(0, regcomp(&re, "^ab?c$", REG_EXTENDED | REG_NEWLINE));
+  ASSERT_EQ(0, regexec(&re, "x\nac\ny", 1, matches, 0));
+  ASSERT_EQ(2, matches[0].rm_so);
+  ASSERT_EQ(4, matches[0].rm_eo);
+  ASSERT_EQ(REG_NOMATCH, regexec(&re, "xac", 0, nullptr, 0));
+  ASSERT_EQ(REG_NOMATCH, regexec(&re, "abc", 0, nullptr, REG_NOTBOL));
+  regfree(&re);
+
+  ASSERT_EQ(0, regcomp(&re, "a*", REG_EXTENDED));
+  ASSERT_EQ(0, regexec(&re, "aab", 1, matches, 0));
+  ASSERT_EQ(0, matches[0].rm_so);
+  ASSERT_EQ(2, matches[0].rm_eo);
+  regfree(&re);
+}
+
+TEST(regex, simple_patterns) {
+  // Patterns made of single characters, `.', brackets and ?*+ are matched
+  // without the full engine. In the C locale that's all of them; in UTF-8
+  // only those that can't match a byte >= 0x80 (so no `.', negated
+  // brackets, classes or REG_ICASE brackets).
+  {
+    ScopedLocale l("C");
+    CheckSimplePatterns();
+  }
+  {
+    ScopedLocale l("C.UTF-8");
+    CheckSimplePatterns();
+  }
+}
+
+// Checks that `pattern` gives the same result as the engine, which we force
+// by making the pattern an alternation of two copies of itself.
+static void CheckSameAsEngine(const char* pattern, int cflags, const char* subject) {
+  SCOPED_TRACE(std::string(pattern) + " ~ " + subject);
+  std::string alternation = std::string("(") + pattern + ")|(" + pattern + ")";
+  regex_t re, engine;
+  ASSERT_EQ(0, regcomp(&re, pattern, REG_EXTENDED | cflags));
+  ASSERT_EQ(0, regcomp(&engine, alternation.c_str(), REG_EXTENDED | cflags));
+  for (int eflags : {0, REG_NOTBOL, REG_NOTEOL}) {
+    regmatch_t expected = {-1, -1};
+    regmatch_t actual = {-1, -1};
+    int expected_result = regexec(&engine, subject, 1, &expected, eflags);
+    ASSERT_EQ(expected_result, regexec(&re, subject, 1, &actual, eflags));
+    if (expected_result == 0) {
+      ASSERT_EQ(expected.rm_so, actual.rm_so);
+      ASSERT_EQ(expected.rm_eo, actual.rm_eo);
+    }
+  }
+  regfree(&engine);
+  regfree(&re);
+}
+
+static void CheckSimplePatternsAgainstEngine() {
+  static const char* kPatterns[] = {
+      "timeout", "[0-9]+x[0-9]+", "t.me",   "^ab?c$", "a*",     "x[a-c]*y", "[^ ]+",
+      "^[0-9]",  "Hz$",           "u0a[0-9]*", "x.y", "x[^a]y", "a[[:alpha:]]+",
+      "(ab)+c?", "\xc3\xa9+",     "x[a\xc3]y", "x\xc3?y",
+  };
+  static const char* kSubjects[] = {
+      "",          "a timeout", "mode 1080x2400@120Hz", "x\nac\ny",       "abc",
+      "aab",       "xabcy xy",  "u0a123 u0a",           "x\xc3y xay xy",  "a\xc3\xa9y",
+      "120Hz\n",   "ababc ab",  "\xc3\xa9timeout",      "t\xc3\xadme",    "ABC xAY",
+  };
+  for (const char* pattern : kPatterns) {
+    for (const char* subject : kSubjects) {
+      CheckSameAsEngine(pattern, 0, subject);
+      CheckSameAsEngine(pattern, REG_NEWLINE, subject);
+      CheckSameAsEngine(pattern, REG_ICASE, subject);
+    }
+  }
+}
+
+TEST(regex, simple_patterns_same_as_engine) {
+  {
+    ScopedLocale l("C");
+    CheckSimplePatternsAgainstEngine();
+  }
+  {
+    ScopedLocale l("C.UTF-8");
+    CheckSimplePatternsAgainstEngine();
+  }
+}
@@ -28,10 +28,24 @@
 
 #include <resolv.h>
 
+#include <dirent.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/cdefs.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
+#include "dns_stub_server.h"
+
 TEST(resolv, b64_pton_28035006) {
   // Test data from https://groups.google.com/forum/#!topic/mailing.openbsd.tech/w3ACIlklJkI.
   const char* data =
@@ -90,3 +104,290 @@ TEST(resolv, res_randomid) {
   GTEST_SKIP() << "musl doesn't have res_randomid";
 #endif
 }
+
+#if defined(__BIONIC__)
+// A network that no real configuration uses, for DnsStubServer::UseForNet().
+static constexpr unsigned kCacheNetId = 65501;
+
+// Answers the A query for "hostN.test" with 10.0.N/256.N%256, so that a
+// lookup's result shows which name it was for.
+static std::string NumberedHostAddress(unsigned n) {
+  return "10.0." + std::to_string(n / 256) + "." + std::to_string(n % 256);
+}
+
+static std::vector<uint8_t> NumberedHostHandler(const DnsStubServer::Query& query) {
+  unsigned n;
+  if (query.type != ns_t_a || sscanf(query.name.c_str(), "host%u.test", &n) != 1) {
+    return DnsStubServer::Reply(query, ns_r_nxdomain, {});
+  }
+  return DnsStubServer::Reply(query, ns_r_noerror, {DnsRecord::A(NumberedHostAddress(n).c_str())});
+}
+
+// Returns the first IPv4 address of name, or "" if the lookup fails.
+static std::string LookupA(const std::string& name, unsigned netid = kCacheNetId) {
+  addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  addrinfo* ai = nullptr;
+  if (android_getaddrinfofornet(name.c_str(), nullptr, &hints, netid, 0, &ai) != 0) {
+    return "";
+  }
+  char buf[INET_ADDRSTRLEN];
+  std::string result =
+      inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(ai->ai_addr)->sin_addr, buf, sizeof(buf));
+  freeaddrinfo(ai);
+  return result;
+}
+
+static std::string LookupNumberedHost(unsigned n) {
+  return LookupA("host" + std::to_string(n) + ".test");
+}
+#endif
+
+TEST(resolv, cache_hit) {
+#if defined(__BIONIC__)
+  DnsStubServer server(NumberedHostHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+
+  ASSERT_EQ(NumberedHostAddress(1), LookupNumberedHost(1));
+  ASSERT_EQ(NumberedHostAddress(1), LookupNumberedHost(1));
+  ASSERT_EQ(1U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(resolv, cache_eviction) {
+#if defined(__BIONIC__)
+  // Small enough to be a single stripe, so that the CLOCK order is known.
+  setenv("ANDROID_DNS_CACHE_SIZE", "8", 1);
+  DnsStubServer server(NumberedHostHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+
+  for (unsigned n = 0; n < 8; n++) ASSERT_EQ(NumberedHostAddress(n), LookupNumberedHost(n));
+  ASSERT_EQ(8U, server.udp_queries());
+  // A hit gives host0 a second chance...
+  ASSERT_EQ(NumberedHostAddress(0), LookupNumberedHost(0));
+  ASSERT_EQ(8U, server.udp_queries());
+  // ...so making room for host8 evicts host1, the oldest not used since.
+  ASSERT_EQ(NumberedHostAddress(8), LookupNumberedHost(8));
+  ASSERT_EQ(9U, server.udp_queries());
+  ASSERT_EQ(NumberedHostAddress(0), LookupNumberedHost(0));
+  ASSERT_EQ(NumberedHostAddress(8), LookupNumberedHost(8));
+  ASSERT_EQ(9U, server.udp_queries());
+  ASSERT_EQ(NumberedHostAddress(1), LookupNumberedHost(1));
+  ASSERT_EQ(10U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(resolv, cache_concurrent_lookup_and_insert) {
+#if defined(__BIONIC__)
+  // More names than entries, so that threads evict each other's answers
+  // while others look them up.
+  setenv("ANDROID_DNS_CACHE_SIZE", "16", 1);
+  DnsStubServer server(NumberedHostHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+
+  constexpr unsigned kNames = 64;
+  std::atomic<unsigned> wrong = 0;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 8; t++) {
+    threads.emplace_back([t, &wrong] {
+      for (unsigned i = 0; i < 500; i++) {
+        unsigned n = (i * 7 + t) % kNames;
+        if (LookupNumberedHost(n) != NumberedHostAddress(n)) wrong++;
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  ASSERT_EQ(0U, wrong);
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(resolv, cache_delete_net_while_looking_up) {
+#if defined(__BIONIC__)
+  DnsStubServer server(NumberedHostHandler);
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+
+  // Lookups in flight keep the cache they started with; they may fail once
+  // the net is gone, but mustn't crash or get the wrong answer.
+  std::atomic<bool> done = false;
+  std::atomic<unsigned> wrong = 0;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 4; t++) {
+    threads.emplace_back([t, &done, &wrong] {
+      for (unsigned i = 0; !done; i++) {
+        unsigned n = (i + t) % 32;
+        std::string address = LookupNumberedHost(n);
+        if (!address.empty() && address != NumberedHostAddress(n)) wrong++;
+      }
+    });
+  }
+  for (int i = 0; i < 200; i++) {
+    _resolv_delete_cache_for_net(kCacheNetId);
+    ASSERT_TRUE(server.UseForNet(kCacheNetId));
+  }
+  done = true;
+  for (std::thread& thread : threads) thread.join();
+  ASSERT_EQ(0U, wrong);
+  ASSERT_EQ(NumberedHostAddress(1), LookupNumberedHost(1));
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+#if defined(__BIONIC__)
+static size_t CountThreads() {
+  size_t count = 0;
+  std::unique_ptr<DIR, decltype(&closedir)> dir(opendir("/proc/self/task"), closedir);
+  while (dirent* e = readdir(dir.get())) count += (e->d_name[0] != '.');
+  return count;
+}
+
+// Waits up to five seconds for pred to hold.
+template <typename Pred>
+static bool WaitFor(Pred pred) {
+  for (int i = 0; i < 500 && !pred(); i++) usleep(10000);
+  return pred();
+}
+#endif
+
+TEST(resolv, cache_serve_stale) {
+#if defined(__BIONIC__)
+  setenv("ANDROID_DNS_CACHE_STALE_TTL", "60", 1);
+  std::atomic<unsigned> queries = 0;
+  DnsStubServer server([&queries](const DnsStubServer::Query& query) {
+    const char* address = (++queries == 1) ? "192.0.2.1" : "192.0.2.2";
+    return DnsStubServer::Reply(query, ns_r_noerror, {DnsRecord::A(address, 1)});
+  });
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+
+  ASSERT_EQ("192.0.2.1", LookupA("stale.test"));
+  sleep(2);
+  // Expired, but still served at once, while one refresh runs behind it.
+  ASSERT_EQ("192.0.2.1", LookupA("stale.test"));
+  ASSERT_TRUE(WaitFor([&] { return LookupA("stale.test") == "192.0.2.2"; }));
+  ASSERT_EQ(2U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(resolv, cache_negative_ttl_floor) {
+#if defined(__BIONIC__)
+  // Negative answers without an SOA have no TTL, so they aren't cached...
+  DnsStubServer server([](const DnsStubServer::Query& query) {
+    int rcode = (query.name == "nodata.test") ? ns_r_noerror : ns_r_nxdomain;
+    return DnsStubServer::Reply(query, rcode, {});
+  });
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+  for (const char* name : {"nxdomain.test", "nodata.test"}) {
+    SCOPED_TRACE(name);
+    ASSERT_EQ("", LookupA(name));
+    size_t queries = server.udp_queries();
+    ASSERT_EQ("", LookupA(name));
+    ASSERT_GT(server.udp_queries(), queries);
+  }
+
+  // ...unless the floor gives them one. (The setting is read when a
+  // network's cache is created.)
+  setenv("ANDROID_DNS_CACHE_NEGATIVE_TTL", "60", 1);
+  ASSERT_TRUE(server.UseForNet(kCacheNetId + 1));
+  for (const char* name : {"nxdomain.test", "nodata.test"}) {
+    SCOPED_TRACE(name);
+    ASSERT_EQ("", LookupA(name, kCacheNetId + 1));
+    size_t queries = server.udp_queries();
+    ASSERT_EQ("", LookupA(name, kCacheNetId + 1));
+    ASSERT_EQ(queries, server.udp_queries());
+  }
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(resolv, cache_delete_net_during_stale_refresh) {
+#if defined(__BIONIC__)
+  setenv("ANDROID_DNS_CACHE_STALE_TTL", "60", 1);
+  std::atomic<unsigned> queries = 0;
+  DnsStubServer server([&queries](const DnsStubServer::Query& query) {
+    if (++queries == 1) return DnsStubServer::Reply(query, ns_r_noerror, {DnsRecord::A("192.0.2.1", 1)});
+    usleep(500000);  // Slow enough to delete the net under the refresh.
+    return DnsStubServer::Reply(query, ns_r_noerror, {DnsRecord::A("192.0.2.2")});
+  });
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+
+  ASSERT_EQ("192.0.2.1", LookupA("stale.test"));
+  sleep(2);
+  size_t threads = CountThreads();
+  ASSERT_EQ("192.0.2.1", LookupA("stale.test"));
+  ASSERT_TRUE(WaitFor([&] { return server.udp_queries() == 2; }));
+  _resolv_delete_cache_for_net(kCacheNetId);
+
+  // The refresh finishes with no cache to put its answer in, and its thread
+  // goes away rather than outliving the cache.
+  ASSERT_TRUE(WaitFor([&] { return CountThreads() == threads; }));
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+  ASSERT_EQ("192.0.2.2", LookupA("stale.test"));
+  ASSERT_EQ(3U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(resolv, tcp_connection_pool) {
+#if defined(__BIONIC__)
+  // Every answer is too big for UDP, so every lookup is retried over TCP.
+  DnsStubServer server([](const DnsStubServer::Query& query) {
+    if (!query.tcp) return DnsStubServer::Reply(query, ns_r_noerror, {}, {}, true);
+    return DnsStubServer::Reply(query, ns_r_noerror, {DnsRecord::A("192.0.2.1")});
+  });
+  ASSERT_TRUE(server.ok());
+  ASSERT_TRUE(server.UseForNet(kCacheNetId));
+
+  // The connection outlives the lookup, and is reused by another thread.
+  ASSERT_EQ("192.0.2.1", LookupA("first.test"));
+  std::string result;
+  std::thread([&result] { result = LookupA("second.test"); }).join();
+  ASSERT_EQ("192.0.2.1", result);
+  ASSERT_EQ(2U, server.tcp_queries());
+  ASSERT_EQ(1U, server.tcp_connections());
+
+  // An idle connection that the server has closed is noticed and replaced.
+  server.CloseTcpConnections();
+  ASSERT_EQ("192.0.2.1", LookupA("third.test"));
+  ASSERT_EQ(3U, server.tcp_queries());
+  ASSERT_EQ(2U, server.tcp_connections());
+  ASSERT_EQ(3U, server.udp_queries());
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
+
+TEST(resolv, set_nameservers_for_net_address_forms) {
+#if defined(__BIONIC__)
+  // netd passes bare addresses, which use port 53. A port can be given too.
+  for (const char* server : {"192.0.2.1", "2001:db8::1", "fe80::1%lo", "192.0.2.1:5353",
+                             "[2001:db8::1]", "[2001:db8::1]:5353", "[fe80::1%lo]:5353"}) {
+    SCOPED_TRACE(server);
+    ASSERT_EQ(0, _resolv_set_nameservers_for_net(kCacheNetId, &server, 1, "", nullptr));
+  }
+  for (const char* server : {"", "192.0.2.1:", ":53", "[2001:db8::1", "[2001:db8::1]53",
+                             "[2001:db8::1]:", "[]:53", "192.0.2.1:domain", "192.0.2.1:65536",
+                             "example.test", "example.test:53"}) {
+    SCOPED_TRACE(server);
+    ASSERT_EQ(EINVAL, _resolv_set_nameservers_for_net(kCacheNetId, &server, 1, "", nullptr));
+  }
+  _resolv_delete_cache_for_net(kCacheNetId);
+#else
+  GTEST_SKIP() << "bionic-only test";
+#endif
+}
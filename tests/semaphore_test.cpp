@@ -18,7 +18,12 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <pthread.h>
+#include <stddef.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -98,6 +103,81 @@ TEST(semaphore, sem_wait__sem_post) {
   ASSERT_EQ(0, pthread_join(t3, &result));
 }
 
+static void sem_post_many_waiters_helper(int pshared) {
+  // Each post wakes one waiter, so every waiter must still get a post of its own.
+  constexpr size_t kWaiterCount = 32;
+  sem_t s;
+  ASSERT_EQ(0, sem_init(&s, pshared, 0));
+
+  pthread_t threads[kWaiterCount];
+  for (pthread_t& t : threads) {
+    ASSERT_EQ(0, pthread_create(&t, nullptr, SemWaitThreadFn, &s));
+  }
+  for (size_t i = 0; i < kWaiterCount; ++i) {
+    ASSERT_EQ(0, sem_post(&s));
+  }
+  for (pthread_t& t : threads) {
+    ASSERT_EQ(0, pthread_join(t, nullptr));
+  }
+
+  int value;
+  ASSERT_EQ(0, sem_getvalue(&s, &value));
+  ASSERT_EQ(0, value);
+  ASSERT_EQ(0, sem_destroy(&s));
+}
+
+TEST(semaphore, sem_post_many_waiters) {
+  sem_post_many_waiters_helper(0);
+}
+
+TEST(semaphore, sem_post_many_waiters_pshared) {
+  // Process-shared semaphores don't count their waiters, because a 32-bit process sharing one
+  // can't, so a post to a contended one still wakes all of them.
+  sem_post_many_waiters_helper(1);
+}
+
+TEST(semaphore, android_sem_post_n) {
+#if defined(__BIONIC__)
+  sem_t s;
+  ASSERT_EQ(0, sem_init(&s, 0, 0));
+
+  int value;
+  ASSERT_EQ(0, android_sem_post_n(&s, 0));
+  ASSERT_EQ(0, android_sem_post_n(&s, 3));
+  ASSERT_EQ(0, sem_getvalue(&s, &value));
+  ASSERT_EQ(3, value);
+
+  // The value can't go past SEM_VALUE_MAX, and is unchanged if it would.
+  errno = 0;
+  ASSERT_EQ(-1, android_sem_post_n(&s, SEM_VALUE_MAX - 2));
+  ASSERT_ERRNO(EOVERFLOW);
+  errno = 0;
+  ASSERT_EQ(-1, android_sem_post_n(&s, static_cast<unsigned>(SEM_VALUE_MAX) + 1));
+  ASSERT_ERRNO(EOVERFLOW);
+  ASSERT_EQ(0, sem_getvalue(&s, &value));
+  ASSERT_EQ(3, value);
+  ASSERT_EQ(0, android_sem_post_n(&s, SEM_VALUE_MAX - 3));
+  ASSERT_EQ(0, sem_getvalue(&s, &value));
+  ASSERT_EQ(SEM_VALUE_MAX, value);
+
+  // A single call wakes as many waiters as it posts.
+  ASSERT_EQ(0, sem_init(&s, 0, 0));
+  pthread_t t1, t2, t3;
+  ASSERT_EQ(0, pthread_create(&t1, nullptr, SemWaitThreadFn, &s));
+  ASSERT_EQ(0, pthread_create(&t2, nullptr, SemWaitThreadFn, &s));
+  ASSERT_EQ(0, pthread_create(&t3, nullptr, SemWaitThreadFn, &s));
+  ASSERT_EQ(0, android_sem_post_n(&s, 3));
+  ASSERT_EQ(0, pthread_join(t1, nullptr));
+  ASSERT_EQ(0, pthread_join(t2, nullptr));
+  ASSERT_EQ(0, pthread_join(t3, nullptr));
+  ASSERT_EQ(0, sem_getvalue(&s, &value));
+  ASSERT_EQ(0, value);
+  ASSERT_EQ(0, sem_destroy(&s));
+#else   // __BIONIC__
+  GTEST_SKIP() << "android_sem_post_n is only supported on bionic";
+#endif  // __BIONIC__
+}
+
 static inline void timespec_add_ms(timespec& ts, size_t ms) {
   ts.tv_sec  += ms / 1000;
   ts.tv_nsec += (ms % 1000) * 1000000;
@@ -164,6 +244,90 @@ TEST(semaphore, sem_clockwait) {
 #endif  // __BIONIC__
 }
 
+#if defined(__BIONIC__)
+static void sem_clockwait_any_np_helper() {
+  sem_t s[3];
+  sem_t* sems[3];
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(0, sem_init(&s[i], 0, 0));
+    sems[i] = &s[i];
+  }
+
+  errno = 0;
+  ASSERT_EQ(-1, sem_clockwait_any_np(sems, 0, CLOCK_MONOTONIC, nullptr));
+  ASSERT_ERRNO(EINVAL);
+  errno = 0;
+  ASSERT_EQ(-1, sem_clockwait_any_np(sems, 3, CLOCK_BOOTTIME, nullptr));
+  ASSERT_ERRNO(EINVAL);
+
+  // An available semaphore is taken without waiting, even with a timeout in the past.
+  ASSERT_EQ(0, sem_post(&s[2]));
+  timespec ts = {.tv_sec = -1};
+  ASSERT_EQ(2, sem_clockwait_any_np(sems, 3, CLOCK_MONOTONIC, &ts));
+  errno = 0;
+  ASSERT_EQ(-1, sem_clockwait_any_np(sems, 3, CLOCK_MONOTONIC, &ts));
+  ASSERT_ERRNO(ETIMEDOUT);
+
+  for (clockid_t clock : {CLOCK_MONOTONIC, CLOCK_REALTIME}) {
+    ASSERT_EQ(0, clock_gettime(clock, &ts));
+    ts.tv_sec += 1;
+    errno = 0;
+    ASSERT_EQ(-1, sem_clockwait_any_np(sems, 3, clock, &ts));
+    ASSERT_ERRNO(ETIMEDOUT);
+  }
+
+  // A post to any of them wakes a waiter, which takes that one.
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, nullptr, [](void* arg) -> void* {
+    usleep(100000);
+    sem_post(reinterpret_cast<sem_t*>(arg));
+    return nullptr;
+  }, &s[1]));
+  ASSERT_EQ(1, sem_clockwait_any_np(sems, 3, CLOCK_MONOTONIC, nullptr));
+  ASSERT_EQ(0, pthread_join(t, nullptr));
+
+  int value;
+  for (sem_t& sem : s) {
+    ASSERT_EQ(0, sem_getvalue(&sem, &value));
+    ASSERT_EQ(0, value);
+  }
+}
+#endif  // __BIONIC__
+
+TEST(semaphore, sem_clockwait_any_np) {
+#if defined(__BIONIC__)
+  sem_clockwait_any_np_helper();
+#else   // __BIONIC__
+  GTEST_SKIP() << "sem_clockwait_any_np is only supported on bionic";
+#endif  // __BIONIC__
+}
+
+TEST_F(semaphore_DeathTest, sem_clockwait_any_np_poll_fallback) {
+#if defined(__BIONIC__)
+  // Make futex_waitv fail with ENOSYS, as on a kernel older than 5.16, so
+  // that sem_clockwait_any_np has to sleep on one semaphore and poll the rest.
+  ASSERT_EXIT(
+      {
+        sock_filter filter[] = {
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_futex_waitv, 0, 1),
+            BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS),
+            BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        };
+        sock_fprog prog = {.len = sizeof(filter) / sizeof(filter[0]), .filter = filter};
+        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 ||
+            prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) != 0) {
+          _exit(2);
+        }
+        sem_clockwait_any_np_helper();
+        _exit(testing::Test::HasFailure() ? 1 : 0);
+      },
+      testing::ExitedWithCode(0), "");
+#else   // __BIONIC__
+  GTEST_SKIP() << "sem_clockwait_any_np is only supported on bionic";
+#endif  // __BIONIC__
+}
+
 TEST_F(semaphore_DeathTest, sem_timedwait_null_timeout) {
   sem_t s;
   ASSERT_EQ(0, sem_init(&s, 0, 0));
@@ -135,6 +135,35 @@ TEST(static_tls_layout, reserve_tp_pair) {
   EXPECT_EQ(51u, layout.size());
 }
 
+TEST(static_tls_layout, surplus) {
+  auto segment = [](const AlignedSizeFlat& config) {
+    return TlsSegment{.aligned_size = unflatten_size(config)};
+  };
+
+  StaticTlsLayout layout;
+  layout.reserve_type<uint64_t>();
+  layout.reserve_surplus(64);
+  layout.finish_layout();
+  EXPECT_EQ(72u, layout.size());
+  EXPECT_EQ(8u, layout.align_);
+
+  EXPECT_EQ(8u, layout.allocate_from_surplus(segment({.size = 4, .align = 4})));
+  // Skew is honored.
+  EXPECT_EQ(17u, layout.allocate_from_surplus(segment({.size = 8, .align = 8, .skew = 1})));
+  // More aligned than the static TLS block.
+  EXPECT_EQ(SIZE_MAX, layout.allocate_from_surplus(segment({.size = 4, .align = 16})));
+  // Too big for what's left of the surplus.
+  EXPECT_EQ(SIZE_MAX, layout.allocate_from_surplus(segment({.size = 48, .align = 8})));
+  EXPECT_EQ(32u, layout.allocate_from_surplus(segment({.size = 40, .align = 8})));
+  EXPECT_EQ(SIZE_MAX, layout.allocate_from_surplus(segment({.size = 1})));
+
+  // No surplus by default.
+  layout = {};
+  layout.reserve_type<uint64_t>();
+  layout.finish_layout();
+  EXPECT_EQ(SIZE_MAX, layout.allocate_from_surplus(segment({.size = 1})));
+}
+
 // A "NUM_words" literal is the size in bytes of NUM words of memory.
 static size_t operator""_words(unsigned long long i) {
   return i * sizeof(void*);
@@ -27,9 +27,12 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <limits>
+#include <random>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/macros.h>
@@ -456,6 +459,84 @@ TEST(stdlib, qsort_r) {
   ASSERT_EQ(count, 3);
 }
 
+static int CompareInts(const void* lhs, const void* rhs) {
+  int a = *reinterpret_cast<const int*>(lhs);
+  int b = *reinterpret_cast<const int*>(rhs);
+  return (a > b) - (a < b);
+}
+
+TEST(stdlib, qsort_large) {
+  std::mt19937 rng(1234);
+  for (size_t n : {0, 1, 2, 23, 24, 25, 127, 129, 1000, 100000}) {
+    std::vector<int> random(n), sorted(n), reversed(n), few_unique(n);
+    for (size_t i = 0; i < n; i++) {
+      random[i] = rng();
+      sorted[i] = i;
+      reversed[i] = n - i;
+      few_unique[i] = rng() % 4;
+    }
+    for (std::vector<int>* v : {&random, &sorted, &reversed, &few_unique}) {
+      std::vector<int> expected(*v);
+      std::sort(expected.begin(), expected.end());
+      qsort(v->data(), v->size(), sizeof(int), CompareInts);
+      ASSERT_EQ(expected, *v) << n;
+    }
+  }
+}
+
+TEST(stdlib, qsort_element_sizes) {
+  // Cover each of the swap routines, including unaligned elements.
+  std::mt19937 rng(1234);
+  for (size_t size : {1, 3, 4, 8, 12, 16, 24, 40}) {
+    for (size_t offset : {0, 1}) {
+      constexpr size_t kCount = 500;
+      std::vector<char> buf(kCount * size + offset);
+      char* base = buf.data() + offset;
+      for (size_t i = 0; i < kCount; i++) {
+        memset(base + i * size, 0, size);
+        base[i * size] = rng() % 64;
+        base[i * size + size - 1] = base[i * size];
+      }
+      qsort(base, kCount, size, [](const void* lhs, const void* rhs) {
+        return *reinterpret_cast<const char*>(lhs) - *reinterpret_cast<const char*>(rhs);
+      });
+      for (size_t i = 0; i < kCount; i++) {
+        ASSERT_EQ(base[i * size], base[i * size + size - 1]) << size;
+        if (i > 0) ASSERT_LE(base[(i - 1) * size], base[i * size]) << size;
+      }
+    }
+  }
+}
+
+TEST(stdlib, qsort_inconsistent_comparator) {
+  // A comparator that doesn't define an order mustn't make qsort read or
+  // write outside the array.
+  std::mt19937 rng(1234);
+  std::vector<int> v(10000);
+  for (int& i : v) i = rng();
+  qsort_r(v.data(), v.size(), sizeof(int),
+          [](const void*, const void*, void* arg) {
+            return static_cast<int>((*reinterpret_cast<std::mt19937*>(arg))() % 3) - 1;
+          },
+          &rng);
+}
+
+TEST(stdlib, bsearch) {
+  std::vector<int> v;
+  for (int i = 0; i < 1000; i++) v.push_back(2 * i);
+  for (int key = -1; key <= 2000; key++) {
+    void* result = bsearch(&key, v.data(), v.size(), sizeof(int), CompareInts);
+    if (key >= 0 && key < 2000 && key % 2 == 0) {
+      ASSERT_EQ(&v[key / 2], result) << key;
+    } else {
+      ASSERT_EQ(nullptr, result) << key;
+    }
+  }
+  int key = 0;
+  ASSERT_EQ(nullptr, bsearch(&key, nullptr, 0, sizeof(int), CompareInts));
+  ASSERT_EQ(v.data(), bsearch(&key, v.data(), 1, sizeof(int), CompareInts));
+}
+
 static void* TestBug57421_child(void* arg) {
   pthread_t main_thread = reinterpret_cast<pthread_t>(arg);
   pthread_join(main_thread, nullptr);
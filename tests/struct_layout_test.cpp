@@ -58,22 +58,24 @@ void tests(CheckSize check_size, CheckOffset check_offset) {
   CHECK_OFFSET(pthread_internal_t, bionic_tcb, 776);
   CHECK_OFFSET(pthread_internal_t, stack_mte_ringbuffer_vma_name_buffer, 784);
   CHECK_OFFSET(pthread_internal_t, should_allocate_stack_mte_ringbuffer, 816);
-  CHECK_SIZE(bionic_tls, 12200);
+  CHECK_SIZE(bionic_tls, 12232);
   CHECK_OFFSET(bionic_tls, key_data, 0);
-  CHECK_OFFSET(bionic_tls, locale, 2080);
-  CHECK_OFFSET(bionic_tls, basename_buf, 2088);
-  CHECK_OFFSET(bionic_tls, dirname_buf, 6184);
-  CHECK_OFFSET(bionic_tls, mntent_buf, 10280);
-  CHECK_OFFSET(bionic_tls, mntent_strings, 10320);
-  CHECK_OFFSET(bionic_tls, ptsname_buf, 11344);
-  CHECK_OFFSET(bionic_tls, ttyname_buf, 11376);
-  CHECK_OFFSET(bionic_tls, strerror_buf, 11440);
-  CHECK_OFFSET(bionic_tls, strsignal_buf, 11695);
-  CHECK_OFFSET(bionic_tls, group, 11952);
-  CHECK_OFFSET(bionic_tls, passwd, 12040);
-  CHECK_OFFSET(bionic_tls, fdtrack_disabled, 12192);
-  CHECK_OFFSET(bionic_tls, bionic_systrace_disabled, 12193);
-  CHECK_OFFSET(bionic_tls, padding, 12194);
+  CHECK_OFFSET(bionic_tls, key_data_set, 2080);
+  CHECK_OFFSET(bionic_tls, key_overflow, 2104);
+  CHECK_OFFSET(bionic_tls, locale, 2112);
+  CHECK_OFFSET(bionic_tls, basename_buf, 2120);
+  CHECK_OFFSET(bionic_tls, dirname_buf, 6216);
+  CHECK_OFFSET(bionic_tls, mntent_buf, 10312);
+  CHECK_OFFSET(bionic_tls, mntent_strings, 10352);
+  CHECK_OFFSET(bionic_tls, ptsname_buf, 11376);
+  CHECK_OFFSET(bionic_tls, ttyname_buf, 11408);
+  CHECK_OFFSET(bionic_tls, strerror_buf, 11472);
+  CHECK_OFFSET(bionic_tls, strsignal_buf, 11727);
+  CHECK_OFFSET(bionic_tls, group, 11984);
+  CHECK_OFFSET(bionic_tls, passwd, 12072);
+  CHECK_OFFSET(bionic_tls, fdtrack_disabled, 12224);
+  CHECK_OFFSET(bionic_tls, bionic_systrace_disabled, 12225);
+  CHECK_OFFSET(bionic_tls, padding, 12226);
 #else
   CHECK_SIZE(pthread_internal_t, 708);
   CHECK_OFFSET(pthread_internal_t, next, 0);
@@ -103,22 +105,24 @@ void tests(CheckSize check_size, CheckOffset check_offset) {
   CHECK_OFFSET(pthread_internal_t, bionic_tcb, 668);
   CHECK_OFFSET(pthread_internal_t, stack_mte_ringbuffer_vma_name_buffer, 672);
   CHECK_OFFSET(pthread_internal_t, should_allocate_stack_mte_ringbuffer, 704);
-  CHECK_SIZE(bionic_tls, 11080);
+  CHECK_SIZE(bionic_tls, 11104);
   CHECK_OFFSET(bionic_tls, key_data, 0);
-  CHECK_OFFSET(bionic_tls, locale, 1040);
-  CHECK_OFFSET(bionic_tls, basename_buf, 1044);
-  CHECK_OFFSET(bionic_tls, dirname_buf, 5140);
-  CHECK_OFFSET(bionic_tls, mntent_buf, 9236);
-  CHECK_OFFSET(bionic_tls, mntent_strings, 9260);
-  CHECK_OFFSET(bionic_tls, ptsname_buf, 10284);
-  CHECK_OFFSET(bionic_tls, ttyname_buf, 10316);
-  CHECK_OFFSET(bionic_tls, strerror_buf, 10380);
-  CHECK_OFFSET(bionic_tls, strsignal_buf, 10635);
-  CHECK_OFFSET(bionic_tls, group, 10892);
-  CHECK_OFFSET(bionic_tls, passwd, 10952);
-  CHECK_OFFSET(bionic_tls, fdtrack_disabled, 11076);
-  CHECK_OFFSET(bionic_tls, bionic_systrace_disabled, 11077);
-  CHECK_OFFSET(bionic_tls, padding, 11078);
+  CHECK_OFFSET(bionic_tls, key_data_set, 1040);
+  CHECK_OFFSET(bionic_tls, key_overflow, 1060);
+  CHECK_OFFSET(bionic_tls, locale, 1064);
+  CHECK_OFFSET(bionic_tls, basename_buf, 1068);
+  CHECK_OFFSET(bionic_tls, dirname_buf, 5164);
+  CHECK_OFFSET(bionic_tls, mntent_buf, 9260);
+  CHECK_OFFSET(bionic_tls, mntent_strings, 9284);
+  CHECK_OFFSET(bionic_tls, ptsname_buf, 10308);
+  CHECK_OFFSET(bionic_tls, ttyname_buf, 10340);
+  CHECK_OFFSET(bionic_tls, strerror_buf, 10404);
+  CHECK_OFFSET(bionic_tls, strsignal_buf, 10659);
+  CHECK_OFFSET(bionic_tls, group, 10916);
+  CHECK_OFFSET(bionic_tls, passwd, 10976);
+  CHECK_OFFSET(bionic_tls, fdtrack_disabled, 11100);
+  CHECK_OFFSET(bionic_tls, bionic_systrace_disabled, 11101);
+  CHECK_OFFSET(bionic_tls, padding, 11102);
 #endif  // __LP64__
 #undef CHECK_SIZE
 #undef CHECK_OFFSET
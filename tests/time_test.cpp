@@ -28,7 +28,9 @@
 
 #include <atomic>
 #include <chrono>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "SignalUtils.h"
 #include "android-base/file.h"
@@ -614,6 +616,94 @@ TEST(time, strptime_z) {
   EXPECT_EQ(0, tm.tm_isdst);
 }
 
+TEST(time, strftime_timestamps) {
+  setenv("TZ", "UTC", 1);
+
+  struct tm tm = {.tm_sec = 7, .tm_min = 22, .tm_hour = 15, .tm_mday = 4, .tm_mon = 9,
+                  .tm_year = 116, .tm_wday = 2, .tm_gmtoff = -25200};
+  char buf[64];
+  EXPECT_EQ(19U, strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm));
+  EXPECT_STREQ("2016-10-04T15:22:07", buf);
+  EXPECT_EQ(19U, strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm));
+  EXPECT_STREQ("2016-10-04 15:22:07", buf);
+  EXPECT_EQ(24U, strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", &tm));
+  EXPECT_STREQ("2016-10-04T15:22:07-0700", buf);
+  EXPECT_EQ(31U, strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %z", &tm));
+  EXPECT_STREQ("Tue, 04 Oct 2016 15:22:07 -0700", buf);
+
+  // The result and the terminating NUL must both fit.
+  errno = 0;
+  EXPECT_EQ(0U, strftime(buf, 19, "%Y-%m-%dT%H:%M:%S", &tm));
+  EXPECT_ERRNO(ERANGE);
+  EXPECT_EQ(19U, strftime(buf, 20, "%Y-%m-%dT%H:%M:%S", &tm));
+
+  // Years are padded to four digits, but not truncated to them.
+  tm.tm_year = 999 - 1900;
+  tm.tm_gmtoff = 19800;
+  EXPECT_EQ(24U, strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", &tm));
+  EXPECT_STREQ("0999-10-04T15:22:07+0530", buf);
+  tm.tm_year = 10000 - 1900;
+  EXPECT_EQ(25U, strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", &tm));
+  EXPECT_STREQ("10000-10-04T15:22:07+0530", buf);
+
+  // Out of range fields are printed the same way as with any other format.
+  tm.tm_year = 116;
+  tm.tm_wday = 7;
+  tm.tm_hour = 123;
+  EXPECT_EQ(30U, strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %z", &tm));
+  EXPECT_STREQ("?, 04 Oct 2016 123:22:07 +0530", buf);
+}
+
+TEST(time, strptime_timestamps) {
+  setenv("TZ", "UTC", 1);
+
+  struct tm tm = {};
+  ASSERT_EQ('\0', *strptime("2016-10-04T15:22:07", "%Y-%m-%dT%H:%M:%S", &tm));
+  EXPECT_EQ(116, tm.tm_year);
+  EXPECT_EQ(9, tm.tm_mon);
+  EXPECT_EQ(4, tm.tm_mday);
+  EXPECT_EQ(15, tm.tm_hour);
+  EXPECT_EQ(22, tm.tm_min);
+  EXPECT_EQ(7, tm.tm_sec);
+  EXPECT_EQ(2, tm.tm_wday);
+  EXPECT_EQ(277, tm.tm_yday);
+
+  tm = {};
+  ASSERT_EQ('\0', *strptime("0999-01-01 00:00:60", "%Y-%m-%d %H:%M:%S", &tm));
+  EXPECT_EQ(999 - 1900, tm.tm_year);
+  EXPECT_EQ(60, tm.tm_sec);
+  EXPECT_EQ(2, tm.tm_wday);
+  EXPECT_EQ(0, tm.tm_yday);
+
+  tm = {};
+  ASSERT_EQ('\0', *strptime("2016-10-04T15:22:07-0700", "%Y-%m-%dT%H:%M:%S%z", &tm));
+  EXPECT_EQ(15, tm.tm_hour);
+  EXPECT_EQ(-25200, tm.tm_gmtoff);
+
+  // Day and month names are matched without regard to case.
+  tm = {};
+  ASSERT_EQ('\0', *strptime("tUE, 04 oCT 2016 15:22:07 +0530", "%a, %d %b %Y %H:%M:%S %z", &tm));
+  EXPECT_EQ(116, tm.tm_year);
+  EXPECT_EQ(9, tm.tm_mon);
+  EXPECT_EQ(2, tm.tm_wday);
+  EXPECT_EQ(277, tm.tm_yday);
+  EXPECT_EQ(19800, tm.tm_gmtoff);
+
+  // Looser input is still accepted...
+  tm = {};
+  ASSERT_EQ('\0', *strptime("Tuesday,  4 October 2016 15:22:07 Z", "%a, %d %b %Y %H:%M:%S %z", &tm));
+  EXPECT_EQ(4, tm.tm_mday);
+  EXPECT_EQ(9, tm.tm_mon);
+  EXPECT_EQ(0, tm.tm_gmtoff);
+  // ...trailing input is left alone...
+  tm = {};
+  EXPECT_STREQ(".123", strptime("2016-10-04 15:22:07.123", "%Y-%m-%d %H:%M:%S", &tm));
+  // ...and invalid input is still rejected.
+  EXPECT_EQ(nullptr, strptime("2016-13-04T15:22:07", "%Y-%m-%dT%H:%M:%S", &tm));
+  EXPECT_EQ(nullptr, strptime("2016-10-04T24:22:07", "%Y-%m-%dT%H:%M:%S", &tm));
+  EXPECT_EQ(nullptr, strptime("Tue, 04 Oct 2016 15:22:07", "%a, %d %b %Y %H:%M:%S %z", &tm));
+}
+
 void SetTime(timer_t t, time_t value_s, time_t value_ns, time_t interval_s, time_t interval_ns) {
   itimerspec ts;
   ts.it_value.tv_sec = value_s;
@@ -1196,6 +1286,40 @@ TEST(time, bug_31339449) {
 #endif
 }
 
+TEST(time, localtime_r_many_zones) {
+  // Switching between more zones than the library keeps loaded at once
+  // must still give each zone's answer.
+  time_t t = 1475619727;
+  for (int i = 0; i < 3; i++) {
+    for (int hours = 0; hours < 24; hours++) {
+      std::string tz = "XYZ" + std::to_string(hours);
+      setenv("TZ", tz.c_str(), 1);
+      struct tm tm = {};
+      localtime_r(&t, &tm);
+      EXPECT_EQ((22 - hours + 24) % 24, tm.tm_hour) << tz;
+    }
+  }
+}
+
+TEST(time, localtime_r_threads) {
+  setenv("TZ", "America/Los_Angeles", 1);
+  tzset();
+  time_t t = 1475619727;
+  std::vector<std::thread> threads;
+  std::atomic<int> wrong = 0;
+  for (int i = 0; i < 8; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 10000; j++) {
+        struct tm tm = {};
+        localtime_r(&t, &tm);
+        if (tm.tm_hour != 15) wrong++;
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  EXPECT_EQ(0, wrong);
+}
+
 TEST(time, asctime) {
   const struct tm tm = {};
   ASSERT_STREQ("Sun Jan  0 00:00:00 1900\n", asctime(&tm));
@@ -1455,6 +1579,45 @@ TEST(time, tzalloc_nullptr) {
 #endif
 }
 
+TEST(time, tzalloc_many_zones) {
+#if defined(__BIONIC__)
+  // Load more zones than are kept cached, more than once each, and hold
+  // on to some of them while others are loaded and freed.
+  static const struct {
+    const char* name;
+    int hour;
+  } kZones[] = {
+      {"America/New_York", 19}, {"Europe/London", 1},     {"Asia/Kolkata", 5},
+      {"Asia/Seoul", 9},        {"Europe/Berlin", 1},     {"Asia/Tokyo", 9},
+      {"America/Chicago", 18},  {"America/Denver", 17},   {"Pacific/Auckland", 12},
+      {"Asia/Shanghai", 8},     {"America/Sao_Paulo", 21}, {"Africa/Cairo", 2},
+  };
+  time_t t = 0;
+  timezone_t held = tzalloc("America/Los_Angeles");
+  ASSERT_NE(nullptr, held);
+  for (int i = 0; i < 3; i++) {
+    for (const auto& zone : kZones) {
+      timezone_t tz = tzalloc(zone.name);
+      ASSERT_NE(nullptr, tz) << zone.name;
+      struct tm tm = {};
+      ASSERT_EQ(&tm, localtime_rz(tz, &t, &tm));
+      EXPECT_EQ(zone.hour, tm.tm_hour) << zone.name;
+      tzfree(tz);
+    }
+  }
+  struct tm tm = {};
+  ASSERT_EQ(&tm, localtime_rz(held, &t, &tm));
+  EXPECT_EQ(16, tm.tm_hour);
+  tzfree(held);
+
+  errno = 0;
+  ASSERT_EQ(nullptr, tzalloc("Not/A_Zone"));
+  ASSERT_ERRNO(ENOENT);
+#else
+  GTEST_SKIP() << "glibc doesn't have timezone_t";
+#endif
+}
+
 TEST(time, tzalloc_unique_ptr) {
 #if defined(__BIONIC__)
   std::unique_ptr<std::remove_pointer_t<timezone_t>, decltype(&tzfree)> tz{tzalloc("Asia/Seoul"),